@@ -0,0 +1,229 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <cassert>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <vector>
+
+#include <gauge/gauge.hpp>
+#include <mts/crc32.hpp>
+#include <mts/demux_pipeline.hpp>
+
+namespace
+{
+void write_section_packet(
+    uint16_t pid, uint8_t continuity_counter,
+    std::vector<uint8_t> section, std::vector<uint8_t>& buffer)
+{
+    // Section length
+    auto length = section.size() - 3 + 4;
+    section[1] = 0xB0 | ((length >> 8) & 0x0F);
+    section[2] = length & 0xFF;
+
+    auto crc = mts::crc32::compute(section.data(), section.size());
+    section.push_back(crc >> 24);
+    section.push_back(crc >> 16);
+    section.push_back(crc >> 8);
+    section.push_back(crc);
+
+    assert(section.size() + 5 <= mts::parser::packet_size());
+    auto offset = buffer.size();
+    buffer.resize(offset + mts::parser::packet_size(), 0xFF);
+    auto packet = buffer.data() + offset;
+    packet[0] = 0x47;
+    packet[1] = 0x40 | ((pid >> 8) & 0x1F);
+    packet[2] = pid & 0xFF;
+    packet[3] = 0x10 | (continuity_counter & 0x0F);
+    packet[4] = 0; // pointer field
+    std::copy(section.begin(), section.end(), packet + 5);
+}
+
+/// Creates a stream of programs with a single video stream each, where the
+/// packets of the streams are interleaved one by one. Each pes spans
+/// pes_packets packets.
+std::vector<uint8_t> make_many_pid_stream(
+    uint32_t programs, uint32_t pes_packets, uint32_t rounds)
+{
+    assert(programs > 0 && programs <= 40);
+    const auto packet_size = mts::parser::packet_size();
+
+    std::vector<uint8_t> buffer;
+    buffer.reserve((2 + programs + rounds * pes_packets * programs) *
+                   packet_size);
+
+    std::vector<uint8_t> pat = { 0x00, 0x00, 0x00, 0x00, 0x01, 0xC1, 0x00, 0x00 };
+    for (uint16_t program = 1; program <= programs; ++program)
+    {
+        uint16_t program_pid = 0x1000 + program - 1;
+        pat.push_back(program >> 8);
+        pat.push_back(program & 0xFF);
+        pat.push_back(0xE0 | (program_pid >> 8));
+        pat.push_back(program_pid & 0xFF);
+    }
+    write_section_packet(0, 0, pat, buffer);
+
+    for (uint16_t program = 1; program <= programs; ++program)
+    {
+        uint16_t program_pid = 0x1000 + program - 1;
+        uint16_t video_pid = 0x100 + program;
+        std::vector<uint8_t> pmt =
+            {
+                0x02, 0x00, 0x00,
+                (uint8_t)(program >> 8), (uint8_t)(program & 0xFF),
+                0xC1, 0x00, 0x00,
+                (uint8_t)(0xE0 | (video_pid >> 8)),
+                (uint8_t)(video_pid & 0xFF),
+                0xF0, 0x00,
+                0x1B,
+                (uint8_t)(0xE0 | (video_pid >> 8)),
+                (uint8_t)(video_pid & 0xFF),
+                0xF0, 0x00
+            };
+        write_section_packet(program_pid, 0, pmt, buffer);
+    }
+
+    uint8_t continuity_counter = 0;
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        for (uint32_t i = 0; i < pes_packets; ++i)
+        {
+            for (uint16_t program = 1; program <= programs; ++program)
+            {
+                uint16_t video_pid = 0x100 + program;
+                bool unit_start = i == 0;
+
+                auto offset = buffer.size();
+                buffer.resize(offset + packet_size, (uint8_t)round);
+                auto packet = buffer.data() + offset;
+                packet[0] = 0x47;
+                packet[1] = (unit_start ? 0x40 : 0x00) | (video_pid >> 8);
+                packet[2] = video_pid & 0xFF;
+                packet[3] = 0x10 | (continuity_counter & 0x0F);
+                if (unit_start)
+                {
+                    // Video pes header of unbounded length without any
+                    // optional fields.
+                    const uint8_t header[] =
+                        { 0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x00, 0x00 };
+                    std::copy(header, header + sizeof(header), packet + 4);
+                }
+            }
+            continuity_counter++;
+        }
+    }
+    return buffer;
+}
+}
+
+class demuxing_benchmark : public gauge::time_benchmark
+{
+public:
+
+    double measurement() override
+    {
+        // Get the time spent per iteration
+        double time = gauge::time_benchmark::measurement();
+
+        gauge::config_set cs = get_current_configuration();
+        auto size = cs.get_value<uint32_t>("size");
+
+        return size / time; // MB/s for each iteration
+    }
+
+    std::string unit_text() const override
+    {
+        return "MB/s";
+    }
+
+    void store_run(tables::table& results) override
+    {
+        if (!results.has_column("throughput"))
+            results.add_column("throughput");
+
+        results.set_value("throughput", measurement());
+    }
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto programs = options["programs"].as<uint32_t>();
+        auto threads = options["threads"].as<std::vector<uint32_t>>();
+
+        gauge::config_set cs;
+        cs.set_value<uint32_t>("programs", programs);
+        cs.set_value<uint32_t>(
+            "size", make_many_pid_stream(programs, pes_packets, rounds).size());
+        for (auto thread_count : threads)
+        {
+            cs.set_value<uint32_t>("threads", thread_count);
+            add_configuration(cs);
+        }
+    }
+
+    void setup() override
+    {
+        gauge::config_set cs = get_current_configuration();
+        auto programs = cs.get_value<uint32_t>("programs");
+        if (m_buffer.empty())
+        {
+            m_buffer = make_many_pid_stream(programs, pes_packets, rounds);
+        }
+        m_threads = cs.get_value<uint32_t>("threads");
+    }
+
+    void test_body() override
+    {
+        RUN
+        {
+            mts::demux_pipeline pipeline(m_threads,
+                [](uint16_t, mts::stream_type type, const mts::pes& pes)
+                {
+                    assert(type == mts::stream_type::avc_video_stream);
+                    assert(pes.payload_size() != 0U);
+                    (void) type;
+                    (void) pes;
+                });
+
+            pipeline.read(m_buffer.data(), m_buffer.size());
+            pipeline.flush();
+        }
+    }
+
+private:
+
+    static const uint32_t pes_packets = 32;
+    static const uint32_t rounds = 64;
+
+    std::vector<uint8_t> m_buffer;
+    uint32_t m_threads = 0;
+};
+
+BENCHMARK_F(demuxing_benchmark, demuxing, many_pids, 5);
+
+BENCHMARK_OPTION(demuxing_options)
+{
+    gauge::po::options_description options;
+
+    options.add_options()
+    ("programs", gauge::po::value<uint32_t>()->default_value(40),
+     "Set the number of programs in the synthetic stream, each with a single "
+     "video stream")
+    ("threads", gauge::po::value<std::vector<uint32_t>>()->default_value(
+         std::vector<uint32_t>{1, 2, 4, 8}, "1 2 4 8")->multitoken(),
+     "Set the number of shard threads of the demux pipeline");
+
+    gauge::runner::instance().register_options(options);
+}
+
+int main(int argc, const char* argv[])
+{
+    srand(static_cast<uint32_t>(time(0)));
+
+    gauge::runner::add_default_printers();
+    gauge::runner::run_benchmarks(argc, argv);
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <cassert>
+#include <cstdint>
+#include <ctime>
+#include <system_error>
+#include <vector>
+
+#include <gauge/gauge.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <mts/mutable_ts_packet_view.hpp>
+#include <mts/pat.hpp>
+#include <mts/program.hpp>
+#include <mts/program_filter.hpp>
+
+namespace
+{
+/// Turns a single program capture into a multi program capture by
+/// interleaving copies of its packets, where program k of the copies has
+/// its PMT on PID 0x1000 + k - 1 and its streams moved up by 0x10 * k. The
+/// PID of the PMT of the original program is assumed to be 0x1000, and its
+/// PMT to fit in a packet.
+std::vector<uint8_t> make_multi_program(
+    const uint8_t* data, uint64_t size, uint32_t programs)
+{
+    const auto packet_size = mts::program_filter::packet_size();
+    std::vector<uint8_t> buffer;
+    buffer.reserve(size * programs);
+
+    mts::pat pat;
+    for (uint16_t program = 1; program <= programs; ++program)
+    {
+        pat.add_program_entry(program, 0x1000 + program - 1);
+    }
+    uint8_t pat_continuity_counter = 0;
+
+    for (uint64_t offset = 0; offset + packet_size <= size;
+         offset += packet_size)
+    {
+        const uint8_t* packet = data + offset;
+        uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        if (pid == 0)
+        {
+            buffer.resize(buffer.size() + packet_size, 0xFF);
+            auto output = buffer.data() + buffer.size() - packet_size;
+            output[0] = 0x47;
+            output[1] = 0x40;
+            output[2] = 0x00;
+            output[3] = 0x10 | pat_continuity_counter;
+            output[4] = 0x00;
+            pat.write(output + 5, packet_size - 5);
+            pat_continuity_counter = (pat_continuity_counter + 1) & 0x0F;
+            continue;
+        }
+
+        for (uint16_t program = 1; program <= programs; ++program)
+        {
+            buffer.insert(buffer.end(), packet, packet + packet_size);
+            auto output = buffer.data() + buffer.size() - packet_size;
+            mts::mutable_ts_packet_view view(output);
+            if (pid == 0x1FFF)
+                break;
+
+            if (pid != 0x1000)
+            {
+                view.set_pid(pid + 0x10 * (program - 1));
+                continue;
+            }
+
+            view.set_pid(0x1000 + program - 1);
+            if (!view.payload_unit_start_indicator())
+                continue;
+
+            auto section = output + view.payload_offset() + 1;
+            std::error_code error;
+            auto pmt = mts::program::parse(
+                section, output + packet_size - section, error);
+            assert(!error);
+            pmt->set_program_number(program);
+            pmt->set_pcr_pid(pmt->pcr_pid() + 0x10 * (program - 1));
+            for (auto& stream : pmt->stream_entries())
+            {
+                stream.set_pid(stream.pid() + 0x10 * (program - 1));
+            }
+            std::vector<uint8_t> written(pmt->serialized_size());
+            pmt->write(written.data(), written.size());
+            std::copy(written.begin(), written.end(), section);
+        }
+    }
+    return buffer;
+}
+}
+
+/// Measures extracting a single program from a multi program capture.
+class filtering_benchmark : public gauge::time_benchmark
+{
+public:
+
+    double measurement() override
+    {
+        // Get the time spent per iteration
+        double time = gauge::time_benchmark::measurement();
+
+        gauge::config_set cs = get_current_configuration();
+        auto size = cs.get_value<uint32_t>("size");
+
+        return size / time; // MB/s for each iteration
+    }
+
+    std::string unit_text() const override
+    {
+        return "MB/s";
+    }
+
+    void store_run(tables::table& results) override
+    {
+        if (!results.has_column("throughput"))
+            results.add_column("throughput");
+
+        results.set_value("throughput", measurement());
+    }
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto filename = options["filename"].as<std::string>();
+        gauge::config_set cs;
+        cs.set_value<std::string>("filename", filename);
+        boost::iostreams::mapped_file_source file;
+        file.open(filename);
+        assert(file.is_open());
+
+        auto programs = options["programs"].as<std::vector<uint32_t>>();
+        for (auto program_count : programs)
+        {
+            auto size = make_multi_program(
+                (uint8_t*)file.data(), file.size(), program_count).size();
+            cs.set_value<uint32_t>("programs", program_count);
+            cs.set_value<uint32_t>("size", (uint32_t)size);
+            add_configuration(cs);
+        }
+        file.close();
+    }
+
+    void setup() override
+    {
+        gauge::config_set cs = get_current_configuration();
+        auto programs = cs.get_value<uint32_t>("programs");
+        if (m_buffer.empty() || m_programs != programs)
+        {
+            auto filename = cs.get_value<std::string>("filename");
+            boost::iostreams::mapped_file_source file;
+            file.open(filename);
+            assert(file.is_open());
+            m_buffer = make_multi_program(
+                (uint8_t*)file.data(), file.size(), programs);
+            m_programs = programs;
+            file.close();
+        }
+        m_output.resize(m_buffer.size());
+    }
+
+    void test_body() override
+    {
+        uint64_t size = 0;
+        RUN
+        {
+            mts::program_filter filter;
+            filter.select_program(1);
+            size += filter.filter(
+                m_buffer.data(), m_buffer.size(), m_output.data());
+        }
+        m_size = size;
+    }
+
+private:
+
+    std::vector<uint8_t> m_buffer;
+    std::vector<uint8_t> m_output;
+    uint32_t m_programs = 0;
+
+    /// Keeps the result alive, so the filtering is not optimized away.
+    volatile uint64_t m_size = 0;
+};
+
+BENCHMARK_F(filtering_benchmark, filtering, single_program, 5);
+
+BENCHMARK_OPTION(filtering_options)
+{
+    gauge::po::options_description options;
+
+    options.add_options()
+    ("filename", gauge::po::value<std::string>()->default_value("test.ts"),
+     "Set the file name")
+    ("programs", gauge::po::value<std::vector<uint32_t>>()->default_value(
+         std::vector<uint32_t>{1, 8}, "1 8")->multitoken(),
+     "Set the number of programs in the multiplex, made from copies of the "
+     "program of the file");
+
+    gauge::runner::instance().register_options(options);
+}
+
+int main(int argc, const char* argv[])
+{
+    srand(static_cast<uint32_t>(time(0)));
+
+    gauge::runner::add_default_printers();
+    gauge::runner::run_benchmarks(argc, argv);
+
+    return 0;
+}
@@ -7,12 +7,48 @@
 #include <cstdint>
 #include <ctime>
 #include <memory>
+#include <random>
 #include <system_error>
+#include <vector>
 
 #include <gauge/gauge.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
 #include <mts/packetizer.hpp>
 
+namespace
+{
+/// Inserts a burst of random bytes before a packet with the given
+/// probability, each burst being between 1 and a packet size long. The
+/// bursts contain sync bytes, as random data would, so the packetizer has to
+/// resynchronize after each of them.
+std::vector<uint8_t> insert_garbage(
+    const uint8_t* data, uint64_t size, double garbage_rate)
+{
+    const auto packet_size = mts::packetizer::packet_size();
+    std::minstd_rand random(42);
+    std::bernoulli_distribution has_garbage(garbage_rate);
+    std::uniform_int_distribution<uint32_t> garbage_size(1, packet_size);
+    std::uniform_int_distribution<uint32_t> garbage_byte(0, 255);
+
+    std::vector<uint8_t> buffer;
+    buffer.reserve(size + size / 2);
+    for (uint64_t offset = 0; offset + packet_size <= size;
+         offset += packet_size)
+    {
+        if (has_garbage(random))
+        {
+            auto garbage = garbage_size(random);
+            for (uint32_t i = 0; i < garbage; ++i)
+            {
+                buffer.push_back((uint8_t)garbage_byte(random));
+            }
+        }
+        buffer.insert(buffer.end(), data + offset, data + offset + packet_size);
+    }
+    return buffer;
+}
+}
+
 class parsing_benchmark : public gauge::time_benchmark
 {
 public:
@@ -47,29 +83,38 @@ public:
         boost::iostreams::mapped_file_source file;
         file.open(filename);
         assert(file.is_open());
-        cs.set_value<uint32_t>("size", file.size());
-        file.close();
 
         auto packet_size = options["packet_size"].as<uint16_t>();
         cs.set_value<uint16_t>("packet_size", packet_size);
 
-        add_configuration(cs);
+        auto garbage_rates = options["garbage"].as<std::vector<double>>();
+        for (auto garbage_rate : garbage_rates)
+        {
+            auto size = insert_garbage(
+                (uint8_t*)file.data(), file.size(), garbage_rate).size();
+            cs.set_value<uint32_t>("size", size);
+            cs.set_value<double>("garbage", garbage_rate);
+            add_configuration(cs);
+        }
+        file.close();
     }
 
     void setup() override
     {
-        if (m_buffer.empty())
+        gauge::config_set cs = get_current_configuration();
+        auto garbage_rate = cs.get_value<double>("garbage");
+        if (m_buffer.empty() || m_garbage_rate != garbage_rate)
         {
-            gauge::config_set cs = get_current_configuration();
             auto filename = cs.get_value<std::string>("filename");
             boost::iostreams::mapped_file_source file;
             file.open(filename);
             assert(file.is_open());
-            m_buffer.insert(m_buffer.begin(), file.data(), file.data() + file.size());
+            m_buffer = insert_garbage(
+                (uint8_t*)file.data(), file.size(), garbage_rate);
+            m_garbage_rate = garbage_rate;
             file.close();
-
-            m_packet_size = cs.get_value<uint16_t>("packet_size");
         }
+        m_packet_size = cs.get_value<uint16_t>("packet_size");
     }
 
     void test_body() override
@@ -95,6 +140,7 @@ private:
 
     std::vector<uint8_t> m_buffer;
     uint16_t m_packet_size = 0;
+    double m_garbage_rate = 0;
 };
 
 BENCHMARK_F(parsing_benchmark, parsing, h264, 10);
@@ -110,7 +156,10 @@ BENCHMARK_OPTION(arithmetic_options)
     ("filename", gauge::po::value<std::string>()->default_value("test.ts"),
      "Set the file name")
     ("packet_size", gauge::po::value<uint16_t>()->default_value(1490U),
-     "Packet size");
+     "Packet size")
+    ("garbage", gauge::po::value<std::vector<double>>()->default_value(
+         std::vector<double>{0.0, 0.1}, "0.0 0.1")->multitoken(),
+     "Set the probability of a burst of garbage before each TS packet");
 
     gauge::runner::instance().register_options(options);
 }
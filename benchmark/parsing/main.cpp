@@ -8,13 +8,109 @@
 #include <ctime>
 #include <memory>
 #include <system_error>
+#include <vector>
 
 #include <gauge/gauge.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
+#include <mts/crc32.hpp>
+#include <mts/parallel_parser.hpp>
 #include <mts/parser.hpp>
 
+namespace
+{
+void write_section_packet(
+    uint16_t pid, uint8_t continuity_counter,
+    std::vector<uint8_t> section, std::vector<uint8_t>& buffer)
+{
+    // Section length
+    auto length = section.size() - 3 + 4;
+    section[1] = 0xB0 | ((length >> 8) & 0x0F);
+    section[2] = length & 0xFF;
+
+    auto crc = mts::crc32::compute(section.data(), section.size());
+    section.push_back(crc >> 24);
+    section.push_back(crc >> 16);
+    section.push_back(crc >> 8);
+    section.push_back(crc);
+
+    assert(section.size() + 5 <= mts::parser::packet_size());
+    auto offset = buffer.size();
+    buffer.resize(offset + mts::parser::packet_size(), 0xFF);
+    auto packet = buffer.data() + offset;
+    packet[0] = 0x47;
+    packet[1] = 0x40 | ((pid >> 8) & 0x1F);
+    packet[2] = pid & 0xFF;
+    packet[3] = 0x10 | (continuity_counter & 0x0F);
+    packet[4] = 0; // pointer field
+    std::copy(section.begin(), section.end(), packet + 5);
+}
+
+/// Turns a single program capture into a multi-program capture by replacing
+/// its PAT with one announcing additional programs, each with a video and an
+/// audio stream that never carries any data. The PID of the PMT of the
+/// original program is assumed to be 0x1000.
+std::vector<uint8_t> make_multi_program(
+    const uint8_t* data, uint64_t size, uint32_t programs)
+{
+    const auto packet_size = mts::parser::packet_size();
+    std::vector<uint8_t> buffer;
+    buffer.reserve(size);
+    uint8_t pmt_continuity_counter = 0;
+    for (uint64_t offset = 0; offset + packet_size <= size;
+         offset += packet_size)
+    {
+        const uint8_t* packet = data + offset;
+        uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        if (pid != 0 || programs <= 1)
+        {
+            buffer.insert(buffer.end(), packet, packet + packet_size);
+            continue;
+        }
+
+        std::vector<uint8_t> pat = { 0x00, 0x00, 0x00, 0x00, 0x01, 0xC1, 0x00, 0x00 };
+        for (uint16_t program = 1; program <= programs; ++program)
+        {
+            uint16_t program_pid = 0x1000 + program - 1;
+            pat.push_back(program >> 8);
+            pat.push_back(program & 0xFF);
+            pat.push_back(0xE0 | (program_pid >> 8));
+            pat.push_back(program_pid & 0xFF);
+        }
+        write_section_packet(0, packet[3], pat, buffer);
+
+        for (uint16_t program = 2; program <= programs; ++program)
+        {
+            uint16_t program_pid = 0x1000 + program - 1;
+            uint16_t video_pid = 0x200 + program * 2;
+            uint16_t audio_pid = video_pid + 1;
+            std::vector<uint8_t> pmt =
+                {
+                    0x02, 0x00, 0x00,
+                    (uint8_t)(program >> 8), (uint8_t)(program & 0xFF),
+                    0xC1, 0x00, 0x00,
+                    (uint8_t)(0xE0 | (video_pid >> 8)),
+                    (uint8_t)(video_pid & 0xFF),
+                    0xF0, 0x00,
+                    0x1B,
+                    (uint8_t)(0xE0 | (video_pid >> 8)),
+                    (uint8_t)(video_pid & 0xFF),
+                    0xF0, 0x00,
+                    0x0F,
+                    (uint8_t)(0xE0 | (audio_pid >> 8)),
+                    (uint8_t)(audio_pid & 0xFF),
+                    0xF0, 0x00
+                };
+            write_section_packet(
+                program_pid, pmt_continuity_counter, pmt, buffer);
+        }
+        pmt_continuity_counter++;
+    }
+    return buffer;
+}
+}
+
 class parsing_benchmark : public gauge::time_benchmark
 {
 public:
@@ -51,24 +147,60 @@ public:
         boost::iostreams::mapped_file_source file;
         file.open(filename);
         assert(file.is_open());
-        cs.set_value<uint32_t>("size", file.size());
-        file.close();
 
-        add_configuration(cs);
+        auto programs = options["programs"].as<std::vector<uint32_t>>();
+        auto threads = options["threads"].as<std::vector<uint32_t>>();
+        for (auto program_count : programs)
+        {
+            auto size = make_multi_program(
+                (uint8_t*)file.data(), file.size(), program_count).size();
+            cs.set_value<uint32_t>("programs", program_count);
+            cs.set_value<uint32_t>("size", size);
+            for (auto read : {"packet", "batch"})
+            {
+                cs.set_value<std::string>("read", read);
+                cs.set_value<uint32_t>("threads", 1);
+                add_configuration(cs);
+            }
+            for (auto thread_count : threads)
+            {
+                cs.set_value<std::string>("read", "parallel");
+                cs.set_value<uint32_t>("threads", thread_count);
+                add_configuration(cs);
+            }
+        }
+        file.close();
     }
 
     void setup() override
     {
-        if (m_buffer.empty())
+        gauge::config_set cs = get_current_configuration();
+        auto programs = cs.get_value<uint32_t>("programs");
+        if (m_buffer.empty() || m_programs != programs)
         {
-            gauge::config_set cs = get_current_configuration();
             auto filename = cs.get_value<std::string>("filename");
             boost::iostreams::mapped_file_source file;
             file.open(filename);
             assert(file.is_open());
-            m_buffer.insert(m_buffer.begin(), file.data(), file.data() + file.size());
+            m_buffer = make_multi_program(
+                (uint8_t*)file.data(), file.size(), programs);
+            m_programs = programs;
             file.close();
         }
+        m_read = cs.get_value<std::string>("read");
+        m_threads = cs.get_value<uint32_t>("threads");
+
+        // A chunk for each thread, the worker threads are started once and
+        // reused by every run.
+        m_parallel_parser.reset();
+        if (m_read == "parallel")
+        {
+            auto chunk_size = (m_buffer.size() + m_threads - 1) / m_threads;
+            chunk_size += mts::parser::packet_size() -
+                (chunk_size % mts::parser::packet_size());
+            m_parallel_parser.reset(
+                new mts::parallel_parser(m_threads, chunk_size));
+        }
     }
 
     void test_body() override
@@ -76,6 +208,44 @@ public:
         RUN
         {
             mts::parser parser;
+            auto on_pes = [&parser](uint16_t pid)
+            {
+                mts::stream_type type = parser.stream_type(pid);
+                if (type != mts::stream_type::avc_video_stream)
+                    return;
+
+                auto& pes_data = parser.pes_data();
+                std::error_code error;
+                auto pes = mts::pes::parse(
+                    pes_data.data(), pes_data.size(), error);
+                if (error)
+                    return;
+
+                assert(pes->payload_data() != nullptr);
+                assert(pes->payload_size() != 0U);
+            };
+
+            if (m_read == "batch")
+            {
+                parser.read(m_buffer.data(), m_buffer.size(), on_pes);
+                continue;
+            }
+
+            if (m_read == "parallel")
+            {
+                m_parallel_parser->read(m_buffer.data(), m_buffer.size(),
+                    [](uint16_t, mts::stream_type type, const mts::pes& pes,
+                       const std::vector<mts::slice>&)
+                    {
+                        if (type != mts::stream_type::avc_video_stream)
+                            return;
+
+                        assert(pes.payload_size() != 0U);
+                        (void) pes;
+                    });
+                continue;
+            }
+
             uint64_t offset = 0;
             const auto packets = m_buffer.size() / mts::parser::packet_size();
             for (uint32_t i = 0; i < packets; ++i)
@@ -85,19 +255,7 @@ public:
                 offset += mts::parser::packet_size();
                 if (parser.has_pes())
                 {
-                    auto pid = parser.pes_pid();
-                    mts::stream_type type = (mts::stream_type)parser.stream_type(pid);
-                    if (type != mts::stream_type::avc_video_stream)
-                        continue;
-
-                    auto& pes_data = parser.pes_data();
-                    std::error_code error;
-                    auto pes = mts::pes::parse(pes_data.data(), pes_data.size(), error);
-                    if (error)
-                        continue;
-
-                    assert(pes->payload_data() != nullptr);
-                    assert(pes->payload_size() != 0U);
+                    on_pes(parser.pes_pid());
                 }
             }
         }
@@ -106,6 +264,10 @@ public:
 private:
 
     std::vector<uint8_t> m_buffer;
+    uint32_t m_programs = 0;
+    std::string m_read;
+    uint32_t m_threads = 1;
+    std::unique_ptr<mts::parallel_parser> m_parallel_parser;
 };
 
 BENCHMARK_F(parsing_benchmark, parsing, h264, 5);
@@ -119,7 +281,14 @@ BENCHMARK_OPTION(arithmetic_options)
 
     options.add_options()
     ("filename", gauge::po::value<std::string>()->default_value("test.ts"),
-     "Set the file name");
+     "Set the file name")
+    ("programs", gauge::po::value<std::vector<uint32_t>>()->default_value(
+         std::vector<uint32_t>{1, 40}, "1 40")->multitoken(),
+     "Set the number of programs in the multiplex, the extra programs are "
+     "added to the PAT of the file")
+    ("threads", gauge::po::value<std::vector<uint32_t>>()->default_value(
+         std::vector<uint32_t>{1, 2, 4}, "1 2 4")->multitoken(),
+     "Set the number of threads of the parallel parser");
 
     gauge::runner::instance().register_options(options);
 }
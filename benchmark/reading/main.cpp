@@ -0,0 +1,177 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <cassert>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <gauge/gauge.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <mts/file_reader.hpp>
+#include <mts/packetizer.hpp>
+#include <mts/parser.hpp>
+
+/// Compares reading a file into the parser with std::ifstream a packet at a
+/// time, with a memory mapping of the whole file and with the file reader.
+class reading_benchmark : public gauge::time_benchmark
+{
+public:
+
+    double measurement() override
+    {
+        // Get the time spent per iteration
+        double time = gauge::time_benchmark::measurement();
+
+        gauge::config_set cs = get_current_configuration();
+        auto size = cs.get_value<uint64_t>("size");
+
+        return size / time; // MB/s for each iteration
+    }
+
+    std::string unit_text() const override
+    {
+        return "MB/s";
+    }
+
+    void store_run(tables::table& results) override
+    {
+        if (!results.has_column("throughput"))
+            results.add_column("throughput");
+
+        results.set_value("throughput", measurement());
+    }
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto filename = options["filename"].as<std::string>();
+        auto buffer_sizes = options["buffer_size"].as<std::vector<uint32_t>>();
+
+        gauge::config_set cs;
+        cs.set_value<std::string>("filename", filename);
+
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        assert(file.is_open());
+        cs.set_value<uint64_t>("size", (uint64_t)file.tellg());
+
+        cs.set_value<uint32_t>("buffer_size", mts::parser::packet_size());
+        cs.set_value<std::string>("read", "ifstream");
+        add_configuration(cs);
+
+        cs.set_value<uint32_t>("buffer_size", 0);
+        cs.set_value<std::string>("read", "mmap");
+        add_configuration(cs);
+
+        for (auto buffer_size : buffer_sizes)
+        {
+            cs.set_value<uint32_t>("buffer_size", buffer_size);
+            cs.set_value<std::string>("read", "file_reader");
+            add_configuration(cs);
+            cs.set_value<std::string>("read", "file_reader_direct");
+            add_configuration(cs);
+        }
+    }
+
+    void setup() override
+    {
+        gauge::config_set cs = get_current_configuration();
+        m_filename = cs.get_value<std::string>("filename");
+        m_read = cs.get_value<std::string>("read");
+        m_buffer_size = cs.get_value<uint32_t>("buffer_size");
+    }
+
+    void test_body() override
+    {
+        RUN
+        {
+            mts::parser parser;
+            uint32_t pes_count = 0;
+            auto on_pes = [&pes_count](uint16_t)
+            {
+                ++pes_count;
+            };
+
+            if (m_read == "ifstream")
+            {
+                std::ifstream file(m_filename, std::ios::binary);
+                assert(file.is_open());
+                std::vector<uint8_t> packet(mts::parser::packet_size());
+                while (file.read((char*)packet.data(), packet.size()))
+                {
+                    std::error_code error;
+                    parser.read(packet.data(), error);
+                    if (parser.has_pes())
+                        on_pes(parser.pes_pid());
+                }
+            }
+            else if (m_read == "mmap")
+            {
+                boost::iostreams::mapped_file_source file;
+                file.open(m_filename);
+                assert(file.is_open());
+                parser.read((const uint8_t*)file.data(), file.size(), on_pes);
+            }
+            else
+            {
+                mts::file_reader reader(m_buffer_size);
+                reader.set_direct_io(m_read == "file_reader_direct");
+                std::error_code error;
+                reader.open(m_filename, error);
+                assert(!error);
+
+                mts::packetizer packetizer(
+                    [&](const uint8_t* data, uint64_t size)
+                    {
+                        parser.read(data, size, on_pes);
+                    });
+                reader.read([&](const uint8_t* data, uint64_t size)
+                {
+                    packetizer.read(data, size);
+                }, error);
+                assert(!error);
+            }
+            assert(pes_count != 0U);
+        }
+    }
+
+private:
+
+    std::string m_filename;
+    std::string m_read;
+    uint32_t m_buffer_size = 0;
+};
+
+BENCHMARK_F(reading_benchmark, reading, file, 5);
+
+/// Using this macro we may specify options. For specifying options
+/// we use the boost program options library. So you may additional
+/// details on how to do it in the manual for that library.
+BENCHMARK_OPTION(arithmetic_options)
+{
+    gauge::po::options_description options;
+
+    options.add_options()
+    ("filename", gauge::po::value<std::string>()->default_value("test.ts"),
+     "Set the file name")
+    ("buffer_size", gauge::po::value<std::vector<uint32_t>>()->default_value(
+         std::vector<uint32_t>{1 << 16, 1 << 20, 1 << 22},
+         "65536 1048576 4194304")->multitoken(),
+     "Set the sizes of the buffers of the file reader");
+
+    gauge::runner::instance().register_options(options);
+}
+
+int main(int argc, const char* argv[])
+{
+    srand(static_cast<uint32_t>(time(0)));
+
+    gauge::runner::add_default_printers();
+    gauge::runner::run_benchmarks(argc, argv);
+
+    return 0;
+}
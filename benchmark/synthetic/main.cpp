@@ -0,0 +1,551 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <gauge/gauge.hpp>
+#include <mts/packetizer.hpp>
+#include <mts/parser.hpp>
+#include <mts/pes.hpp>
+#include <mts/stream_generator.hpp>
+#include <mts/ts_packet_view.hpp>
+
+/// The benchmarks in this file measure the library on streams made by the
+/// mts::stream_generator, so they need no sample files. Each reports the
+/// throughput in MB/s, the packet rate in Mpackets/s and the number of heap
+/// allocations per iteration, counted by replacing the global operator new.
+
+namespace
+{
+std::atomic<uint64_t> allocation_count{0};
+}
+
+// The operators are kept out of line, as GCC otherwise warns that the
+// memory allocated by the inlined operator new is released by free().
+#if defined(__GNUC__)
+#define SYNTHETIC_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define SYNTHETIC_NOINLINE __declspec(noinline)
+#else
+#define SYNTHETIC_NOINLINE
+#endif
+
+SYNTHETIC_NOINLINE void* operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* data = std::malloc(size == 0 ? 1 : size))
+        return data;
+    throw std::bad_alloc();
+}
+
+SYNTHETIC_NOINLINE void operator delete(void* data) noexcept
+{
+    std::free(data);
+}
+
+void operator delete(void* data, std::size_t) noexcept
+{
+    operator delete(data);
+}
+
+namespace
+{
+/// @return The configuration of the default stream, a single program with
+///         a video and an audio stream, without impairments.
+gauge::config_set default_configuration(
+    const gauge::po::variables_map& options)
+{
+    gauge::config_set cs;
+    cs.set_value<uint32_t>("seed", options["seed"].as<uint32_t>());
+    cs.set_value<uint32_t>("packets", options["packets"].as<uint32_t>());
+    cs.set_value<uint32_t>("programs", 1);
+    cs.set_value<uint32_t>("streams", 2);
+    cs.set_value<uint32_t>("min_pes_size", 500);
+    cs.set_value<uint32_t>("max_pes_size", 20000);
+    cs.set_value<uint32_t>("psi_interval", 100);
+
+    // The rates in packets per thousand.
+    cs.set_value<uint32_t>("adaptation_fields", 0);
+    cs.set_value<uint32_t>("loss", 0);
+    cs.set_value<uint32_t>("garbage", 0);
+    return cs;
+}
+
+/// Generates the stream of a configuration.
+std::vector<uint8_t> make_stream(const gauge::config_set& cs)
+{
+    mts::stream_generator generator(cs.get_value<uint32_t>("seed"));
+    generator.set_programs(cs.get_value<uint32_t>("programs"));
+    generator.set_streams(cs.get_value<uint32_t>("streams"));
+    generator.set_pes_size(cs.get_value<uint32_t>("min_pes_size"),
+                           cs.get_value<uint32_t>("max_pes_size"));
+    generator.set_psi_interval(cs.get_value<uint32_t>("psi_interval"));
+    generator.set_adaptation_field_rate(
+        cs.get_value<uint32_t>("adaptation_fields") / 1000.0);
+    generator.set_loss_rate(cs.get_value<uint32_t>("loss") / 1000.0);
+    generator.set_garbage_rate(cs.get_value<uint32_t>("garbage") / 1000.0);
+
+    std::vector<uint8_t> stream;
+    generator.generate(cs.get_value<uint32_t>("packets"), stream);
+    return stream;
+}
+}
+
+class synthetic_benchmark : public gauge::time_benchmark
+{
+public:
+
+    double measurement() override
+    {
+        // Get the time spent per iteration
+        double time = gauge::time_benchmark::measurement();
+
+        gauge::config_set cs = get_current_configuration();
+        auto size = cs.get_value<uint32_t>("size");
+
+        return size / time; // MB/s for each iteration
+    }
+
+    std::string unit_text() const override
+    {
+        return "MB/s";
+    }
+
+    void store_run(tables::table& results) override
+    {
+        if (!results.has_column("throughput"))
+            results.add_column("throughput");
+        if (!results.has_column("packet_rate"))
+            results.add_column("packet_rate");
+        if (!results.has_column("allocations"))
+            results.add_column("allocations");
+
+        gauge::config_set cs = get_current_configuration();
+        auto items = cs.get_value<uint32_t>("items");
+        double time = gauge::time_benchmark::measurement();
+
+        results.set_value("throughput", measurement());
+        results.set_value("packet_rate", items / time);
+        results.set_value("allocations", m_allocations);
+    }
+
+    void setup() override
+    {
+        m_stream = make_stream(get_current_configuration());
+    }
+
+protected:
+
+    /// Adds a configuration measured over the whole stream it describes.
+    void add_stream_configuration(gauge::config_set cs)
+    {
+        auto size = make_stream(cs).size();
+        cs.set_value<uint32_t>("size", (uint32_t)size);
+        cs.set_value<uint32_t>(
+            "items", (uint32_t)(size / mts::parser::packet_size()));
+        add_configuration(cs);
+    }
+
+    /// Runs the function in the benchmark loop, counting the allocations
+    /// made by it.
+    template<class Function>
+    void run(const Function& function)
+    {
+        uint64_t allocations = 0;
+        uint64_t iterations = 0;
+        RUN
+        {
+            auto before = allocation_count.load(std::memory_order_relaxed);
+            function();
+            allocations +=
+                allocation_count.load(std::memory_order_relaxed) - before;
+            iterations++;
+        }
+        m_allocations = iterations == 0 ? 0.0 :
+            (double)allocations / iterations;
+    }
+
+protected:
+
+    std::vector<uint8_t> m_stream;
+    double m_allocations = 0.0;
+
+    /// Keeps the results alive, so the work is not optimized away.
+    volatile uint64_t m_sum = 0;
+};
+
+/// Measures classifying packets by their header, with and without
+/// adaptation fields.
+class headers_benchmark : public synthetic_benchmark
+{
+public:
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto cs = default_configuration(options);
+        for (uint32_t adaptation_fields : {0U, 500U})
+        {
+            cs.set_value<uint32_t>("adaptation_fields", adaptation_fields);
+            add_stream_configuration(cs);
+        }
+    }
+
+    void test_body() override
+    {
+        const auto packet_size = mts::ts_packet_view::packet_size();
+        const auto packets = m_stream.size() / packet_size;
+        run([&]()
+        {
+            uint64_t sum = 0;
+            const uint8_t* data = m_stream.data();
+            for (uint64_t i = 0; i < packets; ++i, data += packet_size)
+            {
+                mts::ts_packet_view packet(data);
+                std::error_code error;
+                packet.verify(error);
+                if (error || !packet.has_payload_field())
+                    continue;
+                sum += packet.pid() + packet.continuity_counter() +
+                       packet.payload_unit_start_indicator() +
+                       packet.payload_offset();
+            }
+            m_sum = sum;
+        });
+    }
+};
+
+/// Measures reading the PAT and the PMTs, with the PSI repeated after
+/// every stream packet.
+class psi_benchmark : public synthetic_benchmark
+{
+public:
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto cs = default_configuration(options);
+        cs.set_value<uint32_t>("psi_interval", 1);
+        for (uint32_t programs : {1U, 8U, 32U})
+        {
+            cs.set_value<uint32_t>("programs", programs);
+            add_stream_configuration(cs);
+        }
+    }
+
+    void test_body() override
+    {
+        run([&]()
+        {
+            mts::parser parser;
+            parser.read(m_stream.data(), m_stream.size(), [](uint16_t) {});
+            m_sum = parser.programs_complete();
+        });
+    }
+};
+
+/// Measures assembling pes in each delivery mode of the parser, for small
+/// and large pes, and with lost packets.
+class reassembly_benchmark : public synthetic_benchmark
+{
+public:
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto cs = default_configuration(options);
+        for (auto mode : {"copy", "zero_copy", "incremental"})
+        {
+            cs.set_value<std::string>("mode", mode);
+            for (uint32_t max_pes_size : {2000U, 100000U})
+            {
+                cs.set_value<uint32_t>("min_pes_size", max_pes_size / 10);
+                cs.set_value<uint32_t>("max_pes_size", max_pes_size);
+                for (uint32_t loss : {0U, 10U})
+                {
+                    cs.set_value<uint32_t>("loss", loss);
+                    add_stream_configuration(cs);
+                }
+            }
+        }
+    }
+
+    void setup() override
+    {
+        synthetic_benchmark::setup();
+        m_mode = get_current_configuration().get_value<std::string>("mode");
+    }
+
+    void test_body() override
+    {
+        run([&]()
+        {
+            uint64_t sum = 0;
+            mts::parser parser;
+            if (m_mode == "zero_copy")
+                parser.set_zero_copy(true);
+            if (m_mode == "incremental")
+            {
+                parser.set_incremental(
+                    [](uint16_t, const mts::pes&) {},
+                    [&sum](uint16_t, const uint8_t*, uint64_t size)
+                    {
+                        sum += size;
+                    },
+                    [](uint16_t, bool) {});
+            }
+
+            parser.read(m_stream.data(), m_stream.size(),
+                [&](uint16_t)
+                {
+                    sum += parser.zero_copy() ?
+                        parser.pes_slices().size() : parser.pes_data().size();
+                });
+            m_sum = sum;
+        });
+    }
+
+private:
+
+    std::string m_mode;
+};
+
+/// Measures pes::parse on the pes of the stream, both copied and as slices.
+/// The packet rate is the rate of pes parsed.
+class pes_parse_benchmark : public synthetic_benchmark
+{
+public:
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto cs = default_configuration(options);
+        for (auto mode : {"copy", "zero_copy"})
+        {
+            cs.set_value<std::string>("mode", mode);
+            for (uint32_t max_pes_size : {2000U, 100000U})
+            {
+                cs.set_value<uint32_t>("min_pes_size", max_pes_size / 10);
+                cs.set_value<uint32_t>("max_pes_size", max_pes_size);
+
+                m_stream = make_stream(cs);
+                extract();
+                uint64_t size = 0;
+                for (const auto& pes : m_pes)
+                    size += pes.size();
+                cs.set_value<uint32_t>("size", (uint32_t)size);
+                cs.set_value<uint32_t>("items", (uint32_t)m_pes.size());
+                add_configuration(cs);
+            }
+        }
+    }
+
+    void setup() override
+    {
+        synthetic_benchmark::setup();
+        m_zero_copy = get_current_configuration().get_value<std::string>(
+            "mode") == "zero_copy";
+        extract();
+    }
+
+    void test_body() override
+    {
+        std::vector<mts::slice> payload;
+        run([&]()
+        {
+            uint64_t sum = 0;
+            std::error_code error;
+            if (m_zero_copy)
+            {
+                for (const auto& slices : m_slices)
+                {
+                    auto pes = mts::pes::parse(slices, payload, error);
+                    assert(!error);
+                    sum += pes->header_size() + payload.size();
+                }
+            }
+            else
+            {
+                for (const auto& data : m_pes)
+                {
+                    auto pes = mts::pes::parse(data.data(), data.size(), error);
+                    assert(!error);
+                    sum += pes->payload_size();
+                }
+            }
+            m_sum = sum;
+        });
+    }
+
+private:
+
+    /// Collects the pes of the stream, and their slices of the stream.
+    void extract()
+    {
+        m_pes.clear();
+        m_slices.clear();
+        mts::parser parser;
+        parser.set_zero_copy(true);
+        parser.read(m_stream.data(), m_stream.size(), [&](uint16_t)
+        {
+            const auto& slices = parser.pes_slices();
+            std::vector<uint8_t> data;
+            for (const auto& slice : slices)
+            {
+                data.insert(data.end(), slice.m_data,
+                            slice.m_data + slice.m_size);
+            }
+            m_pes.push_back(std::move(data));
+            m_slices.push_back(slices);
+        });
+    }
+
+private:
+
+    bool m_zero_copy = false;
+    std::vector<std::vector<uint8_t>> m_pes;
+    std::vector<std::vector<mts::slice>> m_slices;
+};
+
+/// Measures finding the packets in datagrams of various sizes, with and
+/// without garbage between the packets.
+class packetizer_benchmark : public synthetic_benchmark
+{
+public:
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto cs = default_configuration(options);
+        for (uint32_t datagram_size : {188U, 1316U, 65536U})
+        {
+            cs.set_value<uint32_t>("datagram_size", datagram_size);
+            for (uint32_t garbage : {0U, 10U})
+            {
+                cs.set_value<uint32_t>("garbage", garbage);
+                add_stream_configuration(cs);
+            }
+        }
+    }
+
+    void setup() override
+    {
+        synthetic_benchmark::setup();
+        m_datagram_size =
+            get_current_configuration().get_value<uint32_t>("datagram_size");
+    }
+
+    void test_body() override
+    {
+        run([&]()
+        {
+            uint64_t packets = 0;
+            mts::packetizer packetizer([&packets](const uint8_t*, uint64_t)
+            {
+                packets++;
+            });
+            for (uint64_t offset = 0; offset < m_stream.size();
+                 offset += m_datagram_size)
+            {
+                auto size = std::min<uint64_t>(
+                    m_datagram_size, m_stream.size() - offset);
+                packetizer.read(m_stream.data() + offset, size);
+            }
+            m_sum = packets;
+        });
+    }
+
+private:
+
+    uint32_t m_datagram_size = 0;
+};
+
+/// Measures extracting the payloads of all pes from datagrams, i.e. the
+/// packetizer, the parser and pes::parse together, on a clean stream and on
+/// one with adaptation fields, loss and garbage. The parser copies the
+/// payloads, as the packetizer does not keep the packets alive.
+class extraction_benchmark : public synthetic_benchmark
+{
+public:
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto cs = default_configuration(options);
+        for (uint32_t programs : {1U, 8U})
+        {
+            cs.set_value<uint32_t>("programs", programs);
+            for (auto impaired : {false, true})
+            {
+                cs.set_value<uint32_t>("adaptation_fields", impaired ? 100 : 0);
+                cs.set_value<uint32_t>("loss", impaired ? 1 : 0);
+                cs.set_value<uint32_t>("garbage", impaired ? 1 : 0);
+                add_stream_configuration(cs);
+            }
+        }
+    }
+
+    void test_body() override
+    {
+        const uint64_t datagram_size = 1316;
+        run([&]()
+        {
+            uint64_t sum = 0;
+            mts::parser parser;
+            mts::packetizer packetizer(
+                [&](const uint8_t* data, uint64_t)
+                {
+                    std::error_code error;
+                    parser.read(data, error);
+                    if (error || !parser.has_pes())
+                        return;
+
+                    const auto& pes_data = parser.pes_data();
+                    auto pes = mts::pes::parse(
+                        pes_data.data(), pes_data.size(), error);
+                    if (error)
+                        return;
+                    sum += pes->payload_size();
+                });
+            for (uint64_t offset = 0; offset < m_stream.size();
+                 offset += datagram_size)
+            {
+                auto size = std::min<uint64_t>(
+                    datagram_size, m_stream.size() - offset);
+                packetizer.read(m_stream.data() + offset, size);
+            }
+            m_sum = sum;
+        });
+    }
+};
+
+BENCHMARK_F(headers_benchmark, synthetic, headers, 10);
+BENCHMARK_F(psi_benchmark, synthetic, psi, 10);
+BENCHMARK_F(reassembly_benchmark, synthetic, reassembly, 10);
+BENCHMARK_F(pes_parse_benchmark, synthetic, pes_parse, 10);
+BENCHMARK_F(packetizer_benchmark, synthetic, packetizer, 10);
+BENCHMARK_F(extraction_benchmark, synthetic, extraction, 10);
+
+BENCHMARK_OPTION(synthetic_options)
+{
+    gauge::po::options_description options;
+    options.add_options()
+    ("packets", gauge::po::value<uint32_t>()->default_value(20000),
+     "Set the number of packets generated for each stream")
+    ("seed", gauge::po::value<uint32_t>()->default_value(1),
+     "Set the seed of the stream generator");
+    gauge::runner::instance().register_options(options);
+}
+
+int main(int argc, const char* argv[])
+{
+    srand(static_cast<uint32_t>(time(0)));
+    gauge::runner::add_default_printers();
+    gauge::runner::run_benchmarks(argc, argv);
+    return 0;
+}
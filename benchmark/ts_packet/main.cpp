@@ -0,0 +1,149 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <cassert>
+#include <cstdint>
+#include <ctime>
+#include <system_error>
+#include <vector>
+
+#include <gauge/gauge.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <mts/ts_packet.hpp>
+#include <mts/ts_packet_view.hpp>
+
+/// Measures classifying packets by their header, i.e. PID, payload unit
+/// start indicator, continuity counter and payload presence, which is all
+/// the parser needs from most packets.
+class ts_packet_benchmark : public gauge::time_benchmark
+{
+public:
+
+    double measurement() override
+    {
+        // Get the time spent per iteration
+        double time = gauge::time_benchmark::measurement();
+
+        gauge::config_set cs = get_current_configuration();
+        auto packets = cs.get_value<uint32_t>("packets");
+
+        return packets / time; // packets per microsecond for each iteration
+    }
+
+    std::string unit_text() const override
+    {
+        return "Mpackets/s";
+    }
+
+    void store_run(tables::table& results) override
+    {
+        if (!results.has_column("throughput"))
+            results.add_column("throughput");
+
+        results.set_value("throughput", measurement());
+    }
+
+    void get_options(gauge::po::variables_map& options) override
+    {
+        auto filename = options["filename"].as<std::string>();
+        gauge::config_set cs;
+        cs.set_value<std::string>("filename", filename);
+        boost::iostreams::mapped_file_source file;
+        file.open(filename);
+        assert(file.is_open());
+        auto packets = file.size() / mts::ts_packet_view::packet_size();
+        cs.set_value<uint32_t>("packets", (uint32_t)packets);
+        file.close();
+
+        for (auto decode : {"ts_packet", "ts_packet_view"})
+        {
+            cs.set_value<std::string>("decode", decode);
+            add_configuration(cs);
+        }
+    }
+
+    void setup() override
+    {
+        gauge::config_set cs = get_current_configuration();
+        if (m_buffer.empty())
+        {
+            auto filename = cs.get_value<std::string>("filename");
+            boost::iostreams::mapped_file_source file;
+            file.open(filename);
+            assert(file.is_open());
+            m_buffer.assign(file.data(), file.data() + file.size());
+            file.close();
+        }
+        m_view = cs.get_value<std::string>("decode") == "ts_packet_view";
+    }
+
+    void test_body() override
+    {
+        const auto packet_size = mts::ts_packet_view::packet_size();
+        const auto packets = m_buffer.size() / packet_size;
+        uint64_t sum = 0;
+
+        RUN
+        {
+            const uint8_t* data = (const uint8_t*)m_buffer.data();
+            for (uint32_t i = 0; i < packets; ++i, data += packet_size)
+            {
+                if (m_view)
+                {
+                    mts::ts_packet_view packet(data);
+                    std::error_code error;
+                    packet.verify(error);
+                    if (error || !packet.has_payload_field())
+                        continue;
+                    sum += packet.pid() + packet.continuity_counter() +
+                           packet.payload_unit_start_indicator();
+                }
+                else
+                {
+                    std::error_code error;
+                    auto packet = mts::ts_packet::parse(
+                        data, packet_size, error);
+                    if (error || !packet->has_payload_field())
+                        continue;
+                    sum += packet->pid() + packet->continuity_counter() +
+                           packet->payload_unit_start_indicator();
+                }
+            }
+        }
+
+        m_sum = sum;
+    }
+
+private:
+
+    std::vector<char> m_buffer;
+    bool m_view = false;
+
+    /// Keeps the result alive, so the decoding is not optimized away.
+    volatile uint64_t m_sum = 0;
+};
+
+BENCHMARK_F(ts_packet_benchmark, ts_packet, classify, 10);
+
+BENCHMARK_OPTION(ts_packet_options)
+{
+    gauge::po::options_description options;
+
+    options.add_options()
+    ("filename", gauge::po::value<std::string>()->default_value("test.ts"),
+     "Set the file name");
+
+    gauge::runner::instance().register_options(options);
+}
+
+int main(int argc, const char* argv[])
+{
+    srand(static_cast<uint32_t>(time(0)));
+
+    gauge::runner::add_default_printers();
+    gauge::runner::run_benchmarks(argc, argv);
+
+    return 0;
+}
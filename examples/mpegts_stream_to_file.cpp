@@ -73,7 +73,9 @@ struct receiver
 
     void parse_ts_packet(const uint8_t* data)
     {
-        assert(data[0] == 0x47);
+        // The packetizer detects the packet format, e.g. m2ts.
+        m_parser.set_packet_format(m_packetizer.packet_format());
+
         std::error_code error;
         m_parser.read(data, error);
         if (error)
@@ -3,10 +3,12 @@
 //
 // Distributed under the "BSD License". See the accompanying LICENSE.rst file.
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <thread>
 
-#include <mts/parser.hpp>
+#include <mts/parallel_parser.hpp>
 #include <mts/pes.hpp>
 #include <mts/stream_type.hpp>
 
@@ -30,28 +32,23 @@ int main(int argc, char* argv[])
     // Create the AAC output file
     std::ofstream aac_file(argv[2], std::ios::binary);
 
-    mts::parser parser;
+    // The file is memory mapped for the whole run, so it can be parsed in
+    // chunks on all cores without copying the payloads.
+    mts::parallel_parser parser(
+        std::max(1U, std::thread::hardware_concurrency()));
 
-    uint64_t offset = 0;
-    for (uint32_t i = 0; i < file.size() / mts::parser::packet_size(); ++i)
+    parser.read((uint8_t*)file.data(), file.size(),
+        [&](uint16_t, mts::stream_type type, const mts::pes&,
+            const std::vector<mts::slice>& payload)
     {
-        std::error_code error;
-        parser.read((uint8_t*)file.data() + offset, error);
-        offset += mts::parser::packet_size();
-        if (parser.has_pes())
+        if (type != mts::stream_type::adts_transport_13818_7)
+            return;
+
+        for (const auto& slice : payload)
         {
-            auto pid = parser.pes_pid();
-            mts::stream_type type = (mts::stream_type)parser.stream_type(pid);
-            if (type != mts::stream_type::adts_transport_13818_7)
-                continue;
-            auto& pes_data = parser.pes_data();
-            std::error_code error;
-            auto pes = mts::pes::parse(pes_data.data(), pes_data.size(), error);
-            if (error)
-                continue;
-            aac_file.write((char*)pes->payload_data(), pes->payload_size());
+            aac_file.write((char*)slice.m_data, slice.m_size);
         }
-    }
+    });
     if ((std::size_t)aac_file.tellp() == 0)
     {
         std::cout << "No AAC data found." << std::endl;
@@ -5,6 +5,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #include <mts/parser.hpp>
 #include <mts/pes.hpp>
@@ -30,30 +31,28 @@ int main(int argc, char* argv[])
     // Create the h264 output file
     std::ofstream h264_file(argv[2], std::ios::binary);
 
+    // The file is memory mapped for the whole run, so the parser can
+    // deliver the pes packets as slices of the file instead of copying them.
     mts::parser parser;
+    parser.set_zero_copy(true);
 
-    uint64_t offset = 0;
-    for (uint32_t i = 0; i < file.size() / mts::parser::packet_size(); ++i)
+    std::vector<mts::slice> payload;
+    parser.read((uint8_t*)file.data(), file.size(), [&](uint16_t pid)
     {
-        std::error_code error;
-        parser.read((uint8_t*)file.data() + offset, error);
-        offset += mts::parser::packet_size();
-        if (parser.has_pes())
-        {
-            auto pid = parser.pes_pid();
-            mts::stream_type type = (mts::stream_type)parser.stream_type(pid);
-            if (type != mts::stream_type::avc_video_stream)
-                continue;
+        mts::stream_type type = parser.stream_type(pid);
+        if (type != mts::stream_type::avc_video_stream)
+            return;
 
-            auto& pes_data = parser.pes_data();
-            std::error_code error;
-            auto pes = mts::pes::parse(pes_data.data(), pes_data.size(), error);
-            if (error)
-                continue;
+        std::error_code error;
+        auto pes = mts::pes::parse(parser.pes_slices(), payload, error);
+        if (error)
+            return;
 
-            h264_file.write((char*)pes->payload_data(), pes->payload_size());
+        for (const auto& slice : payload)
+        {
+            h264_file.write((char*)slice.m_data, slice.m_size);
         }
-    }
+    });
     if ((std::size_t)h264_file.tellp() == 0)
     {
         std::cout << "No H.264 data found." << std::endl;
@@ -0,0 +1,63 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+// Built with MTS_TRACE defined, so the hot paths of the library record the
+// time spent in each stage.
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <mts/packetizer.hpp>
+#include <mts/parser.hpp>
+#include <mts/pes.hpp>
+#include <mts/trace.hpp>
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2 || std::string(argv[1]) == "--help")
+    {
+        auto usage = "./mpegts_trace MPEG_TS_INPUT";
+        std::cout << usage << std::endl;
+        return 0;
+    }
+
+    auto filename = std::string(argv[1]);
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cout << "Could not open " << filename << std::endl;
+        return 1;
+    }
+
+    mts::parser parser;
+    uint64_t pes_count = 0;
+    auto on_pes = [&](uint16_t)
+    {
+        std::error_code error;
+        const auto& data = parser.pes_data();
+        mts::pes::parse(data.data(), data.size(), error);
+        pes_count++;
+    };
+
+    mts::packetizer packetizer([&](const uint8_t* data, uint64_t size)
+    {
+        parser.set_packet_format(packetizer.packet_format());
+        parser.read(data, size, on_pes);
+    });
+
+    // Read in pieces, as from a network.
+    std::vector<char> buffer(1316);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        if (file.gcount() > 0)
+            packetizer.read((uint8_t*)buffer.data(), file.gcount());
+    }
+
+    std::cout << pes_count << " pes read" << std::endl;
+    mts::trace::write(std::cout);
+    return 0;
+}
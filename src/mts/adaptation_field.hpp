@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <cassert>
 #include <memory>
@@ -278,6 +279,162 @@ public:
         return m_dts_next_au;
     }
 
+    void set_discontinuity_indicator(bool discontinuity_indicator)
+    {
+        m_discontinuity_indicator = discontinuity_indicator;
+        update_length();
+    }
+
+    void set_random_access_indicator(bool random_access_indicator)
+    {
+        m_random_access_indicator = random_access_indicator;
+        update_length();
+    }
+
+    void set_program_clock_reference(uint64_t program_clock_reference)
+    {
+        m_pcr_flag = true;
+        m_program_clock_reference = program_clock_reference;
+        update_length();
+    }
+
+    /// Sets the length, where the bytes following the fields are stuffing.
+    /// The length must cover the fields.
+    void set_length(uint8_t length)
+    {
+        assert(length >= fields_length());
+        m_length = length;
+    }
+
+    /// @return The size of the adaptation field written by write(),
+    ///         including the length byte.
+    uint32_t serialized_size() const
+    {
+        return 1U + m_length;
+    }
+
+    /// Writes the adaptation field followed by stuffing up to its length.
+    /// Reserved bytes of the extension which are not parsed are not kept.
+    ///
+    /// @return The number of bytes written, i.e. serialized_size().
+    uint32_t write(uint8_t* data, uint64_t size) const
+    {
+        assert(data != nullptr);
+        assert(size >= serialized_size());
+        assert(m_length >= fields_length());
+        (void) size;
+
+        data[0] = m_length;
+        if (m_length == 0)
+            return 1U;
+
+        data[1] = (uint8_t)((m_discontinuity_indicator ? 0x80 : 0x00) |
+                            (m_random_access_indicator ? 0x40 : 0x00) |
+                            (m_elementary_stream_priority_indicator ?
+                                0x20 : 0x00) |
+                            (m_pcr_flag ? 0x10 : 0x00) |
+                            (m_opcr_flag ? 0x08 : 0x00) |
+                            (m_splicing_point_flag ? 0x04 : 0x00) |
+                            (m_transport_private_data_flag ? 0x02 : 0x00) |
+                            (m_adaptation_field_extension_flag ?
+                                0x01 : 0x00));
+
+        auto field = data + 2;
+        if (m_pcr_flag)
+        {
+            helper::write_clock_reference(m_program_clock_reference, field);
+            field += 6;
+        }
+        if (m_opcr_flag)
+        {
+            helper::write_clock_reference(
+                m_original_program_clock_reference, field);
+            field += 6;
+        }
+        if (m_splicing_point_flag)
+        {
+            *field++ = m_splice_countdown;
+        }
+        if (m_transport_private_data_flag)
+        {
+            *field++ = m_transport_private_data_length;
+            std::copy(m_transport_private_data,
+                      m_transport_private_data +
+                          m_transport_private_data_length,
+                      field);
+            field += m_transport_private_data_length;
+        }
+        if (m_adaptation_field_extension_flag)
+        {
+            *field++ = (uint8_t)(extension_length() - 1U);
+            *field++ = (uint8_t)((m_ltw_flag ? 0x80 : 0x00) |
+                                 (m_piecewise_rate_flag ? 0x40 : 0x00) |
+                                 (m_seamless_splice_flag ? 0x20 : 0x00) |
+                                 0x1F);
+            if (m_ltw_flag)
+            {
+                *field++ = (uint8_t)((m_ltw_valid_flag ? 0x80 : 0x00) |
+                                     ((m_ltw_offset >> 8) & 0x7F));
+                *field++ = (uint8_t)m_ltw_offset;
+            }
+            if (m_piecewise_rate_flag)
+            {
+                *field++ = (uint8_t)(0xC0 | (m_piecewise_rate >> 16));
+                *field++ = (uint8_t)(m_piecewise_rate >> 8);
+                *field++ = (uint8_t)m_piecewise_rate;
+            }
+            if (m_seamless_splice_flag)
+            {
+                helper::write_timestamp(m_splice_type, m_dts_next_au, field);
+                field += 5;
+            }
+        }
+
+        std::fill(field, data + serialized_size(), 0xFF);
+        return serialized_size();
+    }
+
+private:
+
+    /// @return The size of the extension written, including its length
+    ///         byte.
+    uint32_t extension_length() const
+    {
+        return 2U + (m_ltw_flag ? 2U : 0U) + (m_piecewise_rate_flag ? 3U : 0U) +
+               (m_seamless_splice_flag ? 5U : 0U);
+    }
+
+    /// @return The length needed for the fields, excluding stuffing.
+    uint32_t fields_length() const
+    {
+        if (!m_discontinuity_indicator && !m_random_access_indicator &&
+            !m_elementary_stream_priority_indicator && !m_pcr_flag &&
+            !m_opcr_flag && !m_splicing_point_flag &&
+            !m_transport_private_data_flag &&
+            !m_adaptation_field_extension_flag)
+        {
+            return m_length == 0 ? 0U : 1U;
+        }
+
+        uint32_t length = 1U;
+        if (m_pcr_flag)
+            length += 6U;
+        if (m_opcr_flag)
+            length += 6U;
+        if (m_splicing_point_flag)
+            length += 1U;
+        if (m_transport_private_data_flag)
+            length += 1U + m_transport_private_data_length;
+        if (m_adaptation_field_extension_flag)
+            length += extension_length();
+        return length;
+    }
+
+    void update_length()
+    {
+        m_length = (uint8_t)std::max<uint32_t>(m_length, fields_length());
+    }
+
 private:
 
     uint8_t m_length = 0;
@@ -0,0 +1,262 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <system_error>
+
+#include "error.hpp"
+
+namespace mts
+{
+/// View of an adaptation field which decodes the fields when they are
+/// accessed, as opposed to adaptation_field which decodes every field up
+/// front.
+///
+/// The fields have the same meaning and preconditions as the accessors of
+/// adaptation_field. Call verify() before accessing the optional fields of
+/// untrusted data.
+class adaptation_field_view
+{
+public:
+
+    /// @param data The adaptation field starting with the length byte,
+    ///        which must be followed by length() bytes.
+    explicit adaptation_field_view(const uint8_t* data) :
+        m_data(data)
+    {
+        assert(m_data != nullptr);
+    }
+
+    /// Checks that the fields announced by the flags fit within the length.
+    void verify(std::error_code& error) const
+    {
+        if (length() == 0)
+            return;
+
+        if (end_offset() > 1U + length())
+        {
+            error = mts::error::invalid_adaptation_field_length;
+        }
+    }
+
+    uint8_t length() const
+    {
+        return m_data[0];
+    }
+
+    bool discontinuity_indicator() const
+    {
+        return flag(0x80);
+    }
+
+    bool random_access_indicator() const
+    {
+        return flag(0x40);
+    }
+
+    bool elementary_stream_priority_indicator() const
+    {
+        return flag(0x20);
+    }
+
+    bool pcr_flag() const
+    {
+        return flag(0x10);
+    }
+
+    bool opcr_flag() const
+    {
+        return flag(0x08);
+    }
+
+    bool splicing_point_flag() const
+    {
+        return flag(0x04);
+    }
+
+    bool transport_private_data_flag() const
+    {
+        return flag(0x02);
+    }
+
+    bool adaptation_field_extension_flag() const
+    {
+        return flag(0x01);
+    }
+
+    uint64_t program_clock_reference() const
+    {
+        assert(pcr_flag());
+        return read_clock_reference(m_data + 2);
+    }
+
+    uint64_t original_program_clock_reference() const
+    {
+        assert(opcr_flag());
+        return read_clock_reference(m_data + opcr_offset());
+    }
+
+    uint8_t splice_countdown() const
+    {
+        assert(splicing_point_flag());
+        return m_data[splice_countdown_offset()];
+    }
+
+    const uint8_t* transport_private_data() const
+    {
+        assert(transport_private_data_flag());
+        return m_data + private_data_offset() + 1;
+    }
+
+    uint8_t transport_private_data_length() const
+    {
+        assert(transport_private_data_flag());
+        return m_data[private_data_offset()];
+    }
+
+    bool ltw_flag() const
+    {
+        return extension_flag(0x80);
+    }
+
+    bool piecewise_rate_flag() const
+    {
+        return extension_flag(0x40);
+    }
+
+    bool seamless_splice_flag() const
+    {
+        return extension_flag(0x20);
+    }
+
+    bool ltw_valid_flag() const
+    {
+        assert(ltw_flag());
+        return (m_data[extension_offset() + 2] & 0x80) != 0;
+    }
+
+    uint16_t ltw_offset() const
+    {
+        assert(ltw_flag());
+        auto data = m_data + extension_offset() + 2;
+        return ((data[0] & 0x7F) << 8) | data[1];
+    }
+
+    uint32_t piecewise_rate() const
+    {
+        assert(piecewise_rate_flag());
+        auto data = m_data + piecewise_rate_offset();
+        return ((uint32_t)(data[0] & 0x3F) << 16) | (data[1] << 8) | data[2];
+    }
+
+    uint8_t splice_type() const
+    {
+        assert(seamless_splice_flag());
+        return m_data[seamless_splice_offset()] >> 4;
+    }
+
+    uint64_t dts_next_au() const
+    {
+        assert(seamless_splice_flag());
+        auto data = m_data + seamless_splice_offset();
+        return ((uint64_t)(data[0] & 0x0E) << 29) |
+               ((uint64_t)data[1] << 22) |
+               ((uint64_t)(data[2] & 0xFE) << 14) |
+               ((uint64_t)data[3] << 7) |
+               ((uint64_t)data[4] >> 1);
+    }
+
+private:
+
+    bool flag(uint8_t mask) const
+    {
+        assert(length() != 0);
+        return (m_data[1] & mask) != 0;
+    }
+
+    bool extension_flag(uint8_t mask) const
+    {
+        assert(adaptation_field_extension_flag());
+        return (m_data[extension_offset() + 1] & mask) != 0;
+    }
+
+    static uint64_t read_clock_reference(const uint8_t* data)
+    {
+        // 33 bit base, 6 reserved bits and a 9 bit extension.
+        uint64_t base = ((uint64_t)data[0] << 25) |
+                        ((uint64_t)data[1] << 17) |
+                        ((uint64_t)data[2] << 9) |
+                        ((uint64_t)data[3] << 1) |
+                        (data[4] >> 7);
+        uint16_t extension = ((data[4] & 0x01) << 8) | data[5];
+        return base * 300 + extension;
+    }
+
+    // The offsets of the optional fields, relative to the length byte.
+
+    uint32_t opcr_offset() const
+    {
+        return 2U + (pcr_flag() ? 6U : 0U);
+    }
+
+    uint32_t splice_countdown_offset() const
+    {
+        return opcr_offset() + (opcr_flag() ? 6U : 0U);
+    }
+
+    uint32_t private_data_offset() const
+    {
+        return splice_countdown_offset() + (splicing_point_flag() ? 1U : 0U);
+    }
+
+    uint32_t extension_offset() const
+    {
+        auto offset = private_data_offset();
+        if (transport_private_data_flag())
+            offset += 1U + m_data[offset];
+        return offset;
+    }
+
+    uint32_t piecewise_rate_offset() const
+    {
+        return extension_offset() + 2U + (ltw_flag() ? 2U : 0U);
+    }
+
+    uint32_t seamless_splice_offset() const
+    {
+        return piecewise_rate_offset() + (piecewise_rate_flag() ? 3U : 0U);
+    }
+
+    /// @return The offset following the last field, as far as it can be
+    ///         determined without reading beyond the length.
+    uint32_t end_offset() const
+    {
+        uint32_t end = 1U + length();
+        auto offset = private_data_offset();
+        if (transport_private_data_flag())
+        {
+            if (offset >= end)
+                return offset + 1U;
+            offset += 1U + m_data[offset];
+        }
+        if (!adaptation_field_extension_flag())
+            return offset;
+
+        if (offset + 1U >= end)
+            return offset + 2U;
+        auto extension_end = offset + 1U + m_data[offset];
+        auto fields_end = seamless_splice_offset() +
+            (seamless_splice_flag() ? 5U : 0U);
+        return fields_end > extension_end ? fields_end : extension_end;
+    }
+
+private:
+
+    const uint8_t* m_data;
+};
+}
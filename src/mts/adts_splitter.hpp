@@ -0,0 +1,295 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "sync_scanner.hpp"
+
+namespace mts
+{
+/// An ADTS frame of an AAC stream.
+struct adts_frame
+{
+    /// The frame starting with its header.
+    const uint8_t* m_data;
+    uint32_t m_size;
+
+    /// The audio object type minus one, e.g. 1 for AAC LC.
+    uint8_t m_profile;
+    uint32_t m_sample_rate;
+    uint8_t m_channel_configuration;
+
+    /// The number of samples per channel, 1024 per raw data block.
+    uint32_t m_samples;
+
+    /// The presentation timestamp of the frame, in 90 kHz ticks.
+    uint64_t m_pts;
+};
+
+/// Splits the pes payloads of an ADTS stream, i.e. of the
+/// adts_transport_13818_7 stream type, into frames.
+///
+/// A pes usually carries several frames while its presentation timestamp
+/// applies to the first frame starting in it. The timestamps of the
+/// following frames are derived from it and the number of samples before
+/// them.
+///
+/// The frames are delivered as views of the payload, apart from frames
+/// split between pes which are copied. Bytes which are not frames are
+/// skipped until the next valid header.
+class adts_splitter
+{
+public:
+
+    using on_frame_callback = std::function<void(const adts_frame& frame)>;
+
+    /// @return The size of a header without the CRC.
+    static uint32_t header_size()
+    {
+        return 7U;
+    }
+
+    /// @return The sample rate of a sampling frequency index, or zero for
+    ///         the reserved and explicit indices.
+    static uint32_t sample_rate(uint8_t sampling_frequency_index)
+    {
+        static const uint32_t sample_rates[16] =
+        {
+            96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+            16000, 12000, 11025, 8000, 7350, 0, 0, 0
+        };
+        return sample_rates[sampling_frequency_index & 0x0F];
+    }
+
+public:
+
+    /// Reads the payload of a pes with a presentation timestamp.
+    void read(
+        const uint8_t* data, uint64_t size, uint64_t pts,
+        const on_frame_callback& on_frame)
+    {
+        read(data, size, true, pts, on_frame);
+    }
+
+    /// Reads the payload of a pes without a presentation timestamp, or the
+    /// continuation of a payload, where the timestamps follow from the
+    /// previous frames.
+    void read(
+        const uint8_t* data, uint64_t size, const on_frame_callback& on_frame)
+    {
+        read(data, size, false, 0, on_frame);
+    }
+
+    /// Drops the frame split between pes and forgets the timestamps.
+    void reset()
+    {
+        m_pending.clear();
+        m_has_pes_pts = false;
+        m_has_anchor = false;
+    }
+
+    /// @return The number of bytes skipped which were not part of a frame.
+    uint64_t skipped_bytes() const
+    {
+        return m_skipped_bytes;
+    }
+
+private:
+
+    void read(
+        const uint8_t* data, uint64_t size, bool has_pts, uint64_t pts,
+        const on_frame_callback& on_frame)
+    {
+        assert(data != nullptr || size == 0);
+        assert(on_frame);
+
+        const uint8_t* end = data + size;
+        if (!m_pending.empty())
+        {
+            complete_pending(data, end, on_frame);
+        }
+
+        // The frame begun in the previous pes has its timestamp.
+        if (has_pts)
+        {
+            m_pes_pts = pts;
+            m_has_pes_pts = true;
+        }
+
+        while (data != end)
+        {
+            if ((uint64_t)(end - data) < header_size())
+            {
+                if (data[0] == 0xFF)
+                {
+                    m_pending.assign(data, end);
+                    return;
+                }
+                skip(data, end);
+                continue;
+            }
+
+            if (!start_frame(data))
+            {
+                skip(data, end);
+                continue;
+            }
+
+            if (m_frame_size > (uint64_t)(end - data))
+            {
+                m_pending.assign(data, end);
+                return;
+            }
+
+            deliver(data, on_frame);
+            data += m_frame_size;
+        }
+    }
+
+    /// Decodes the header of a frame and finds its timestamp.
+    ///
+    /// @return false if the header is not valid.
+    bool start_frame(const uint8_t* header)
+    {
+        // The syncword and layer 0.
+        if (header[0] != 0xFF || (header[1] & 0xF6) != 0xF0)
+            return false;
+
+        bool protection_absent = (header[1] & 0x01) != 0;
+        uint8_t sampling_frequency_index = (header[2] >> 2) & 0x0F;
+        uint32_t frame_size = ((header[3] & 0x03) << 11) |
+                              (header[4] << 3) | (header[5] >> 5);
+        uint32_t rate = sample_rate(sampling_frequency_index);
+        if (rate == 0 ||
+            frame_size < header_size() + (protection_absent ? 0U : 2U))
+        {
+            return false;
+        }
+
+        m_frame.m_profile = header[2] >> 6;
+        m_frame.m_sample_rate = rate;
+        m_frame.m_channel_configuration =
+            ((header[2] & 0x01) << 2) | (header[3] >> 6);
+        m_frame.m_samples = 1024U * ((header[6] & 0x03) + 1U);
+        m_frame_size = frame_size;
+
+        // The timestamp of the pes applies to the first frame starting in
+        // it, the following frames are counted from there.
+        if (m_has_pes_pts)
+        {
+            m_anchor_pts = m_pes_pts;
+            m_anchor_samples = 0;
+            m_anchor_rate = rate;
+            m_has_anchor = true;
+            m_has_pes_pts = false;
+        }
+        else if (m_has_anchor && m_anchor_rate != rate)
+        {
+            // Counting samples of another rate starts from this frame.
+            m_anchor_pts = next_pts();
+            m_anchor_samples = 0;
+            m_anchor_rate = rate;
+        }
+
+        m_frame.m_pts = m_has_anchor ? next_pts() : 0U;
+        m_anchor_samples += m_frame.m_samples;
+        return true;
+    }
+
+    /// @return The timestamp following the samples since the anchor.
+    uint64_t next_pts() const
+    {
+        assert(m_has_anchor);
+        return (m_anchor_pts + m_anchor_samples * 90000U / m_anchor_rate) &
+               0x1FFFFFFFFULL;
+    }
+
+    /// Completes the frame begun in the previous payload.
+    void complete_pending(
+        const uint8_t*& data, const uint8_t* end,
+        const on_frame_callback& on_frame)
+    {
+        while (m_pending.size() < header_size())
+        {
+            auto kept = m_pending.size();
+            auto count = std::min<uint64_t>(
+                header_size() - kept, end - data);
+            m_pending.insert(m_pending.end(), data, data + count);
+            if (m_pending.size() < header_size())
+            {
+                data += count;
+                return;
+            }
+            if (start_frame(m_pending.data()))
+            {
+                data += count;
+                break;
+            }
+
+            // Not a header, so the bytes kept are searched for the next
+            // syncword, and the payload is read from its first byte.
+            m_pending.resize(kept);
+            auto offset = 1U + sync_scanner::find(
+                m_pending.data() + 1, kept - 1, 0xFF);
+            m_skipped_bytes += offset;
+            m_pending.erase(m_pending.begin(), m_pending.begin() + offset);
+            if (m_pending.empty())
+                return;
+        }
+
+        auto count = std::min<uint64_t>(
+            m_frame_size - m_pending.size(), end - data);
+        m_pending.insert(m_pending.end(), data, data + count);
+        data += count;
+        if (m_pending.size() < m_frame_size)
+            return;
+
+        deliver(m_pending.data(), on_frame);
+        m_pending.clear();
+    }
+
+    /// Skips to the next candidate syncword.
+    void skip(const uint8_t*& data, const uint8_t* end)
+    {
+        auto offset = 1U + sync_scanner::find(data + 1, end - data - 1, 0xFF);
+        m_skipped_bytes += offset;
+        data += offset;
+    }
+
+    void deliver(const uint8_t* data, const on_frame_callback& on_frame)
+    {
+        m_frame.m_data = data;
+        m_frame.m_size = m_frame_size;
+        on_frame(m_frame);
+    }
+
+private:
+
+    /// The frame begun in the previous payload.
+    std::vector<uint8_t> m_pending;
+
+    /// The frame being read and its size.
+    adts_frame m_frame;
+    uint32_t m_frame_size = 0;
+
+    uint64_t m_pes_pts = 0;
+    bool m_has_pes_pts = false;
+
+    /// The timestamp of the last frame starting a pes, and the number of
+    /// samples since.
+    uint64_t m_anchor_pts = 0;
+    uint64_t m_anchor_samples = 0;
+    uint32_t m_anchor_rate = 0;
+    bool m_has_anchor = false;
+
+    uint64_t m_skipped_bytes = 0;
+};
+}
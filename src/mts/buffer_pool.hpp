@@ -0,0 +1,138 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace mts
+{
+/// Pool of byte buffers grouped in size classes by their capacity, where
+/// size class n holds buffers with a capacity of at least 2^n bytes.
+///
+/// A released buffer keeps its capacity, so once the pool holds enough
+/// buffers of the sizes needed, acquiring a buffer does not allocate.
+class buffer_pool
+{
+public:
+
+    /// @return The capacity of the buffers allocated for the smallest size
+    ///         class in use.
+    static uint64_t min_capacity()
+    {
+        return 1024U;
+    }
+
+public:
+
+    buffer_pool() :
+        m_free(size_classes())
+    {
+    }
+
+    /// @return An empty buffer with a capacity of at least capacity bytes.
+    std::vector<uint8_t> acquire(uint64_t capacity)
+    {
+        auto size_class = ceil_size_class(capacity);
+
+        // Only take buffers up to one size class larger than needed, so
+        // small requests do not use up the large buffers.
+        auto end = std::min<uint32_t>(size_class + 2, size_classes());
+        for (auto i = size_class; i < end; ++i)
+        {
+            auto& buffers = m_free[i];
+            if (!buffers.empty())
+            {
+                auto buffer = std::move(buffers.back());
+                buffers.pop_back();
+                return buffer;
+            }
+        }
+
+        std::vector<uint8_t> buffer;
+        buffer.reserve((uint64_t)1 << size_class);
+        m_allocations++;
+        return buffer;
+    }
+
+    /// Returns a buffer to the pool, the content is discarded.
+    void release(std::vector<uint8_t>&& buffer)
+    {
+        if (buffer.capacity() < min_capacity())
+            return;
+
+        buffer.clear();
+        m_free[floor_size_class(buffer.capacity())].push_back(
+            std::move(buffer));
+    }
+
+    /// Adds buffers to the pool up front, e.g. to avoid allocating while
+    /// warming up.
+    void reserve(uint32_t buffers, uint64_t capacity)
+    {
+        for (uint32_t i = 0; i < buffers; ++i)
+        {
+            std::vector<uint8_t> buffer;
+            buffer.reserve(capacity);
+            release(std::move(buffer));
+        }
+    }
+
+    /// @return The number of buffers allocated by acquire().
+    uint64_t allocations() const
+    {
+        return m_allocations;
+    }
+
+    /// @return The number of buffers in the pool.
+    uint64_t free_buffers() const
+    {
+        uint64_t count = 0;
+        for (const auto& buffers : m_free)
+        {
+            count += buffers.size();
+        }
+        return count;
+    }
+
+private:
+
+    static uint32_t size_classes()
+    {
+        return 40U;
+    }
+
+    static uint32_t floor_size_class(uint64_t capacity)
+    {
+        assert(capacity > 0);
+        uint32_t size_class = 0;
+        while (capacity > 1 && size_class + 1 < size_classes())
+        {
+            capacity >>= 1;
+            size_class++;
+        }
+        return size_class;
+    }
+
+    static uint32_t ceil_size_class(uint64_t capacity)
+    {
+        if (capacity < min_capacity())
+            capacity = min_capacity();
+        auto size_class = floor_size_class(capacity);
+        if (((uint64_t)1 << size_class) < capacity)
+            size_class++;
+        assert(size_class < size_classes());
+        return size_class;
+    }
+
+private:
+
+    std::vector<std::vector<std::vector<uint8_t>>> m_free;
+    uint64_t m_allocations = 0;
+};
+}
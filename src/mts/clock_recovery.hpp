@@ -0,0 +1,199 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+namespace mts
+{
+/// Recovers the clock of a program from its program clock references (PCR).
+///
+/// Each PCR is given together with the byte position of the packet carrying
+/// it and the local time it arrived. The byte positions give the bitrate of
+/// the multiplex, and the arrival times give the offset between the local
+/// clock and the PCR, which is used to pace output, and its jitter.
+///
+/// All times are in ticks of the 27 MHz system clock. The estimates are
+/// smoothed with a moving average, so each update is a handful of
+/// arithmetic operations.
+class clock_recovery
+{
+public:
+
+    /// @return The frequency of the system clock.
+    static uint64_t frequency()
+    {
+        return 27000000U;
+    }
+
+    /// @return The value at which the PCR wraps around, i.e. its 33 bit
+    ///         base times 300.
+    static uint64_t pcr_period()
+    {
+        return ((uint64_t)1 << 33) * 300U;
+    }
+
+    /// @return The largest distance between two PCRs which is not
+    ///         considered a discontinuity. The standard requires a PCR at
+    ///         least every 100 ms, this leaves room for some packet loss.
+    static uint64_t max_pcr_interval()
+    {
+        return frequency();
+    }
+
+public:
+
+    /// @param pcr The program clock reference.
+    /// @param position The byte position in the stream of the packet
+    ///        carrying the PCR.
+    /// @param arrival_time The local time the packet arrived.
+    /// @param discontinuity Whether the discontinuity_indicator of the
+    ///        adaptation field carrying the PCR is set.
+    void update(
+        uint64_t pcr, uint64_t position, uint64_t arrival_time,
+        bool discontinuity)
+    {
+        assert(pcr < pcr_period());
+
+        if (!m_has_pcr)
+        {
+            m_has_pcr = true;
+            restart(pcr, position, arrival_time);
+            return;
+        }
+
+        auto pcr_delta = (pcr + pcr_period() - m_pcr) % pcr_period();
+        if (discontinuity || pcr_delta == 0 ||
+            pcr_delta > max_pcr_interval() || position <= m_position)
+        {
+            // The PCR jumped, either signalled or not, so the estimates
+            // are continued from the new PCR.
+            m_discontinuities++;
+            if (has_bitrate() && position > m_position)
+            {
+                m_extended_pcr += (uint64_t)(
+                    (position - m_position) * 8.0 * frequency() / m_bitrate);
+            }
+            restart(pcr, position, arrival_time);
+            return;
+        }
+
+        double bitrate =
+            (position - m_position) * 8.0 * frequency() / pcr_delta;
+        m_bitrate = has_bitrate() ? m_bitrate + (bitrate - m_bitrate) / 16.0
+                                  : bitrate;
+
+        m_extended_pcr += pcr_delta;
+        double deviation = offset(arrival_time) - m_offset;
+        m_offset += deviation / 16.0;
+        m_jitter += (std::fabs(deviation) - m_jitter) / 16.0;
+
+        m_pcr = pcr;
+        m_position = position;
+    }
+
+    bool has_pcr() const
+    {
+        return m_has_pcr;
+    }
+
+    /// @return The latest PCR.
+    uint64_t pcr() const
+    {
+        assert(has_pcr());
+        return m_pcr;
+    }
+
+    bool has_bitrate() const
+    {
+        return m_bitrate > 0.0;
+    }
+
+    /// @return The bitrate of the multiplex in bits per second.
+    double bitrate() const
+    {
+        assert(has_bitrate());
+        return m_bitrate;
+    }
+
+    /// @return The average deviation of the arrival times from the
+    ///         recovered clock. Only meaningful if the arrival times are
+    ///         given.
+    double jitter() const
+    {
+        return m_jitter;
+    }
+
+    /// @return The number of discontinuities in the PCR, signalled or not.
+    uint32_t discontinuities() const
+    {
+        return m_discontinuities;
+    }
+
+    /// @return The PCR interpolated to a byte position, following the
+    ///         latest PCR.
+    uint64_t pcr_at(uint64_t position) const
+    {
+        assert(has_bitrate());
+        assert(position >= m_position);
+        auto delta = (uint64_t)(
+            (position - m_position) * 8.0 * frequency() / m_bitrate);
+        return (m_pcr + delta) % pcr_period();
+    }
+
+    /// @return The local time at which data with a given PCR, e.g. as
+    ///         returned by pcr_at(), should be sent to keep the pace of the
+    ///         original stream. The PCR must be close to the latest PCR.
+    uint64_t departure_time(uint64_t pcr) const
+    {
+        assert(has_pcr());
+        auto delta = (pcr + pcr_period() - m_pcr) % pcr_period();
+
+        // Wrapped differences of more than half the period are negative.
+        int64_t signed_delta = delta > pcr_period() / 2
+            ? (int64_t)delta - (int64_t)pcr_period() : (int64_t)delta;
+        return (uint64_t)((double)m_extended_pcr + signed_delta + m_offset);
+    }
+
+    void reset()
+    {
+        *this = clock_recovery();
+    }
+
+private:
+
+    void restart(uint64_t pcr, uint64_t position, uint64_t arrival_time)
+    {
+        m_pcr = pcr;
+        m_position = position;
+        m_offset = offset(arrival_time);
+    }
+
+    /// @return The offset of the local clock from the PCR, without the
+    ///         wrap around of the PCR.
+    double offset(uint64_t arrival_time) const
+    {
+        return (double)arrival_time - (double)m_extended_pcr;
+    }
+
+private:
+
+    bool m_has_pcr = false;
+    uint64_t m_pcr = 0;
+    uint64_t m_position = 0;
+
+    /// The PCR counted from the first PCR without wrapping around, and
+    /// continued over discontinuities.
+    uint64_t m_extended_pcr = 0;
+
+    double m_bitrate = 0.0;
+    double m_offset = 0.0;
+    double m_jitter = 0.0;
+    uint32_t m_discontinuities = 0;
+};
+}
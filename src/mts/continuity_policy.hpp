@@ -0,0 +1,40 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cstdint>
+
+namespace mts
+{
+/// What the parser does with the pes being assembled on a stream when
+/// packets of the stream are lost, i.e. on a continuity error.
+enum class continuity_policy
+{
+    /// The pes is dropped, as are the packets until the start of the next
+    /// pes.
+    drop,
+
+    /// The pes is delivered as it is, flagged as truncated, and the packets
+    /// until the start of the next pes are dropped.
+    truncate,
+
+    /// The payload of each lost packet is replaced by zeros and the pes is
+    /// assembled further, so it keeps its size. The ranges padded are
+    /// recorded in a loss map, so a decoder can conceal them.
+    pad
+};
+
+/// A range of a pes padded with zeros for lost packets, see
+/// continuity_policy::pad.
+struct pes_loss
+{
+    /// The offset of the range from the start of the pes.
+    uint64_t m_offset;
+
+    /// The size of the range.
+    uint64_t m_size;
+};
+}
@@ -0,0 +1,104 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+namespace mts
+{
+/// The CRC-32/MPEG-2 used by the PSI sections, i.e. the polynomial
+/// 0x04C11DB7 with an initial value of 0xFFFFFFFF, processed most significant
+/// bit first without a final xor. The CRC of a whole section, including its
+/// CRC field, is zero.
+class crc32
+{
+public:
+
+    static uint32_t polynomial()
+    {
+        return 0x04C11DB7U;
+    }
+
+    static uint32_t initial_value()
+    {
+        return 0xFFFFFFFFU;
+    }
+
+    /// @return The CRC of a buffer.
+    static uint32_t compute(const uint8_t* data, uint64_t size)
+    {
+        return update(initial_value(), data, size);
+    }
+
+    /// Continues a CRC with more data.
+    ///
+    /// Eight bytes are processed at a time using eight lookup tables
+    /// (slice-by-8), as sections are small this is mostly a matter of
+    /// avoiding the byte at a time dependency chain.
+    static uint32_t update(uint32_t crc, const uint8_t* data, uint64_t size)
+    {
+        assert(data != nullptr || size == 0);
+        const auto& t = tables();
+
+        while (size >= 8)
+        {
+            crc ^= ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                   ((uint32_t)data[2] << 8) | data[3];
+            crc = t[7][crc >> 24] ^ t[6][(crc >> 16) & 0xFF] ^
+                  t[5][(crc >> 8) & 0xFF] ^ t[4][crc & 0xFF] ^
+                  t[3][data[4]] ^ t[2][data[5]] ^
+                  t[1][data[6]] ^ t[0][data[7]];
+            data += 8;
+            size -= 8;
+        }
+
+        while (size > 0)
+        {
+            crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data];
+            data++;
+            size--;
+        }
+        return crc;
+    }
+
+private:
+
+    using table_type = uint32_t[8][256];
+
+    /// @return The lookup tables, where table k gives the CRC of a byte
+    ///         followed by k zero bytes.
+    static const table_type& tables()
+    {
+        static const table_type& t = make_tables();
+        return t;
+    }
+
+    static const table_type& make_tables()
+    {
+        static table_type t;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i << 24;
+            for (uint32_t bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 0x80000000U) ?
+                    (crc << 1) ^ polynomial() : (crc << 1);
+            }
+            t[0][i] = crc;
+        }
+        for (uint32_t k = 1; k < 8; ++k)
+        {
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                auto previous = t[k - 1][i];
+                t[k][i] = (previous << 8) ^ t[0][previous >> 24];
+            }
+        }
+        return t;
+    }
+};
+}
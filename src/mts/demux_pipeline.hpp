@@ -0,0 +1,416 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "parser.hpp"
+#include "pat.hpp"
+#include "pes.hpp"
+#include "section_assembler.hpp"
+#include "spsc_queue.hpp"
+#include "stream_type.hpp"
+#include "ts_packet_view.hpp"
+
+namespace mts
+{
+/// Demultiplexes a transport stream on several threads.
+///
+/// The thread calling read() classifies the packets by PID and hands them to
+/// a number of shards, each running an mts::parser on a thread of its own.
+/// Every stream PID is assigned to a single shard, round robin in the order
+/// the PIDs are first seen, so the pes of a PID are delivered in order. The
+/// PAT and the PMTs are given to every shard. Packets of the PIDs reserved
+/// for the PAT and the SI tables are dropped, as are packets of unknown PIDs
+/// until the first PAT is read, so a PMT read before the PAT does not end up
+/// on a single shard.
+///
+/// A thread waiting for packets, or for room in a queue, spins briefly and
+/// then sleeps until woken, so idle shards do not occupy a core.
+class demux_pipeline
+{
+public:
+
+    /// Callback invoked with each completed and parsed pes. The callback is
+    /// invoked on the thread of the shard owning the PID, so it may be
+    /// invoked concurrently for different PIDs. The pes and its payload are
+    /// only valid for the duration of the call.
+    using on_pes_callback = std::function<
+        void(uint16_t pid, mts::stream_type type, const mts::pes& pes)>;
+
+    using packet = std::array<uint8_t, 188>;
+
+    /// @return The number of packets which can be queued for each shard.
+    static uint32_t queue_capacity()
+    {
+        return 4096U;
+    }
+
+    /// @return The number of times a waiting thread yields before sleeping.
+    static uint32_t spin_count()
+    {
+        return 64U;
+    }
+
+public:
+
+    demux_pipeline(uint32_t shards, on_pes_callback on_pes) :
+        m_on_pes(on_pes),
+        m_routes(parser::pid_count(), unassigned)
+    {
+        assert(shards > 0);
+        assert(shards < discard);
+        assert(m_on_pes);
+
+        m_routes[0] = broadcast;
+        // The CAT, the TSDT and the SI tables are not read by the parser.
+        for (uint16_t pid = 1; pid < first_stream_pid(); ++pid)
+        {
+            m_routes[pid] = discard;
+        }
+        // Null packets carry no data.
+        m_routes[0x1FFF] = discard;
+
+        for (uint32_t i = 0; i < shards; ++i)
+        {
+            m_shards.emplace_back(new shard());
+        }
+        for (auto& shard : m_shards)
+        {
+            shard->m_thread = std::thread(
+                &demux_pipeline::run, this, std::ref(*shard));
+        }
+    }
+
+    demux_pipeline(const demux_pipeline&) = delete;
+    demux_pipeline& operator=(const demux_pipeline&) = delete;
+
+    /// Processes the packets already read and stops the shards.
+    ~demux_pipeline()
+    {
+        m_stop.store(true, std::memory_order_release);
+        for (auto& shard : m_shards)
+        {
+            shard->m_packets.notify();
+            shard->m_thread.join();
+        }
+    }
+
+    /// Reads all whole packets in a buffer of consecutive 188 byte packets.
+    /// Packets without a sync byte are skipped. Blocks while the queue of a
+    /// shard is full.
+    void read(const uint8_t* data, uint64_t size)
+    {
+        assert(data != nullptr);
+
+        const uint8_t* end = data + (size - (size % parser::packet_size()));
+        for (; data != end; data += parser::packet_size())
+        {
+            if (data[0] != 0x47)
+                continue;
+
+            uint16_t pid = ((data[1] & 0x1F) << 8) | data[2];
+            auto route = m_routes[pid];
+
+            if (route == unassigned)
+            {
+                // The PID may be a PMT until the PAT says otherwise.
+                if (!m_has_pat)
+                    continue;
+                route = (uint8_t)(m_next_shard++ % m_shards.size());
+                m_routes[pid] = route;
+            }
+            if (route == discard)
+                continue;
+            if (route != broadcast)
+            {
+                push(*m_shards[route], data);
+                continue;
+            }
+
+            if (pid == 0)
+                read_pat(data);
+
+            for (auto& shard : m_shards)
+            {
+                push(*shard, data);
+            }
+        }
+    }
+
+    /// Waits until the shards have processed every packet read. A pes is
+    /// only complete once the first packet of the next pes on the same PID
+    /// is read, so the last pes of each PID is not delivered.
+    void flush()
+    {
+        for (auto& shard : m_shards)
+        {
+            shard->m_space.wait([&]
+            {
+                return shard->m_processed.load(std::memory_order_acquire) ==
+                       shard->m_pushed;
+            });
+        }
+    }
+
+    uint32_t shards() const
+    {
+        return (uint32_t)m_shards.size();
+    }
+
+private:
+
+    /// Lets a thread sleep until a condition set by another thread holds.
+    /// The other thread only takes the lock when the waiting thread sleeps.
+    struct waiter
+    {
+        template<class Condition>
+        void wait(const Condition& condition)
+        {
+            for (uint32_t i = 0; i < spin_count(); ++i)
+            {
+                if (condition())
+                    return;
+                std::this_thread::yield();
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sleeping.store(true);
+            // Orders the flag before reading the condition, as notify()
+            // orders setting the condition before reading the flag.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_condition.wait(lock, condition);
+            m_sleeping.store(false);
+        }
+
+        /// Wakes the waiting thread, to be called after setting the
+        /// condition.
+        void notify()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!m_sleeping.load())
+                return;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_condition.notify_one();
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::atomic<bool> m_sleeping{false};
+    };
+
+    struct shard
+    {
+        spsc_queue<packet> m_queue{queue_capacity()};
+        mts::parser m_parser;
+        std::thread m_thread;
+
+        /// Woken when a packet is pushed or the pipeline stops.
+        waiter m_packets;
+
+        /// Woken when a packet is processed.
+        waiter m_space;
+
+        /// Written by the reading thread only.
+        uint64_t m_pushed = 0;
+
+        std::atomic<uint64_t> m_processed{0};
+    };
+
+    /// @return The lowest PID which may carry a stream or a PMT, the PIDs
+    ///         below are reserved for the PAT, the CAT and the SI tables.
+    static uint16_t first_stream_pid()
+    {
+        return 0x0020;
+    }
+
+    /// Special values of the routes, any other value is a shard index.
+    enum special_route : uint8_t
+    {
+        unassigned = 0xFF,
+        broadcast = 0xFE,
+        discard = 0xFD
+    };
+
+private:
+
+    void push(shard& shard, const uint8_t* data)
+    {
+        packet* slot = shard.m_queue.try_reserve();
+        if (slot == nullptr)
+        {
+            shard.m_space.wait([&]
+            {
+                return (slot = shard.m_queue.try_reserve()) != nullptr;
+            });
+        }
+        std::copy(data, data + parser::packet_size(), slot->begin());
+        shard.m_queue.commit_push();
+        shard.m_pushed++;
+        shard.m_packets.notify();
+    }
+
+    /// Assembles the sections of the PAT, which are checked with their CRC.
+    void read_pat(const uint8_t* data)
+    {
+        ts_packet_view packet(data);
+        std::error_code error;
+        packet.verify(error);
+        if (error || !packet.has_payload_field())
+            return;
+
+        m_pat_assembler.read(
+            packet.payload_data(), packet.payload_size(),
+            packet.payload_unit_start_indicator(),
+            packet.continuity_counter(),
+            [&](const uint8_t* section, uint32_t size)
+            {
+                read_pat_section(section, size);
+            },
+            error);
+    }
+
+    /// Collects the PIDs of a section of the PAT, which are routed once
+    /// every section of the current version has been read.
+    void read_pat_section(const uint8_t* section, uint32_t size)
+    {
+        // The table id of the PAT.
+        if (section[0] != 0x00)
+            return;
+
+        std::error_code error;
+        auto pat = mts::pat::parse(section, size, error);
+        if (error || !pat->current_next_indicator())
+            return;
+
+        auto sections = pat->last_section_number() + 1U;
+        if (pat->section_number() >= sections)
+            return;
+
+        if (pat->version_number() != m_pat_version ||
+            m_pat_received.size() != sections)
+        {
+            m_pat_version = pat->version_number();
+            m_pat_received.assign(sections, false);
+            m_pat_sections.assign(sections, {});
+        }
+
+        auto& entries = m_pat_sections[pat->section_number()];
+        entries.clear();
+        for (const auto& program_entry : pat->program_entries())
+        {
+            auto pid = program_entry.pid();
+            if (pid < first_stream_pid() || pid >= 0x1FFF)
+                continue;
+            entries.emplace_back(pid, program_entry.is_network_pid());
+        }
+        m_pat_received[pat->section_number()] = true;
+
+        if (std::find(m_pat_received.begin(), m_pat_received.end(), false) ==
+            m_pat_received.end())
+        {
+            apply_pat();
+        }
+    }
+
+    /// Marks the PMT PIDs of the PAT as broadcast, so every shard learns the
+    /// streams of every program, and the network PID as discarded. The PIDs
+    /// routed by the previous PAT are unassigned first, so a PID no longer
+    /// listed is routed as any other.
+    void apply_pat()
+    {
+        for (auto pid : m_pat_pids)
+        {
+            m_routes[pid] = unassigned;
+        }
+        m_pat_pids.clear();
+
+        for (const auto& entries : m_pat_sections)
+        {
+            for (const auto& entry : entries)
+            {
+                // The NIT is not read by the parser.
+                m_routes[entry.first] = entry.second ? discard : broadcast;
+                m_pat_pids.push_back(entry.first);
+            }
+        }
+        m_has_pat = true;
+    }
+
+    void run(shard& shard)
+    {
+        while (true)
+        {
+            auto packet = shard.m_queue.front();
+            if (packet == nullptr)
+            {
+                shard.m_packets.wait([&]
+                {
+                    return shard.m_queue.front() != nullptr ||
+                           m_stop.load(std::memory_order_acquire);
+                });
+
+                // Drain the queue before stopping.
+                if (shard.m_queue.front() == nullptr)
+                    return;
+                continue;
+            }
+
+            std::error_code error;
+            shard.m_parser.read(packet->data(), error);
+            shard.m_queue.commit_pop();
+
+            if (!error && shard.m_parser.has_pes())
+            {
+                auto pid = shard.m_parser.pes_pid();
+                const auto& pes_data = shard.m_parser.pes_data();
+                auto pes = mts::pes::parse(
+                    pes_data.data(), pes_data.size(), error);
+                if (!error)
+                {
+                    m_on_pes(pid, shard.m_parser.stream_type(pid), *pes);
+                }
+            }
+
+            shard.m_processed.fetch_add(1, std::memory_order_release);
+            shard.m_space.notify();
+        }
+    }
+
+private:
+
+    const on_pes_callback m_on_pes;
+
+    /// The shard of each PID, or one of the special values.
+    std::vector<uint8_t> m_routes;
+    uint32_t m_next_shard = 0;
+    bool m_has_pat = false;
+
+    /// The sections of the PAT being read, with the PMT PIDs of each and
+    /// whether they are the network PID.
+    section_assembler m_pat_assembler;
+    uint8_t m_pat_version = 0;
+    std::vector<bool> m_pat_received;
+    std::vector<std::vector<std::pair<uint16_t, bool>>> m_pat_sections;
+
+    /// The PIDs routed by the PAT applied.
+    std::vector<uint16_t> m_pat_pids;
+
+    std::vector<std::unique_ptr<shard>> m_shards;
+    std::atomic<bool> m_stop{false};
+};
+}
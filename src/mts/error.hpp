@@ -0,0 +1,64 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <string>
+#include <system_error>
+
+namespace mts
+{
+/// Enumeration of the errors reported by mts itself, errors found while
+/// reading fields are reported by bnb. Like the stream types we use a bit of
+/// macro uglyness to make this easy.
+enum class error
+{
+#define ERROR_TAG(id,msg) id,
+#include "error_tags.hpp"
+#undef ERROR_TAG
+};
+
+/// The error category of mts::error
+class error_category : public std::error_category
+{
+public:
+
+    const char* name() const noexcept override
+    {
+        return "mts";
+    }
+
+    std::string message(int value) const override
+    {
+        switch (static_cast<mts::error>(value))
+        {
+#define ERROR_TAG(id,msg)                       \
+        case mts::error::id: return std::string(msg);
+#include "error_tags.hpp"
+#undef ERROR_TAG
+        }
+        return "Unknown mts error";
+    }
+
+    static const error_category& instance()
+    {
+        static error_category category;
+        return category;
+    }
+};
+
+/// @return An error code for the given mts::error
+inline std::error_code make_error_code(mts::error e)
+{
+    return std::error_code(static_cast<int>(e), error_category::instance());
+}
+}
+
+namespace std
+{
+template<>
+struct is_error_code_enum<mts::error> : public true_type
+{ };
+}
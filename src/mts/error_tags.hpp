@@ -0,0 +1,40 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+ERROR_TAG(
+    no_error,
+    "No error")
+
+ERROR_TAG(
+    invalid_sync_byte,
+    "The packet does not start with the sync byte 0x47")
+
+ERROR_TAG(
+    transport_error_indicator_set,
+    "The transport error indicator of the packet is set")
+
+ERROR_TAG(
+    invalid_adaptation_field_length,
+    "The adaptation field length exceeds the packet")
+
+ERROR_TAG(
+    invalid_pes_packet_length,
+    "The PES packet length exceeds the available data")
+
+ERROR_TAG(
+    invalid_section_length,
+    "The section length exceeds the maximum section size")
+
+ERROR_TAG(
+    invalid_crc,
+    "The CRC of the section does not match its content")
+
+ERROR_TAG(
+    invalid_rtp_header,
+    "The RTP header exceeds the datagram")
+
+ERROR_TAG(
+    invalid_datagram,
+    "The datagram does not carry whole transport stream packets")
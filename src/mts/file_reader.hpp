@@ -0,0 +1,391 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MTS_FILE_READER_POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mts
+{
+/// Reads a file in large aligned buffers on a worker thread, so reading
+/// from the disk overlaps processing the data, e.g. packetizing and parsing
+/// it, while the memory used stays fixed regardless of the size of the
+/// file. This suits files larger than the memory and network file systems,
+/// where memory mapping the file stalls the parsing on every page fault.
+///
+/// The worker reads ahead into the free buffers while the buffers read are
+/// delivered in order on the thread calling read(). Each buffer is released
+/// back to the worker when the callback returns.
+///
+/// Where supported the file can be opened for direct I/O, which bypasses
+/// the page cache, see set_direct_io().
+class file_reader
+{
+public:
+
+    using on_data_callback =
+        std::function<void(const uint8_t* data, uint64_t size)>;
+
+    /// @return The alignment of the buffers, the reads and their sizes,
+    ///         as required for direct I/O.
+    static uint64_t alignment()
+    {
+        return 4096U;
+    }
+
+public:
+
+    /// @param buffer_size The size of each buffer, rounded up to the
+    ///        alignment.
+    /// @param buffers The number of buffers, at least two so one is read
+    ///        while the other is processed.
+    explicit file_reader(uint64_t buffer_size = 1U << 20, uint32_t buffers = 2)
+    {
+        assert(buffer_size > 0);
+        assert(buffers >= 2);
+        m_buffer_size = (buffer_size + alignment() - 1) & ~(alignment() - 1);
+        m_buffers.resize(buffers);
+        for (auto& buffer : m_buffers)
+        {
+            buffer.m_storage.resize(m_buffer_size + alignment());
+            auto address = reinterpret_cast<uintptr_t>(buffer.m_storage.data());
+            buffer.m_data = buffer.m_storage.data() +
+                ((alignment() - address % alignment()) % alignment());
+        }
+    }
+
+    file_reader(const file_reader&) = delete;
+    file_reader& operator=(const file_reader&) = delete;
+
+    ~file_reader()
+    {
+        close();
+    }
+
+    /// Sets whether the file is opened for direct I/O, i.e. O_DIRECT on
+    /// Linux and F_NOCACHE on macOS. Where the file system does not support
+    /// it the file is read through the page cache. Must be set before
+    /// open().
+    void set_direct_io(bool direct_io)
+    {
+        m_direct_io = direct_io;
+    }
+
+    bool direct_io() const
+    {
+        return m_direct_io;
+    }
+
+    void open(const std::string& path, std::error_code& error)
+    {
+        assert(!is_open());
+#if defined(MTS_FILE_READER_POSIX)
+        int flags = O_RDONLY;
+#if defined(O_DIRECT)
+        if (m_direct_io)
+            flags |= O_DIRECT;
+#endif
+        m_file = ::open(path.c_str(), flags);
+#if defined(O_DIRECT)
+        if (m_file < 0 && errno == EINVAL && m_direct_io)
+            m_file = ::open(path.c_str(), O_RDONLY);
+#endif
+        if (m_file < 0)
+        {
+            error = std::error_code(errno, std::generic_category());
+            return;
+        }
+#if defined(F_NOCACHE)
+        if (m_direct_io)
+            ::fcntl(m_file, F_NOCACHE, 1);
+#endif
+        struct stat status;
+        if (::fstat(m_file, &status) != 0)
+        {
+            error = std::error_code(errno, std::generic_category());
+            close();
+            return;
+        }
+        m_file_size = (uint64_t)status.st_size;
+#else
+        m_file = std::fopen(path.c_str(), "rb");
+        if (m_file == nullptr)
+        {
+            error = std::error_code(errno, std::generic_category());
+            return;
+        }
+        if (!seek(0, SEEK_END))
+        {
+            error = std::error_code(errno, std::generic_category());
+            close();
+            return;
+        }
+        m_file_size = (uint64_t)_ftelli64(m_file);
+#endif
+    }
+
+    bool is_open() const
+    {
+#if defined(MTS_FILE_READER_POSIX)
+        return m_file >= 0;
+#else
+        return m_file != nullptr;
+#endif
+    }
+
+    void close()
+    {
+        if (!is_open())
+            return;
+#if defined(MTS_FILE_READER_POSIX)
+        ::close(m_file);
+        m_file = -1;
+#else
+        std::fclose(m_file);
+        m_file = nullptr;
+#endif
+        m_file_size = 0;
+    }
+
+    /// @return The size of the file opened.
+    uint64_t file_size() const
+    {
+        assert(is_open());
+        return m_file_size;
+    }
+
+    uint64_t buffer_size() const
+    {
+        return m_buffer_size;
+    }
+
+    /// @return The memory used for the buffers.
+    uint64_t memory_size() const
+    {
+        return m_buffers.size() * m_buffer_size;
+    }
+
+    /// Reads the file from an offset to its end, and invokes the callback
+    /// with the data in order, in pieces of at most buffer_size() bytes.
+    /// Returns when the file is read or a read fails.
+    void read(
+        uint64_t offset, const on_data_callback& on_data,
+        std::error_code& error)
+    {
+        assert(is_open());
+        assert(on_data);
+
+        if (offset >= m_file_size)
+            return;
+
+        m_read = 0;
+        m_delivered = 0;
+        m_stop = false;
+        m_error.clear();
+        std::thread worker([this, offset]() { read_ahead(offset); });
+
+        // The reads start at an aligned offset, of which the bytes before
+        // the offset are skipped.
+        uint64_t skip = offset % alignment();
+        for (uint64_t index = 0;; ++index)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [&]() { return m_read > index || m_stop; });
+            if (m_read <= index)
+                break;
+            lock.unlock();
+
+            auto& buffer = m_buffers[index % m_buffers.size()];
+            if (buffer.m_size > skip)
+            {
+                try
+                {
+                    on_data(buffer.m_data + skip, buffer.m_size - skip);
+                }
+                catch (...)
+                {
+                    stop(worker);
+                    throw;
+                }
+            }
+            skip = 0;
+
+            lock.lock();
+            m_delivered = index + 1;
+            lock.unlock();
+            m_condition.notify_all();
+        }
+
+        worker.join();
+        error = m_error;
+    }
+
+    /// Reads the whole file, see read(offset, on_data, error).
+    void read(const on_data_callback& on_data, std::error_code& error)
+    {
+        read(0, on_data, error);
+    }
+
+private:
+
+    struct buffer
+    {
+        std::vector<uint8_t> m_storage;
+
+        /// The aligned start of the storage.
+        uint8_t* m_data = nullptr;
+
+        /// The number of bytes read into the buffer.
+        uint64_t m_size = 0;
+    };
+
+private:
+
+    /// Runs on the worker, filling the buffers in turn as they are
+    /// delivered, until the end of the file.
+    void read_ahead(uint64_t offset)
+    {
+        uint64_t position = offset - offset % alignment();
+        for (uint64_t index = 0; position < m_file_size; ++index)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [&]()
+                {
+                    return index - m_delivered < m_buffers.size() || m_stop;
+                });
+                if (m_stop)
+                    return;
+            }
+
+            auto& buffer = m_buffers[index % m_buffers.size()];
+            std::error_code error;
+            buffer.m_size = read_at(buffer.m_data, position, error);
+            position += buffer.m_size;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (error || buffer.m_size == 0)
+                {
+                    m_error = error;
+                    m_stop = true;
+                }
+                else
+                {
+                    m_read = index + 1;
+                }
+            }
+            m_condition.notify_all();
+            if (error || buffer.m_size == 0)
+                return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+    }
+
+    /// Fills a buffer from a position, or with what is left of the file.
+    ///
+    /// @return The number of bytes read.
+    uint64_t read_at(uint8_t* data, uint64_t position, std::error_code& error)
+    {
+        uint64_t size = std::min(m_buffer_size, m_file_size - position);
+        uint64_t done = 0;
+        while (done < size)
+        {
+#if defined(MTS_FILE_READER_POSIX)
+            // Direct I/O reads whole aligned blocks, even at the end of the
+            // file where fewer bytes are returned.
+            uint64_t blocks = std::min(
+                (size - done + alignment() - 1) & ~(alignment() - 1),
+                m_buffer_size - done);
+            auto result = ::pread(
+                m_file, data + done, (size_t)blocks, (off_t)(position + done));
+            if (result < 0 && errno == EINTR)
+                continue;
+#else
+            int64_t result = -1;
+            if (seek(position + done, SEEK_SET))
+            {
+                result = (int64_t)std::fread(
+                    data + done, 1, (size_t)(size - done), m_file);
+                if (result == 0 && std::ferror(m_file))
+                    result = -1;
+            }
+#endif
+            if (result < 0)
+            {
+                error = std::error_code(errno, std::generic_category());
+                break;
+            }
+            if (result == 0)
+                break;
+            done += std::min<uint64_t>((uint64_t)result, size - done);
+        }
+        return done;
+    }
+
+#if !defined(MTS_FILE_READER_POSIX)
+    bool seek(uint64_t position, int origin)
+    {
+        return _fseeki64(m_file, (int64_t)position, origin) == 0;
+    }
+#endif
+
+    /// Stops the worker and waits for it.
+    void stop(std::thread& worker)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        worker.join();
+    }
+
+private:
+
+#if defined(MTS_FILE_READER_POSIX)
+    int m_file = -1;
+#else
+    std::FILE* m_file = nullptr;
+#endif
+    uint64_t m_file_size = 0;
+    bool m_direct_io = false;
+
+    uint64_t m_buffer_size = 0;
+    std::vector<buffer> m_buffers;
+
+    /// Shared with the worker, guarded by the mutex. The buffers are read
+    /// and delivered in turn, so the counts give the buffers in use.
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    uint64_t m_read = 0;
+    uint64_t m_delivered = 0;
+    bool m_stop = false;
+    std::error_code m_error;
+};
+}
@@ -22,6 +22,36 @@ struct helper
         return writer.data();
     }
 
+    /// Writes a 33 bit timestamp in the 5 byte layout of the pes header,
+    /// the inverse of read_timestamp.
+    ///
+    /// @param prefix The 4 bit prefix, 0x2 for a PTS alone, 0x3 for a PTS
+    ///        followed by a DTS and 0x1 for the DTS.
+    static void write_timestamp(uint8_t prefix, uint64_t timestamp,
+                                uint8_t* data)
+    {
+        assert(prefix < 16U);
+        data[0] = (uint8_t)((prefix << 4) | ((timestamp >> 29) & 0x0E) | 0x01);
+        data[1] = (uint8_t)(timestamp >> 22);
+        data[2] = (uint8_t)(((timestamp >> 14) & 0xFE) | 0x01);
+        data[3] = (uint8_t)(timestamp >> 7);
+        data[4] = (uint8_t)(((timestamp << 1) & 0xFE) | 0x01);
+    }
+
+    /// Writes a program clock reference, i.e. a 27 MHz clock value, in the
+    /// 6 byte layout of the adaptation field.
+    static void write_clock_reference(uint64_t clock_reference, uint8_t* data)
+    {
+        uint64_t base = clock_reference / 300;
+        uint16_t extension = clock_reference % 300;
+        data[0] = (uint8_t)(base >> 25);
+        data[1] = (uint8_t)(base >> 17);
+        data[2] = (uint8_t)(base >> 9);
+        data[3] = (uint8_t)(base >> 1);
+        data[4] = (uint8_t)(((base & 0x01) << 7) | 0x7E | (extension >> 8));
+        data[5] = (uint8_t)extension;
+    }
+
     static uint8_t continuity_loss_calculation(uint8_t expected, uint8_t actual)
     {
         assert(actual < 16U);
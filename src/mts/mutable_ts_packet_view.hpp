@@ -0,0 +1,68 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+#include "helper.hpp"
+#include "ts_packet_view.hpp"
+
+namespace mts
+{
+/// View of a 188 byte packet which rewrites header fields in place, leaving
+/// the rest of the packet untouched.
+class mutable_ts_packet_view : public ts_packet_view
+{
+public:
+
+    /// @param data The packet, which must be packet_size() bytes.
+    explicit mutable_ts_packet_view(uint8_t* data) :
+        ts_packet_view(data),
+        m_data(data)
+    {
+    }
+
+    void set_pid(uint16_t pid)
+    {
+        assert(pid <= 0x1FFF);
+        m_data[1] = (uint8_t)((m_data[1] & 0xE0) | (pid >> 8));
+        m_data[2] = (uint8_t)pid;
+    }
+
+    void set_continuity_counter(uint8_t continuity_counter)
+    {
+        assert(continuity_counter < 16U);
+        m_data[3] = (uint8_t)((m_data[3] & 0xF0) | continuity_counter);
+    }
+
+    void set_discontinuity_indicator(bool discontinuity_indicator)
+    {
+        assert(has_adaptation_field());
+        assert(adaptation_field().length() != 0);
+        m_data[5] = (uint8_t)((m_data[5] & 0x7F) |
+                              (discontinuity_indicator ? 0x80 : 0x00));
+    }
+
+    /// Rewrites the PCR of a packet which carries one, as when
+    /// restamping the clock of a remultiplexed stream.
+    void set_program_clock_reference(uint64_t program_clock_reference)
+    {
+        assert(has_adaptation_field());
+        assert(adaptation_field().pcr_flag());
+        helper::write_clock_reference(program_clock_reference, m_data + 6);
+    }
+
+    uint8_t* data()
+    {
+        return m_data;
+    }
+
+private:
+
+    uint8_t* m_data;
+};
+}
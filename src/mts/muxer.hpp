@@ -0,0 +1,434 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "helper.hpp"
+#include "pat.hpp"
+#include "pes.hpp"
+#include "program.hpp"
+#include "stream_type.hpp"
+
+namespace mts
+{
+/// Multiplexes the elementary streams of a single program into a transport
+/// stream.
+///
+/// Each pes written is split into packets with the continuity counter of
+/// its stream, and the last packet is padded with adaptation field
+/// stuffing. The PAT and PMT are written at an interval, and the PCR is
+/// carried in the adaptation field of the PCR stream at an interval.
+///
+/// The packets are written directly into the output given, so writing
+/// does not allocate.
+///
+/// All timestamps are in ticks of the 90 kHz clock used by the PTS and
+/// DTS. The clock of the multiplex follows the DTS of the pes written,
+/// lagging a delay behind, so the PCR stays ahead of the decoding times.
+class muxer
+{
+public:
+
+    static uint32_t packet_size()
+    {
+        return 188U;
+    }
+
+    /// @return The size of the pes headers written, at most, i.e. the fixed
+    ///         part, the flags, and the PTS and DTS.
+    constexpr static uint32_t max_pes_header_size()
+    {
+        return 6U + 3U + 10U;
+    }
+
+    /// @return The default interval of the PAT and PMT, 100 ms.
+    static uint64_t default_psi_interval()
+    {
+        return 9000U;
+    }
+
+    /// @return The default interval of the PCR, 40 ms.
+    static uint64_t default_pcr_interval()
+    {
+        return 3600U;
+    }
+
+    /// @return The default delay of the PCR behind the DTS, 100 ms.
+    static uint64_t default_pcr_delay()
+    {
+        return 9000U;
+    }
+
+public:
+
+    /// @param program_number The program number in the PAT and PMT.
+    /// @param pmt_pid The PID of the PMT.
+    explicit muxer(uint16_t program_number = 1, uint16_t pmt_pid = 0x1000) :
+        m_program_number(program_number),
+        m_pmt_pid(pmt_pid)
+    {
+        assert(pmt_pid != 0 && pmt_pid < 0x1FFF);
+    }
+
+    /// Adds an elementary stream to the program. If no PCR PID is set, the
+    /// first stream added carries the PCR.
+    ///
+    /// @param stream_id The stream id of the pes headers, e.g. 0xE0 for
+    ///        video or 0xC0 for audio.
+    void add_stream(uint16_t pid, mts::stream_type type, uint8_t stream_id)
+    {
+        assert(pid != 0 && pid != m_pmt_pid && pid < 0x1FFF);
+        assert(find_stream(pid) == nullptr);
+        assert(m_streams.size() < max_streams());
+
+        m_streams.push_back({pid, (uint8_t)type, stream_id, 0});
+        if (m_pcr_pid == 0x1FFF)
+            m_pcr_pid = pid;
+        psi_changed();
+    }
+
+    void set_pcr_pid(uint16_t pid)
+    {
+        assert(find_stream(pid) != nullptr);
+        m_pcr_pid = pid;
+        psi_changed();
+    }
+
+    uint16_t pcr_pid() const
+    {
+        return m_pcr_pid;
+    }
+
+    void set_psi_interval(uint64_t interval)
+    {
+        m_psi_interval = interval;
+    }
+
+    void set_pcr_interval(uint64_t interval)
+    {
+        assert(interval <= 9000U);
+        m_pcr_interval = interval;
+    }
+
+    void set_pcr_delay(uint64_t delay)
+    {
+        m_pcr_delay = delay;
+    }
+
+    /// @return The largest number of bytes write_pes() writes for a payload
+    ///         of the given size.
+    static uint64_t max_output_size(uint64_t payload_size)
+    {
+        // The PAT and the PMT, and the pes with the largest header and an
+        // adaptation field with the PCR in the first packet.
+        uint64_t pes_size = max_pes_header_size() + 8U + payload_size;
+        return (2U + (pes_size + 183U) / 184U) * packet_size();
+    }
+
+    /// Writes a pes as packets, preceded by the PAT and PMT when due. The
+    /// DTS is only written if it differs from the PTS.
+    ///
+    /// @param output The output buffer, which must have room for
+    ///        max_output_size() bytes.
+    /// @return The number of bytes written.
+    uint64_t write_pes(
+        uint16_t pid, const uint8_t* data, uint64_t size, uint64_t pts,
+        uint64_t dts, uint8_t* output)
+    {
+        assert(data != nullptr || size == 0);
+        assert(size <= 0xFFFFFFFF);
+        assert(output != nullptr);
+        auto stream = find_stream(pid);
+        assert(stream != nullptr);
+
+        auto clock = update_clock(dts);
+
+        uint8_t* out = output;
+        if (!m_has_clock || m_psi_dirty ||
+            clock - m_psi_time >= m_psi_interval)
+        {
+            out = write_psi(out);
+            m_psi_time = clock;
+        }
+
+        bool write_pcr = false;
+        if (pid == m_pcr_pid &&
+            (!m_has_clock || clock - m_pcr_time >= m_pcr_interval))
+        {
+            write_pcr = true;
+            m_pcr_time = clock;
+        }
+        m_has_clock = true;
+
+        mts::pes pes;
+        pes.set_stream_id(stream->m_stream_id);
+        pes.set_data_alignment_indicator(true);
+        pes.set_presentation_timestamp(pts);
+        if (dts != pts)
+            pes.set_decoding_timestamp(dts);
+        pes.set_payload(data, (uint32_t)size);
+
+        std::array<uint8_t, max_pes_header_size()> header;
+        auto header_size = pes.write_header(header.data(), header.size());
+
+        // The pes is written from two parts, the header and the payload.
+        const uint8_t* parts[2] = { header.data(), data };
+        uint64_t part_sizes[2] = { header_size, size };
+        uint32_t part = 0;
+        uint64_t part_offset = 0;
+
+        uint64_t remaining = header_size + size;
+        bool first = true;
+        while (remaining > 0)
+        {
+            bool pcr = first && write_pcr;
+
+            // The length byte, the flags and the PCR.
+            uint32_t adaptation_size = pcr ? 8U : 0U;
+            uint32_t room = 184U - adaptation_size;
+            uint32_t count = (uint32_t)std::min<uint64_t>(room, remaining);
+            adaptation_size += room - count;
+
+            out = write_header(
+                pid, first, adaptation_size != 0,
+                stream->m_continuity_counter, out);
+            if (adaptation_size != 0)
+            {
+                auto clock_reference = (clock * 300U) % pcr_period();
+                write_adaptation_field(
+                    adaptation_size, pcr, clock_reference, out);
+                out += adaptation_size;
+            }
+
+            // Copy the bytes of the packet from the parts.
+            uint32_t copied = 0;
+            while (copied < count)
+            {
+                auto n = (uint32_t)std::min<uint64_t>(
+                    count - copied, part_sizes[part] - part_offset);
+                std::memcpy(out + copied, parts[part] + part_offset, n);
+                copied += n;
+                part_offset += n;
+                if (part_offset == part_sizes[part])
+                {
+                    part++;
+                    part_offset = 0;
+                }
+            }
+            out += count;
+            remaining -= count;
+            first = false;
+        }
+        return out - output;
+    }
+
+    /// Writes the PAT and the PMT.
+    ///
+    /// @param output The output buffer, with room for two packets.
+    /// @return The end of the packets written.
+    uint8_t* write_psi(uint8_t* output)
+    {
+        assert(!m_streams.empty());
+        if (m_psi_dirty)
+            build_psi();
+
+        std::memcpy(output, m_pat_packet.data(), packet_size());
+        output[3] = 0x10 | m_pat_continuity_counter;
+        m_pat_continuity_counter = (m_pat_continuity_counter + 1) & 0x0F;
+        output += packet_size();
+
+        std::memcpy(output, m_pmt_packet.data(), packet_size());
+        output[3] = 0x10 | m_pmt_continuity_counter;
+        m_pmt_continuity_counter = (m_pmt_continuity_counter + 1) & 0x0F;
+        return output + packet_size();
+    }
+
+    /// @return The version number of the PAT and PMT, which is incremented
+    ///         when the streams change after the PSI has been written.
+    uint8_t version_number() const
+    {
+        return m_version_number;
+    }
+
+private:
+
+    struct stream
+    {
+        uint16_t m_pid;
+        uint8_t m_type;
+        uint8_t m_stream_id;
+        uint8_t m_continuity_counter;
+    };
+
+private:
+
+    /// The streams which fit in a PMT in a single packet.
+    static uint32_t max_streams()
+    {
+        return (184U - 1U - 12U - 4U) / 5U;
+    }
+
+    /// @return The value at which the PCR wraps around.
+    static uint64_t pcr_period()
+    {
+        return ((uint64_t)1 << 33) * 300U;
+    }
+
+    /// Advances the clock of the multiplex with the DTS of a pes.
+    ///
+    /// @return The clock, counted from the first DTS without wrapping
+    ///         around.
+    uint64_t update_clock(uint64_t dts)
+    {
+        const uint64_t mask = ((uint64_t)1 << 33) - 1;
+        if (!m_has_clock)
+        {
+            m_dts = dts;
+            m_extended_dts = dts;
+        }
+
+        // The DTS of the streams interleave, so a DTS behind the latest
+        // does not move the clock.
+        auto delta = (dts - m_dts) & mask;
+        if (delta < mask / 2)
+        {
+            m_dts = dts;
+            m_extended_dts += delta;
+        }
+
+        auto clock = m_extended_dts > m_pcr_delay ?
+            m_extended_dts - m_pcr_delay : 0;
+        m_clock = std::max(m_clock, clock);
+        return m_clock;
+    }
+
+    stream* find_stream(uint16_t pid)
+    {
+        for (auto& s : m_streams)
+        {
+            if (s.m_pid == pid)
+                return &s;
+        }
+        return nullptr;
+    }
+
+    void psi_changed()
+    {
+        if (m_psi_built)
+            m_version_number = (m_version_number + 1) & 0x1F;
+        m_psi_dirty = true;
+    }
+
+    static uint8_t* write_header(
+        uint16_t pid, bool payload_unit_start_indicator,
+        bool adaptation_field, uint8_t& continuity_counter, uint8_t* data)
+    {
+        data[0] = 0x47;
+        data[1] = (uint8_t)(
+            (payload_unit_start_indicator ? 0x40 : 0x00) | (pid >> 8));
+        data[2] = (uint8_t)pid;
+        data[3] = (uint8_t)(
+            (adaptation_field ? 0x30 : 0x10) | continuity_counter);
+        continuity_counter = (continuity_counter + 1) & 0x0F;
+        return data + 4;
+    }
+
+    /// Writes an adaptation field of a given size, including its length
+    /// byte, filled up with stuffing.
+    static void write_adaptation_field(
+        uint32_t size, bool pcr, uint64_t clock_reference, uint8_t* data)
+    {
+        assert(size > 0);
+        data[0] = (uint8_t)(size - 1);
+        if (size == 1)
+            return;
+
+        data[1] = pcr ? 0x10 : 0x00;
+        uint32_t offset = 2;
+        if (pcr)
+        {
+            helper::write_clock_reference(clock_reference, data + offset);
+            offset += 6;
+        }
+        std::memset(data + offset, 0xFF, size - offset);
+    }
+
+    void build_psi()
+    {
+        // The PAT with the single program.
+        mts::pat pat;
+        pat.set_transport_stream_id(1);
+        pat.set_version_number(m_version_number);
+        pat.add_program_entry(m_program_number, m_pmt_pid);
+        write_section_packet(0, pat, m_pat_packet);
+
+        mts::program pmt;
+        pmt.set_program_number(m_program_number);
+        pmt.set_version_number(m_version_number);
+        pmt.set_pcr_pid(m_pcr_pid);
+        for (const auto& s : m_streams)
+        {
+            pmt.add_stream_entry(s.m_type, s.m_pid);
+        }
+        write_section_packet(m_pmt_pid, pmt, m_pmt_packet);
+
+        m_psi_dirty = false;
+        m_psi_built = true;
+    }
+
+    /// Writes a section into a packet, where the continuity counter is set
+    /// when written.
+    template<class Section>
+    static void write_section_packet(
+        uint16_t pid, const Section& section,
+        std::array<uint8_t, 188>& packet)
+    {
+        assert(section.serialized_size() + 5 <= packet.size());
+
+        packet.fill(0xFF);
+        packet[0] = 0x47;
+        packet[1] = (uint8_t)(0x40 | (pid >> 8));
+        packet[2] = (uint8_t)pid;
+        packet[3] = 0x10;
+        packet[4] = 0; // pointer field
+        section.write(packet.data() + 5, packet.size() - 5);
+    }
+
+private:
+
+    const uint16_t m_program_number;
+    const uint16_t m_pmt_pid;
+    uint16_t m_pcr_pid = 0x1FFF;
+    std::vector<stream> m_streams;
+
+    uint64_t m_psi_interval = default_psi_interval();
+    uint64_t m_pcr_interval = default_pcr_interval();
+    uint64_t m_pcr_delay = default_pcr_delay();
+
+    /// The clock of the multiplex, and when the PSI and the PCR were last
+    /// written.
+    bool m_has_clock = false;
+    uint64_t m_dts = 0;
+    uint64_t m_extended_dts = 0;
+    uint64_t m_clock = 0;
+    uint64_t m_psi_time = 0;
+    uint64_t m_pcr_time = 0;
+
+    std::array<uint8_t, 188> m_pat_packet;
+    std::array<uint8_t, 188> m_pmt_packet;
+    uint8_t m_pat_continuity_counter = 0;
+    uint8_t m_pmt_continuity_counter = 0;
+    uint8_t m_version_number = 0;
+    bool m_psi_dirty = true;
+    bool m_psi_built = false;
+};
+}
@@ -0,0 +1,351 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "pes.hpp"
+#include "start_code_scanner.hpp"
+#include "stream_type.hpp"
+
+namespace mts
+{
+/// A NAL unit of an H.264 or HEVC byte stream.
+struct nalu
+{
+    /// The NAL unit starting with its header, without the start code and
+    /// the trailing zero bytes.
+    const uint8_t* m_data;
+    uint32_t m_size;
+
+    /// The nal_unit_type of the header.
+    uint8_t m_type;
+
+    /// The timestamps of the pes in which the NAL unit starts.
+    uint64_t m_pts;
+    uint64_t m_dts;
+
+    /// Whether the NAL unit is the first of an access unit.
+    bool m_access_unit_start;
+
+    /// Whether the NAL unit is a slice of a picture which decoding can
+    /// start from, i.e. of an IDR picture for H.264 and of an IRAP picture
+    /// for HEVC.
+    bool m_random_access;
+};
+
+/// Splits the pes payloads of an H.264 or HEVC stream into NAL units and
+/// finds the access units they belong to.
+///
+/// The NAL units are delivered as views of the payload. A NAL unit is only
+/// known to end at the next start code, so the NAL unit still open at the
+/// end of a payload is copied and delivered once the next payload shows
+/// where it ends, which also covers NAL units and start codes split
+/// between pes. When the pes are known to end with a complete NAL unit, the
+/// last NAL unit of a payload is delivered right away instead, see
+/// set_aligned().
+class nalu_splitter
+{
+public:
+
+    using on_nalu_callback = std::function<void(const nalu& nalu)>;
+
+public:
+
+    /// @param type The stream type, avc_video_stream or hevc_video_stream.
+    explicit nalu_splitter(mts::stream_type type) :
+        m_hevc(type == mts::stream_type::hevc_video_stream)
+    {
+        assert(type == mts::stream_type::avc_video_stream ||
+               type == mts::stream_type::hevc_video_stream);
+    }
+
+    /// Sets whether every pes ends with a complete NAL unit.
+    void set_aligned(bool aligned)
+    {
+        m_aligned = aligned;
+    }
+
+    bool aligned() const
+    {
+        return m_aligned;
+    }
+
+    /// Reads the payload of a pes, delivering the NAL units which end in it.
+    void read(
+        const uint8_t* data, uint64_t size, uint64_t pts, uint64_t dts,
+        const on_nalu_callback& on_nalu)
+    {
+        read_payload(data, size, pts, dts, m_aligned, on_nalu);
+    }
+
+    /// Reads the payload of a pes, delivering the NAL units which end in it.
+    /// The DTS defaults to the PTS, which defaults to zero.
+    ///
+    /// The data alignment indicator only tells that the payload starts with
+    /// a NAL unit, which may still continue in the next pes, so the last NAL
+    /// unit is kept open unless set_aligned().
+    void read(const mts::pes& pes, const on_nalu_callback& on_nalu)
+    {
+        uint64_t pts = pes.has_presentation_timestamp() ?
+            pes.presentation_timestamp() : 0;
+        uint64_t dts = pes.has_decoding_timestamp() ?
+            pes.decoding_timestamp() : pts;
+        read_payload(pes.payload_data(), pes.payload_size(), pts, dts,
+                     m_aligned, on_nalu);
+    }
+
+    /// Delivers the NAL unit still open, e.g. at the end of the stream.
+    void flush(const on_nalu_callback& on_nalu)
+    {
+        assert(on_nalu);
+        if (m_has_pending)
+            deliver_pending(on_nalu);
+    }
+
+    /// Drops the NAL unit still open and forgets the access unit.
+    void reset()
+    {
+        m_pending.clear();
+        m_has_pending = false;
+        m_synchronized = false;
+        m_started = false;
+        m_vcl_seen = false;
+        m_in_prefix = false;
+    }
+
+private:
+
+    void read_payload(
+        const uint8_t* data, uint64_t size, uint64_t pts, uint64_t dts,
+        bool aligned, const on_nalu_callback& on_nalu)
+    {
+        assert(data != nullptr || size == 0);
+        assert(on_nalu);
+
+        // Until the first start code, the last bytes are kept in case the
+        // start code is split between payloads.
+        if (!aligned && !m_has_pending)
+        {
+            m_pending.clear();
+            m_has_pending = true;
+            m_synchronized = false;
+        }
+
+        const uint8_t* end = data + size;
+        const uint8_t* start = find_boundary_start_code(data, end, on_nalu);
+        if (start == nullptr)
+        {
+            auto offset = start_code_scanner::find(data, size);
+            start = data + offset;
+
+            // The bytes before the first start code end the open NAL unit.
+            if (m_has_pending)
+            {
+                m_pending.insert(m_pending.end(), data, start);
+                if (start == end)
+                {
+                    if (!m_synchronized && m_pending.size() > 2)
+                    {
+                        m_pending.erase(
+                            m_pending.begin(), m_pending.end() - 2);
+                    }
+                    return;
+                }
+                deliver_pending(on_nalu);
+            }
+            if (start == end)
+                return;
+            start += 3;
+        }
+        m_synchronized = true;
+
+        // Each NAL unit ends at the next start code.
+        while (true)
+        {
+            auto offset = start_code_scanner::find(start, end - start);
+            const uint8_t* next = start + offset;
+            if (next == end)
+                break;
+
+            deliver(start, next, pts, dts, on_nalu);
+            start = next + 3;
+        }
+
+        if (aligned)
+        {
+            deliver(start, end, pts, dts, on_nalu);
+            return;
+        }
+
+        m_pending.assign(start, end);
+        m_pending_pts = pts;
+        m_pending_dts = dts;
+        m_has_pending = true;
+    }
+
+    /// Finds a start code split between the open NAL unit and the payload.
+    ///
+    /// @return The first byte after the start code, or nullptr if the
+    ///         payload does not complete a start code.
+    const uint8_t* find_boundary_start_code(
+        const uint8_t* data, const uint8_t* end,
+        const on_nalu_callback& on_nalu)
+    {
+        if (!m_has_pending || m_pending.empty() || data == end)
+            return nullptr;
+
+        auto size = m_pending.size();
+        bool one_zero = m_pending[size - 1] == 0;
+        bool two_zeros = one_zero && size >= 2 && m_pending[size - 2] == 0;
+
+        const uint8_t* start = nullptr;
+        if (two_zeros && data[0] == 1)
+        {
+            start = data + 1;
+        }
+        else if (one_zero && end - data >= 2 && data[0] == 0 && data[1] == 1)
+        {
+            start = data + 2;
+        }
+
+        if (start != nullptr)
+            deliver_pending(on_nalu);
+        return start;
+    }
+
+    void deliver_pending(const on_nalu_callback& on_nalu)
+    {
+        assert(m_has_pending);
+        m_has_pending = false;
+        if (!m_synchronized)
+            return;
+        deliver(m_pending.data(), m_pending.data() + m_pending.size(),
+                m_pending_pts, m_pending_dts, on_nalu);
+    }
+
+    void deliver(
+        const uint8_t* data, const uint8_t* end, uint64_t pts, uint64_t dts,
+        const on_nalu_callback& on_nalu)
+    {
+        // The zero bytes before a start code are not part of the NAL unit.
+        while (end != data && end[-1] == 0)
+            --end;
+
+        uint32_t header_size = m_hevc ? 2U : 1U;
+        if ((uint64_t)(end - data) < header_size)
+            return;
+
+        nalu nalu;
+        nalu.m_data = data;
+        nalu.m_size = (uint32_t)(end - data);
+        nalu.m_pts = pts;
+        nalu.m_dts = dts;
+        if (m_hevc)
+        {
+            nalu.m_type = (data[0] >> 1) & 0x3F;
+            classify_hevc(nalu);
+        }
+        else
+        {
+            nalu.m_type = data[0] & 0x1F;
+            classify_h264(nalu);
+        }
+        on_nalu(nalu);
+    }
+
+    /// Finds the first NAL unit of each access unit as in section 7.4.1.2.3
+    /// of ITU-T H.264.
+    void classify_h264(nalu& nalu)
+    {
+        auto type = nalu.m_type;
+        bool vcl = type >= 1 && type <= 5;
+
+        // The first slice of a picture has first_mb_in_slice equal to
+        // zero, i.e. its exp-Golomb code starts with a one bit.
+        bool first_slice = vcl && nalu.m_size > 1 &&
+                           (nalu.m_data[1] & 0x80) != 0;
+        bool prefix = type == 6 || type == 7 || type == 8 || type == 9 ||
+                      (type >= 14 && type <= 18);
+
+        nalu.m_random_access = type == 5;
+        update_access_unit(nalu, vcl, first_slice, prefix);
+    }
+
+    /// Finds the first NAL unit of each access unit as in section 7.4.2.4.4
+    /// of ITU-T H.265.
+    void classify_hevc(nalu& nalu)
+    {
+        auto type = nalu.m_type;
+        bool vcl = type <= 31;
+
+        // The first slice segment of a picture has
+        // first_slice_segment_in_pic_flag set.
+        bool first_slice = vcl && nalu.m_size > 2 &&
+                           (nalu.m_data[2] & 0x80) != 0;
+        bool prefix = (type >= 32 && type <= 35) || type == 39 ||
+                      (type >= 41 && type <= 44) ||
+                      (type >= 48 && type <= 55);
+
+        nalu.m_random_access = type >= 16 && type <= 23;
+        update_access_unit(nalu, vcl, first_slice, prefix);
+    }
+
+    void update_access_unit(
+        nalu& nalu, bool vcl, bool first_slice, bool prefix)
+    {
+        // A prefix NAL unit only starts an access unit after the slices of
+        // the previous one, and is otherwise followed by the first slice.
+        if (prefix)
+        {
+            nalu.m_access_unit_start = m_vcl_seen || !m_started;
+            if (nalu.m_access_unit_start)
+            {
+                m_vcl_seen = false;
+                m_in_prefix = true;
+            }
+        }
+        else if (vcl)
+        {
+            nalu.m_access_unit_start = first_slice && !m_in_prefix;
+            m_vcl_seen = true;
+            m_in_prefix = false;
+        }
+        else
+        {
+            nalu.m_access_unit_start = !m_started;
+        }
+        m_started = true;
+    }
+
+private:
+
+    bool m_hevc;
+    bool m_aligned = false;
+
+    /// The NAL unit open at the end of the previous payload.
+    std::vector<uint8_t> m_pending;
+    uint64_t m_pending_pts = 0;
+    uint64_t m_pending_dts = 0;
+    bool m_has_pending = false;
+
+    /// Whether a start code was found, i.e. the bytes kept are a NAL unit.
+    bool m_synchronized = false;
+
+    /// Whether a NAL unit was delivered.
+    bool m_started = false;
+
+    /// Whether a slice of the current access unit was delivered.
+    bool m_vcl_seen = false;
+
+    /// Whether the current access unit was started by a prefix NAL unit,
+    /// and the first slice is not yet delivered.
+    bool m_in_prefix = false;
+};
+}
@@ -0,0 +1,59 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+namespace mts
+{
+/// The framing of the 188 byte transport stream packets in a stream.
+enum class packet_format
+{
+    /// Plain 188 byte packets.
+    ts,
+
+    /// 192 byte packets as used by Blu-ray (BDAV/M2TS), where each packet is
+    /// preceded by a 4 byte header carrying an arrival timestamp.
+    m2ts,
+
+    /// 204 byte packets, where each packet is followed by 16 bytes of
+    /// Reed-Solomon parity.
+    reed_solomon
+};
+
+/// @return The distance in bytes between the start of two packets.
+inline uint32_t packet_stride(mts::packet_format format)
+{
+    switch (format)
+    {
+    case mts::packet_format::ts: return 188U;
+    case mts::packet_format::m2ts: return 192U;
+    case mts::packet_format::reed_solomon: return 204U;
+    }
+    assert(0 && "Invalid packet format");
+    return 188U;
+}
+
+/// @return The offset of the 188 byte packet, i.e. of the sync byte, within
+///         each stride.
+inline uint32_t packet_offset(mts::packet_format format)
+{
+    return format == mts::packet_format::m2ts ? 4U : 0U;
+}
+
+/// @return The 30 bit arrival timestamp, in 27 MHz ticks, of the 4 byte
+///         header preceding a packet in the m2ts format. The 2 most
+///         significant bits of the header are the copy permission indicator.
+inline uint32_t m2ts_arrival_timestamp(const uint8_t* header)
+{
+    assert(header != nullptr);
+    return ((uint32_t)(header[0] & 0x3F) << 24) |
+           ((uint32_t)header[1] << 16) |
+           ((uint32_t)header[2] << 8) |
+           (uint32_t)header[3];
+}
+}
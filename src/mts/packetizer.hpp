@@ -10,10 +10,24 @@
 #include <vector>
 #include <functional>
 
+#include "packet_format.hpp"
+#include "sync_scanner.hpp"
+#include "trace.hpp"
+
 namespace mts
 {
 /// Reads packets of abitray size and then constructs packets of
 /// 188 bytes - while ensuring the sync byte 0x47 is present.
+///
+/// To get in sync the packetizer requires lock_packets() sync bytes spaced
+/// one packet apart, so that a 0x47 in the payload or in garbage between
+/// packets is not mistaken for the start of a packet. Once in sync, packets
+/// are released as long as they, and the packet following them when read,
+/// start with the sync byte.
+///
+/// The packet format is detected while getting in sync, so 192 byte m2ts and
+/// 204 byte Reed-Solomon framed packets are released whole, i.e. including
+/// the m2ts header or the parity bytes, see packet_format().
 class packetizer
 {
 public:
@@ -27,11 +41,20 @@ public:
         return 0x47;
     }
 
+    /// @return The size of a transport stream packet excluding any framing,
+    ///         see packet_stride().
     static uint64_t packet_size()
     {
         return 188U;
     }
 
+    /// @return The number of consecutive packets which must start with the
+    ///         sync byte before the packetizer is in sync.
+    static uint32_t lock_packets()
+    {
+        return 3U;
+    }
+
 public:
 
     packetizer(on_data_callback on_data) :
@@ -44,75 +67,208 @@ public:
     {
         assert(data != nullptr);
         assert(size > 0);
+        MTS_TRACE_SCOPE(packetizer_read);
 
-        // If leftover data and the incoming data is enough to release a packet
-        if (!m_buffer.empty() && ((m_buffer.size() + size) > packet_size()))
+        if (!m_buffer.empty())
         {
+            auto sync_offset = packet_offset(m_format);
+
+            // Wait until the incoming data is enough to release a packet and
+            // verify the sync byte of the next.
+            if (m_synced &&
+                (m_buffer.size() + size) <= packet_stride() + sync_offset)
+            {
+                m_buffer.insert(m_buffer.end(), data, data + size);
+                return;
+            }
+
+            if (!m_synced || m_buffer.size() >= packet_stride())
+            {
+                // The buffer starts with a sync byte candidate which could
+                // not be confirmed with the data available, or holds a whole
+                // m2ts packet and part of the header of the next, so process
+                // it again with the incoming data appended.
+                m_buffer.insert(m_buffer.end(), data, data + size);
+                m_scratch.swap(m_buffer);
+                m_buffer.clear();
+                process(m_scratch.data(), m_scratch.size());
+                return;
+            }
+
             // The amount missing in the buffer to constitute a complete packet
-            auto delta = packet_size() - m_buffer.size();
+            auto delta = packet_stride() - m_buffer.size();
 
-            // Is this a valid packet?
-            if (data[delta] == sync_byte())
+            // Add to buffer
+            m_buffer.insert(m_buffer.end(), data, data + delta);
+
+            // Is this a valid packet? The sync byte of the buffered packet
+            // is not yet verified if fewer than sync_offset bytes were
+            // buffered.
+            if (m_buffer[sync_offset] == sync_byte() &&
+                data[delta + sync_offset] == sync_byte())
             {
-                // Add to buffer
-                m_buffer.insert(m_buffer.end(), data, data + delta);
                 data += delta;
                 size -= delta;
 
                 // Release packet
                 m_on_data(m_buffer.data(), m_buffer.size());
             }
+            else
+            {
+                m_synced = false;
+            }
             // Either the buffer was released or invalid
             m_buffer.clear();
         }
 
-        // Release as many packets as possible.
-        while (size >= packet_size())
+        process(data, size);
+    }
+
+    void reset()
+    {
+        m_buffer.clear();
+        m_synced = false;
+        m_format = mts::packet_format::ts;
+    }
+
+    uint64_t buffered() const
+    {
+        return m_buffer.size();
+    }
+
+    bool is_synced() const
+    {
+        return m_synced;
+    }
+
+    /// @return The format of the packets released, only meaningful when
+    ///         in sync.
+    mts::packet_format packet_format() const
+    {
+        return m_format;
+    }
+
+    /// @return The size of the packets released.
+    uint64_t packet_stride() const
+    {
+        return mts::packet_stride(m_format);
+    }
+
+private:
+
+    void process(const uint8_t* data, uint64_t size)
+    {
+        while (size > 0)
         {
-            // Check that the data is valid
-            if (data[0] == sync_byte())
+            if (!m_synced)
             {
-                // Release packet
-                m_on_data(data, packet_size());
-                data += packet_size();
-                size -= packet_size();
+                auto offset = find_lock(data, size);
+                data += offset;
+                size -= offset;
+
+                if (!m_synced)
+                {
+                    // Keep the candidate, if any, until there is enough data
+                    // to confirm it.
+                    m_buffer.insert(m_buffer.end(), data, data + size);
+                    return;
+                }
             }
-            else
+
+            auto stride = packet_stride();
+            auto sync_offset = packet_offset(m_format);
+
+            // Release as many packets as possible, verifying the sync byte
+            // of the next packet when available as for a buffered packet.
+            while (size >= stride && data[sync_offset] == sync_byte() &&
+                   (size <= stride + sync_offset ||
+                    data[stride + sync_offset] == sync_byte()))
             {
-                // Didn't find sync byte, advance the buffer
-                data += 1;
-                size -= 1;
+                m_on_data(data, stride);
+                data += stride;
+                size -= stride;
             }
-        }
 
-        // If the buffer already contains data, we don't need a sync byte.
-        if (m_buffer.empty())
-        {
-            // Look for end of data or sync byte
-            while (size > 0 && data[0] != sync_byte())
+            if ((size > sync_offset && data[sync_offset] != sync_byte()) ||
+                size > stride + sync_offset)
             {
-                data += 1;
-                size -= 1;
+                // Lost sync, search for it again.
+                m_synced = false;
+                continue;
             }
-        }
 
-        // Store the data to be used for next call to read.
-        m_buffer.insert(m_buffer.end(), data, data + size);
+            // Store the partial packet to be used for next call to read.
+            m_buffer.insert(m_buffer.end(), data, data + size);
+            return;
+        }
     }
 
-    void reset()
+    /// Searches for the start of lock_packets() packets in a row, trying
+    /// each of the packet formats in turn.
+    ///
+    /// @return The offset of the first packet if found, in which case the
+    ///         packetizer is now in sync. Otherwise the offset of the last
+    ///         candidate which could not be confirmed due to lack of data, or
+    ///         size if there is no such candidate.
+    uint64_t find_lock(const uint8_t* data, uint64_t size)
     {
-        m_buffer.clear();
-    }
+        assert(!m_synced);
 
-    uint64_t buffered() const
-    {
-        return m_buffer.size();
+        const mts::packet_format formats[] =
+        {
+            mts::packet_format::ts,
+            mts::packet_format::m2ts,
+            mts::packet_format::reed_solomon
+        };
+
+        uint64_t offset = 0;
+        while (true)
+        {
+            offset += sync_scanner::find(
+                data + offset, size - offset, sync_byte());
+            if (offset == size)
+                return size;
+
+            bool undecided = false;
+            for (auto format : formats)
+            {
+                // The header in front of the sync byte must be available.
+                auto sync_offset = mts::packet_offset(format);
+                if (offset < sync_offset)
+                    continue;
+
+                auto stride = mts::packet_stride(format);
+                auto matches = sync_scanner::count_strided(
+                    data, size, offset, sync_byte(), stride, lock_packets());
+
+                if (matches == lock_packets())
+                {
+                    m_synced = true;
+                    m_format = format;
+                    return offset - sync_offset;
+                }
+
+                // Ran out of data before a mismatch.
+                undecided |= offset + matches * stride >= size;
+            }
+
+            if (undecided)
+            {
+                // Keep room for an m2ts header in front of the candidate.
+                auto header = mts::packet_offset(mts::packet_format::m2ts);
+                return offset < header ? offset : offset - header;
+            }
+
+            offset += 1;
+        }
     }
 
 private:
 
     const on_data_callback m_on_data;
     std::vector<uint8_t> m_buffer;
+    std::vector<uint8_t> m_scratch;
+    bool m_synced = false;
+    mts::packet_format m_format = mts::packet_format::ts;
 };
 }
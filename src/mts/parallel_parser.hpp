@@ -0,0 +1,366 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "parser.hpp"
+#include "pes.hpp"
+#include "slice.hpp"
+#include "stream_type.hpp"
+
+namespace mts
+{
+/// Parses a buffer of consecutive packets, e.g. a memory mapped recording,
+/// on several threads.
+///
+/// The buffer is split into chunks of whole packets which are parsed
+/// concurrently, a number of threads at a time. Before that the beginning
+/// of the buffer, up to max_psi_scan() bytes, is scanned for the PAT and
+/// PMTs, which are given to the parser of every chunk. A pes which crosses
+/// the end of a chunk is completed by the parser of the chunk it starts in,
+/// reading up to max_overlap() bytes past the end of the chunk.
+///
+/// The chunks are parsed by worker threads started with the parser and
+/// reused by every read(), together with the thread calling read().
+///
+/// The payloads are not copied, so the buffer must stay valid while reading.
+class parallel_parser
+{
+public:
+
+    /// Callback invoked with each completed pes, on the thread calling
+    /// read(). The pes of each PID are delivered in order. The payload is
+    /// given as slices of the buffer read.
+    using on_pes_callback = std::function<void(
+        uint16_t pid, mts::stream_type type, const mts::pes& pes,
+        const std::vector<slice>& payload)>;
+
+    static uint64_t default_chunk_size()
+    {
+        return 32U * 1024U * 1024U;
+    }
+
+    static uint64_t default_max_psi_scan()
+    {
+        return 16U * 1024U * 1024U;
+    }
+
+    static uint64_t default_max_overlap()
+    {
+        return 16U * 1024U * 1024U;
+    }
+
+public:
+
+    /// @param threads The number of chunks to parse concurrently, i.e. one
+    ///        more than the number of worker threads started.
+    /// @param chunk_size The size of each chunk, rounded down to whole
+    ///        packets.
+    parallel_parser(
+        uint32_t threads, uint64_t chunk_size = default_chunk_size()) :
+        m_threads(threads),
+        m_chunk_size(chunk_size - (chunk_size % parser::packet_size())),
+        m_tasks(threads - 1)
+    {
+        assert(m_threads > 0);
+        assert(m_chunk_size > 0);
+
+        for (uint32_t i = 0; i + 1 < m_threads; ++i)
+        {
+            m_workers.emplace_back(&parallel_parser::work, this, i);
+        }
+    }
+
+    parallel_parser(const parallel_parser&) = delete;
+    parallel_parser& operator=(const parallel_parser&) = delete;
+
+    ~parallel_parser()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_work.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    /// Reads all whole packets in a buffer of consecutive 188 byte packets,
+    /// starting at the beginning of the buffer. Packets which fail to parse
+    /// are skipped.
+    void read(const uint8_t* data, uint64_t size, const on_pes_callback& on_pes)
+    {
+        assert(data != nullptr);
+        assert(on_pes);
+
+        size -= size % parser::packet_size();
+        auto psi_packets = scan_psi(
+            data, std::min(size, m_max_psi_scan));
+
+        std::vector<std::vector<entry>> results(m_threads);
+        for (uint64_t offset = 0; offset < size;
+             offset += m_chunk_size * m_threads)
+        {
+            // Hand the next chunks to the workers, and parse the last one on
+            // this thread.
+            std::function<void()> last_task;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (uint32_t i = 0; i < m_threads; ++i)
+                {
+                    auto begin = offset + i * m_chunk_size;
+                    if (begin >= size)
+                        break;
+                    auto end = std::min(begin + m_chunk_size, size);
+                    auto overlap_end = size - end > m_max_overlap ?
+                        end + m_max_overlap : size;
+                    auto task = [&, i, begin, end, overlap_end]()
+                    {
+                        parse_chunk(data, begin, end, overlap_end,
+                                    psi_packets, results[i]);
+                    };
+                    if (i + 1 < m_threads && end < size)
+                    {
+                        m_tasks[i] = task;
+                        m_pending++;
+                    }
+                    else
+                    {
+                        last_task = task;
+                    }
+                }
+                m_round++;
+            }
+            m_work.notify_all();
+
+            last_task();
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [this] { return m_pending == 0; });
+            }
+
+            for (auto& entries : results)
+            {
+                for (const auto& e : entries)
+                {
+                    on_pes(e.m_pid, e.m_type, e.m_pes, e.m_payload);
+                }
+                entries.clear();
+            }
+        }
+    }
+
+    uint32_t threads() const
+    {
+        return m_threads;
+    }
+
+    uint64_t chunk_size() const
+    {
+        return m_chunk_size;
+    }
+
+    /// Sets how far into the buffer the PAT and the PMTs are looked for. A
+    /// PMT which is not found is only read by the chunks containing it.
+    void set_max_psi_scan(uint64_t size)
+    {
+        m_max_psi_scan = size;
+    }
+
+    uint64_t max_psi_scan() const
+    {
+        return m_max_psi_scan;
+    }
+
+    /// Sets how far past the end of a chunk a pes started in the chunk is
+    /// read to complete it. A pes not completed within it is dropped, as is
+    /// the last pes of a PID, which is never completed.
+    void set_max_overlap(uint64_t size)
+    {
+        m_max_overlap = size;
+    }
+
+    uint64_t max_overlap() const
+    {
+        return m_max_overlap;
+    }
+
+private:
+
+    struct entry
+    {
+        uint16_t m_pid;
+        mts::stream_type m_type;
+        mts::pes m_pes;
+        std::vector<slice> m_payload;
+    };
+
+private:
+
+    /// Runs the task handed to a worker in each round, until the parser is
+    /// destroyed.
+    void work(uint32_t index)
+    {
+        uint64_t round = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_work.wait(lock, [&] { return m_stop || m_round != round; });
+            if (m_stop)
+                return;
+
+            // A worker without a task in a round may sleep through it.
+            round = m_round;
+            if (!m_tasks[index])
+                continue;
+
+            auto task = std::move(m_tasks[index]);
+            m_tasks[index] = nullptr;
+            lock.unlock();
+            task();
+            lock.lock();
+
+            if (--m_pending == 0)
+                m_done.notify_one();
+        }
+    }
+
+    /// Reads from the beginning of the buffer until the PMT of every program
+    /// in the PAT has been read, or the end of the buffer.
+    ///
+    /// @return The packets of the PAT and of the PMTs it lists.
+    static std::vector<const uint8_t*> scan_psi(
+        const uint8_t* data, uint64_t size)
+    {
+        std::vector<const uint8_t*> psi_packets;
+        mts::parser parser;
+        parser.set_zero_copy(true);
+
+        for (uint64_t offset = 0; offset < size;
+             offset += mts::parser::packet_size())
+        {
+            const uint8_t* packet = data + offset;
+            std::error_code error;
+            parser.read(packet, error);
+            if (error)
+                continue;
+
+            uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+            if (pid == 0 || parser.is_program_pid(pid))
+            {
+                psi_packets.push_back(packet);
+            }
+            if (parser.programs_complete())
+                break;
+        }
+        return psi_packets;
+    }
+
+    /// Parses the packets from begin to end, and completes the pes started
+    /// in them with the packets up to overlap_end.
+    static void parse_chunk(
+        const uint8_t* data, uint64_t begin, uint64_t end,
+        uint64_t overlap_end, const std::vector<const uint8_t*>& psi_packets,
+        std::vector<entry>& entries)
+    {
+        mts::parser parser;
+        parser.set_zero_copy(true);
+
+        for (auto packet : psi_packets)
+        {
+            std::error_code error;
+            parser.read(packet, error);
+        }
+
+        parser.read(data + begin, end - begin, [&](uint16_t pid)
+        {
+            add_entry(parser, pid, entries);
+        });
+
+        // Continue past the end of the chunk to complete the pes which
+        // started in it, the following chunk skips to the next pes of each
+        // PID.
+        std::vector<uint16_t> pending;
+        for (uint32_t pid = 0; pid < mts::parser::pid_count(); ++pid)
+        {
+            if (parser.has_stream(pid) && parser.has_partial_pes(pid))
+                pending.push_back(pid);
+        }
+
+        for (uint64_t offset = end; offset < overlap_end && !pending.empty();
+             offset += mts::parser::packet_size())
+        {
+            const uint8_t* packet = data + offset;
+            if (packet[0] != 0x47)
+                continue;
+
+            uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+            auto it = std::find(pending.begin(), pending.end(), pid);
+            if (it == pending.end())
+                continue;
+
+            std::error_code error;
+            parser.read(packet, error);
+            if (error)
+                continue;
+
+            if (parser.has_pes())
+            {
+                add_entry(parser, pid, entries);
+                pending.erase(it);
+            }
+            else if (!parser.has_partial_pes(pid))
+            {
+                // Lost due to a continuity error.
+                pending.erase(it);
+            }
+        }
+    }
+
+    static void add_entry(
+        const mts::parser& parser, uint16_t pid, std::vector<entry>& entries)
+    {
+        std::vector<slice> payload;
+        std::error_code error;
+        auto pes = mts::pes::parse(parser.pes_slices(), payload, error);
+        if (error)
+            return;
+
+        entries.push_back(
+            {pid, parser.stream_type(pid), *pes, std::move(payload)});
+    }
+
+private:
+
+    const uint32_t m_threads;
+    const uint64_t m_chunk_size;
+    uint64_t m_max_psi_scan = default_max_psi_scan();
+    uint64_t m_max_overlap = default_max_overlap();
+
+    /// The tasks of the workers for the current round, guarded by the mutex
+    /// along with the round number and the number of tasks not yet done.
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_done;
+    std::vector<std::function<void()>> m_tasks;
+    uint64_t m_round = 0;
+    uint32_t m_pending = 0;
+    bool m_stop = false;
+
+    std::vector<std::thread> m_workers;
+};
+}
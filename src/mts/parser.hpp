@@ -5,17 +5,32 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
 #include <system_error>
 #include <vector>
 
 #include <recycle/unique_pool.hpp>
 
+#include "buffer_pool.hpp"
+#include "clock_recovery.hpp"
+#include "continuity_policy.hpp"
+#include "error.hpp"
+#include "packet_format.hpp"
 #include "pes.hpp"
 #include "pat.hpp"
 #include "program.hpp"
+#include "section_assembler.hpp"
+#include "slice.hpp"
+#include "stream_monitor.hpp"
+#include "trace.hpp"
 #include "ts_packet.hpp"
+#include "ts_packet_view.hpp"
 
 namespace mts
 {
@@ -26,26 +41,171 @@ private:
     struct stream_state
     {
         std::vector<uint8_t> m_data;
+        std::vector<slice> m_slices;
         uint8_t m_last_continuity_counter;
+
+        /// The arrival timestamp of the first packet, only set in the m2ts
+        /// packet format.
+        uint32_t m_arrival_timestamp;
+
+        /// The header being read in the incremental mode, and the payload
+        /// left of a pes with a length.
+        std::array<uint8_t, pes::max_header_size()> m_header;
+        uint32_t m_header_size;
+        bool m_header_complete;
+        bool m_bounded;
+        uint64_t m_remaining;
+
+        /// Whether packets of the pes were lost, and the ranges padded for
+        /// them with the pad continuity policy.
+        bool m_truncated;
+        std::vector<pes_loss> m_losses;
+    };
+
+    /// What a PID carries, as far as the parser knows from the PSI read
+    /// so far.
+    enum class pid_type : uint8_t
+    {
+        unknown,
+        pat,
+        program,
+        stream
+    };
+
+    struct pid_entry
+    {
+        pid_type m_type = pid_type::unknown;
+        uint8_t m_stream_type = 0;
+
+        /// Index into the stream states, only valid for stream PIDs.
+        uint16_t m_stream_index = 0;
+
+        /// Index into the clocks for the PCR PID and the stream PIDs of a
+        /// program with a PCR.
+        uint16_t m_clock_index = no_clock;
+
+        /// Whether the PID carries the PCR of its program.
+        bool m_pcr = false;
+    };
+
+    static const uint16_t no_clock = 0xFFFF;
+
+    static uint8_t pat_table_id()
+    {
+        return 0x00;
+    }
+
+    static uint8_t pmt_table_id()
+    {
+        return 0x02;
+    }
+
+    /// A program listed in the PAT, and its PMT once read.
+    struct program_state
+    {
+        uint16_t m_program_number = 0;
+        boost::optional<mts::program> m_program;
+
+        /// The PMT section the program is parsed from, which the program
+        /// points into.
+        std::vector<uint8_t> m_section;
+    };
+
+    /// The PAT sections of the latest version read, which are applied
+    /// together once all of them are read.
+    struct pat_state
+    {
+        uint8_t m_version_number = 0;
+        std::vector<bool> m_received;
+
+        /// The program number and PMT PID of the programs of each section.
+        std::vector<std::vector<std::pair<uint16_t, uint16_t>>> m_programs;
+    };
+
+    /// State shared with the stream state pool, which may recycle states
+    /// after the parser is gone.
+    struct resources
+    {
+        buffer_pool m_buffers;
+
+        /// The number of stream states allocated and slice lists grown.
+        uint64_t m_allocations = 0;
     };
 
 public:
 
     using pool_type = recycle::unique_pool<stream_state>;
 
+    /// Callback invoked with the PID of each completed pes. The pes is
+    /// available through pes_data() or pes_slices() for the duration of the
+    /// call.
+    using on_pes_callback = std::function<void(uint16_t)>;
+
     constexpr static uint32_t packet_size()
     {
         return 188;
     }
 
+    /// The number of different PIDs, i.e. the size of the 13 bit PID space.
+    constexpr static uint32_t pid_count()
+    {
+        return 8192;
+    }
+
 public:
 
-    parser() :
+    /// @param format The framing of the packets given to read(), as e.g.
+    ///        detected by the packetizer.
+    explicit parser(mts::packet_format format = mts::packet_format::ts) :
+        m_resources(std::make_shared<resources>()),
         m_stream_state_pool(
-            pool_type::allocate_function(std::make_unique<stream_state>),
-            [](auto& o) { o->m_data.resize(0); })
-    { }
+            [resources = m_resources]()
+            {
+                resources->m_allocations++;
+                return std::make_unique<stream_state>();
+            },
+            [resources = m_resources](auto& o)
+            {
+                resources->m_buffers.release(std::move(o->m_data));
+                o->m_data.clear();
+                o->m_slices.resize(0);
+                o->m_losses.clear();
+            }),
+        m_pid_table(pid_count()),
+        m_format(format)
+    {
+        m_pid_table[0].m_type = pid_type::pat;
+    }
+
+    /// Callback invoked when a program changes, i.e. when its PMT is read
+    /// for the first time or in a new version, or when it is removed from
+    /// the PAT. The PID is the PMT PID of the program, and the program before
+    /// and after the change is given. The PIDs of the program are updated
+    /// before the callback is invoked, the streams which are part of the
+    /// program both before and after keep their state.
+    using on_program_change_callback = std::function<void(
+        uint16_t pid, const boost::optional<mts::program>& previous,
+        const boost::optional<mts::program>& current)>;
+
+    /// Callback invoked in the incremental mode with the header of a pes as
+    /// soon as it is read. The payload of the header is empty.
+    using on_pes_header_callback =
+        std::function<void(uint16_t pid, const mts::pes& header)>;
+
+    /// Callback invoked in the incremental mode with the payload of a pes
+    /// as it arrives, pointing into the packets read.
+    using on_pes_payload_callback = std::function<void(
+        uint16_t pid, const uint8_t* data, uint64_t size)>;
 
+    /// Callback invoked in the incremental mode when a pes ends, either
+    /// when its PES_packet_length is read or at the start of the next pes.
+    /// The pes is incomplete if it was cut short, e.g. by lost packets.
+    using on_pes_end_callback =
+        std::function<void(uint16_t pid, bool complete)>;
+
+public:
+
+    /// Reads a single packet of packet_stride() bytes.
     void read(const uint8_t* data, std::error_code& error)
     {
         if (has_pes())
@@ -55,189 +215,1149 @@ public:
             m_pes = nullptr;
         }
 
-        bnb::stream_reader<endian::big_endian> reader(
-            data, packet_size(), error);
-        auto res = mts::ts_packet::parse(reader);
+        read_framed_packet(data, error);
+    }
+
+    /// Sets the local time, in 27 MHz ticks, at which the following packets
+    /// arrived. The arrival times are used to recover the clock of each
+    /// program, see clock(). In the m2ts packet format the arrival
+    /// timestamps of the packets are used instead.
+    void set_arrival_time(uint64_t arrival_time)
+    {
+        m_arrival_time = arrival_time;
+    }
+
+    /// Reads all whole packets in a buffer of consecutive packets, starting
+    /// at the beginning of the buffer, and invokes the callback for every
+    /// completed pes. Packets which fail to parse are skipped, as when
+    /// ignoring the error of the single packet read.
+    void read(const uint8_t* data, uint64_t size, const on_pes_callback& on_pes)
+    {
+        assert(data != nullptr);
+        assert(on_pes);
+
+        if (has_pes())
+        {
+            m_pes_pid = 0;
+            m_pes = nullptr;
+        }
+
+        std::error_code error;
+        const uint64_t stride = packet_stride();
+        const uint8_t* end = data + (size - (size % stride));
+        for (; data != end; data += stride)
+        {
+            read_framed_packet(data, error);
+            if (error)
+            {
+                error.clear();
+                continue;
+            }
+            if (has_pes())
+            {
+                on_pes(m_pes_pid);
+                m_pes_pid = 0;
+                m_pes = nullptr;
+            }
+        }
+    }
+
+    /// Enables or disables zero copy mode. In zero copy mode the payloads
+    /// are not copied, instead each pes is delivered as a list of slices
+    /// pointing into the packets given to read(). The caller must therefore
+    /// keep the packets of a pes alive until the pes has been delivered,
+    /// e.g. by reading from a memory mapped file. Must be set before
+    /// reading, or after a reset().
+    void set_zero_copy(bool zero_copy)
+    {
+        m_zero_copy = zero_copy;
+    }
+
+    bool zero_copy() const
+    {
+        return m_zero_copy;
+    }
+
+    /// Enables the incremental mode, in which each pes is delivered while
+    /// it arrives instead of once it is complete: the header as soon as it
+    /// is read, then the payload of each packet and finally the end of the
+    /// pes. The payloads are not buffered, so the memory used does not grow
+    /// with the size of the pes, and a pes with a length is ended by its
+    /// last packet rather than by the start of the next pes. No pes are
+    /// delivered through has_pes() or the callback of read(). Must be set
+    /// before reading, or after a reset().
+    void set_incremental(
+        const on_pes_header_callback& on_header,
+        const on_pes_payload_callback& on_payload,
+        const on_pes_end_callback& on_end)
+    {
+        assert(on_header);
+        assert(on_payload);
+        assert(on_end);
+        m_on_pes_header = on_header;
+        m_on_pes_payload = on_payload;
+        m_on_pes_end = on_end;
+        m_incremental = true;
+    }
+
+    bool incremental() const
+    {
+        return m_incremental;
+    }
+
+    /// Sets what is done with the pes being assembled on a stream when
+    /// packets of the stream are lost, by default it is dropped. In the
+    /// incremental mode the pes ends incomplete at the loss, unless it is
+    /// padded, in which case the zeros are delivered as payload and the pes
+    /// ends incomplete when it ends.
+    void set_continuity_policy(mts::continuity_policy policy)
+    {
+        m_continuity_policy = policy;
+    }
+
+    mts::continuity_policy continuity_policy() const
+    {
+        return m_continuity_policy;
+    }
+
+    /// Sets the framing of the packets given to read(). Must be set before
+    /// reading, or after a reset().
+    void set_packet_format(mts::packet_format format)
+    {
+        m_format = format;
+    }
+
+    mts::packet_format packet_format() const
+    {
+        return m_format;
+    }
+
+    /// @return The size of the packets given to read().
+    uint64_t packet_stride() const
+    {
+        return mts::packet_stride(m_format);
+    }
+
+    /// Sets a monitor which is updated with every packet read, or nullptr
+    /// for none. The monitor must be kept alive while reading.
+    void set_monitor(mts::stream_monitor* monitor)
+    {
+        m_monitor = monitor;
+    }
+
+    mts::stream_monitor* monitor() const
+    {
+        return m_monitor;
+    }
+
+    /// Sets the callback invoked when a program changes, see
+    /// on_program_change_callback.
+    void set_on_program_change(const on_program_change_callback& callback)
+    {
+        m_on_program_change = callback;
+    }
+
+    void reset()
+    {
+        m_programs.clear();
+        m_pat = pat_state();
+        m_pid_table.assign(pid_count(), pid_entry());
+        m_pid_table[0].m_type = pid_type::pat;
+        m_stream_states.clear();
+        m_capacity_hints.clear();
+        m_free_stream_indices.clear();
+        m_clocks.clear();
+        m_free_clock_indices.clear();
+        m_pes.reset();
+        m_pes_pid = 0;
+        m_section_assemblers.clear();
+        m_continuity_errors = 0;
+        m_duplicate_packets = 0;
+        m_arrival_timestamp = 0;
+        m_arrival_time = 0;
+        m_position = 0;
+    }
+
+    bool has_pes() const
+    {
+        return m_pes != nullptr;
+    }
+
+    const std::vector<uint8_t>& pes_data() const
+    {
+        assert(has_pes());
+        assert(!m_zero_copy);
+        return m_pes->m_data;
+    }
+
+    /// @return The pes as slices of the packets it was read from, only
+    ///         available in zero copy mode. Use pes::parse with the slices
+    ///         to parse it.
+    const std::vector<slice>& pes_slices() const
+    {
+        assert(has_pes());
+        assert(m_zero_copy);
+        return m_pes->m_slices;
+    }
+
+    uint16_t pes_pid() const
+    {
+        assert(has_pes());
+        return m_pes_pid;
+    }
+
+    /// @return The 30 bit arrival timestamp, in 27 MHz ticks, of the first
+    ///         packet of the pes. Only available in the m2ts packet format.
+    uint32_t pes_arrival_timestamp() const
+    {
+        assert(has_pes());
+        assert(m_format == mts::packet_format::m2ts);
+        return m_pes->m_arrival_timestamp;
+    }
+
+    /// @return Whether packets of the pes were lost, in which case it is
+    ///         cut short or padded depending on the continuity policy. A
+    ///         pes cut short is parsed with the truncated pes::parse.
+    bool pes_truncated() const
+    {
+        assert(has_pes());
+        return m_pes->m_truncated;
+    }
+
+    /// @return The ranges of the pes padded with zeros for lost packets,
+    ///         which are only recorded with the pad continuity policy. The
+    ///         padding of packets lost at the end of the pes may extend past
+    ///         its PES_packet_length.
+    const std::vector<pes_loss>& pes_losses() const
+    {
+        assert(has_pes());
+        return m_pes->m_losses;
+    }
+
+    bool has_stream(uint16_t pid) const
+    {
+        assert(pid < pid_count());
+        return m_pid_table[pid].m_type == pid_type::stream;
+    }
+
+    mts::stream_type stream_type(uint16_t pid) const
+    {
+        assert(has_stream(pid));
+        return static_cast<mts::stream_type>(m_pid_table[pid].m_stream_type);
+    }
+
+    /// Adds buffers for pes data to the parser up front, so the parser does
+    /// not have to allocate them while warming up.
+    void reserve_buffers(uint32_t buffers, uint64_t capacity)
+    {
+        m_resources->m_buffers.reserve(buffers, capacity);
+    }
+
+    /// @return The number of heap allocations made by the parser for
+    ///         assembling pes, i.e. for stream states and pes buffers. The
+    ///         buffers are reused and sized from the previous pes of each
+    ///         stream, so once warmed up the count stays constant as long
+    ///         as the PSI does not change.
+    uint64_t allocations() const
+    {
+        return m_resources->m_allocations +
+               m_resources->m_buffers.allocations();
+    }
+
+    /// @return Whether the PID is the PCR PID or a stream of a program with
+    ///         a PCR.
+    bool has_clock(uint16_t pid) const
+    {
+        assert(pid < pid_count());
+        return m_pid_table[pid].m_clock_index != no_clock;
+    }
+
+    /// @return The recovered clock of the program of a PID, updated with
+    ///         every PCR read.
+    const mts::clock_recovery& clock(uint16_t pid) const
+    {
+        assert(has_clock(pid));
+        return m_clocks[m_pid_table[pid].m_clock_index];
+    }
+
+    /// @return Whether a PAT has been read together with the PMT of every
+    ///         program it lists.
+    bool programs_complete() const
+    {
+        if (m_programs.empty())
+            return false;
+        for (const auto& item : m_programs)
+        {
+            if (item.second.m_program == boost::none)
+                return false;
+        }
+        return true;
+    }
+
+    /// @return Whether the PID is the PMT PID of a program listed in the
+    ///         PAT, whether or not its PMT has been read.
+    bool is_program_pid(uint16_t pid) const
+    {
+        return m_programs.find(pid) != m_programs.end();
+    }
+
+    /// @return Whether the program with the PMT PID is listed in the PAT
+    ///         and its PMT has been read.
+    bool has_program(uint16_t pid) const
+    {
+        auto result = m_programs.find(pid);
+        return result != m_programs.end() &&
+               result->second.m_program != boost::none;
+    }
+
+    /// @return The program with the PMT PID, valid until the program
+    ///         changes.
+    const mts::program& program(uint16_t pid) const
+    {
+        assert(has_program(pid));
+        return *m_programs.at(pid).m_program;
+    }
+
+    /// @return Whether a pes is being assembled on the stream, i.e. the
+    ///         first packet of a pes has been read but the pes is not yet
+    ///         complete.
+    bool has_partial_pes(uint16_t pid) const
+    {
+        assert(has_stream(pid));
+        return m_stream_states[m_pid_table[pid].m_stream_index] != nullptr;
+    }
+
+    /// @return The number of packets lost on the streams, according to
+    ///         their continuity counters.
+    uint32_t continuity_errors() const
+    {
+        return m_continuity_errors;
+    }
+
+    /// @return The number of stream packets ignored as duplicates, i.e.
+    ///         repeating the continuity counter of the previous packet.
+    uint32_t duplicate_packets() const
+    {
+        return m_duplicate_packets;
+    }
+
+private:
+
+    void read_framed_packet(const uint8_t* data, std::error_code& error)
+    {
+        assert(data != nullptr);
+        switch (m_format)
+        {
+        case mts::packet_format::m2ts:
+        {
+            // Extend the 30 bit timestamp to the 64 bit arrival time.
+            auto timestamp = m2ts_arrival_timestamp(data);
+            m_arrival_time += (timestamp - m_arrival_timestamp) & 0x3FFFFFFF;
+            m_arrival_timestamp = timestamp;
+            read_packet(data + packet_offset(m_format), error);
+            break;
+        }
+        case mts::packet_format::ts:
+        case mts::packet_format::reed_solomon:
+            // Any parity bytes follow the packet and are ignored.
+            read_packet(data, error);
+            break;
+        }
+        m_position += packet_stride();
+    }
+
+    void read_packet(const uint8_t* data, std::error_code& error)
+    {
+        assert(data != nullptr);
+        assert(!has_pes());
+
+        // Only the header is decoded, the adaptation field is only needed to
+        // find the payload.
+        MTS_TRACE_SCOPE(ts_header);
+        ts_packet_view packet(data);
+        if (m_monitor != nullptr)
+        {
+            auto type = m_pid_table[packet.pid()].m_type;
+            m_monitor->read(data, m_arrival_time,
+                            type == pid_type::pat || type == pid_type::program);
+        }
+
+        packet.verify(error);
         if (error)
             return;
-        auto& ts_packet = *res;
 
-        if (!ts_packet.has_payload_field())
+        uint16_t pid = packet.pid();
+        const auto& entry = m_pid_table[pid];
+
+        if (entry.m_pcr && packet.has_adaptation_field())
+            read_pcr(packet, entry);
+
+        if (!packet.has_payload_field())
             return;
 
-        auto pid = ts_packet.pid();
+        bool payload_unit_start_indicator =
+            packet.payload_unit_start_indicator();
+        uint8_t continuity_counter = packet.continuity_counter();
+        const uint8_t* payload = packet.payload_data();
+        uint32_t payload_size = packet.payload_size();
+        MTS_TRACE_STOP(ts_header);
 
-        if (has_stream(pid))
+        if (entry.m_type == pid_type::stream)
         {
             assert(pid != 0);
-            assert(m_programs.count(pid) == 0);
+            MTS_TRACE_SCOPE(pes_append);
+            auto& stream_state = m_stream_states[entry.m_stream_index];
 
             // Verify data
-            if (has_stream_state(pid))
-            {
-                auto& stream_state = m_stream_states.at(pid);
-                auto expected =
-                    (stream_state->m_last_continuity_counter + 1) % 16;
-                auto loss = helper::continuity_loss_calculation(
-                    expected, ts_packet.continuity_counter());
-                if (loss != 0)
+            if (stream_state != nullptr)
+            {
+                auto last = stream_state->m_last_continuity_counter;
+                auto expected = (last + 1) % 16;
+                if (continuity_counter != expected &&
+                    !discontinuity_indicator(packet))
                 {
+                    // A packet may be sent twice in a row, of which the
+                    // second is ignored.
+                    if (continuity_counter == last)
+                    {
+                        m_duplicate_packets++;
+                        return;
+                    }
+
+                    auto loss = helper::continuity_loss_calculation(
+                        expected, continuity_counter);
                     m_continuity_errors += loss;
-                    m_stream_states.erase(pid);
-                    return;
+                    if (!recover(pid, stream_state,
+                                 payload_unit_start_indicator, loss))
+                    {
+                        return;
+                    }
+                }
+                if (stream_state != nullptr)
+                {
+                    stream_state->m_last_continuity_counter =
+                        continuity_counter;
                 }
-                stream_state->m_last_continuity_counter = expected;
+            }
+
+            if (m_incremental)
+            {
+                read_incremental(
+                    pid, stream_state, payload_unit_start_indicator,
+                    continuity_counter, payload, payload_size);
+                return;
             }
 
             // extract data and create state
-            if (ts_packet.payload_unit_start_indicator())
+            if (payload_unit_start_indicator)
             {
+                auto& capacity_hint = m_capacity_hints[entry.m_stream_index];
+
                 // extract if state exists
-                if (has_stream_state(pid))
+                if (stream_state != nullptr)
                 {
+                    // Let the hint decay slowly, so the buffers stay large
+                    // enough for the occasional large pes, e.g. key frames.
+                    auto size = (uint32_t)stream_state->m_data.size();
+                    capacity_hint = std::max(
+                        size, capacity_hint - capacity_hint / 16);
+
                     m_pes_pid = pid;
-                    m_pes = std::move(m_stream_states.at(pid));
+                    m_pes = std::move(stream_state);
                 }
                 // create new stream state
-                auto stream_state = m_stream_state_pool.allocate();
-                stream_state->m_last_continuity_counter = ts_packet.continuity_counter();
-                m_stream_states[pid] = std::move(stream_state);
+                stream_state = m_stream_state_pool.allocate();
+                stream_state->m_last_continuity_counter = continuity_counter;
+                stream_state->m_arrival_timestamp = m_arrival_timestamp;
+                stream_state->m_truncated = false;
+                if (!m_zero_copy)
+                {
+                    stream_state->m_data =
+                        m_resources->m_buffers.acquire(capacity_hint);
+                }
             }
 
             // insert data
-            if (has_stream_state(pid))
+            if (stream_state != nullptr && payload_size != 0)
             {
-                auto& buffer = m_stream_states.at(pid)->m_data;
-                buffer.insert(
-                    buffer.end(),
-                    reader.remaining_data(),
-                    reader.remaining_data() + reader.remaining_size());
+                if (m_zero_copy)
+                {
+                    auto& slices = stream_state->m_slices;
+                    if (slices.size() == slices.capacity())
+                        m_resources->m_allocations++;
+                    slices.push_back({payload, payload_size});
+                }
+                else
+                {
+                    auto& buffer = stream_state->m_data;
+                    if (buffer.size() + payload_size > buffer.capacity())
+                        grow(buffer, buffer.size() + payload_size);
+                    buffer.insert(
+                        buffer.end(), payload, payload + payload_size);
+                }
             }
             return;
         }
 
-        if (ts_packet.payload_unit_start_indicator())
+        if (entry.m_type == pid_type::unknown)
+            return;
+
+        // The PID table may change while reading the sections.
+        MTS_TRACE_SCOPE(psi_parse);
+        auto type = entry.m_type;
+        m_section_assemblers[pid].read(
+            payload, payload_size, payload_unit_start_indicator,
+            continuity_counter,
+            [&](const uint8_t* section, uint32_t size)
+            {
+                read_section(pid, type, section, size, error);
+            },
+            error);
+        if (m_monitor != nullptr && error == mts::error::invalid_crc)
+            m_monitor->read_crc_error(pid);
+    }
+
+    /// Reads the payload of a stream packet in the incremental mode.
+    void read_incremental(
+        uint16_t pid, pool_type::pool_ptr& stream_state,
+        bool payload_unit_start_indicator, uint8_t continuity_counter,
+        const uint8_t* payload, uint32_t payload_size)
+    {
+        if (payload_unit_start_indicator)
+        {
+            // A pes with a length ends with its last packet.
+            if (stream_state != nullptr)
+                end_pes(pid, *stream_state, !stream_state->m_bounded);
+
+            stream_state = m_stream_state_pool.allocate();
+            stream_state->m_last_continuity_counter = continuity_counter;
+            stream_state->m_arrival_timestamp = m_arrival_timestamp;
+            stream_state->m_header_size = 0;
+            stream_state->m_header_complete = false;
+            stream_state->m_bounded = false;
+            stream_state->m_remaining = 0;
+            stream_state->m_truncated = false;
+        }
+
+        if (stream_state == nullptr || payload_size == 0)
+            return;
+
+        if (!stream_state->m_header_complete)
         {
-            uint8_t pointer_field = 0;
-            reader.read_bytes<1>(pointer_field);
-            if (pointer_field != 0)
+            auto used = read_header(*stream_state, payload, payload_size);
+            if (!stream_state->m_header_complete)
+                return;
+
+            if (!start_pes(pid, *stream_state))
             {
-                reader.skip(pointer_field);
+                stream_state.reset();
+                return;
             }
+            payload += used;
+            payload_size -= used;
         }
 
-        if (pid == 0)
+        uint64_t size = payload_size;
+        if (stream_state->m_bounded)
+            size = std::min(size, stream_state->m_remaining);
+        if (size != 0)
+            m_on_pes_payload(pid, payload, size);
+
+        if (stream_state->m_bounded)
         {
-            auto pat = mts::pat::parse(reader);
-            if (error)
-                return;
+            stream_state->m_remaining -= size;
+            if (stream_state->m_remaining == 0)
+            {
+                end_pes(pid, *stream_state, true);
+                stream_state.reset();
+            }
+        }
+    }
+
+    /// Ends the pes of a stream in the incremental mode, if its header was
+    /// delivered. A pes which lost packets is incomplete.
+    void end_pes(uint16_t pid, const stream_state& state, bool complete)
+    {
+        if (state.m_header_complete)
+            m_on_pes_end(pid, complete && !state.m_truncated);
+    }
+
+    /// @return Whether the adaptation field of a packet signals that its
+    ///         continuity counter may be discontinuous.
+    static bool discontinuity_indicator(const ts_packet_view& packet)
+    {
+        if (!packet.has_adaptation_field())
+            return false;
+        auto field = packet.adaptation_field();
+        return field.length() != 0 && field.discontinuity_indicator();
+    }
+
+    /// Applies the continuity policy to the pes of a stream, after packets
+    /// were lost before the packet being read.
+    ///
+    /// @return Whether the packet is read further.
+    bool recover(
+        uint16_t pid, pool_type::pool_ptr& stream_state,
+        bool payload_unit_start_indicator, uint32_t loss)
+    {
+        assert(stream_state != nullptr);
+        stream_state->m_truncated = true;
+
+        if (m_continuity_policy == mts::continuity_policy::pad &&
+            (!m_incremental || stream_state->m_header_complete))
+        {
+            pad(pid, stream_state, loss * (packet_size() - 4U));
+            return true;
+        }
+
+        if (m_continuity_policy == mts::continuity_policy::truncate &&
+            !m_incremental)
+        {
+            // Delivered right away, unless the next pes starts, which
+            // delivers it.
+            if (payload_unit_start_indicator)
+                return true;
+            m_pes_pid = pid;
+            m_pes = std::move(stream_state);
+            return false;
+        }
+
+        if (m_incremental)
+            end_pes(pid, *stream_state, false);
+        stream_state.reset();
+        return payload_unit_start_indicator;
+    }
+
+    /// Adds zeros for lost payload to the pes of a stream. The whole size is
+    /// recorded in the loss map, while in the incremental mode the zeros are
+    /// delivered up to the end of a pes with a length.
+    void pad(uint16_t pid, pool_type::pool_ptr& stream_state, uint64_t size)
+    {
+        auto& state = *stream_state;
+        const uint8_t* zeros = padding().data();
+        const uint64_t chunk = padding().size();
 
-            for (const auto& program_entry : pat->program_entries())
+        if (m_incremental)
+        {
+            if (state.m_bounded)
+                size = std::min(size, state.m_remaining);
+            for (uint64_t done = 0; done < size; done += chunk)
             {
-                if (program_entry.is_network_pid())
-                {
-                    continue;
-                }
-                auto program_pid = program_entry.pid();
-                if (!m_programs.count(program_pid))
+                m_on_pes_payload(pid, zeros, std::min(chunk, size - done));
+            }
+            if (state.m_bounded)
+            {
+                state.m_remaining -= size;
+                if (state.m_remaining == 0)
                 {
-                    m_programs.emplace(program_pid, boost::none);
+                    end_pes(pid, state, false);
+                    stream_state.reset();
                 }
             }
+            return;
+        }
+
+        if (m_zero_copy)
+        {
+            uint64_t offset = 0;
+            for (const auto& slice : state.m_slices)
+            {
+                offset += slice.m_size;
+            }
+            state.m_losses.push_back({offset, size});
+            for (uint64_t done = 0; done < size; done += chunk)
+            {
+                state.m_slices.push_back({zeros, std::min(chunk, size - done)});
+            }
         }
         else
         {
-            auto result = m_programs.find(pid);
-            // if this is a program pid and the program we have hasn't been
-            // initialized.
-            if (result != m_programs.end() && result->second == boost::none)
+            auto& buffer = state.m_data;
+            state.m_losses.push_back({buffer.size(), size});
+            if (buffer.size() + size > buffer.capacity())
+                grow(buffer, buffer.size() + size);
+            buffer.resize(buffer.size() + size, 0);
+        }
+    }
+
+    /// Moves the data of a pes to a buffer of the pool at least twice as
+    /// large. The buffers grown are returned to the pool, so a pes larger
+    /// than its stream usually has, e.g. a key frame, reuses the buffers of
+    /// the previous ones as it grows.
+    void grow(std::vector<uint8_t>& buffer, uint64_t size)
+    {
+        auto& buffers = m_resources->m_buffers;
+        auto larger = buffers.acquire(std::max<uint64_t>(
+            size, 2 * (uint64_t)buffer.capacity()));
+        larger.insert(larger.end(), buffer.begin(), buffer.end());
+        buffers.release(std::move(buffer));
+        buffer = std::move(larger);
+    }
+
+    /// The payload of a packet worth of zeros, which the slices of padding
+    /// point into in zero copy mode.
+    static const std::array<uint8_t, 184>& padding()
+    {
+        static const std::array<uint8_t, 184> zeros = {};
+        return zeros;
+    }
+
+    /// Collects the bytes of the pes header of a stream.
+    ///
+    /// @return The number of bytes of the payload used.
+    static uint32_t read_header(
+        stream_state& state, const uint8_t* payload, uint32_t payload_size)
+    {
+        uint32_t used = 0;
+        while (true)
+        {
+            // The fixed part, then the flags and the header data length of
+            // the optional header, and then the header data.
+            const auto& header = state.m_header;
+            uint32_t needed = 6;
+            if (state.m_header_size >= 6 && pes::has_optional_header(header[3]))
             {
-                auto program = mts::program::parse(reader);
-                if (error)
-                    return;
+                needed = state.m_header_size < 9 ? 9U : 9U + header[8];
+            }
 
-                m_programs[pid] = program;
-                return;
+            if (state.m_header_size == needed)
+            {
+                state.m_header_complete = true;
+                return used;
             }
+
+            auto count = std::min(needed - state.m_header_size,
+                                  payload_size - used);
+            std::copy(payload + used, payload + used + count,
+                      state.m_header.begin() + state.m_header_size);
+            state.m_header_size += count;
+            used += count;
+            if (used == payload_size && state.m_header_size != needed)
+                return used;
         }
     }
 
-    void reset()
+    /// Parses the complete header of a pes and delivers it.
+    ///
+    /// @return false if the header is invalid.
+    bool start_pes(uint16_t pid, stream_state& state)
     {
-        m_programs.clear();
-        m_stream_states.clear();
-        m_pes.reset();
-        m_pes_pid = 0;
-        m_continuity_errors = 0;
+        auto& header = state.m_header;
+        if (header[0] != 0x00 || header[1] != 0x00 || header[2] != 0x01)
+            return false;
+
+        // The header is parsed as a pes of unbounded length, i.e. without
+        // payload.
+        uint16_t packet_length = (uint16_t)((header[4] << 8) | header[5]);
+        header[4] = 0;
+        header[5] = 0;
+        std::error_code error;
+        auto pes = mts::pes::parse(header.data(), state.m_header_size, error);
+        if (error)
+            return false;
+
+        if (packet_length != 0)
+        {
+            if (packet_length + 6U < state.m_header_size)
+                return false;
+            state.m_bounded = true;
+            state.m_remaining = packet_length + 6U - state.m_header_size;
+        }
+
+        m_on_pes_header(pid, *pes);
+        return true;
     }
 
-    bool has_pes() const
+    void read_section(
+        uint16_t pid, pid_type type, const uint8_t* section, uint32_t size,
+        std::error_code& error)
     {
-        return m_pes != nullptr;
+        if (type == pid_type::pat)
+        {
+            if (section[0] == pat_table_id())
+                read_pat(section, size, error);
+        }
+        else
+        {
+            assert(type == pid_type::program);
+            if (section[0] == pmt_table_id())
+                read_pmt(pid, section, size, error);
+        }
     }
 
-    const std::vector<uint8_t>& pes_data() const
+    void read_pat(const uint8_t* section, uint32_t size, std::error_code& error)
     {
-        assert(has_pes());
-        return m_pes->m_data;
+        auto pat = mts::pat::parse(section, size, error);
+        if (error)
+            return;
+
+        // Sections which are not yet applicable.
+        if (!pat->current_next_indicator())
+            return;
+
+        auto sections = pat->last_section_number() + 1U;
+        if (pat->section_number() >= sections)
+            return;
+
+        if (pat->version_number() != m_pat.m_version_number ||
+            m_pat.m_received.size() != sections)
+        {
+            m_pat.m_version_number = pat->version_number();
+            m_pat.m_received.assign(sections, false);
+            m_pat.m_programs.assign(sections, {});
+        }
+
+        auto& programs = m_pat.m_programs[pat->section_number()];
+        programs.clear();
+        for (const auto& program_entry : pat->program_entries())
+        {
+            auto program_pid = program_entry.pid();
+            if (program_entry.is_network_pid() || program_pid == 0 ||
+                program_pid >= 0x1FFF)
+            {
+                continue;
+            }
+            programs.emplace_back(program_entry.program_number(), program_pid);
+        }
+        m_pat.m_received[pat->section_number()] = true;
+
+        if (std::find(m_pat.m_received.begin(), m_pat.m_received.end(),
+                      false) != m_pat.m_received.end())
+        {
+            return;
+        }
+        apply_pat();
     }
 
-    uint16_t pes_pid() const
+    /// Adds and removes programs to match the sections of the PAT.
+    void apply_pat()
     {
-        assert(has_pes());
-        return m_pes_pid;
+        std::map<uint16_t, uint16_t> programs;
+        for (const auto& section : m_pat.m_programs)
+        {
+            for (const auto& item : section)
+            {
+                programs.emplace(item.second, item.first);
+            }
+        }
+
+        std::vector<uint16_t> pids;
+        // Reserved up front, so the programs are not copied away from the
+        // sections they point into.
+        std::vector<std::pair<uint16_t, program_state>> removed;
+        removed.reserve(m_programs.size());
+        for (auto it = m_programs.begin(); it != m_programs.end();)
+        {
+            auto result = programs.find(it->first);
+            if (result != programs.end() &&
+                result->second == it->second.m_program_number)
+            {
+                ++it;
+                continue;
+            }
+
+            pids.push_back(it->first);
+            add_pids(it->second.m_program, pids);
+            removed.emplace_back(it->first, std::move(it->second));
+            m_section_assemblers.erase(it->first);
+            it = m_programs.erase(it);
+        }
+
+        for (const auto& item : programs)
+        {
+            if (m_programs.count(item.first))
+                continue;
+
+            program_state state;
+            state.m_program_number = item.second;
+            m_programs.emplace(item.first, std::move(state));
+            pids.push_back(item.first);
+        }
+
+        if (pids.empty())
+            return;
+
+        update_pid_table(pids);
+
+        if (!m_on_program_change)
+            return;
+        for (const auto& item : removed)
+        {
+            if (item.second.m_program != boost::none)
+            {
+                m_on_program_change(
+                    item.first, item.second.m_program, boost::none);
+            }
+        }
     }
 
-    bool has_stream(uint16_t pid) const
+    void read_pmt(
+        uint16_t pid, const uint8_t* section, uint32_t size,
+        std::error_code& error)
     {
-        return find_stream(pid) != nullptr;
+        auto& state = m_programs.at(pid);
+
+        // Keep a copy of the section, which the program points into.
+        std::vector<uint8_t> data(section, section + size);
+        auto program = mts::program::parse(data.data(), data.size(), error);
+        if (error)
+            return;
+
+        // Sections which are not yet applicable, or of other programs
+        // sharing the PID.
+        if (!program->current_next_indicator() ||
+            program->program_number() != state.m_program_number)
+        {
+            return;
+        }
+
+        std::vector<uint16_t> pids;
+        add_pids(state.m_program, pids);
+        add_pids(program, pids);
+
+        // The previous program points into its section, which is kept
+        // until the callback returns.
+        auto previous = std::move(state.m_program);
+        auto previous_section = std::move(state.m_section);
+        state.m_program = std::move(program);
+        state.m_section = std::move(data);
+
+        update_pid_table(pids);
+
+        if (m_on_program_change)
+            m_on_program_change(pid, previous, state.m_program);
     }
 
-    mts::stream_type stream_type(uint16_t pid) const
+    /// Adds the stream PIDs and the PCR PID of a program.
+    static void add_pids(
+        const boost::optional<mts::program>& program,
+        std::vector<uint16_t>& pids)
     {
-        auto stream_entry = find_stream(pid);
-        assert(stream_entry != nullptr);
-        return static_cast<mts::stream_type>(stream_entry->type());
+        if (program == boost::none)
+            return;
+
+        pids.push_back(program->pcr_pid());
+        for (const auto& stream_entry : program->stream_entries())
+        {
+            pids.push_back(stream_entry.pid());
+        }
     }
 
-    uint32_t continuity_errors() const
+    void read_pcr(const ts_packet_view& packet, const pid_entry& entry)
     {
-        return m_continuity_errors;
-    }
+        auto field = packet.adaptation_field();
 
-private:
+        // The flags and the 6 byte PCR.
+        if (field.length() < 7 || !field.pcr_flag())
+            return;
+
+        m_clocks[entry.m_clock_index].update(
+            field.program_clock_reference(), m_position, m_arrival_time,
+            field.discontinuity_indicator());
+    }
 
-    bool has_stream_state(uint16_t pid) const
+    /// @return Whether a PCR PID carries PCRs, as opposed to the value
+    ///         signalling a program without a PCR.
+    static bool is_pcr_pid(uint16_t pid)
     {
-        return m_stream_states.count(pid) != 0;
+        return pid != 0 && pid < 0x1FFF;
     }
 
-    const program::stream_entry* find_stream(uint16_t pid) const
+    /// @return The entry of a PID according to the known programs, where
+    ///         the stream entry of the first program with the PID wins. The
+    ///         indices are not set, instead the PCR PID of the program of a
+    ///         stream is returned.
+    pid_entry classify(uint16_t pid, uint16_t& clock_pid) const
     {
+        pid_entry entry;
+        clock_pid = 0x1FFF;
+        if (pid == 0)
+        {
+            entry.m_type = pid_type::pat;
+            return entry;
+        }
+        if (m_programs.count(pid))
+            entry.m_type = pid_type::program;
+
         for (const auto& item : m_programs)
         {
-            const auto& program = item.second;
+            const auto& program = item.second.m_program;
             if (program == boost::none)
                 continue;
+
+            if (program->pcr_pid() == pid && is_pcr_pid(pid))
+                entry.m_pcr = true;
+
+            if (entry.m_type == pid_type::stream)
+                continue;
             for (const auto& stream_entry : program->stream_entries())
             {
-                if (pid == stream_entry.pid())
+                if (stream_entry.pid() != pid)
+                    continue;
+                entry.m_type = pid_type::stream;
+                entry.m_stream_type = stream_entry.type();
+                clock_pid = program->pcr_pid();
+                break;
+            }
+        }
+        return entry;
+    }
+
+    /// Updates the PID lookup table for PIDs affected by a change of the
+    /// PSI. This is only done when the PSI changes, so that classifying a
+    /// packet is a single lookup. The stream states and the clocks of PIDs
+    /// which keep their role are kept, those of other PIDs are dropped and
+    /// their slots reused.
+    void update_pid_table(std::vector<uint16_t> pids)
+    {
+        std::sort(pids.begin(), pids.end());
+        pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+        pids.erase(std::remove_if(pids.begin(), pids.end(),
+            [](uint16_t pid) { return pid >= 0x1FFF; }), pids.end());
+
+        std::vector<pid_entry> entries;
+        std::vector<uint16_t> clock_pids(pids.size());
+        for (uint32_t i = 0; i < pids.size(); ++i)
+        {
+            entries.push_back(classify(pids[i], clock_pids[i]));
+        }
+
+        // Release the slots first, so they can be reused right away.
+        for (uint32_t i = 0; i < pids.size(); ++i)
+        {
+            const auto& old_entry = m_pid_table[pids[i]];
+            const auto& entry = entries[i];
+            if (old_entry.m_type == pid_type::stream &&
+                entry.m_type != pid_type::stream)
+            {
+                m_stream_states[old_entry.m_stream_index].reset();
+                m_free_stream_indices.push_back(old_entry.m_stream_index);
+            }
+            if (old_entry.m_pcr && !entry.m_pcr)
+            {
+                m_free_clock_indices.push_back(old_entry.m_clock_index);
+            }
+        }
+
+        for (uint32_t i = 0; i < pids.size(); ++i)
+        {
+            auto& old_entry = m_pid_table[pids[i]];
+            auto& entry = entries[i];
+            if (entry.m_type == pid_type::stream)
+            {
+                if (old_entry.m_type != pid_type::stream)
                 {
-                    return &stream_entry;
+                    entry.m_stream_index = allocate_stream_index();
                 }
+                else
+                {
+                    entry.m_stream_index = old_entry.m_stream_index;
+
+                    // A stream of another type starts over.
+                    if (entry.m_stream_type != old_entry.m_stream_type)
+                        m_stream_states[entry.m_stream_index].reset();
+                }
+            }
+            if (entry.m_pcr)
+            {
+                entry.m_clock_index = old_entry.m_pcr ?
+                    old_entry.m_clock_index : allocate_clock_index();
             }
+            old_entry = entry;
         }
-        return nullptr;
+
+        // Streams follow the clock of their program, which is now in place.
+        for (uint32_t i = 0; i < pids.size(); ++i)
+        {
+            auto& entry = m_pid_table[pids[i]];
+            if (entry.m_pcr || !is_pcr_pid(clock_pids[i]))
+                continue;
+            const auto& pcr_entry = m_pid_table[clock_pids[i]];
+            assert(pcr_entry.m_pcr);
+            entry.m_clock_index = pcr_entry.m_clock_index;
+        }
+    }
+
+    uint16_t allocate_stream_index()
+    {
+        if (!m_free_stream_indices.empty())
+        {
+            auto index = m_free_stream_indices.back();
+            m_free_stream_indices.pop_back();
+            m_capacity_hints[index] = 0;
+            return index;
+        }
+        m_stream_states.push_back(nullptr);
+        m_capacity_hints.push_back(0);
+        return (uint16_t)(m_stream_states.size() - 1);
+    }
+
+    uint16_t allocate_clock_index()
+    {
+        if (!m_free_clock_indices.empty())
+        {
+            auto index = m_free_clock_indices.back();
+            m_free_clock_indices.pop_back();
+            m_clocks[index].reset();
+            return index;
+        }
+        m_clocks.emplace_back();
+        return (uint16_t)(m_clocks.size() - 1);
     }
 
 private:
 
+    std::shared_ptr<resources> m_resources;
     pool_type m_stream_state_pool;
 
-    std::map<uint16_t, boost::optional<program>> m_programs;
-    std::map<uint16_t, pool_type::pool_ptr> m_stream_states;
+    /// The programs of the PAT, by the PID of their PMT.
+    std::map<uint16_t, program_state> m_programs;
+    pat_state m_pat;
+    on_program_change_callback m_on_program_change;
+
+    /// PID indexed lookup table, updated whenever the PSI changes.
+    std::vector<pid_entry> m_pid_table;
+
+    /// In-progress stream states, indexed by pid_entry::m_stream_index.
+    std::vector<pool_type::pool_ptr> m_stream_states;
+
+    /// The expected pes size of each stream, indexed like the stream states.
+    std::vector<uint32_t> m_capacity_hints;
+
+    /// Stream state slots no longer in use.
+    std::vector<uint16_t> m_free_stream_indices;
+
+    /// The clocks of the programs, indexed by pid_entry::m_clock_index.
+    std::vector<mts::clock_recovery> m_clocks;
+
+    /// Clock slots no longer in use.
+    std::vector<uint16_t> m_free_clock_indices;
+
+    /// The sections being assembled on the PAT and PMT PIDs.
+    std::map<uint16_t, section_assembler> m_section_assemblers;
+
     pool_type::pool_ptr m_pes;
     uint16_t m_pes_pid = 0;
     uint32_t m_continuity_errors = 0;
+    uint32_t m_duplicate_packets = 0;
+    mts::continuity_policy m_continuity_policy = mts::continuity_policy::drop;
+    bool m_zero_copy = false;
+    mts::packet_format m_format;
+
+    bool m_incremental = false;
+    on_pes_header_callback m_on_pes_header;
+    on_pes_payload_callback m_on_pes_payload;
+    on_pes_end_callback m_on_pes_end;
+
+    mts::stream_monitor* m_monitor = nullptr;
+
+    /// The arrival timestamp of the packet being read.
+    uint32_t m_arrival_timestamp = 0;
+
+    /// The arrival time of the packet being read, in 27 MHz ticks.
+    uint64_t m_arrival_time = 0;
+
+    /// The byte position of the packet being read.
+    uint64_t m_position = 0;
 };
 }
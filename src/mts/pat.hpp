@@ -14,6 +14,8 @@
 #include <endian/big_endian.hpp>
 #include <bnb/stream_reader.hpp>
 
+#include "crc32.hpp"
+
 namespace mts
 {
 /// program association table
@@ -42,6 +44,17 @@ private:
             return m_program_number == 0;
         }
 
+        void set_program_number(uint16_t program_number)
+        {
+            m_program_number = program_number;
+        }
+
+        void set_pid(uint16_t pid)
+        {
+            assert(pid < 0x2000);
+            m_pid = pid;
+        }
+
     private:
 
         uint16_t m_program_number = 0;
@@ -147,13 +160,89 @@ public:
         return m_crc;
     }
 
+    void set_transport_stream_id(uint16_t transport_stream_id)
+    {
+        m_transport_stream_id = transport_stream_id;
+    }
+
+    void set_version_number(uint8_t version_number)
+    {
+        assert(version_number < 32);
+        m_version_number = version_number;
+    }
+
+    void set_current_next_indicator(bool current_next_indicator)
+    {
+        m_current_next_indicator = current_next_indicator;
+    }
+
+    std::vector<program_entry>& program_entries()
+    {
+        return m_program_entries;
+    }
+
+    void add_program_entry(uint16_t program_number, uint16_t pid)
+    {
+        program_entry program;
+        program.set_program_number(program_number);
+        program.set_pid(pid);
+        m_program_entries.push_back(program);
+    }
+
+    /// @return The size of the section written by write().
+    uint64_t serialized_size() const
+    {
+        return 8U + 4U * m_program_entries.size() + 4U;
+    }
+
+    /// Writes the section, with the section length and the CRC computed
+    /// from the content.
+    ///
+    /// @return The number of bytes written, i.e. serialized_size().
+    uint64_t write(uint8_t* data, uint64_t size) const
+    {
+        assert(data != nullptr);
+        assert(size >= serialized_size());
+        (void) size;
+
+        auto section_size = serialized_size();
+        auto section_length = section_size - 3U;
+        data[0] = m_table_id;
+        data[1] = (uint8_t)((m_section_syntax_indicator ? 0xB0 : 0x30) |
+                            (section_length >> 8));
+        data[2] = (uint8_t)section_length;
+        data[3] = (uint8_t)(m_transport_stream_id >> 8);
+        data[4] = (uint8_t)m_transport_stream_id;
+        data[5] = (uint8_t)(0xC0 | (m_version_number << 1) |
+                            (m_current_next_indicator ? 0x01 : 0x00));
+        data[6] = m_section_number;
+        data[7] = m_last_section_number;
+
+        auto entry = data + 8;
+        for (const auto& program : m_program_entries)
+        {
+            entry[0] = (uint8_t)(program.m_program_number >> 8);
+            entry[1] = (uint8_t)program.m_program_number;
+            entry[2] = (uint8_t)(0xE0 | (program.m_pid >> 8));
+            entry[3] = (uint8_t)program.m_pid;
+            entry += 4;
+        }
+
+        auto crc = crc32::compute(data, section_size - 4U);
+        entry[0] = (uint8_t)(crc >> 24);
+        entry[1] = (uint8_t)(crc >> 16);
+        entry[2] = (uint8_t)(crc >> 8);
+        entry[3] = (uint8_t)crc;
+        return section_size;
+    }
+
 private:
 
     uint8_t m_table_id = 0;
-    bool m_section_syntax_indicator = false;
+    bool m_section_syntax_indicator = true;
     uint16_t m_transport_stream_id = 0;
     uint8_t m_version_number = 0;
-    bool m_current_next_indicator = false;
+    bool m_current_next_indicator = true;
     uint8_t m_section_number = 0;
     uint8_t m_last_section_number = 0;
     std::vector<program_entry> m_program_entries;
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <cassert>
 #include <vector>
@@ -14,8 +16,11 @@
 #include <bnb/stream_reader.hpp>
 #include <boost/optional.hpp>
 
+#include "error.hpp"
 #include "helper.hpp"
+#include "slice.hpp"
 #include "stream_type.hpp"
+#include "trace.hpp"
 
 namespace mts
 {
@@ -25,16 +30,48 @@ class pes
 {
 public:
 
+    /// The largest possible size of a pes header, i.e. the fixed part, the
+    /// flags and the maximum header data length.
+    constexpr static uint32_t max_header_size()
+    {
+        return 6 + 3 + 255;
+    }
+
+    /// @return Whether the pes of a stream id have the optional header with
+    ///         the flags and the timestamps.
+    static bool has_optional_header(uint8_t stream_id)
+    {
+        return stream_id != 0xbc && // program_stream_map
+               stream_id != 0xbe && // padding_stream
+               stream_id != 0xbf && // private_stream_2
+               stream_id != 0xf0 && // ECM
+               stream_id != 0xf1 && // EMM
+               stream_id != 0xff && // program_stream_directory
+               stream_id != 0xf2 && // DSMCC
+               stream_id != 0xf8; // H.222.1 type E
+    }
+
     static boost::optional<pes> parse(
         const uint8_t* data, uint64_t size, std::error_code& error)
+    {
+        return parse(data, size, false, error);
+    }
+
+    /// Parses a pes which may be truncated, e.g. cut short by a continuity
+    /// error as told by parser::pes_truncated(). If so, the payload is the
+    /// data following the header, even if the pes packet length is larger.
+    static boost::optional<pes> parse(
+        const uint8_t* data, uint64_t size, bool truncated,
+        std::error_code& error)
     {
         bnb::stream_reader<endian::big_endian> reader(data, size, error);
-        return parse(reader);
+        return parse(reader, truncated);
     }
 
     static boost::optional<pes> parse(
-        bnb::stream_reader<endian::big_endian>& reader)
+        bnb::stream_reader<endian::big_endian>& reader, bool truncated = false)
     {
+        MTS_TRACE_SCOPE(pes_parse);
         mts::pes pes;
 
         reader.read_bytes<3>(pes.m_packet_start_code_prefix);
@@ -53,128 +90,247 @@ public:
         // in transport stream packets.
         //
         // From ISO/IEC 13818-1:2013 p. 35
-        if (bytes_to_skip == 0)
+        if (bytes_to_skip == 0 ||
+            (truncated && bytes_to_skip > reader.remaining_size()))
         {
             bytes_to_skip = reader.remaining_size();
         }
 
         auto packet_reader = reader.skip(bytes_to_skip);
-        if (pes.m_stream_id != 0xbc && // program_stream_map
-            pes.m_stream_id != 0xbe && // padding_stream
-            pes.m_stream_id != 0xbf && // private_stream_2
-            pes.m_stream_id != 0xf0 && // ECM
-            pes.m_stream_id != 0xf1 && // EMM
-            pes.m_stream_id != 0xff && // program_stream_directory
-            pes.m_stream_id != 0xf2 && // DSMCC
-            pes.m_stream_id != 0xf8) // H.222.1 type E
+        if (has_optional_header(pes.m_stream_id))
         {
-            packet_reader
-            .read_bits<bitter::u8, bitter::msb0, 2, 2, 1, 1, 1, 1>()
-            .get<0>().expect_eq(0x02)
-            .get<1>(pes.m_scrambling_control)
-            .get<2>(pes.m_priority)
-            .get<3>(pes.m_data_alignment_indicator)
-            .get<4>(pes.m_copyright)
-            .get<5>(pes.m_original_or_copy);
-
-            packet_reader
-            .read_bits<bitter::u8, bitter::msb0, 2, 1, 1, 1, 1, 1, 1>()
-            .get<0>(pes.m_pts_dts_flags).expect_ne(0x01)
-            .get<1>(pes.m_escr_flag)
-            .get<2>(pes.m_es_rate_flag)
-            .get<3>(pes.m_dsm_trick_mode_flag)
-            .get<4>(pes.m_additional_copy_info_flag)
-            .get<5>(pes.m_crc_flag)
-            .get<6>(pes.m_extension_flag);
-
-            uint8_t header_data_length = 0;
-            packet_reader.read_bytes<1>(header_data_length);
-            auto header_reader = packet_reader.skip(header_data_length);
-
-            if (pes.has_presentation_timestamp())
-            {
-                uint8_t ts_32_30 = 0;
-                uint16_t ts_29_15 = 0;
-                uint16_t ts_14_0 = 0;
+            read_optional_header(packet_reader, pes);
+        }
 
-                header_reader
-                .read_bits<bitter::u40, bitter::msb0, 4, 3, 1, 15, 1, 15, 1>()
-                .get<1>(ts_32_30)
-                .get<3>(ts_29_15)
-                .get<5>(ts_14_0);
+        if (reader.error())
+            return boost::none;
 
-                pes.m_pts = helper::read_timestamp(ts_32_30, ts_29_15, ts_14_0);
-            }
-            if (pes.has_decoding_timestamp())
-            {
-                uint8_t ts_32_30 = 0;
-                uint16_t ts_29_15 = 0;
-                uint16_t ts_14_0 = 0;
+        pes.m_payload_data = packet_reader.remaining_data();
+        pes.m_payload_size = (uint32_t)packet_reader.remaining_size();
 
-                header_reader
-                .read_bits<bitter::u40, bitter::msb0, 4, 3, 1, 15, 1, 15, 1>()
-                .get<1>(ts_32_30)
-                .get<3>(ts_29_15)
-                .get<5>(ts_14_0);
+        return pes;
+    }
 
-                pes.m_dts = helper::read_timestamp(ts_32_30, ts_29_15, ts_14_0);
-            }
+    /// Parses a pes which is split over several slices, e.g. the payloads
+    /// of the TS packets carrying it. The header may cross slice
+    /// boundaries. The payload is not copied but returned as slices of the
+    /// same memory, and payload_data() of the returned pes is not set.
+    static boost::optional<pes> parse(
+        const std::vector<slice>& slices, std::vector<slice>& payload,
+        std::error_code& error)
+    {
+        return parse(slices, false, payload, error);
+    }
 
-            if (pes.m_escr_flag)
-            {
-                uint8_t escr_32_30 = 0;
-                uint16_t escr_29_15 = 0;
-                uint16_t escr_14_0 = 0;
-                uint16_t escr_base = 0;
-
-                header_reader
-                .read_bits<bitter::u48, bitter::msb0, 2, 3, 1, 15, 1, 15, 1, 9, 1>()
-                .get<1>(escr_32_30)
-                .get<3>(escr_29_15)
-                .get<5>(escr_14_0)
-                .get<7>(escr_base);
-
-                pes.m_escr = helper::read_timestamp(
-                    escr_32_30, escr_29_15, escr_14_0) * 300 + escr_base;
-            }
+    /// Parses a pes which is split over several slices and may be
+    /// truncated, see the contiguous parse.
+    static boost::optional<pes> parse(
+        const std::vector<slice>& slices, bool truncated,
+        std::vector<slice>& payload, std::error_code& error)
+    {
+        MTS_TRACE_SCOPE(pes_parse);
+        payload.clear();
 
-            if (pes.m_es_rate_flag)
-            {
-                header_reader
-                .read_bits<bitter::u24, bitter::msb0, 1, 22, 1>()
-                .get<1>(pes.m_es_rate);
-            }
+        uint64_t total_size = 0;
+        for (const auto& s : slices)
+        {
+            total_size += s.m_size;
+        }
 
-            if (pes.m_dsm_trick_mode_flag)
-            {
-                header_reader
-                .read_bits<bitter::u8, bitter::msb0, 3, 5>()
-                .get<0>(pes.m_trick_mode_control)
-                .get<1>(pes.m_trick_mode_data);
-            }
+        // Gather the bytes which may contain the header.
+        std::array<uint8_t, max_header_size()> header;
+        uint64_t header_available = 0;
+        for (const auto& s : slices)
+        {
+            if (header_available == header.size())
+                break;
+            auto size = std::min<uint64_t>(
+                s.m_size, header.size() - header_available);
+            std::copy(s.m_data, s.m_data + size,
+                      header.data() + header_available);
+            header_available += size;
+        }
 
-            if (pes.m_additional_copy_info_flag)
-            {
-                header_reader
-                .read_bits<bitter::u8, bitter::msb0, 1, 7>()
-                .get<1>(pes.m_additional_copy_info);
-            }
+        bnb::stream_reader<endian::big_endian> reader(
+            header.data(), header_available, error);
 
-            if (pes.m_crc_flag)
-            {
-                header_reader.read_bytes<2>(pes.m_previous_crc);
-            }
+        mts::pes pes;
+        reader.read_bytes<3>(pes.m_packet_start_code_prefix);
+        reader.read_bytes<1>(pes.m_stream_id);
+
+        uint16_t read_packet_length = 0;
+        reader.read_bytes<2>(read_packet_length);
+
+        if (reader.error())
+            return boost::none;
+
+        // See the contiguous parse for the meaning of zero.
+        uint64_t bytes_to_skip = read_packet_length;
+        if (bytes_to_skip == 0 ||
+            (truncated && bytes_to_skip > total_size - 6))
+        {
+            bytes_to_skip = total_size - 6;
+        }
+        if (bytes_to_skip > total_size - 6)
+        {
+            error = mts::error::invalid_pes_packet_length;
+            return boost::none;
+        }
+
+        auto available = std::min(bytes_to_skip, reader.remaining_size());
+        auto packet_reader = reader.skip(available);
+        if (has_optional_header(pes.m_stream_id))
+        {
+            read_optional_header(packet_reader, pes);
         }
 
         if (reader.error())
             return boost::none;
 
-        pes.m_payload_data = packet_reader.remaining_data();
-        pes.m_payload_size = (uint32_t)packet_reader.remaining_size();
+        // Slice the payload out of the input.
+        uint64_t header_size = 6 + available - packet_reader.remaining_size();
+        uint64_t payload_end = 6 + bytes_to_skip;
+        uint64_t offset = 0;
+        for (const auto& s : slices)
+        {
+            auto begin = std::max(offset, header_size);
+            auto end = std::min(offset + s.m_size, payload_end);
+            if (begin < end)
+            {
+                payload.push_back({s.m_data + (begin - offset), end - begin});
+            }
+            offset += s.m_size;
+            if (offset >= payload_end)
+                break;
+        }
 
+        pes.m_payload_size = (uint32_t)(payload_end - header_size);
         return pes;
     }
 
+private:
+
+    uint8_t header_data_length() const
+    {
+        uint8_t length = 0;
+        if (has_decoding_timestamp())
+            length += 10;
+        else if (has_presentation_timestamp())
+            length += 5;
+        if (m_escr_flag)
+            length += 6;
+        if (m_es_rate_flag)
+            length += 3;
+        if (m_dsm_trick_mode_flag)
+            length += 1;
+        if (m_additional_copy_info_flag)
+            length += 1;
+        if (m_crc_flag)
+            length += 2;
+        return length;
+    }
+
+    static void read_optional_header(
+        bnb::stream_reader<endian::big_endian>& packet_reader, mts::pes& pes)
+    {
+        packet_reader
+        .read_bits<bitter::u8, bitter::msb0, 2, 2, 1, 1, 1, 1>()
+        .get<0>().expect_eq(0x02)
+        .get<1>(pes.m_scrambling_control)
+        .get<2>(pes.m_priority)
+        .get<3>(pes.m_data_alignment_indicator)
+        .get<4>(pes.m_copyright)
+        .get<5>(pes.m_original_or_copy);
+
+        packet_reader
+        .read_bits<bitter::u8, bitter::msb0, 2, 1, 1, 1, 1, 1, 1>()
+        .get<0>(pes.m_pts_dts_flags).expect_ne(0x01)
+        .get<1>(pes.m_escr_flag)
+        .get<2>(pes.m_es_rate_flag)
+        .get<3>(pes.m_dsm_trick_mode_flag)
+        .get<4>(pes.m_additional_copy_info_flag)
+        .get<5>(pes.m_crc_flag)
+        .get<6>(pes.m_extension_flag);
+
+        uint8_t header_data_length = 0;
+        packet_reader.read_bytes<1>(header_data_length);
+        auto header_reader = packet_reader.skip(header_data_length);
+
+        if (pes.has_presentation_timestamp())
+        {
+            uint8_t ts_32_30 = 0;
+            uint16_t ts_29_15 = 0;
+            uint16_t ts_14_0 = 0;
+
+            header_reader
+            .read_bits<bitter::u40, bitter::msb0, 4, 3, 1, 15, 1, 15, 1>()
+            .get<1>(ts_32_30)
+            .get<3>(ts_29_15)
+            .get<5>(ts_14_0);
+
+            pes.m_pts = helper::read_timestamp(ts_32_30, ts_29_15, ts_14_0);
+        }
+        if (pes.has_decoding_timestamp())
+        {
+            uint8_t ts_32_30 = 0;
+            uint16_t ts_29_15 = 0;
+            uint16_t ts_14_0 = 0;
+
+            header_reader
+            .read_bits<bitter::u40, bitter::msb0, 4, 3, 1, 15, 1, 15, 1>()
+            .get<1>(ts_32_30)
+            .get<3>(ts_29_15)
+            .get<5>(ts_14_0);
+
+            pes.m_dts = helper::read_timestamp(ts_32_30, ts_29_15, ts_14_0);
+        }
+
+        if (pes.m_escr_flag)
+        {
+            uint8_t escr_32_30 = 0;
+            uint16_t escr_29_15 = 0;
+            uint16_t escr_14_0 = 0;
+            uint16_t escr_base = 0;
+
+            header_reader
+            .read_bits<bitter::u48, bitter::msb0, 2, 3, 1, 15, 1, 15, 1, 9, 1>()
+            .get<1>(escr_32_30)
+            .get<3>(escr_29_15)
+            .get<5>(escr_14_0)
+            .get<7>(escr_base);
+
+            pes.m_escr = helper::read_timestamp(
+                escr_32_30, escr_29_15, escr_14_0) * 300 + escr_base;
+        }
+
+        if (pes.m_es_rate_flag)
+        {
+            header_reader
+            .read_bits<bitter::u24, bitter::msb0, 1, 22, 1>()
+            .get<1>(pes.m_es_rate);
+        }
+
+        if (pes.m_dsm_trick_mode_flag)
+        {
+            header_reader
+            .read_bits<bitter::u8, bitter::msb0, 3, 5>()
+            .get<0>(pes.m_trick_mode_control)
+            .get<1>(pes.m_trick_mode_data);
+        }
+
+        if (pes.m_additional_copy_info_flag)
+        {
+            header_reader
+            .read_bits<bitter::u8, bitter::msb0, 1, 7>()
+            .get<1>(pes.m_additional_copy_info);
+        }
+
+        if (pes.m_crc_flag)
+        {
+            header_reader.read_bytes<2>(pes.m_previous_crc);
+        }
+    }
+
 public:
 
     bool has_presentation_timestamp() const
@@ -311,6 +467,156 @@ public:
         return m_payload_size;
     }
 
+    void set_stream_id(uint8_t stream_id)
+    {
+        m_packet_start_code_prefix = 0x000001;
+        m_stream_id = stream_id;
+    }
+
+    void set_data_alignment_indicator(bool data_alignment_indicator)
+    {
+        m_data_alignment_indicator = data_alignment_indicator;
+    }
+
+    void set_presentation_timestamp(uint64_t pts)
+    {
+        m_pts_dts_flags |= 0x02;
+        m_pts = pts;
+    }
+
+    /// Sets the DTS, which requires a PTS.
+    void set_decoding_timestamp(uint64_t dts)
+    {
+        assert(has_presentation_timestamp());
+        m_pts_dts_flags = 0x03;
+        m_dts = dts;
+    }
+
+    void set_payload(const uint8_t* data, uint32_t size)
+    {
+        assert(data != nullptr || size == 0);
+        m_payload_data = data;
+        m_payload_size = size;
+    }
+
+    /// @return The size of the header written by write_header(), i.e. the
+    ///         size of the pes without the payload.
+    uint32_t header_size() const
+    {
+        if (!has_optional_header(m_stream_id))
+            return 6U;
+        return 9U + header_data_length();
+    }
+
+    /// @return The size of the pes written by write().
+    uint64_t serialized_size() const
+    {
+        return header_size() + m_payload_size;
+    }
+
+    /// Writes the header. The pes packet length is computed from the
+    /// payload size, or zero if it does not fit. The extension is not kept
+    /// when parsing, so the extension flag is cleared.
+    ///
+    /// @return The number of bytes written, i.e. header_size().
+    uint32_t write_header(uint8_t* data, uint64_t size) const
+    {
+        assert(data != nullptr);
+        assert(size >= header_size());
+        (void) size;
+
+        uint64_t length = serialized_size() - 6U;
+        if (length > 0xFFFF)
+            length = 0;
+
+        data[0] = 0x00;
+        data[1] = 0x00;
+        data[2] = 0x01;
+        data[3] = m_stream_id;
+        data[4] = (uint8_t)(length >> 8);
+        data[5] = (uint8_t)length;
+        if (!has_optional_header(m_stream_id))
+            return 6U;
+
+        data[6] = (uint8_t)(0x80 | (m_scrambling_control << 4) |
+                            (m_priority ? 0x08 : 0x00) |
+                            (m_data_alignment_indicator ? 0x04 : 0x00) |
+                            (m_copyright ? 0x02 : 0x00) |
+                            (m_original_or_copy ? 0x01 : 0x00));
+        data[7] = (uint8_t)((m_pts_dts_flags << 6) |
+                            (m_escr_flag ? 0x20 : 0x00) |
+                            (m_es_rate_flag ? 0x10 : 0x00) |
+                            (m_dsm_trick_mode_flag ? 0x08 : 0x00) |
+                            (m_additional_copy_info_flag ? 0x04 : 0x00) |
+                            (m_crc_flag ? 0x02 : 0x00));
+        data[8] = header_data_length();
+
+        auto field = data + 9;
+        if (has_decoding_timestamp())
+        {
+            helper::write_timestamp(0x3, m_pts, field);
+            helper::write_timestamp(0x1, m_dts, field + 5);
+            field += 10;
+        }
+        else if (has_presentation_timestamp())
+        {
+            helper::write_timestamp(0x2, m_pts, field);
+            field += 5;
+        }
+        if (m_escr_flag)
+        {
+            uint64_t base = m_escr / 300;
+            uint16_t extension = m_escr % 300;
+            field[0] = (uint8_t)(0xC4 | ((base >> 27) & 0x38) |
+                                 ((base >> 28) & 0x03));
+            field[1] = (uint8_t)(base >> 20);
+            field[2] = (uint8_t)(((base >> 12) & 0xF8) | 0x04 |
+                                 ((base >> 13) & 0x03));
+            field[3] = (uint8_t)(base >> 5);
+            field[4] = (uint8_t)(((base << 3) & 0xF8) | 0x04 |
+                                 (extension >> 7));
+            field[5] = (uint8_t)((extension << 1) | 0x01);
+            field += 6;
+        }
+        if (m_es_rate_flag)
+        {
+            field[0] = (uint8_t)(0x80 | (m_es_rate >> 15));
+            field[1] = (uint8_t)(m_es_rate >> 7);
+            field[2] = (uint8_t)((m_es_rate << 1) | 0x01);
+            field += 3;
+        }
+        if (m_dsm_trick_mode_flag)
+        {
+            field[0] = (uint8_t)((m_trick_mode_control << 5) |
+                                 (m_trick_mode_data & 0x1F));
+            field += 1;
+        }
+        if (m_additional_copy_info_flag)
+        {
+            field[0] = (uint8_t)(0x80 | m_additional_copy_info);
+            field += 1;
+        }
+        if (m_crc_flag)
+        {
+            field[0] = (uint8_t)(m_previous_crc >> 8);
+            field[1] = (uint8_t)m_previous_crc;
+            field += 2;
+        }
+        return (uint32_t)(field - data);
+    }
+
+    /// Writes the header followed by the payload.
+    ///
+    /// @return The number of bytes written, i.e. serialized_size().
+    uint64_t write(uint8_t* data, uint64_t size) const
+    {
+        assert(m_payload_data != nullptr || m_payload_size == 0);
+        auto offset = write_header(data, size);
+        std::copy(m_payload_data, m_payload_data + m_payload_size,
+                  data + offset);
+        return offset + m_payload_size;
+    }
+
 private:
 
     uint32_t m_packet_start_code_prefix = 0;
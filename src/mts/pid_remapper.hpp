@@ -0,0 +1,261 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <vector>
+
+#include "crc32.hpp"
+#include "error.hpp"
+#include "mutable_ts_packet_view.hpp"
+#include "pat.hpp"
+#include "program.hpp"
+
+namespace mts
+{
+/// Moves the streams of a transport stream to other PIDs, rewriting the
+/// packets in place.
+///
+/// The packets are passed through as they are, apart from the PID in the
+/// header. The program association and program map sections are rewritten
+/// to refer to the new PIDs, and as they are repeated unchanged the
+/// rewritten payload of each table is kept, so a repeated table costs a
+/// comparison and a copy.
+///
+/// Only sections which start and end within the packet, which covers the
+/// tables of most streams, are rewritten. Sections spanning several packets
+/// are passed through unchanged.
+class pid_remapper
+{
+public:
+
+    static uint32_t packet_size()
+    {
+        return 188U;
+    }
+
+    static uint16_t pat_pid()
+    {
+        return 0x0000;
+    }
+
+    static uint16_t null_pid()
+    {
+        return 0x1FFF;
+    }
+
+public:
+
+    pid_remapper()
+    {
+        for (uint32_t pid = 0; pid < m_pids.size(); ++pid)
+        {
+            m_pids[pid] = (uint16_t)pid;
+        }
+    }
+
+    /// Moves the packets of a PID to another PID. The PAT and the null
+    /// packets keep their PIDs.
+    void remap(uint16_t from, uint16_t to)
+    {
+        assert(from <= 0x1FFF);
+        assert(to <= 0x1FFF);
+        assert(from != pat_pid() && from != null_pid());
+        m_pids[from] = to;
+
+        // The rewritten tables refer to the previous PIDs.
+        for (auto& table : m_tables)
+        {
+            table.m_input.clear();
+        }
+    }
+
+    /// @return The PID the packets of a PID are moved to.
+    uint16_t pid(uint16_t from) const
+    {
+        assert(from <= 0x1FFF);
+        return m_pids[from];
+    }
+
+    /// Rewrites a packet.
+    ///
+    /// The PMT PIDs are learnt from the program association sections, so
+    /// they must be rewritten before the program map sections. A section
+    /// which fails to parse is left unchanged and reported through the
+    /// error, the PID of the packet is rewritten regardless.
+    void rewrite(uint8_t* data, std::error_code& error)
+    {
+        assert(data != nullptr);
+
+        mutable_ts_packet_view packet(data);
+        packet.verify(error);
+        if (error)
+            return;
+
+        auto pid = packet.pid();
+        if (m_pids[pid] != pid)
+        {
+            packet.set_pid(m_pids[pid]);
+        }
+
+        if (!packet.has_payload_field() ||
+            !packet.payload_unit_start_indicator())
+        {
+            return;
+        }
+
+        if (pid == pat_pid() ||
+            std::find(m_pmt_pids.begin(), m_pmt_pids.end(), pid) !=
+                m_pmt_pids.end())
+        {
+            rewrite_table(pid, packet, error);
+        }
+    }
+
+    /// Rewrites all whole packets in a buffer of consecutive packets.
+    /// Packets which fail to parse are skipped, as when ignoring the error
+    /// of the single packet rewrite.
+    void rewrite(uint8_t* data, uint64_t size)
+    {
+        assert(data != nullptr);
+
+        std::error_code error;
+        uint8_t* end = data + (size - (size % packet_size()));
+        for (; data != end; data += packet_size())
+        {
+            rewrite(data, error);
+            error.clear();
+        }
+    }
+
+    /// Forgets the PMT PIDs and the rewritten tables, keeping the PIDs to
+    /// move.
+    void reset()
+    {
+        m_pmt_pids.clear();
+        m_tables.clear();
+    }
+
+private:
+
+    /// The last payload of a table PID and its rewritten payload.
+    struct table_state
+    {
+        uint16_t m_pid;
+        std::vector<uint8_t> m_input;
+        std::vector<uint8_t> m_output;
+    };
+
+private:
+
+    void rewrite_table(
+        uint16_t pid, mutable_ts_packet_view& packet, std::error_code& error)
+    {
+        uint8_t* payload = packet.data() + packet.payload_offset();
+        uint32_t size = packet.payload_size();
+
+        auto table = std::find_if(
+            m_tables.begin(), m_tables.end(),
+            [pid](const table_state& other) { return other.m_pid == pid; });
+        if (table == m_tables.end())
+        {
+            m_tables.push_back({pid, {}, {}});
+            table = m_tables.end() - 1;
+        }
+
+        if (table->m_input.size() == size &&
+            std::memcmp(table->m_input.data(), payload, size) == 0)
+        {
+            std::copy(table->m_output.begin(), table->m_output.end(), payload);
+            return;
+        }
+
+        // The section must start at the pointer field and end within the
+        // payload.
+        if (size < 4 || payload[0] != 0)
+            return;
+        uint8_t* section = payload + 1;
+        uint32_t section_size = 3U + (((section[1] & 0x0F) << 8) | section[2]);
+        if (section_size > size - 1U)
+            return;
+
+        if (crc32::compute(section, section_size) != 0)
+        {
+            error = mts::error::invalid_crc;
+            return;
+        }
+
+        table->m_input.assign(payload, payload + size);
+        if (pid == pat_pid())
+        {
+            rewrite_pat(section, section_size, error);
+        }
+        else
+        {
+            rewrite_pmt(section, section_size, error);
+        }
+
+        if (error)
+        {
+            table->m_input.clear();
+            return;
+        }
+        table->m_output.assign(payload, payload + size);
+    }
+
+    void rewrite_pat(uint8_t* section, uint32_t size, std::error_code& error)
+    {
+        auto pat = mts::pat::parse(section, size, error);
+        if (error)
+            return;
+
+        m_pmt_pids.clear();
+        for (auto& program : pat->program_entries())
+        {
+            if (!program.is_network_pid())
+            {
+                m_pmt_pids.push_back(program.pid());
+            }
+            program.set_pid(m_pids[program.pid()]);
+        }
+
+        assert(pat->serialized_size() == size);
+        pat->write(section, size);
+    }
+
+    void rewrite_pmt(uint8_t* section, uint32_t size, std::error_code& error)
+    {
+        auto program = mts::program::parse(section, size, error);
+        if (error)
+            return;
+
+        program->set_pcr_pid(m_pids[program->pcr_pid()]);
+        for (auto& stream : program->stream_entries())
+        {
+            stream.set_pid(m_pids[stream.pid()]);
+        }
+
+        // The program info and descriptors are copied from the section, so
+        // the section is written to a buffer of its own.
+        assert(program->serialized_size() == size);
+        m_section.resize(size);
+        program->write(m_section.data(), m_section.size());
+        std::copy(m_section.begin(), m_section.end(), section);
+    }
+
+private:
+
+    std::array<uint16_t, 0x2000> m_pids;
+    std::vector<uint16_t> m_pmt_pids;
+    std::vector<table_state> m_tables;
+    std::vector<uint8_t> m_section;
+};
+}
@@ -5,15 +5,18 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 #include <cassert>
 #include <memory>
 
-#include <endian/stream_reader.hpp>
+#include <bnb/stream_reader.hpp>
 #include <endian/big_endian.hpp>
 #include <boost/optional.hpp>
 
+#include "crc32.hpp"
+
 namespace mts
 {
 class program
@@ -95,6 +98,63 @@ public:
             return m_es_info_entries;
         }
 
+        void set_type(uint8_t type)
+        {
+            m_type = type;
+        }
+
+        void set_pid(uint16_t pid)
+        {
+            assert(pid < 0x2000);
+            m_pid = pid;
+        }
+
+        /// @return The size of the entry written by write().
+        uint64_t serialized_size() const
+        {
+            return 5U + es_info_length();
+        }
+
+        /// @return The number of bytes written, i.e. serialized_size().
+        uint64_t write(uint8_t* data, uint64_t size) const
+        {
+            assert(data != nullptr);
+            assert(size >= serialized_size());
+            (void) size;
+
+            auto length = es_info_length();
+            data[0] = m_type;
+            data[1] = (uint8_t)(0xE0 | (m_pid >> 8));
+            data[2] = (uint8_t)m_pid;
+            data[3] = (uint8_t)(0xF0 | (length >> 8));
+            data[4] = (uint8_t)length;
+
+            auto descriptor = data + 5;
+            for (const auto& entry : m_es_info_entries)
+            {
+                descriptor[0] = entry.m_tag;
+                descriptor[1] = entry.m_description_length;
+                std::copy(entry.m_description_data,
+                          entry.m_description_data +
+                              entry.m_description_length,
+                          descriptor + 2);
+                descriptor += 2U + entry.m_description_length;
+            }
+            return serialized_size();
+        }
+
+    private:
+
+        uint16_t es_info_length() const
+        {
+            uint16_t length = 0;
+            for (const auto& entry : m_es_info_entries)
+            {
+                length += 2U + entry.m_description_length;
+            }
+            return length;
+        }
+
     private:
 
         uint8_t m_type = 0;
@@ -221,16 +281,105 @@ public:
         return m_program_info_data;
     }
 
+    std::vector<stream_entry>& stream_entries()
+    {
+        return m_stream_entries;
+    }
+
+    void add_stream_entry(uint8_t type, uint16_t pid)
+    {
+        stream_entry entry;
+        entry.set_type(type);
+        entry.set_pid(pid);
+        m_stream_entries.push_back(entry);
+    }
+
+    void set_program_number(uint16_t program_number)
+    {
+        m_program_number = program_number;
+    }
+
+    void set_version_number(uint8_t version_number)
+    {
+        assert(version_number < 32);
+        m_version_number = version_number;
+    }
+
+    void set_current_next_indicator(bool current_next_indicator)
+    {
+        m_current_next_indicator = current_next_indicator;
+    }
+
+    void set_pcr_pid(uint16_t pcr_pid)
+    {
+        assert(pcr_pid < 0x2000);
+        m_pcr_pid = pcr_pid;
+    }
+
+    /// @return The size of the section written by write().
+    uint64_t serialized_size() const
+    {
+        uint64_t size = 12U + m_program_info_length + 4U;
+        for (const auto& stream : m_stream_entries)
+        {
+            size += stream.serialized_size();
+        }
+        return size;
+    }
+
+    /// Writes the section, with the section length and the CRC computed
+    /// from the content. The program info and the descriptors of the
+    /// streams are copied from the data they point into.
+    ///
+    /// @return The number of bytes written, i.e. serialized_size().
+    uint64_t write(uint8_t* data, uint64_t size) const
+    {
+        assert(data != nullptr);
+        assert(size >= serialized_size());
+
+        auto section_size = serialized_size();
+        auto section_length = section_size - 3U;
+        data[0] = m_table_id;
+        data[1] = (uint8_t)((m_section_syntax_indicator ? 0xB0 : 0x30) |
+                            (section_length >> 8));
+        data[2] = (uint8_t)section_length;
+        data[3] = (uint8_t)(m_program_number >> 8);
+        data[4] = (uint8_t)m_program_number;
+        data[5] = (uint8_t)(0xC0 | (m_version_number << 1) |
+                            (m_current_next_indicator ? 0x01 : 0x00));
+        data[6] = m_section_number;
+        data[7] = m_last_section_number;
+        data[8] = (uint8_t)(0xE0 | (m_pcr_pid >> 8));
+        data[9] = (uint8_t)m_pcr_pid;
+        data[10] = (uint8_t)(0xF0 | (m_program_info_length >> 8));
+        data[11] = (uint8_t)m_program_info_length;
+        std::copy(m_program_info_data,
+                  m_program_info_data + m_program_info_length, data + 12);
+
+        uint64_t offset = 12U + m_program_info_length;
+        for (const auto& stream : m_stream_entries)
+        {
+            offset += stream.write(data + offset, size - offset);
+        }
+
+        auto crc = crc32::compute(data, offset);
+        data[offset] = (uint8_t)(crc >> 24);
+        data[offset + 1] = (uint8_t)(crc >> 16);
+        data[offset + 2] = (uint8_t)(crc >> 8);
+        data[offset + 3] = (uint8_t)crc;
+        return section_size;
+    }
+
 private:
 
-    uint8_t m_table_id = 0;
-    bool m_section_syntax_indicator = false;
+    uint8_t m_table_id = 0x02;
+    bool m_section_syntax_indicator = true;
     uint16_t m_program_number = 0;
     uint8_t m_version_number = 0;
-    bool m_current_next_indicator = false;
+    bool m_current_next_indicator = true;
     uint8_t m_section_number = 0;
     uint8_t m_last_section_number = 0;
-    uint16_t m_pcr_pid = 0;
+    uint16_t m_pcr_pid = 0x1FFF;
     uint16_t m_program_info_length = 0;
     const uint8_t* m_program_info_data = nullptr;
 
@@ -0,0 +1,388 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <system_error>
+#include <vector>
+
+#include "pat.hpp"
+#include "program.hpp"
+#include "section_assembler.hpp"
+#include "ts_packet_view.hpp"
+
+namespace mts
+{
+/// Carves programs out of a multi program transport stream, e.g. to produce
+/// a single program transport stream.
+///
+/// The packets of the selected programs, i.e. of their PMT, PCR and
+/// elementary stream PIDs, are passed through untouched along with any PIDs
+/// selected directly. All other packets are dropped, and the PAT is replaced
+/// by one listing only the selected programs.
+///
+/// The pes are not reassembled, each packet is looked up in a flat PID
+/// table and copied, and the PAT and PMT sections are only parsed when they
+/// change.
+class program_filter
+{
+public:
+
+    static uint32_t packet_size()
+    {
+        return 188U;
+    }
+
+    static uint16_t pat_pid()
+    {
+        return 0x0000;
+    }
+
+    /// @return The largest number of programs in the PAT written, which
+    ///         fits in a single packet.
+    static uint32_t max_programs()
+    {
+        return (packet_size() - 4U - 1U - 12U) / 4U;
+    }
+
+public:
+
+    program_filter()
+    {
+        m_actions.fill(action::drop);
+        m_actions[pat_pid()] = action::pat;
+    }
+
+    /// Selects a program by its program number.
+    void select_program(uint16_t program_number)
+    {
+        assert(program_number != 0);
+        if (std::find(m_selected_programs.begin(), m_selected_programs.end(),
+                      program_number) != m_selected_programs.end())
+        {
+            return;
+        }
+        assert(m_selected_programs.size() < max_programs());
+        m_selected_programs.push_back(program_number);
+        update();
+    }
+
+    /// Selects a PID to be passed through, regardless of the programs.
+    void select_pid(uint16_t pid)
+    {
+        assert(pid != pat_pid() && pid <= 0x1FFF);
+        m_selected_pids.push_back(pid);
+        update();
+    }
+
+    /// @return true if the packets of the PID are passed through.
+    bool is_selected(uint16_t pid) const
+    {
+        assert(pid <= 0x1FFF);
+        return m_actions[pid] == action::forward ||
+               m_actions[pid] == action::pmt;
+    }
+
+    /// Filters a packet.
+    ///
+    /// @param data The packet.
+    /// @param output The output, which has room for a packet and may be the
+    ///        packet itself.
+    /// @return The number of bytes written to the output, i.e. either zero
+    ///         or packet_size().
+    uint32_t filter(
+        const uint8_t* data, uint8_t* output, std::error_code& error)
+    {
+        assert(data != nullptr);
+        assert(output != nullptr);
+
+        ts_packet_view packet(data);
+        packet.verify(error);
+        if (error)
+            return 0;
+
+        auto pid = packet.pid();
+        switch (m_actions[pid])
+        {
+        case action::drop:
+            return 0;
+        case action::forward:
+            break;
+        case action::pmt:
+            read_section(pid, packet, error);
+            break;
+        case action::pat:
+            read_section(pid, packet, error);
+            return write_pat(packet, output);
+        }
+
+        if (output != data)
+            std::memcpy(output, data, packet_size());
+        return packet_size();
+    }
+
+    /// Filters all whole packets in a buffer of consecutive packets.
+    /// Packets which fail to parse are dropped, as when ignoring the error
+    /// of the single packet filter.
+    ///
+    /// @param output The output, which has room for as many bytes as the
+    ///        input and may be the input itself.
+    /// @return The number of bytes written to the output.
+    uint64_t filter(const uint8_t* data, uint64_t size, uint8_t* output)
+    {
+        assert(data != nullptr);
+        assert(output != nullptr);
+
+        std::error_code error;
+        uint8_t* begin = output;
+        const uint8_t* end = data + (size - (size % packet_size()));
+        for (; data != end; data += packet_size())
+        {
+            output += filter(data, output, error);
+            error.clear();
+        }
+        return output - begin;
+    }
+
+    /// @return The version number of the PAT written, which is incremented
+    ///         when the selected programs change.
+    uint8_t version_number() const
+    {
+        return m_version_number;
+    }
+
+    /// Forgets the tables read, keeping the selection.
+    void reset()
+    {
+        m_pat = boost::none;
+        m_programs.clear();
+        m_section_assemblers.clear();
+        m_pat_section.clear();
+        update();
+    }
+
+private:
+
+    enum class action : uint8_t
+    {
+        drop,
+        forward,
+        pat,
+        pmt
+    };
+
+    /// The PIDs of a selected program.
+    struct program_state
+    {
+        uint16_t m_program_number;
+        std::vector<uint16_t> m_pids;
+    };
+
+private:
+
+    void read_section(
+        uint16_t pid, const ts_packet_view& packet, std::error_code& error)
+    {
+        if (!packet.has_payload_field())
+            return;
+
+        m_section_assemblers[pid].read(
+            packet.payload_data(), packet.payload_size(),
+            packet.payload_unit_start_indicator(),
+            packet.continuity_counter(),
+            [&](const uint8_t* section, uint32_t size)
+            {
+                if (pid == pat_pid())
+                {
+                    read_pat(section, size, error);
+                }
+                else
+                {
+                    read_pmt(pid, section, size, error);
+                }
+            }, error);
+    }
+
+    void read_pat(const uint8_t* section, uint32_t size, std::error_code& error)
+    {
+        auto pat = mts::pat::parse(section, size, error);
+        if (error)
+            return;
+
+        // Tables which are not yet applicable, and tables split over
+        // several sections, are not supported.
+        if (!pat->current_next_indicator() || pat->last_section_number() != 0)
+            return;
+
+        m_pat = pat;
+        update();
+    }
+
+    void read_pmt(
+        uint16_t pid, const uint8_t* section, uint32_t size,
+        std::error_code& error)
+    {
+        auto program = mts::program::parse(section, size, error);
+        if (error)
+            return;
+        if (!program->current_next_indicator())
+            return;
+
+        auto state = m_programs.find(pid);
+        if (state == m_programs.end() ||
+            state->second.m_program_number != program->program_number())
+        {
+            return;
+        }
+
+        state->second.m_pids.clear();
+        if (is_stream_pid(program->pcr_pid()))
+            state->second.m_pids.push_back(program->pcr_pid());
+        for (const auto& stream : program->stream_entries())
+        {
+            if (is_stream_pid(stream.pid()))
+                state->second.m_pids.push_back(stream.pid());
+        }
+        update();
+    }
+
+    /// @return false for the PAT and null PIDs, which a PAT or PMT may not
+    ///         assign to a program.
+    static bool is_stream_pid(uint16_t pid)
+    {
+        return pid != pat_pid() && pid < 0x1FFF;
+    }
+
+    /// Rebuilds the PID table and the PAT written from the selection and
+    /// the tables read.
+    void update()
+    {
+        std::map<uint16_t, program_state> programs;
+        mts::pat pat;
+        if (m_pat)
+        {
+            pat.set_transport_stream_id(m_pat->transport_stream_id());
+            for (const auto& entry : m_pat->program_entries())
+            {
+                if (entry.is_network_pid() || !is_stream_pid(entry.pid()) ||
+                    std::find(m_selected_programs.begin(),
+                              m_selected_programs.end(),
+                              entry.program_number()) ==
+                        m_selected_programs.end())
+                {
+                    continue;
+                }
+
+                // Keep what was learnt from the PMT if it did not move.
+                auto state = m_programs.find(entry.pid());
+                if (state != m_programs.end() &&
+                    state->second.m_program_number == entry.program_number())
+                {
+                    programs.insert(*state);
+                }
+                else
+                {
+                    programs[entry.pid()] = {entry.program_number(), {}};
+                    m_section_assemblers.erase(entry.pid());
+                }
+                pat.add_program_entry(entry.program_number(), entry.pid());
+            }
+        }
+        m_programs.swap(programs);
+
+        for (auto it = m_section_assemblers.begin();
+             it != m_section_assemblers.end();)
+        {
+            if (it->first != pat_pid() && m_programs.count(it->first) == 0)
+            {
+                it = m_section_assemblers.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        m_actions.fill(action::drop);
+        m_actions[pat_pid()] = action::pat;
+        for (auto pid : m_selected_pids)
+        {
+            m_actions[pid] = action::forward;
+        }
+        for (const auto& program : m_programs)
+        {
+            for (auto pid : program.second.m_pids)
+            {
+                m_actions[pid] = action::forward;
+            }
+        }
+        for (const auto& program : m_programs)
+        {
+            m_actions[program.first] = action::pmt;
+        }
+
+        if (!m_pat)
+            return;
+
+        // A new version is only announced if the table changed.
+        pat.set_version_number(m_version_number);
+        std::vector<uint8_t> section(pat.serialized_size());
+        pat.write(section.data(), section.size());
+        if (!m_pat_section.empty() && section != m_pat_section)
+        {
+            m_version_number = (m_version_number + 1) & 0x1F;
+            pat.set_version_number(m_version_number);
+            pat.write(section.data(), section.size());
+        }
+        m_pat_section = section;
+
+        m_pat_packet.fill(0xFF);
+        m_pat_packet[0] = 0x47;
+        m_pat_packet[1] = 0x40 | (pat_pid() >> 8);
+        m_pat_packet[2] = (uint8_t)pat_pid();
+        m_pat_packet[3] = 0x10;
+        m_pat_packet[4] = 0x00;
+        std::copy(section.begin(), section.end(), m_pat_packet.begin() + 5);
+    }
+
+    /// Writes the PAT in place of each packet starting a PAT section.
+    uint32_t write_pat(const ts_packet_view& packet, uint8_t* output)
+    {
+        if (m_pat_section.empty() || !packet.has_payload_field() ||
+            !packet.payload_unit_start_indicator())
+        {
+            return 0;
+        }
+
+        std::memcpy(output, m_pat_packet.data(), packet_size());
+        output[3] = 0x10 | m_pat_continuity_counter;
+        m_pat_continuity_counter = (m_pat_continuity_counter + 1) & 0x0F;
+        return packet_size();
+    }
+
+private:
+
+    std::array<action, 0x2000> m_actions;
+    std::vector<uint16_t> m_selected_programs;
+    std::vector<uint16_t> m_selected_pids;
+
+    boost::optional<mts::pat> m_pat;
+
+    /// The selected programs by their PMT PID.
+    std::map<uint16_t, program_state> m_programs;
+    std::map<uint16_t, section_assembler> m_section_assemblers;
+
+    std::vector<uint8_t> m_pat_section;
+    std::array<uint8_t, 188> m_pat_packet;
+    uint8_t m_pat_continuity_counter = 0;
+    uint8_t m_version_number = 0;
+};
+}
@@ -0,0 +1,496 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <system_error>
+#include <vector>
+
+#include <bnb/stream_reader.hpp>
+#include <boost/optional.hpp>
+
+#include "helper.hpp"
+#include "pat.hpp"
+#include "pes.hpp"
+#include "program.hpp"
+#include "section_assembler.hpp"
+#include "ts_packet_view.hpp"
+
+namespace mts
+{
+/// Index of the points of a transport stream file to start reading from.
+///
+/// The index is built by reading the packets of the file once, and records
+/// the offsets of the pes starts with their presentation timestamps, of the
+/// PCRs and of every new version of the PAT and PMT sections, which are
+/// needed to read the streams from any point. The timestamps are extended
+/// past their wrap around, so those of each PID grow through the file.
+///
+/// The index is stored in a compact binary form with write() and restored
+/// with parse().
+class random_access_index
+{
+public:
+
+    /// The start of a pes with a presentation timestamp.
+    struct pes_entry
+    {
+        uint64_t m_offset;
+
+        /// The presentation timestamp, in 90 kHz ticks.
+        uint64_t m_pts;
+        uint16_t m_pid;
+
+        /// Whether the random access indicator of the packet is set, i.e.
+        /// decoding can start from the pes.
+        bool m_random_access;
+    };
+
+    /// A packet with a PCR.
+    struct pcr_entry
+    {
+        uint64_t m_offset;
+
+        /// The PCR, in 27 MHz ticks.
+        uint64_t m_pcr;
+        uint16_t m_pid;
+    };
+
+    /// A new version of a PAT or PMT section.
+    struct section_entry
+    {
+        uint64_t m_offset;
+        uint16_t m_pid;
+        std::vector<uint8_t> m_section;
+    };
+
+    static uint32_t packet_size()
+    {
+        return 188U;
+    }
+
+    /// @return The version of the binary form.
+    static uint8_t version()
+    {
+        return 1U;
+    }
+
+public:
+
+    /// Restores an index from its binary form.
+    static boost::optional<random_access_index> parse(
+        const uint8_t* data, uint64_t size, std::error_code& error)
+    {
+        bnb::stream_reader<endian::big_endian> reader(data, size, error);
+        return parse(reader);
+    }
+
+    static boost::optional<random_access_index> parse(
+        bnb::stream_reader<endian::big_endian>& reader)
+    {
+        random_access_index index;
+
+        uint32_t magic = 0;
+        uint8_t version = 0;
+        reader.read_bytes<4>(magic).expect_eq(random_access_index::magic());
+        reader.read_bytes<1>(version).expect_eq(
+            random_access_index::version());
+        reader.read_bytes<8>(index.m_size);
+
+        uint32_t pes_count = 0;
+        reader.read_bytes<4>(pes_count);
+        for (uint32_t i = 0; i < pes_count && !reader.error(); ++i)
+        {
+            pes_entry entry;
+            uint16_t pid = 0;
+            reader.read_bytes<8>(entry.m_offset);
+            reader.read_bytes<8>(entry.m_pts);
+            reader.read_bytes<2>(pid);
+            entry.m_pid = pid & 0x1FFF;
+            entry.m_random_access = (pid & 0x8000) != 0;
+            index.m_pes_entries.push_back(entry);
+        }
+
+        uint32_t pcr_count = 0;
+        reader.read_bytes<4>(pcr_count);
+        for (uint32_t i = 0; i < pcr_count && !reader.error(); ++i)
+        {
+            pcr_entry entry;
+            reader.read_bytes<8>(entry.m_offset);
+            reader.read_bytes<8>(entry.m_pcr);
+            reader.read_bytes<2>(entry.m_pid);
+            index.m_pcr_entries.push_back(entry);
+        }
+
+        uint32_t section_count = 0;
+        reader.read_bytes<4>(section_count);
+        for (uint32_t i = 0; i < section_count && !reader.error(); ++i)
+        {
+            section_entry entry;
+            uint16_t section_size = 0;
+            reader.read_bytes<8>(entry.m_offset);
+            reader.read_bytes<2>(entry.m_pid);
+            reader.read_bytes<2>(section_size);
+            auto section_reader = reader.skip(section_size);
+            if (reader.error())
+                break;
+            entry.m_section.assign(
+                section_reader.data(), section_reader.data() + section_size);
+            index.m_section_entries.push_back(std::move(entry));
+        }
+
+        if (reader.error())
+            return boost::none;
+        return index;
+    }
+
+public:
+
+    /// Reads all whole packets in a buffer of consecutive packets, which
+    /// continue the packets read before. The offsets of the entries count
+    /// from the first packet read.
+    void read(const uint8_t* data, uint64_t size)
+    {
+        assert(data != nullptr || size == 0);
+
+        const uint8_t* end = data + (size - (size % packet_size()));
+        for (; data != end; data += packet_size())
+        {
+            std::error_code error;
+            read_packet(data, error);
+            m_size += packet_size();
+        }
+    }
+
+    /// @return The size of the packets read.
+    uint64_t size() const
+    {
+        return m_size;
+    }
+
+    const std::vector<pes_entry>& pes_entries() const
+    {
+        return m_pes_entries;
+    }
+
+    const std::vector<pcr_entry>& pcr_entries() const
+    {
+        return m_pcr_entries;
+    }
+
+    const std::vector<section_entry>& section_entries() const
+    {
+        return m_section_entries;
+    }
+
+    /// @return The size of the binary form written by write().
+    uint64_t serialized_size() const
+    {
+        uint64_t size = 4U + 1U + 8U + 4U + m_pes_entries.size() * 18U +
+                        4U + m_pcr_entries.size() * 18U + 4U;
+        for (const auto& entry : m_section_entries)
+        {
+            size += 12U + entry.m_section.size();
+        }
+        return size;
+    }
+
+    /// Writes the binary form of the index.
+    ///
+    /// @return The number of bytes written, i.e. serialized_size().
+    uint64_t write(uint8_t* data, uint64_t size) const
+    {
+        assert(data != nullptr);
+        assert(size >= serialized_size());
+        (void) size;
+
+        uint8_t* begin = data;
+        data = write_bytes(data, 4, magic());
+        data = write_bytes(data, 1, version());
+        data = write_bytes(data, 8, m_size);
+
+        data = write_bytes(data, 4, m_pes_entries.size());
+        for (const auto& entry : m_pes_entries)
+        {
+            data = write_bytes(data, 8, entry.m_offset);
+            data = write_bytes(data, 8, entry.m_pts);
+            data = write_bytes(
+                data, 2, entry.m_pid | (entry.m_random_access ? 0x8000 : 0));
+        }
+
+        data = write_bytes(data, 4, m_pcr_entries.size());
+        for (const auto& entry : m_pcr_entries)
+        {
+            data = write_bytes(data, 8, entry.m_offset);
+            data = write_bytes(data, 8, entry.m_pcr);
+            data = write_bytes(data, 2, entry.m_pid);
+        }
+
+        data = write_bytes(data, 4, m_section_entries.size());
+        for (const auto& entry : m_section_entries)
+        {
+            data = write_bytes(data, 8, entry.m_offset);
+            data = write_bytes(data, 2, entry.m_pid);
+            data = write_bytes(data, 2, entry.m_section.size());
+            data = std::copy(
+                entry.m_section.begin(), entry.m_section.end(), data);
+        }
+        return data - begin;
+    }
+
+private:
+
+    enum class pid_type : uint8_t
+    {
+        unknown,
+        pat,
+        program,
+        stream
+    };
+
+    static uint32_t magic()
+    {
+        // "MTSI"
+        return 0x4D545349U;
+    }
+
+    static uint8_t* write_bytes(uint8_t* data, uint32_t bytes, uint64_t value)
+    {
+        for (uint32_t i = 0; i < bytes; ++i)
+        {
+            data[i] = (uint8_t)(value >> (8 * (bytes - 1 - i)));
+        }
+        return data + bytes;
+    }
+
+    /// @return The value extended past its wrap around, closest to the
+    ///         previous extended value.
+    static uint64_t extend(uint64_t value, uint64_t previous, uint64_t period)
+    {
+        uint64_t base = previous - previous % period;
+        uint64_t extended = base + value;
+        if (extended + period / 2 < previous)
+            extended += period;
+        else if (extended > previous + period / 2 && extended >= period)
+            extended -= period;
+        return extended;
+    }
+
+private:
+
+    void read_packet(const uint8_t* data, std::error_code& error)
+    {
+        ts_packet_view packet(data);
+        packet.verify(error);
+        if (error)
+            return;
+
+        auto pid = packet.pid();
+        auto type = m_pid_types[pid];
+        bool random_access = false;
+        if (packet.has_adaptation_field() &&
+            packet.adaptation_field().length() != 0)
+        {
+            auto field = packet.adaptation_field();
+            field.verify(error);
+            if (error)
+                return;
+
+            // The flags and the 6 byte PCR.
+            random_access = field.random_access_indicator();
+            if (m_pcr_pids[pid] && field.length() >= 7 && field.pcr_flag())
+                read_pcr(pid, field.program_clock_reference());
+        }
+
+        if (!packet.has_payload_field())
+            return;
+
+        if (type == pid_type::stream)
+        {
+            if (packet.payload_unit_start_indicator())
+            {
+                read_pes_header(
+                    pid, packet.payload_data(), packet.payload_size(),
+                    random_access);
+            }
+            return;
+        }
+
+        if (type == pid_type::unknown)
+            return;
+
+        m_section_assemblers[pid].read(
+            packet.payload_data(), packet.payload_size(),
+            packet.payload_unit_start_indicator(),
+            packet.continuity_counter(),
+            [&](const uint8_t* section, uint32_t size)
+            {
+                read_section(pid, type, section, size, error);
+            }, error);
+    }
+
+    void read_pcr(uint16_t pid, uint64_t pcr)
+    {
+        const uint64_t period = (1ULL << 33) * 300U;
+        auto last = m_last_pcrs.find(pid);
+        pcr_entry entry;
+        entry.m_offset = m_size;
+        entry.m_pcr = last == m_last_pcrs.end() ?
+            pcr : extend(pcr, last->second, period);
+        entry.m_pid = pid;
+        m_pcr_entries.push_back(entry);
+
+        m_last_pcrs[pid] = entry.m_pcr;
+    }
+
+    /// Reads the presentation timestamp of a pes header in the payload of
+    /// its first packet.
+    void read_pes_header(
+        uint16_t pid, const uint8_t* payload, uint32_t size,
+        bool random_access)
+    {
+        // The start code, stream id, length and flags before the PTS. Only
+        // some streams have the optional header, which starts with the '10'
+        // marker bits.
+        if (size < 14 || payload[0] != 0x00 || payload[1] != 0x00 ||
+            payload[2] != 0x01 || !pes::has_optional_header(payload[3]) ||
+            (payload[6] & 0xC0) != 0x80 || (payload[7] & 0x80) == 0)
+        {
+            return;
+        }
+
+        auto data = payload + 9;
+        uint64_t pts = helper::read_timestamp(
+            (data[0] >> 1) & 0x07,
+            (uint16_t)((data[1] << 7) | (data[2] >> 1)),
+            (uint16_t)((data[3] << 7) | (data[4] >> 1)));
+
+        const uint64_t period = 1ULL << 33;
+        auto last = m_last_pts.find(pid);
+        pes_entry entry;
+        entry.m_offset = m_size;
+        entry.m_pts = last == m_last_pts.end() ?
+            pts : extend(pts, last->second, period);
+        entry.m_pid = pid;
+        entry.m_random_access = random_access;
+        m_pes_entries.push_back(entry);
+
+        m_last_pts[pid] = entry.m_pts;
+    }
+
+    void read_section(
+        uint16_t pid, pid_type type, const uint8_t* section, uint32_t size,
+        std::error_code& error)
+    {
+        // Only new versions of the sections are recorded.
+        auto& last_section = m_sections[pid];
+        if (last_section.size() == size &&
+            std::equal(section, section + size, last_section.begin()))
+        {
+            return;
+        }
+
+        if (type == pid_type::pat)
+        {
+            auto pat = mts::pat::parse(section, size, error);
+            if (error || !pat->current_next_indicator())
+                return;
+
+            // Keep what was learnt from the PMTs still listed.
+            std::map<uint16_t, std::vector<uint16_t>> programs;
+            for (const auto& entry : pat->program_entries())
+            {
+                if (entry.is_network_pid() || entry.pid() == 0 ||
+                    entry.pid() >= 0x1FFF)
+                {
+                    continue;
+                }
+                programs[entry.pid()] = m_programs[entry.pid()];
+            }
+            m_programs.swap(programs);
+        }
+        else
+        {
+            auto program = mts::program::parse(section, size, error);
+            if (error || !program->current_next_indicator())
+                return;
+
+            auto& pids = m_programs[pid];
+            pids.clear();
+            pids.push_back(program->pcr_pid());
+            for (const auto& stream : program->stream_entries())
+            {
+                pids.push_back(stream.pid());
+            }
+        }
+
+        last_section.assign(section, section + size);
+        m_section_entries.push_back({m_size, pid, last_section});
+        update_pid_types();
+    }
+
+    void update_pid_types()
+    {
+        m_pid_types.fill(pid_type::unknown);
+        m_pcr_pids.fill(false);
+        m_pid_types[0] = pid_type::pat;
+        for (const auto& program : m_programs)
+        {
+            m_pid_types[program.first] = pid_type::program;
+            if (program.second.empty())
+                continue;
+
+            auto pcr_pid = program.second.front();
+            if (pcr_pid != 0 && pcr_pid < 0x1FFF)
+                m_pcr_pids[pcr_pid] = true;
+            for (auto it = program.second.begin() + 1;
+                 it != program.second.end(); ++it)
+            {
+                if (*it < 0x1FFF && m_pid_types[*it] == pid_type::unknown)
+                    m_pid_types[*it] = pid_type::stream;
+            }
+        }
+    }
+
+private:
+
+    uint64_t m_size = 0;
+    std::vector<pes_entry> m_pes_entries;
+    std::vector<pcr_entry> m_pcr_entries;
+    std::vector<section_entry> m_section_entries;
+
+    // The state of the reading, which is not stored.
+    std::array<pid_type, 0x2000> m_pid_types = make_pid_types();
+    std::array<bool, 0x2000> m_pcr_pids = {};
+
+    /// The PCR PID followed by the stream PIDs of each program by its PMT
+    /// PID.
+    std::map<uint16_t, std::vector<uint16_t>> m_programs;
+    std::map<uint16_t, section_assembler> m_section_assemblers;
+
+    /// The last section read on each PAT and PMT PID.
+    std::map<uint16_t, std::vector<uint8_t>> m_sections;
+
+    /// The last extended PCR and PTS of each PID, as the clocks of the
+    /// programs are unrelated.
+    std::map<uint16_t, uint64_t> m_last_pcrs;
+    std::map<uint16_t, uint64_t> m_last_pts;
+
+private:
+
+    static std::array<pid_type, 0x2000> make_pid_types()
+    {
+        std::array<pid_type, 0x2000> types;
+        types.fill(pid_type::unknown);
+        types[0] = pid_type::pat;
+        return types;
+    }
+};
+}
@@ -0,0 +1,180 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <system_error>
+
+#include "error.hpp"
+#include "slice.hpp"
+
+namespace mts
+{
+/// Finds the transport stream packets of the datagrams of a UDP stream,
+/// which carry the packets either directly or behind an RTP header as in
+/// RFC 2250 and SMPTE 2022-2.
+///
+/// Each datagram is detected on its own, a datagram starting with the sync
+/// byte is raw UDP and one starting with RTP version 2 is RTP, which cannot
+/// be mistaken for each other. The RTP sequence numbers are tracked to
+/// count the datagrams lost on the way, and datagrams arriving late or
+/// twice are dropped.
+class rtp_depacketizer
+{
+public:
+
+    static uint32_t packet_size()
+    {
+        return 188U;
+    }
+
+    /// @return The size of the fixed part of the RTP header.
+    static uint32_t rtp_header_size()
+    {
+        return 12U;
+    }
+
+    /// @return The RTP payload type of MPEG-2 transport streams, though
+    ///         dynamic payload types are accepted as well.
+    static uint8_t mp2t_payload_type()
+    {
+        return 33U;
+    }
+
+public:
+
+    /// Finds the packets of a datagram.
+    ///
+    /// @return The packets, which are empty if the datagram is dropped or
+    ///         invalid.
+    slice read(const uint8_t* data, uint64_t size, std::error_code& error)
+    {
+        assert(data != nullptr || size == 0);
+        slice payload;
+        if (size == 0)
+        {
+            error = mts::error::invalid_datagram;
+            return payload;
+        }
+
+        if (data[0] == 0x47)
+        {
+            m_rtp = false;
+            payload = {data, size};
+        }
+        else if ((data[0] >> 6) == 2)
+        {
+            m_rtp = true;
+            payload = read_rtp(data, size, error);
+            if (error || payload.m_size == 0)
+                return slice();
+        }
+        else
+        {
+            error = mts::error::invalid_datagram;
+            return payload;
+        }
+
+        if (payload.m_size % packet_size() != 0 || payload.m_data[0] != 0x47)
+        {
+            error = mts::error::invalid_datagram;
+            return slice();
+        }
+        return payload;
+    }
+
+    /// @return Whether the last datagram read was RTP.
+    bool is_rtp() const
+    {
+        return m_rtp;
+    }
+
+    /// @return The number of datagrams missing from the RTP sequence
+    ///         numbers.
+    uint64_t lost_datagrams() const
+    {
+        return m_lost_datagrams;
+    }
+
+    /// @return The number of datagrams dropped because they arrived after a
+    ///         later datagram, or twice.
+    uint64_t late_datagrams() const
+    {
+        return m_late_datagrams;
+    }
+
+    /// Forgets the sequence number, keeping the counts.
+    void reset()
+    {
+        m_has_sequence_number = false;
+    }
+
+private:
+
+    slice read_rtp(const uint8_t* data, uint64_t size, std::error_code& error)
+    {
+        if (size < rtp_header_size())
+        {
+            error = mts::error::invalid_rtp_header;
+            return slice();
+        }
+
+        bool padding = (data[0] & 0x20) != 0;
+        bool extension = (data[0] & 0x10) != 0;
+        uint32_t csrc_count = data[0] & 0x0F;
+        uint16_t sequence_number = (uint16_t)((data[2] << 8) | data[3]);
+
+        uint64_t header_size = rtp_header_size() + 4U * csrc_count;
+        if (extension)
+        {
+            if (header_size + 4U > size)
+            {
+                error = mts::error::invalid_rtp_header;
+                return slice();
+            }
+            uint32_t length = (data[header_size + 2] << 8) |
+                              data[header_size + 3];
+            header_size += 4U + 4U * length;
+        }
+
+        uint64_t padding_size = padding ? data[size - 1] : 0U;
+        if (header_size + padding_size > size)
+        {
+            error = mts::error::invalid_rtp_header;
+            return slice();
+        }
+
+        if (m_has_sequence_number)
+        {
+            // The distance is taken modulo 2^16, where the upper half is
+            // behind the expected sequence number.
+            uint16_t distance = (uint16_t)(sequence_number - m_sequence_number);
+            if (distance >= 0x8000)
+            {
+                m_late_datagrams++;
+                return slice();
+            }
+            m_lost_datagrams += distance;
+        }
+        m_sequence_number = (uint16_t)(sequence_number + 1);
+        m_has_sequence_number = true;
+
+        return {data + header_size, size - header_size - padding_size};
+    }
+
+private:
+
+    bool m_rtp = false;
+
+    /// The sequence number expected next.
+    uint16_t m_sequence_number = 0;
+    bool m_has_sequence_number = false;
+
+    uint64_t m_lost_datagrams = 0;
+    uint64_t m_late_datagrams = 0;
+};
+}
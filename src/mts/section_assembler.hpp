@@ -0,0 +1,252 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <system_error>
+#include <vector>
+
+#include "crc32.hpp"
+#include "error.hpp"
+
+namespace mts
+{
+/// Assembles the PSI sections carried on a PID from the payloads of its
+/// packets.
+///
+/// Sections may span several packets and a packet may hold the end of one
+/// section followed by several new ones. Sections with the section syntax
+/// indicator set are checked with their CRC.
+///
+/// The tables are repeated continuously while rarely changing, so the
+/// assembler remembers the version and CRC of each section delivered, and a
+/// section identical to the one already delivered is skipped without
+/// computing its CRC.
+class section_assembler
+{
+public:
+
+    /// Callback invoked with each complete section, new or changed.
+    using on_section_callback =
+        std::function<void(const uint8_t* data, uint32_t size)>;
+
+    /// @return The largest size of a section, including its 3 byte header.
+    static uint32_t max_section_size()
+    {
+        return 4096U;
+    }
+
+public:
+
+    /// Reads the payload of a packet of the PID.
+    ///
+    /// @param payload The payload, starting with the pointer field if the
+    ///        payload unit start indicator is set.
+    void read(
+        const uint8_t* payload, uint32_t size,
+        bool payload_unit_start_indicator, uint8_t continuity_counter,
+        const on_section_callback& on_section, std::error_code& error)
+    {
+        assert(payload != nullptr || size == 0);
+        assert(continuity_counter < 16U);
+        assert(on_section);
+
+        if (m_has_continuity_counter)
+        {
+            // Duplicate packets are sent at most once, and carry the same
+            // data as the previous packet.
+            if (continuity_counter == m_continuity_counter)
+                return;
+
+            if (continuity_counter != ((m_continuity_counter + 1) & 0x0F))
+                drop();
+        }
+        m_continuity_counter = continuity_counter;
+        m_has_continuity_counter = true;
+
+        const uint8_t* end = payload + size;
+        if (!payload_unit_start_indicator)
+        {
+            append(payload, end, on_section, error);
+            return;
+        }
+
+        if (size == 0)
+            return;
+
+        // The pointer field gives the start of the first new section, the
+        // bytes before it end the current section.
+        uint8_t pointer_field = *payload++;
+        if (pointer_field > end - payload)
+        {
+            drop();
+            return;
+        }
+        append(payload, payload + pointer_field, on_section, error);
+        drop();
+
+        m_collecting = true;
+        append(payload, end, on_section, error);
+    }
+
+    /// Drops the section being assembled and forgets the sections delivered,
+    /// so they are delivered again.
+    void reset()
+    {
+        drop();
+        m_has_continuity_counter = false;
+        m_delivered.clear();
+    }
+
+    /// @return The number of sections skipped because they were identical
+    ///         to the section delivered.
+    uint64_t repeated_sections() const
+    {
+        return m_repeated_sections;
+    }
+
+private:
+
+    /// The identity of a delivered section.
+    struct section_key
+    {
+        uint8_t m_table_id;
+        uint16_t m_table_id_extension;
+        uint8_t m_section_number;
+
+        /// The version number and current next indicator byte.
+        uint8_t m_version;
+        uint32_t m_crc;
+    };
+
+private:
+
+    void drop()
+    {
+        m_buffer.clear();
+        m_collecting = false;
+    }
+
+    /// @return The size of the section being assembled, requires its header.
+    uint32_t section_size() const
+    {
+        assert(m_buffer.size() >= 3);
+        return 3U + (((m_buffer[1] & 0x0F) << 8) | m_buffer[2]);
+    }
+
+    void append(
+        const uint8_t*& data, const uint8_t* end,
+        const on_section_callback& on_section, std::error_code& error)
+    {
+        while (m_collecting && data < end)
+        {
+            // The rest of the packet is stuffing.
+            if (m_buffer.empty() && *data == 0xFF)
+            {
+                m_collecting = false;
+                return;
+            }
+
+            uint32_t needed = m_buffer.size() < 3 ? 3U : section_size();
+            auto count =
+                std::min<uint64_t>(needed - m_buffer.size(), end - data);
+            m_buffer.insert(m_buffer.end(), data, data + count);
+            data += count;
+
+            if (m_buffer.size() < 3)
+                return;
+
+            if (section_size() > max_section_size())
+            {
+                error = mts::error::invalid_section_length;
+                drop();
+                return;
+            }
+
+            if (m_buffer.size() == section_size())
+            {
+                complete(on_section, error);
+                m_buffer.clear();
+            }
+        }
+    }
+
+    void complete(const on_section_callback& on_section, std::error_code& error)
+    {
+        const uint8_t* data = m_buffer.data();
+        uint32_t size = (uint32_t)m_buffer.size();
+
+        bool section_syntax_indicator = (data[1] & 0x80) != 0;
+        if (!section_syntax_indicator)
+        {
+            on_section(data, size);
+            return;
+        }
+
+        // The long header and the CRC.
+        if (size < 12U)
+        {
+            error = mts::error::invalid_section_length;
+            return;
+        }
+
+        section_key key;
+        key.m_table_id = data[0];
+        key.m_table_id_extension = (data[3] << 8) | data[4];
+        key.m_version = data[5];
+        key.m_section_number = data[6];
+        key.m_crc = ((uint32_t)data[size - 4] << 24) |
+                    ((uint32_t)data[size - 3] << 16) |
+                    ((uint32_t)data[size - 2] << 8) | data[size - 1];
+
+        auto delivered = std::find_if(
+            m_delivered.begin(), m_delivered.end(),
+            [&key](const section_key& other)
+            {
+                return other.m_table_id == key.m_table_id &&
+                       other.m_table_id_extension ==
+                           key.m_table_id_extension &&
+                       other.m_section_number == key.m_section_number;
+            });
+
+        if (delivered != m_delivered.end() &&
+            delivered->m_version == key.m_version &&
+            delivered->m_crc == key.m_crc)
+        {
+            m_repeated_sections++;
+            return;
+        }
+
+        if (crc32::compute(data, size) != 0)
+        {
+            error = mts::error::invalid_crc;
+            return;
+        }
+
+        if (delivered != m_delivered.end())
+        {
+            *delivered = key;
+        }
+        else
+        {
+            m_delivered.push_back(key);
+        }
+        on_section(data, size);
+    }
+
+private:
+
+    std::vector<uint8_t> m_buffer;
+    bool m_collecting = false;
+    uint8_t m_continuity_counter = 0;
+    bool m_has_continuity_counter = false;
+    std::vector<section_key> m_delivered;
+    uint64_t m_repeated_sections = 0;
+};
+}
@@ -0,0 +1,263 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "parser.hpp"
+#include "random_access_index.hpp"
+
+namespace mts
+{
+/// Reads a transport stream file, e.g. a memory mapped file, from any point
+/// in time using its random_access_index.
+///
+/// The time is found by a binary search of the PCRs of a program, and the
+/// reading starts at the last random access point before it. Since the PSI
+/// is usually far behind, the parser is primed with the PAT and PMT
+/// sections in effect at that point, so it recognizes the streams right
+/// away.
+///
+/// The PCRs are expected to increase through the file, i.e. times after a
+/// PCR discontinuity are not found.
+class seekable_reader
+{
+public:
+
+    static uint32_t packet_size()
+    {
+        return 188U;
+    }
+
+public:
+
+    /// @param data The packets the index was built from, which must be
+    ///        kept alive while reading.
+    /// @param size The size of the packets.
+    /// @param index The index, which must be kept alive while reading.
+    seekable_reader(
+        const uint8_t* data, uint64_t size,
+        const random_access_index& index) :
+        m_data(data),
+        m_size(size),
+        m_index(index)
+    {
+        assert(data != nullptr || size == 0);
+        assert(index.size() <= size);
+
+        const auto& pcrs = m_index.pcr_entries();
+        set_pcr_pid(pcrs.empty() ? 0x1FFF : pcrs.front().m_pid);
+
+        for (const auto& entry : m_index.pes_entries())
+        {
+            if (entry.m_random_access)
+            {
+                m_has_random_access = true;
+                break;
+            }
+        }
+    }
+
+    /// Sets the PID of the PCRs the time is measured with, by default the
+    /// PID of the first PCR.
+    void set_pcr_pid(uint16_t pid)
+    {
+        m_pcr_pid = pid;
+        m_pcrs.clear();
+        for (const auto& entry : m_index.pcr_entries())
+        {
+            if (entry.m_pid == pid)
+                m_pcrs.push_back(&entry);
+        }
+    }
+
+    uint16_t pcr_pid() const
+    {
+        return m_pcr_pid;
+    }
+
+    /// @return The time between the first and the last PCR, in 27 MHz
+    ///         ticks.
+    uint64_t duration() const
+    {
+        if (m_pcrs.empty())
+            return 0;
+        return m_pcrs.back()->m_pcr - m_pcrs.front()->m_pcr;
+    }
+
+    /// Finds the packet to start reading from to reach a time.
+    ///
+    /// @param time The time since the first PCR, in 27 MHz ticks.
+    /// @return The offset of the last random access point at or before the
+    ///         last PCR at or before the time, or of the last pes start if
+    ///         the stream has no random access indicators.
+    uint64_t find(uint64_t time) const
+    {
+        return find(time, 0x1FFF);
+    }
+
+    /// Finds the packet to start reading a stream from to reach a time,
+    /// e.g. the last key frame of a video stream.
+    ///
+    /// @param time The time since the first PCR, in 27 MHz ticks.
+    /// @param pid The PID of the stream, or 0x1FFF for any stream.
+    uint64_t find(uint64_t time, uint16_t pid) const
+    {
+        if (m_pcrs.empty())
+            return 0;
+
+        uint64_t pcr = m_pcrs.front()->m_pcr + time;
+        auto pcr_entry = std::upper_bound(
+            m_pcrs.begin(), m_pcrs.end(), pcr,
+            [](uint64_t value, const random_access_index::pcr_entry* entry)
+            {
+                return value < entry->m_pcr;
+            });
+        if (pcr_entry == m_pcrs.begin())
+            return 0;
+        uint64_t offset = (*(pcr_entry - 1))->m_offset;
+
+        const auto& pes_entries = m_index.pes_entries();
+        auto pes_entry = std::upper_bound(
+            pes_entries.begin(), pes_entries.end(), offset,
+            [](uint64_t value, const random_access_index::pes_entry& entry)
+            {
+                return value < entry.m_offset;
+            });
+        while (pes_entry != pes_entries.begin())
+        {
+            --pes_entry;
+            if (pid != 0x1FFF && pes_entry->m_pid != pid)
+                continue;
+            if (pes_entry->m_random_access || !m_has_random_access)
+                return pes_entry->m_offset;
+        }
+        return 0;
+    }
+
+    /// Resets the parser and feeds it the PAT and PMT sections in effect at
+    /// an offset, after which the packets from the offset can be read.
+    void prime(mts::parser& parser, uint64_t offset) const
+    {
+        assert(offset % packet_size() == 0);
+        assert(offset <= m_index.size() && offset <= m_size);
+        assert(parser.packet_format() == mts::packet_format::ts);
+
+        parser.reset();
+
+        // The latest section on each PID, of which the PAT is read first
+        // as the PMTs are ignored until their programs are known.
+        using section_entry = random_access_index::section_entry;
+        std::map<uint16_t, const section_entry*> sections;
+        for (const auto& entry : m_index.section_entries())
+        {
+            if (entry.m_offset > offset)
+                break;
+            sections[entry.m_pid] = &entry;
+        }
+
+        for (const auto& item : sections)
+        {
+            write_section(parser, *item.second, offset);
+        }
+    }
+
+    /// Seeks to a time, see find(), and primes the parser for reading from
+    /// there.
+    ///
+    /// @return The offset of the packet to read from.
+    uint64_t seek(
+        mts::parser& parser, uint64_t time, uint16_t pid = 0x1FFF) const
+    {
+        auto offset = find(time, pid);
+        prime(parser, offset);
+        return offset;
+    }
+
+private:
+
+    /// Feeds a section to the parser in packets on its PID. The packets
+    /// continue the continuity counter of the last packet of the PID before
+    /// the offset, so the packets read from the offset follow them.
+    void write_section(
+        mts::parser& parser, const random_access_index::section_entry& entry,
+        uint64_t offset) const
+    {
+        const auto& section = entry.m_section;
+        uint32_t payload_size = packet_size() - 4U;
+        uint32_t packets =
+            (uint32_t)((section.size() + 1U + payload_size - 1U) /
+                       payload_size);
+        uint8_t continuity_counter =
+            (last_continuity_counter(entry, offset) - packets + 1) & 0x0F;
+
+        std::error_code error;
+        std::array<uint8_t, 188> packet;
+        uint64_t written = 0;
+        for (uint32_t i = 0; i < packets; ++i)
+        {
+            packet.fill(0xFF);
+            packet[0] = 0x47;
+            packet[1] =
+                (uint8_t)((i == 0 ? 0x40 : 0x00) | (entry.m_pid >> 8));
+            packet[2] = (uint8_t)entry.m_pid;
+            packet[3] = 0x10 | continuity_counter;
+
+            auto payload = packet.data() + 4;
+            if (i == 0)
+            {
+                // The pointer field.
+                *payload++ = 0x00;
+            }
+            auto count = std::min<uint64_t>(
+                section.size() - written,
+                packet.data() + packet_size() - payload);
+            std::memcpy(payload, section.data() + written, count);
+            written += count;
+
+            parser.read(packet.data(), error);
+            error.clear();
+            continuity_counter = (continuity_counter + 1) & 0x0F;
+        }
+    }
+
+    /// @return The continuity counter of the last packet of the PID of a
+    ///         section before the offset, which is at the latest the packet
+    ///         completing the section.
+    uint8_t last_continuity_counter(
+        const random_access_index::section_entry& entry, uint64_t offset) const
+    {
+        assert(entry.m_offset <= offset);
+        uint64_t position = offset;
+        while (position > entry.m_offset)
+        {
+            position -= packet_size();
+            auto packet = m_data + position;
+            if ((((packet[1] & 0x1F) << 8) | packet[2]) == entry.m_pid)
+                break;
+        }
+        return m_data[position + 3] & 0x0F;
+    }
+
+private:
+
+    const uint8_t* m_data;
+    uint64_t m_size;
+    const random_access_index& m_index;
+
+    /// The PCRs of the PCR PID.
+    uint16_t m_pcr_pid = 0x1FFF;
+    std::vector<const random_access_index::pcr_entry*> m_pcrs;
+
+    bool m_has_random_access = false;
+};
+}
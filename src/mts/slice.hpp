@@ -0,0 +1,19 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cstdint>
+
+namespace mts
+{
+/// A view of a contiguous range of bytes owned by someone else, similar to
+/// struct iovec.
+struct slice
+{
+    const uint8_t* m_data = nullptr;
+    uint64_t m_size = 0;
+};
+}
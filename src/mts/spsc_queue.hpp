@@ -0,0 +1,147 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace mts
+{
+/// Bounded lock-free queue for a single producer thread and a single
+/// consumer thread.
+///
+/// Each side keeps a cached copy of the other side's index, so the shared
+/// indices are only read when the queue appears full or empty.
+template<class T>
+class spsc_queue
+{
+public:
+
+    /// @param capacity The number of elements, must be a power of two.
+    spsc_queue(uint32_t capacity) :
+        m_elements(capacity),
+        m_mask(capacity - 1)
+    {
+        assert(capacity > 0);
+        assert((capacity & m_mask) == 0 && "Capacity must be a power of two");
+    }
+
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    /// Producer side. Returns a pointer to the next free element, or nullptr
+    /// if the queue is full. The element is not visible to the consumer
+    /// until commit_push() is called.
+    T* try_reserve()
+    {
+        auto tail = m_producer.m_index.load(std::memory_order_relaxed);
+        if (tail - m_producer.m_cached_index == m_elements.size())
+        {
+            m_producer.m_cached_index =
+                m_consumer.m_index.load(std::memory_order_acquire);
+            if (tail - m_producer.m_cached_index == m_elements.size())
+                return nullptr;
+        }
+        return &m_elements[tail & m_mask];
+    }
+
+    /// Producer side. Publishes the element returned by try_reserve().
+    void commit_push()
+    {
+        auto tail = m_producer.m_index.load(std::memory_order_relaxed);
+        m_producer.m_index.store(tail + 1, std::memory_order_release);
+    }
+
+    /// Producer side.
+    bool try_push(const T& element)
+    {
+        auto slot = try_reserve();
+        if (slot == nullptr)
+            return false;
+        *slot = element;
+        commit_push();
+        return true;
+    }
+
+    /// Consumer side. Returns a pointer to the oldest element, or nullptr if
+    /// the queue is empty. The element stays valid until commit_pop() is
+    /// called.
+    T* front()
+    {
+        auto head = m_consumer.m_index.load(std::memory_order_relaxed);
+        if (head == m_consumer.m_cached_index)
+        {
+            m_consumer.m_cached_index =
+                m_producer.m_index.load(std::memory_order_acquire);
+            if (head == m_consumer.m_cached_index)
+                return nullptr;
+        }
+        return &m_elements[head & m_mask];
+    }
+
+    /// Consumer side. Releases the element returned by front().
+    void commit_pop()
+    {
+        auto head = m_consumer.m_index.load(std::memory_order_relaxed);
+        m_consumer.m_index.store(head + 1, std::memory_order_release);
+    }
+
+    /// Consumer side.
+    bool try_pop(T& element)
+    {
+        auto slot = front();
+        if (slot == nullptr)
+            return false;
+        element = *slot;
+        commit_pop();
+        return true;
+    }
+
+    /// @return The number of elements in the queue, only exact when neither
+    ///         side is active.
+    uint64_t size() const
+    {
+        return m_producer.m_index.load(std::memory_order_acquire) -
+               m_consumer.m_index.load(std::memory_order_acquire);
+    }
+
+    uint64_t capacity() const
+    {
+        return m_elements.size();
+    }
+
+private:
+
+    /// The size of the padding separating the sides, two cache lines as the
+    /// adjacent line is prefetched together with a line on x86.
+    enum : uint32_t
+    {
+        padding_size = 128
+    };
+
+    /// The index of a side and its cached copy of the other side's index,
+    /// padded so the indices of the two sides are padding_size bytes apart.
+    /// The queue may be allocated without its alignment being honoured, so
+    /// the padding does not rely on alignas.
+    struct side
+    {
+        std::atomic<uint64_t> m_index{0};
+        uint64_t m_cached_index = 0;
+        uint8_t m_padding[padding_size - 2 * sizeof(uint64_t)];
+    };
+
+private:
+
+    std::vector<T> m_elements;
+    const uint64_t m_mask;
+    uint8_t m_padding[padding_size];
+
+    side m_producer;
+    side m_consumer;
+};
+}
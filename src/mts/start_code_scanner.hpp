@@ -0,0 +1,122 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#define MTS_START_CODE_SCANNER_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MTS_START_CODE_SCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace mts
+{
+/// Finds the 0x000001 start code prefixes of H.264 and HEVC byte streams.
+/// The search is vectorized with AVX2 or SSE2 when the compiler targets
+/// them, comparing a block against the three bytes of the prefix at once,
+/// otherwise a scalar search is used.
+struct start_code_scanner
+{
+    /// @return The offset of the first start code prefix, or size if no
+    ///         prefix is found.
+    static uint64_t find(const uint8_t* data, uint64_t size)
+    {
+        assert(data != nullptr || size == 0);
+
+        uint64_t offset = 0;
+#if defined(MTS_START_CODE_SCANNER_AVX2)
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi8(1);
+        for (; offset + 2 + 32 <= size; offset += 32)
+        {
+            auto block = data + offset;
+            __m256i first = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(block));
+            __m256i second = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(block + 1));
+            __m256i third = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(block + 2));
+            __m256i match = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_cmpeq_epi8(first, zero),
+                    _mm256_cmpeq_epi8(second, zero)),
+                _mm256_cmpeq_epi8(third, one));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+            if (mask != 0)
+            {
+                return offset + count_trailing_zeros(mask);
+            }
+        }
+#elif defined(MTS_START_CODE_SCANNER_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi8(1);
+        for (; offset + 2 + 16 <= size; offset += 16)
+        {
+            auto block = data + offset;
+            __m128i first = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(block));
+            __m128i second = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(block + 1));
+            __m128i third = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(block + 2));
+            __m128i match = _mm_and_si128(
+                _mm_and_si128(
+                    _mm_cmpeq_epi8(first, zero),
+                    _mm_cmpeq_epi8(second, zero)),
+                _mm_cmpeq_epi8(third, one));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+            if (mask != 0)
+            {
+                return offset + count_trailing_zeros(mask);
+            }
+        }
+#endif
+        // A prefix ends at the third byte, so when that byte is above one
+        // no prefix ends at the next two bytes either.
+        while (offset + 2 < size)
+        {
+            uint8_t third = data[offset + 2];
+            if (third > 1)
+            {
+                offset += 3;
+            }
+            else if (third == 1 && data[offset] == 0 &&
+                     data[offset + 1] == 0)
+            {
+                return offset;
+            }
+            else
+            {
+                offset++;
+            }
+        }
+        return size;
+    }
+
+private:
+
+    static uint32_t count_trailing_zeros(uint32_t value)
+    {
+        assert(value != 0);
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward(&index, value);
+        return (uint32_t)index;
+#else
+        return (uint32_t)__builtin_ctz(value);
+#endif
+    }
+};
+}
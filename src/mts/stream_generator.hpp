@@ -0,0 +1,572 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "crc32.hpp"
+#include "helper.hpp"
+#include "stream_type.hpp"
+
+namespace mts
+{
+/// Generates a synthetic transport stream, e.g. for benchmarks and tests
+/// which should not depend on sample files.
+///
+/// The stream has a number of programs, each with a PMT and a number of
+/// elementary streams: an AVC video stream carrying the PCR, followed by
+/// ADTS audio streams. The packets of the streams are interleaved at random,
+/// and the PAT and the PMTs are repeated at an interval. The pes payloads
+/// are random bytes, in the video streams split into NAL units by start
+/// codes. Optionally packets carry adaptation fields, stream packets are
+/// lost and garbage is inserted between packets.
+///
+/// The output only depends on the seed and the settings, also across
+/// platforms, as the generator does not use the distributions of the
+/// standard library.
+class stream_generator
+{
+public:
+
+    static uint32_t packet_size()
+    {
+        return 188U;
+    }
+
+    /// @return The largest number of programs, which fit in a PAT in a
+    ///         single packet.
+    static uint32_t max_programs()
+    {
+        return (184U - 1U - 8U - 4U) / 4U;
+    }
+
+    /// @return The largest number of streams of a program, which fit in a
+    ///         PMT in a single packet.
+    static uint32_t max_streams()
+    {
+        return (184U - 1U - 12U - 4U) / 5U;
+    }
+
+    /// @return The time between two packets in 27 MHz ticks, corresponding
+    ///         to a multiplex of 20 Mbit/s.
+    static uint64_t packet_ticks()
+    {
+        return 2030U;
+    }
+
+    /// @return The PID of the PMT of a program, counted from zero.
+    static uint16_t pmt_pid(uint32_t program)
+    {
+        assert(program < max_programs());
+        return (uint16_t)(0x1000U + program);
+    }
+
+    /// @return The PID of a stream of a program, both counted from zero.
+    ///         The first stream of each program is the video stream.
+    static uint16_t stream_pid(uint32_t program, uint32_t stream)
+    {
+        assert(program < max_programs());
+        assert(stream < max_streams());
+        return (uint16_t)(0x100U + program * 0x40U + stream);
+    }
+
+public:
+
+    explicit stream_generator(uint64_t seed = 1) :
+        m_random(seed == 0 ? 1 : seed)
+    {
+    }
+
+    /// The settings must be given before generating the first packets.
+    void set_programs(uint32_t programs)
+    {
+        assert(programs > 0 && programs <= max_programs());
+        assert(!m_started);
+        m_programs = programs;
+    }
+
+    uint32_t programs() const
+    {
+        return m_programs;
+    }
+
+    /// Sets the number of elementary streams of each program, so the
+    /// stream carries programs() * (streams() + 1) + 1 PIDs in total.
+    void set_streams(uint32_t streams)
+    {
+        assert(streams > 0 && streams <= max_streams());
+        assert(!m_started);
+        m_streams = streams;
+    }
+
+    uint32_t streams() const
+    {
+        return m_streams;
+    }
+
+    /// Sets the range of the payload sizes of the pes, which are chosen
+    /// uniformly within it.
+    void set_pes_size(uint32_t min_size, uint32_t max_size)
+    {
+        assert(min_size > 0 && min_size <= max_size);
+        assert(!m_started);
+        m_min_pes_size = min_size;
+        m_max_pes_size = max_size;
+    }
+
+    uint32_t min_pes_size() const
+    {
+        return m_min_pes_size;
+    }
+
+    uint32_t max_pes_size() const
+    {
+        return m_max_pes_size;
+    }
+
+    /// Sets the fraction of the stream packets carrying an adaptation field
+    /// besides those needed for the PCR and for stuffing the last packet
+    /// of each pes.
+    void set_adaptation_field_rate(double rate)
+    {
+        assert(rate >= 0.0 && rate <= 1.0);
+        assert(!m_started);
+        m_adaptation_field_rate = rate;
+    }
+
+    double adaptation_field_rate() const
+    {
+        return m_adaptation_field_rate;
+    }
+
+    /// Sets the fraction of the stream packets which are lost, i.e. left
+    /// out of the output. The PAT and the PMTs are never lost.
+    void set_loss_rate(double rate)
+    {
+        assert(rate >= 0.0 && rate < 1.0);
+        assert(!m_started);
+        m_loss_rate = rate;
+    }
+
+    double loss_rate() const
+    {
+        return m_loss_rate;
+    }
+
+    /// Sets the fraction of the packets preceded by garbage, i.e. between 1
+    /// and packet_size() random bytes, which may contain sync bytes.
+    void set_garbage_rate(double rate)
+    {
+        assert(rate >= 0.0 && rate <= 1.0);
+        assert(!m_started);
+        m_garbage_rate = rate;
+    }
+
+    double garbage_rate() const
+    {
+        return m_garbage_rate;
+    }
+
+    /// Sets the number of stream packets between the repetitions of the
+    /// PAT and the PMTs, which are also written first.
+    void set_psi_interval(uint32_t packets)
+    {
+        assert(packets > 0);
+        assert(!m_started);
+        m_psi_interval = packets;
+    }
+
+    uint32_t psi_interval() const
+    {
+        return m_psi_interval;
+    }
+
+    /// Generates a number of packets, including the lost ones, and appends
+    /// them to the output. The stream continues where the previous call
+    /// ended.
+    void generate(uint64_t packets, std::vector<uint8_t>& output)
+    {
+        if (!m_started)
+            start();
+
+        output.reserve(output.size() + packets * packet_size());
+        std::array<uint8_t, 188> packet;
+        for (uint64_t i = 0; i < packets; ++i)
+        {
+            auto psi_packets = m_psi.size() / packet_size();
+            if (m_psi_index == psi_packets && m_stream_packets == m_next_psi)
+            {
+                m_psi_index = 0;
+                m_next_psi += m_psi_interval;
+            }
+
+            bool lost = false;
+            if (m_psi_index < psi_packets)
+            {
+                write_psi(packet.data());
+            }
+            else
+            {
+                auto index = (uint32_t)uniform(m_states.size());
+                write_stream(m_states[index], packet.data());
+                lost = chance(m_loss_rate);
+            }
+            m_packets++;
+
+            if (lost)
+            {
+                m_lost_packets++;
+                continue;
+            }
+
+            if (chance(m_garbage_rate))
+            {
+                auto size = 1U + (uint32_t)uniform(packet_size());
+                auto offset = output.size();
+                output.resize(offset + size);
+                fill(output.data() + offset, size, false);
+                m_garbage_bytes += size;
+            }
+            output.insert(output.end(), packet.begin(), packet.end());
+        }
+    }
+
+    /// @return The number of packets generated, including the lost ones.
+    uint64_t packets() const
+    {
+        return m_packets;
+    }
+
+    uint64_t lost_packets() const
+    {
+        return m_lost_packets;
+    }
+
+    uint64_t garbage_bytes() const
+    {
+        return m_garbage_bytes;
+    }
+
+    /// @return The number of pes started, over all streams.
+    uint64_t pes_count() const
+    {
+        return m_pes_count;
+    }
+
+private:
+
+    struct stream_state
+    {
+        uint16_t m_pid;
+        uint8_t m_stream_id;
+        bool m_video;
+        bool m_pcr;
+        uint8_t m_continuity_counter;
+
+        /// The pes being written, including its header.
+        std::vector<uint8_t> m_pes;
+        uint64_t m_offset;
+    };
+
+private:
+
+    void start()
+    {
+        m_started = true;
+        for (uint32_t program = 0; program < m_programs; ++program)
+        {
+            for (uint32_t stream = 0; stream < m_streams; ++stream)
+            {
+                stream_state state;
+                state.m_pid = stream_pid(program, stream);
+                state.m_video = stream == 0;
+                state.m_pcr = stream == 0;
+                state.m_stream_id = (uint8_t)(
+                    state.m_video ? 0xE0U : 0xC0U + (stream - 1) % 32U);
+                state.m_continuity_counter = 0;
+                state.m_offset = 0;
+                m_states.push_back(std::move(state));
+            }
+        }
+        build_psi();
+        m_psi_index = m_psi.size() / packet_size();
+    }
+
+    void build_psi()
+    {
+        std::vector<uint8_t> pat =
+        {
+            0x00, 0x00, 0x00, 0x00, 0x01, 0xC1, 0x00, 0x00
+        };
+        for (uint32_t program = 0; program < m_programs; ++program)
+        {
+            auto program_number = (uint16_t)(program + 1);
+            auto pid = pmt_pid(program);
+            pat.insert(pat.end(), {
+                (uint8_t)(program_number >> 8), (uint8_t)program_number,
+                (uint8_t)(0xE0 | (pid >> 8)), (uint8_t)pid });
+        }
+        write_section_packet(0, pat);
+
+        for (uint32_t program = 0; program < m_programs; ++program)
+        {
+            auto program_number = (uint16_t)(program + 1);
+            auto pcr_pid = stream_pid(program, 0);
+            std::vector<uint8_t> pmt =
+            {
+                0x02, 0x00, 0x00,
+                (uint8_t)(program_number >> 8), (uint8_t)program_number,
+                0xC1, 0x00, 0x00,
+                (uint8_t)(0xE0 | (pcr_pid >> 8)), (uint8_t)pcr_pid,
+                0xF0, 0x00
+            };
+            for (uint32_t stream = 0; stream < m_streams; ++stream)
+            {
+                auto type = stream == 0 ?
+                    mts::stream_type::avc_video_stream :
+                    mts::stream_type::adts_transport_13818_7;
+                auto pid = stream_pid(program, stream);
+                pmt.insert(pmt.end(), {
+                    (uint8_t)type, (uint8_t)(0xE0 | (pid >> 8)),
+                    (uint8_t)pid, 0xF0, 0x00 });
+            }
+            write_section_packet(pmt_pid(program), pmt);
+        }
+        m_psi_continuity_counters.resize(m_programs + 1, 0);
+    }
+
+    /// Fills in the length and the CRC of a section, and appends it as a
+    /// packet to the PSI, where the continuity counter is set when written.
+    void write_section_packet(uint16_t pid, std::vector<uint8_t>& section)
+    {
+        auto length = section.size() - 3 + 4;
+        section[1] = (uint8_t)(0xB0 | (length >> 8));
+        section[2] = (uint8_t)length;
+        auto crc = crc32::compute(section.data(), section.size());
+        section.insert(section.end(), {
+            (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8),
+            (uint8_t)crc });
+        assert(section.size() + 5 <= packet_size());
+
+        auto offset = m_psi.size();
+        m_psi.resize(offset + packet_size(), 0xFF);
+        auto packet = m_psi.data() + offset;
+        packet[0] = 0x47;
+        packet[1] = (uint8_t)(0x40 | (pid >> 8));
+        packet[2] = (uint8_t)pid;
+        packet[3] = 0x10;
+        packet[4] = 0; // pointer field
+        std::copy(section.begin(), section.end(), packet + 5);
+    }
+
+    void write_psi(uint8_t* packet)
+    {
+        std::memcpy(packet, m_psi.data() + m_psi_index * packet_size(),
+                    packet_size());
+        auto& continuity_counter = m_psi_continuity_counters[m_psi_index];
+        packet[3] |= continuity_counter;
+        continuity_counter = (continuity_counter + 1) & 0x0F;
+        m_psi_index++;
+    }
+
+    void write_stream(stream_state& state, uint8_t* packet)
+    {
+        m_stream_packets++;
+        bool first = state.m_offset == state.m_pes.size();
+        if (first)
+            start_pes(state);
+
+        auto remaining = state.m_pes.size() - state.m_offset;
+        bool pcr = first && state.m_pcr;
+
+        // The length byte, the flags and the PCR, or the length byte, the
+        // flags and up to 14 bytes of stuffing.
+        uint32_t adaptation_size = 0;
+        if (pcr)
+            adaptation_size = 8U;
+        else if (chance(m_adaptation_field_rate))
+            adaptation_size = 2U + (uint32_t)uniform(15);
+
+        uint32_t count = (uint32_t)std::min<uint64_t>(
+            184U - adaptation_size, remaining);
+        adaptation_size = 184U - count;
+
+        packet[0] = 0x47;
+        packet[1] = (uint8_t)((first ? 0x40 : 0x00) | (state.m_pid >> 8));
+        packet[2] = (uint8_t)state.m_pid;
+        packet[3] = (uint8_t)(
+            (adaptation_size != 0 ? 0x30 : 0x10) | state.m_continuity_counter);
+        state.m_continuity_counter = (state.m_continuity_counter + 1) & 0x0F;
+
+        uint8_t* data = packet + 4;
+        if (adaptation_size != 0)
+        {
+            data[0] = (uint8_t)(adaptation_size - 1);
+            if (adaptation_size > 1)
+            {
+                uint32_t offset = 2;
+                data[1] = (uint8_t)(
+                    (pcr ? 0x10 : 0x00) |
+                    (first && state.m_video ? 0x40 : 0x00));
+                if (pcr)
+                {
+                    auto clock = m_packets * packet_ticks();
+                    helper::write_clock_reference(
+                        clock % pcr_period(), data + offset);
+                    offset += 6;
+                }
+                std::memset(data + offset, 0xFF, adaptation_size - offset);
+            }
+            data += adaptation_size;
+        }
+
+        std::memcpy(data, state.m_pes.data() + state.m_offset, count);
+        state.m_offset += count;
+    }
+
+    void start_pes(stream_state& state)
+    {
+        m_pes_count++;
+        auto size = m_min_pes_size +
+            (uint32_t)uniform(m_max_pes_size - m_min_pes_size + 1U);
+
+        // The decoding time trails the clock of the multiplex by 100 ms,
+        // and video is presented a frame after it is decoded.
+        auto dts = (m_packets * packet_ticks() / 300U + 9000U) & pts_mask();
+        auto pts = state.m_video ? (dts + 3003U) & pts_mask() : dts;
+        uint32_t header_data_length = state.m_video ? 10U : 5U;
+
+        auto& pes = state.m_pes;
+        pes.resize(9U + header_data_length + size);
+        uint64_t length = 3U + header_data_length + size;
+        if (length > 0xFFFF)
+            length = 0;
+
+        pes[0] = 0x00;
+        pes[1] = 0x00;
+        pes[2] = 0x01;
+        pes[3] = state.m_stream_id;
+        pes[4] = (uint8_t)(length >> 8);
+        pes[5] = (uint8_t)length;
+
+        // The marker bits and the data alignment indicator.
+        pes[6] = 0x84;
+        pes[7] = state.m_video ? 0xC0 : 0x80;
+        pes[8] = (uint8_t)header_data_length;
+        helper::write_timestamp(state.m_video ? 0x3 : 0x2, pts, &pes[9]);
+        if (state.m_video)
+            helper::write_timestamp(0x1, dts, &pes[14]);
+
+        uint8_t* payload = pes.data() + 9U + header_data_length;
+        fill(payload, size, true);
+
+        // The video is split into NAL units of up to 2000 bytes, each
+        // starting with a four byte start code and the NAL unit header.
+        if (state.m_video)
+        {
+            uint64_t offset = 0;
+            while (offset + 5U <= size)
+            {
+                payload[offset] = 0x00;
+                payload[offset + 1] = 0x00;
+                payload[offset + 2] = 0x00;
+                payload[offset + 3] = 0x01;
+                payload[offset + 4] = offset == 0 ? 0x09 : 0x41;
+                offset += 5U + uniform(2000);
+            }
+        }
+        state.m_offset = 0;
+    }
+
+    /// Fills data with random bytes, which are non-zero if so requested so
+    /// they do not form start codes.
+    void fill(uint8_t* data, uint64_t size, bool non_zero)
+    {
+        for (uint64_t i = 0; i < size; i += 8)
+        {
+            auto value = next();
+            auto count = std::min<uint64_t>(8U, size - i);
+            for (uint64_t j = 0; j < count; ++j)
+            {
+                auto byte = (uint8_t)(value >> (j * 8));
+                data[i + j] = (non_zero && byte == 0) ? 0x01 : byte;
+            }
+        }
+    }
+
+    static uint64_t pts_mask()
+    {
+        return ((uint64_t)1 << 33) - 1;
+    }
+
+    /// @return The value at which the PCR wraps around.
+    static uint64_t pcr_period()
+    {
+        return ((uint64_t)1 << 33) * 300U;
+    }
+
+    /// @return The next value of a xorshift64* generator.
+    uint64_t next()
+    {
+        m_random ^= m_random >> 12;
+        m_random ^= m_random << 25;
+        m_random ^= m_random >> 27;
+        return m_random * 0x2545F4914F6CDD1DULL;
+    }
+
+    /// @return A value from zero up to, but excluding, the limit.
+    uint64_t uniform(uint64_t limit)
+    {
+        assert(limit > 0);
+        return next() % limit;
+    }
+
+    /// @return True with the given probability.
+    bool chance(double probability)
+    {
+        if (probability <= 0.0)
+            return false;
+        return (double)(next() >> 11) * (1.0 / 9007199254740992.0) <
+            probability;
+    }
+
+private:
+
+    uint64_t m_random;
+
+    uint32_t m_programs = 1;
+    uint32_t m_streams = 2;
+    uint32_t m_min_pes_size = 500;
+    uint32_t m_max_pes_size = 20000;
+    double m_adaptation_field_rate = 0.0;
+    double m_loss_rate = 0.0;
+    double m_garbage_rate = 0.0;
+    uint32_t m_psi_interval = 100;
+
+    bool m_started = false;
+    std::vector<stream_state> m_states;
+
+    /// The PAT and PMT packets, the next of them to write, if any, and
+    /// their continuity counters.
+    std::vector<uint8_t> m_psi;
+    uint64_t m_psi_index = 0;
+    std::vector<uint8_t> m_psi_continuity_counters;
+
+    /// The number of stream packets after which the PSI is written next.
+    uint64_t m_next_psi = 0;
+
+    uint64_t m_packets = 0;
+    uint64_t m_stream_packets = 0;
+    uint64_t m_lost_packets = 0;
+    uint64_t m_garbage_bytes = 0;
+    uint64_t m_pes_count = 0;
+};
+}
@@ -0,0 +1,584 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "ts_packet_view.hpp"
+
+namespace mts
+{
+/// Keeps per-PID statistics of a transport stream in the spirit of the
+/// priority 1 and 2 checks of ETSI TR 101 290, e.g. for exporting them to a
+/// monitoring system.
+///
+/// The monitor is updated with every packet on the reading thread, usually
+/// by the parser, see parser::set_monitor(). The statistics can be read at
+/// the same time from any other thread without locking, see snapshot().
+/// The counters of each PID are kept on their own cache lines and guarded
+/// by a sequence lock, so a snapshot of a PID is always consistent while
+/// the reading thread never waits.
+///
+/// Intervals of sections and bitrates are measured in the arrival time of
+/// the packets, see parser::set_arrival_time(), while the PCR checks only
+/// use the PCRs and the positions of the packets.
+class stream_monitor
+{
+public:
+
+    /// The statistics of a PID, or of the whole multiplex, see multiplex().
+    struct statistics
+    {
+        /// The PID, or pid_count() for the multiplex.
+        uint16_t m_pid = 0;
+
+        uint64_t m_packets = 0;
+
+        /// The arrival times of the first and the latest packet.
+        uint64_t m_first_arrival_time = 0;
+        uint64_t m_last_arrival_time = 0;
+
+        /// Packets without sync byte, only counted for the multiplex.
+        uint64_t m_sync_byte_errors = 0;
+
+        /// Packets with the transport_error_indicator set.
+        uint64_t m_transport_errors = 0;
+
+        /// Packets with the transport_scrambling_control set.
+        uint64_t m_scrambled_packets = 0;
+
+        /// Packets lost according to the continuity counters, and packets
+        /// repeating the continuity counter of the previous packet.
+        uint64_t m_continuity_errors = 0;
+        uint64_t m_duplicate_packets = 0;
+
+        /// PCRs read, and the PCRs following the previous PCR later than
+        /// max_pcr_interval(), out of order or later than
+        /// max_pcr_discontinuity() without a discontinuity_indicator, and
+        /// deviating more than max_pcr_inaccuracy() from the previous PCRs.
+        uint64_t m_pcrs = 0;
+        uint64_t m_pcr_repetition_errors = 0;
+        uint64_t m_pcr_discontinuity_errors = 0;
+        uint64_t m_pcr_accuracy_errors = 0;
+
+        /// The longest interval between two PCRs, in 27 MHz ticks, and the
+        /// largest deviation of a PCR, in nanoseconds.
+        uint64_t m_max_pcr_interval = 0;
+        uint64_t m_max_pcr_inaccuracy = 0;
+
+        /// Sections started on the PAT and PMT PIDs, the sections following
+        /// the previous later than max_section_interval(), and the longest
+        /// interval between two sections in 27 MHz ticks.
+        uint64_t m_sections = 0;
+        uint64_t m_section_repetition_errors = 0;
+        uint64_t m_max_section_interval = 0;
+
+        /// Sections failing their CRC check.
+        uint64_t m_crc_errors = 0;
+
+        /// @return The average bitrate between the first and the latest
+        ///         packet in bits per second.
+        double bitrate() const
+        {
+            if (m_last_arrival_time <= m_first_arrival_time)
+                return 0.0;
+            return (double)(m_packets - 1) * packet_size() * 8.0 *
+                   frequency() /
+                   (double)(m_last_arrival_time - m_first_arrival_time);
+        }
+    };
+
+    static uint32_t packet_size()
+    {
+        return 188U;
+    }
+
+    constexpr static uint32_t pid_count()
+    {
+        return 8192;
+    }
+
+    /// @return The frequency of the arrival time and the PCR.
+    static uint64_t frequency()
+    {
+        return 27000000U;
+    }
+
+    /// @return The interval of PCRs above which a PCR repetition error is
+    ///         counted, i.e. 40 ms.
+    static uint64_t max_pcr_interval()
+    {
+        return frequency() / 25U;
+    }
+
+    /// @return The interval of PCRs above which a PCR discontinuity error
+    ///         is counted, i.e. 100 ms.
+    static uint64_t max_pcr_discontinuity()
+    {
+        return frequency() / 10U;
+    }
+
+    /// @return The deviation of a PCR in nanoseconds above which a PCR
+    ///         accuracy error is counted.
+    static uint64_t max_pcr_inaccuracy()
+    {
+        return 500U;
+    }
+
+    /// @return The interval of sections on a PAT or PMT PID above which a
+    ///         section repetition error is counted, i.e. 500 ms.
+    static uint64_t max_section_interval()
+    {
+        return frequency() / 2U;
+    }
+
+    /// @return The average bitrate of a PID between two snapshots of it,
+    ///         e.g. taken a second apart, in bits per second.
+    static double bitrate(const statistics& previous, const statistics& current)
+    {
+        assert(previous.m_pid == current.m_pid);
+        if (current.m_last_arrival_time <= previous.m_last_arrival_time)
+            return 0.0;
+        return (double)(current.m_packets - previous.m_packets) *
+               packet_size() * 8.0 * frequency() /
+               (double)(current.m_last_arrival_time -
+                        previous.m_last_arrival_time);
+    }
+
+public:
+
+    /// @param max_pids The number of PIDs with statistics of their own.
+    ///        Packets of further PIDs are only counted for the multiplex.
+    explicit stream_monitor(uint32_t max_pids = 256) :
+        m_capacity(std::min(max_pids, pid_count())),
+        m_storage(new uint8_t[
+            (m_capacity + 1) * sizeof(pid_slot) + alignof(pid_slot)]),
+        m_indices(pid_count(), no_slot)
+    {
+        // The slots are aligned by hand, as the storage is not.
+        const uint64_t alignment = alignof(pid_slot);
+        auto address = reinterpret_cast<uintptr_t>(m_storage.get());
+        m_slots = reinterpret_cast<pid_slot*>(
+            m_storage.get() + ((alignment - address % alignment) % alignment));
+        for (uint32_t i = 0; i <= m_capacity; ++i)
+        {
+            new (&m_slots[i]) pid_slot();
+        }
+        m_slots[m_capacity].m_pid = (uint16_t)pid_count();
+    }
+
+    stream_monitor(const stream_monitor&) = delete;
+    stream_monitor& operator=(const stream_monitor&) = delete;
+
+    ~stream_monitor()
+    {
+        for (uint32_t i = 0; i <= m_capacity; ++i)
+        {
+            m_slots[i].~pid_slot();
+        }
+    }
+
+    /// Reading side. Updates the statistics with a packet.
+    ///
+    /// @param data The 188 byte packet.
+    /// @param arrival_time The local time the packet arrived, in 27 MHz
+    ///        ticks.
+    /// @param psi Whether the PID carries the PAT or a PMT.
+    void read(const uint8_t* data, uint64_t arrival_time, bool psi)
+    {
+        assert(data != nullptr);
+        m_position += packet_size();
+
+        auto& multiplex = m_slots[m_capacity];
+        begin(multiplex);
+        count_packet(multiplex, arrival_time);
+        ts_packet_view packet(data);
+        if (data[0] != 0x47)
+        {
+            increment(multiplex, sync_byte_errors);
+            end(multiplex);
+            return;
+        }
+        if (packet.transport_error_indicator())
+            increment(multiplex, transport_errors);
+
+        auto slot = find(packet.pid());
+        if (slot == nullptr)
+        {
+            increment(multiplex, untracked);
+            end(multiplex);
+            return;
+        }
+
+        begin(*slot);
+        count_packet(*slot, arrival_time);
+        if (packet.transport_error_indicator())
+        {
+            // The rest of the header can not be trusted.
+            increment(*slot, transport_errors);
+        }
+        else
+        {
+            read_packet(*slot, multiplex, packet, arrival_time, psi);
+        }
+        end(*slot);
+        end(multiplex);
+    }
+
+    /// Reading side. Counts a section of a PID failing its CRC check.
+    void read_crc_error(uint16_t pid)
+    {
+        assert(pid < pid_count());
+        auto slot = find(pid);
+        if (slot == nullptr)
+            return;
+        begin(*slot);
+        increment(*slot, crc_errors);
+        end(*slot);
+    }
+
+    /// @return The statistics of the PIDs seen so far, ordered by PID. Can
+    ///         be called from any thread.
+    std::vector<statistics> snapshot() const
+    {
+        auto count = m_slot_count.load(std::memory_order_acquire);
+        std::vector<statistics> result(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            result[i] = read_slot(m_slots[i]);
+        }
+        std::sort(result.begin(), result.end(),
+                  [](const statistics& a, const statistics& b)
+                  {
+                      return a.m_pid < b.m_pid;
+                  });
+        return result;
+    }
+
+    /// @return The statistics of all packets read. The continuity errors
+    ///         and the transport errors of all PIDs are summed up, while the
+    ///         PCR and section statistics are not kept. Can be called from
+    ///         any thread.
+    statistics multiplex() const
+    {
+        return read_slot(m_slots[m_capacity]);
+    }
+
+    /// @return The number of packets of PIDs without statistics of their
+    ///         own. Can be called from any thread.
+    uint64_t untracked_packets() const
+    {
+        return load(m_slots[m_capacity], untracked);
+    }
+
+private:
+
+    /// The counters of a slot, which are read as a whole by the other
+    /// threads.
+    enum counter : uint32_t
+    {
+        packets,
+        first_arrival_time,
+        last_arrival_time,
+        sync_byte_errors,
+        transport_errors,
+        scrambled_packets,
+        continuity_errors,
+        duplicate_packets,
+        pcrs,
+        pcr_repetition_errors,
+        pcr_discontinuity_errors,
+        pcr_accuracy_errors,
+        max_pcr_interval_ticks,
+        max_pcr_inaccuracy_ns,
+        sections,
+        section_repetition_errors,
+        max_section_interval_ticks,
+        crc_errors,
+        untracked,
+        counter_count
+    };
+
+    /// The counters of a PID and the state of its checks, which is only
+    /// used by the reading thread.
+    struct alignas(64) pid_slot
+    {
+        std::atomic<uint32_t> m_sequence{0};
+        std::array<std::atomic<uint64_t>, counter_count> m_counters{};
+        uint16_t m_pid = 0;
+
+        uint8_t m_continuity_counter = 0;
+        bool m_has_continuity_counter = false;
+
+        /// The latest two PCRs and the positions of their packets, the
+        /// previous one only set if there was no discontinuity between.
+        uint64_t m_pcr = 0;
+        uint64_t m_pcr_position = 0;
+        uint64_t m_previous_pcr = 0;
+        uint64_t m_previous_pcr_position = 0;
+        bool m_has_pcr = false;
+        bool m_has_previous_pcr = false;
+
+        uint64_t m_section_time = 0;
+        bool m_has_section = false;
+    };
+
+    static const uint16_t no_slot = 0xFFFF;
+
+private:
+
+    /// @return The slot of a PID, which is added if there is room.
+    pid_slot* find(uint16_t pid)
+    {
+        auto index = m_indices[pid];
+        if (index != no_slot)
+            return &m_slots[index];
+
+        auto count = m_slot_count.load(std::memory_order_relaxed);
+        if (count == m_capacity)
+            return nullptr;
+
+        // The slot is set up before the other threads see it.
+        m_slots[count].m_pid = pid;
+        m_indices[pid] = (uint16_t)count;
+        m_slot_count.store(count + 1, std::memory_order_release);
+        return &m_slots[count];
+    }
+
+    void read_packet(
+        pid_slot& slot, pid_slot& multiplex, const ts_packet_view& packet,
+        uint64_t arrival_time, bool psi)
+    {
+        if (packet.transport_scrambling_control() != 0)
+        {
+            increment(slot, scrambled_packets);
+            increment(multiplex, scrambled_packets);
+        }
+
+        bool discontinuity = false;
+        if (packet.has_adaptation_field() && packet.payload_offset() <= 188U)
+        {
+            auto field = packet.adaptation_field();
+            if (field.length() != 0)
+            {
+                discontinuity = field.discontinuity_indicator();
+                // The flags and the 6 byte PCR.
+                if (field.length() >= 7 && field.pcr_flag())
+                {
+                    read_pcr(slot, field.program_clock_reference(),
+                             discontinuity);
+                }
+            }
+        }
+
+        if (packet.is_null_packet() || !packet.has_payload_field())
+            return;
+
+        auto continuity_counter = packet.continuity_counter();
+        if (slot.m_has_continuity_counter && !discontinuity)
+        {
+            auto expected = (slot.m_continuity_counter + 1) & 0x0F;
+            if (continuity_counter == slot.m_continuity_counter)
+            {
+                increment(slot, duplicate_packets);
+            }
+            else if (continuity_counter != expected)
+            {
+                auto lost = (continuity_counter - expected) & 0x0F;
+                add(slot, continuity_errors, lost);
+                add(multiplex, continuity_errors, lost);
+            }
+        }
+        slot.m_continuity_counter = continuity_counter;
+        slot.m_has_continuity_counter = true;
+
+        if (psi && packet.payload_unit_start_indicator())
+            read_section(slot, arrival_time);
+    }
+
+    void read_pcr(pid_slot& slot, uint64_t pcr, bool discontinuity)
+    {
+        increment(slot, pcrs);
+        if (!slot.m_has_pcr || discontinuity)
+        {
+            restart_pcr(slot, pcr);
+            return;
+        }
+
+        const uint64_t period = ((uint64_t)1 << 33) * 300U;
+        uint64_t interval = (pcr + period - slot.m_pcr) % period;
+        if (interval > max_pcr_discontinuity())
+        {
+            increment(slot, pcr_discontinuity_errors);
+            restart_pcr(slot, pcr);
+            return;
+        }
+        if (interval > max_pcr_interval())
+            increment(slot, pcr_repetition_errors);
+        maximize(slot, max_pcr_interval_ticks, interval);
+
+        // The PCR is compared to the value expected at its position at the
+        // rate of the previous two PCRs.
+        if (slot.m_has_previous_pcr &&
+            slot.m_pcr_position != slot.m_previous_pcr_position)
+        {
+            double rate =
+                (double)((slot.m_pcr + period - slot.m_previous_pcr) %
+                         period) /
+                (double)(slot.m_pcr_position - slot.m_previous_pcr_position);
+            double expected =
+                rate * (double)(m_position - slot.m_pcr_position);
+            double deviation = std::fabs((double)interval - expected);
+            auto inaccuracy = (uint64_t)(deviation * 1e9 / frequency());
+            if (inaccuracy > max_pcr_inaccuracy())
+                increment(slot, pcr_accuracy_errors);
+            maximize(slot, max_pcr_inaccuracy_ns, inaccuracy);
+        }
+
+        slot.m_previous_pcr = slot.m_pcr;
+        slot.m_previous_pcr_position = slot.m_pcr_position;
+        slot.m_has_previous_pcr = true;
+        slot.m_pcr = pcr;
+        slot.m_pcr_position = m_position;
+    }
+
+    void restart_pcr(pid_slot& slot, uint64_t pcr)
+    {
+        slot.m_pcr = pcr;
+        slot.m_pcr_position = m_position;
+        slot.m_has_pcr = true;
+        slot.m_has_previous_pcr = false;
+    }
+
+    void read_section(pid_slot& slot, uint64_t arrival_time)
+    {
+        increment(slot, sections);
+        if (slot.m_has_section)
+        {
+            auto interval = arrival_time - slot.m_section_time;
+            if (interval > max_section_interval())
+                increment(slot, section_repetition_errors);
+            maximize(slot, max_section_interval_ticks, interval);
+        }
+        slot.m_section_time = arrival_time;
+        slot.m_has_section = true;
+    }
+
+    void count_packet(pid_slot& slot, uint64_t arrival_time)
+    {
+        if (load(slot, packets) == 0)
+            store(slot, first_arrival_time, arrival_time);
+        store(slot, last_arrival_time, arrival_time);
+        increment(slot, packets);
+    }
+
+    /// Starts and ends an update of a slot, between which the sequence is
+    /// odd and the other threads retry reading the slot.
+    static void begin(pid_slot& slot)
+    {
+        auto sequence = slot.m_sequence.load(std::memory_order_relaxed);
+        slot.m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void end(pid_slot& slot)
+    {
+        auto sequence = slot.m_sequence.load(std::memory_order_relaxed);
+        slot.m_sequence.store(sequence + 1, std::memory_order_release);
+    }
+
+    /// The counters are only written by the reading thread, so they are
+    /// updated without read-modify-write operations.
+    static uint64_t load(const pid_slot& slot, counter counter)
+    {
+        return slot.m_counters[counter].load(std::memory_order_relaxed);
+    }
+
+    static void store(pid_slot& slot, counter counter, uint64_t value)
+    {
+        slot.m_counters[counter].store(value, std::memory_order_relaxed);
+    }
+
+    static void add(pid_slot& slot, counter counter, uint64_t value)
+    {
+        store(slot, counter, load(slot, counter) + value);
+    }
+
+    static void increment(pid_slot& slot, counter counter)
+    {
+        add(slot, counter, 1U);
+    }
+
+    static void maximize(pid_slot& slot, counter counter, uint64_t value)
+    {
+        if (value > load(slot, counter))
+            store(slot, counter, value);
+    }
+
+    /// Reads the counters of a slot, retrying while they are updated.
+    static statistics read_slot(const pid_slot& slot)
+    {
+        std::array<uint64_t, counter_count> values;
+        while (true)
+        {
+            auto before = slot.m_sequence.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < counter_count; ++i)
+            {
+                values[i] =
+                    slot.m_counters[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto after = slot.m_sequence.load(std::memory_order_relaxed);
+            if (before == after && (before & 1U) == 0)
+                break;
+        }
+
+        statistics result;
+        result.m_pid = slot.m_pid;
+        result.m_packets = values[packets];
+        result.m_first_arrival_time = values[first_arrival_time];
+        result.m_last_arrival_time = values[last_arrival_time];
+        result.m_sync_byte_errors = values[sync_byte_errors];
+        result.m_transport_errors = values[transport_errors];
+        result.m_scrambled_packets = values[scrambled_packets];
+        result.m_continuity_errors = values[continuity_errors];
+        result.m_duplicate_packets = values[duplicate_packets];
+        result.m_pcrs = values[pcrs];
+        result.m_pcr_repetition_errors = values[pcr_repetition_errors];
+        result.m_pcr_discontinuity_errors = values[pcr_discontinuity_errors];
+        result.m_pcr_accuracy_errors = values[pcr_accuracy_errors];
+        result.m_max_pcr_interval = values[max_pcr_interval_ticks];
+        result.m_max_pcr_inaccuracy = values[max_pcr_inaccuracy_ns];
+        result.m_sections = values[sections];
+        result.m_section_repetition_errors = values[section_repetition_errors];
+        result.m_max_section_interval = values[max_section_interval_ticks];
+        result.m_crc_errors = values[crc_errors];
+        return result;
+    }
+
+private:
+
+    /// The slots of the PIDs, followed by the slot of the multiplex.
+    uint32_t m_capacity;
+    std::unique_ptr<uint8_t[]> m_storage;
+    pid_slot* m_slots = nullptr;
+    std::atomic<uint32_t> m_slot_count{0};
+
+    /// The slot index of each PID, only used by the reading thread.
+    std::vector<uint16_t> m_indices;
+
+    /// The byte position of the packet being read.
+    uint64_t m_position = 0;
+};
+}
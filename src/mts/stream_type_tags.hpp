@@ -185,6 +185,11 @@ STREAM_TYPE_TAG(
 
 STREAM_TYPE_TAG(
     0x24,
+    hevc_video_stream,
+    "ISO/IEC 23008-2 HEVC video stream")
+
+STREAM_TYPE_TAG(
+    0x25,
     first_13818_1_reserved,
     "First ISO/IEC 13818-1 Reserved")
 
@@ -0,0 +1,106 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#define MTS_SYNC_SCANNER_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MTS_SYNC_SCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace mts
+{
+/// Finds sync bytes in a buffer. The search is vectorized with AVX2 or SSE2
+/// when the compiler targets them, otherwise a scalar search is used.
+struct sync_scanner
+{
+    /// @return The offset of the first occurrence of value, or size if the
+    ///         value is not found.
+    static uint64_t find(const uint8_t* data, uint64_t size, uint8_t value)
+    {
+        assert(data != nullptr || size == 0);
+
+        uint64_t offset = 0;
+#if defined(MTS_SYNC_SCANNER_AVX2)
+        const __m256i wanted = _mm256_set1_epi8((char)value);
+        for (; offset + 32 <= size; offset += 32)
+        {
+            __m256i block = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(data + offset));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(block, wanted));
+            if (mask != 0)
+            {
+                return offset + count_trailing_zeros(mask);
+            }
+        }
+#elif defined(MTS_SYNC_SCANNER_SSE2)
+        const __m128i wanted = _mm_set1_epi8((char)value);
+        for (; offset + 16 <= size; offset += 16)
+        {
+            __m128i block = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data + offset));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(block, wanted));
+            if (mask != 0)
+            {
+                return offset + count_trailing_zeros(mask);
+            }
+        }
+#endif
+        for (; offset < size; ++offset)
+        {
+            if (data[offset] == value)
+                return offset;
+        }
+        return size;
+    }
+
+    /// Checks whether value is found every stride bytes starting at offset.
+    ///
+    /// @return The number of consecutive matches, at most count. Fewer
+    ///         matches than count is either a mismatch or the end of the
+    ///         data, which can be told apart by checking whether
+    ///         offset + matches * stride is less than size.
+    static uint32_t count_strided(
+        const uint8_t* data, uint64_t size, uint64_t offset, uint8_t value,
+        uint64_t stride, uint32_t count)
+    {
+        assert(stride > 0);
+        uint32_t matches = 0;
+        for (; matches < count && offset < size; ++matches, offset += stride)
+        {
+            if (data[offset] != value)
+                break;
+        }
+        return matches;
+    }
+
+private:
+
+    static uint32_t count_trailing_zeros(uint32_t value)
+    {
+        assert(value != 0);
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward(&index, value);
+        return (uint32_t)index;
+#else
+        return (uint32_t)__builtin_ctz(value);
+#endif
+    }
+};
+}
@@ -0,0 +1,360 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/// The hot paths of the library are traced when MTS_TRACE is defined, in
+/// which case MTS_TRACE_SCOPE(stage) measures the time until the end of the
+/// scope, or until MTS_TRACE_STOP(stage), as a mts::trace::stage. Otherwise
+/// the macros expand to nothing. MTS_TRACE must be defined for the whole
+/// program, as the headers differ with and without it.
+#if defined(MTS_TRACE)
+#define MTS_TRACE_SCOPE(name) \
+    mts::trace::scope mts_trace_##name(mts::trace::stage::name)
+#define MTS_TRACE_STOP(name) mts_trace_##name.stop()
+#else
+#define MTS_TRACE_SCOPE(name)
+#define MTS_TRACE_STOP(name)
+#endif
+
+namespace mts
+{
+/// Records the time spent in the stages of the hot paths, see
+/// MTS_TRACE_SCOPE, into a ring buffer of each thread, and collects them
+/// into histograms, e.g. to find where the time goes in production.
+///
+/// The time is measured in cycles of the time stamp counter on x86, and in
+/// nanoseconds elsewhere. The time of a stage excludes the time of the
+/// stages traced within it, e.g. the packetizer excludes the parser reading
+/// the packets it releases.
+class trace
+{
+private:
+
+    struct thread_buffer;
+
+    /// The sizes, usable in the declarations within the class.
+    enum : uint32_t
+    {
+        stages = 5,
+        ring_events = 1U << 16,
+        buckets = 40
+    };
+
+public:
+
+    enum class stage : uint8_t
+    {
+        /// Decoding the header of a packet and looking up its PID.
+        ts_header,
+
+        /// Assembling and parsing the PAT and PMT sections.
+        psi_parse,
+
+        /// Checking the continuity of a stream packet and appending its
+        /// payload to the pes.
+        pes_append,
+
+        /// Parsing a pes header, see pes::parse().
+        pes_parse,
+
+        /// Finding the packets in the data read by the packetizer.
+        packetizer_read
+    };
+
+    constexpr static uint32_t stage_count()
+    {
+        return stages;
+    }
+
+    /// The number of events kept per thread, of which the latest are used
+    /// for the histograms.
+    constexpr static uint32_t ring_size()
+    {
+        return ring_events;
+    }
+
+    /// The number of histogram buckets, where bucket i holds the events
+    /// taking from 2^i up to 2^(i+1) ticks, and bucket 0 those below 2.
+    constexpr static uint32_t bucket_count()
+    {
+        return buckets;
+    }
+
+    /// The times of the events of a stage.
+    struct histogram
+    {
+        trace::stage m_stage = trace::stage::ts_header;
+
+        /// The number and the total time of all events, including those no
+        /// longer in the ring buffers.
+        uint64_t m_events = 0;
+        uint64_t m_ticks = 0;
+
+        /// The events in the ring buffers by their time.
+        std::array<uint64_t, buckets> m_buckets{};
+    };
+
+    /// Measures the time of a stage from construction until stop() or
+    /// destruction.
+    class scope
+    {
+    public:
+
+        explicit scope(trace::stage stage) :
+            m_stage(stage),
+            m_buffer(trace::buffer()),
+            m_outer_ticks(m_buffer.m_inner_ticks),
+            m_start(trace::now())
+        {
+            m_buffer.m_inner_ticks = 0;
+        }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+        ~scope()
+        {
+            stop();
+        }
+
+        void stop()
+        {
+            if (m_stopped)
+                return;
+            m_stopped = true;
+            uint64_t ticks = trace::now() - m_start;
+            uint64_t inner = std::min(ticks, m_buffer.m_inner_ticks);
+            trace::record(m_buffer, m_stage, ticks - inner);
+            m_buffer.m_inner_ticks = m_outer_ticks + ticks;
+        }
+
+    private:
+
+        trace::stage m_stage;
+        thread_buffer& m_buffer;
+        uint64_t m_outer_ticks;
+        uint64_t m_start;
+        bool m_stopped = false;
+    };
+
+public:
+
+    /// @return The current time in ticks.
+    static uint64_t now()
+    {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /// Records an event of a stage on the calling thread.
+    static void record(trace::stage stage, uint64_t ticks)
+    {
+        record(buffer(), stage, ticks);
+    }
+
+    /// @return The histograms of the stages over all threads. Can be called
+    ///         from any thread, while the events are recorded.
+    static std::vector<histogram> histograms()
+    {
+        std::vector<histogram> result(stage_count());
+        for (uint32_t i = 0; i < stage_count(); ++i)
+        {
+            result[i].m_stage = static_cast<trace::stage>(i);
+        }
+
+        std::lock_guard<std::mutex> lock(registry().m_mutex);
+        for (const auto& buffer : registry().m_buffers)
+        {
+            for (uint32_t i = 0; i < stage_count(); ++i)
+            {
+                result[i].m_events +=
+                    buffer->m_events[i].load(std::memory_order_relaxed);
+                result[i].m_ticks +=
+                    buffer->m_ticks[i].load(std::memory_order_relaxed);
+            }
+
+            auto written = buffer->m_written.load(std::memory_order_acquire);
+            auto count = std::min<uint64_t>(written, ring_size());
+            for (uint64_t i = written - count; i < written; ++i)
+            {
+                auto event = buffer->m_ring[i % ring_size()].load(
+                    std::memory_order_relaxed);
+                auto stage = (uint32_t)(event >> 56);
+                if (stage < stage_count())
+                    result[stage].m_buckets[bucket(event & tick_mask())]++;
+            }
+        }
+        return result;
+    }
+
+    /// Writes the histograms of the stages with events as text.
+    static void write(std::ostream& output)
+    {
+        for (const auto& histogram : histograms())
+        {
+            if (histogram.m_events == 0)
+                continue;
+
+            output << stage_name(histogram.m_stage) << ": "
+                   << histogram.m_events << " events, "
+                   << histogram.m_ticks / histogram.m_events
+                   << " ticks on average\n";
+
+            uint64_t largest = *std::max_element(
+                histogram.m_buckets.begin(), histogram.m_buckets.end());
+            for (uint32_t i = 0; i < bucket_count(); ++i)
+            {
+                auto count = histogram.m_buckets[i];
+                if (count == 0)
+                    continue;
+                output << "  " << std::setw(12) << ((uint64_t)1 << i)
+                       << " " << std::setw(10) << count << " "
+                       << std::string((size_t)(count * 50 / largest), '#')
+                       << "\n";
+            }
+        }
+    }
+
+    /// Clears the events of all threads. Must not be called while events
+    /// are recorded.
+    static void reset()
+    {
+        std::lock_guard<std::mutex> lock(registry().m_mutex);
+        for (const auto& buffer : registry().m_buffers)
+        {
+            buffer->m_written.store(0, std::memory_order_relaxed);
+            for (uint32_t i = 0; i < stage_count(); ++i)
+            {
+                buffer->m_events[i].store(0, std::memory_order_relaxed);
+                buffer->m_ticks[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    static const char* stage_name(trace::stage stage)
+    {
+        switch (stage)
+        {
+        case trace::stage::ts_header: return "ts_header";
+        case trace::stage::psi_parse: return "psi_parse";
+        case trace::stage::pes_append: return "pes_append";
+        case trace::stage::pes_parse: return "pes_parse";
+        case trace::stage::packetizer_read: return "packetizer_read";
+        }
+        return "unknown";
+    }
+
+private:
+
+    /// The events of a thread. Only the thread writes to it, so the
+    /// counters are updated without read-modify-write operations, while
+    /// other threads may read it at any time.
+    struct thread_buffer
+    {
+        /// The events, with the stage in the top byte and the ticks below.
+        std::array<std::atomic<uint64_t>, ring_events> m_ring;
+        std::atomic<uint64_t> m_written{0};
+
+        std::array<std::atomic<uint64_t>, stages> m_events;
+        std::array<std::atomic<uint64_t>, stages> m_ticks;
+
+        /// The time of the stages traced within the current one.
+        uint64_t m_inner_ticks = 0;
+
+        thread_buffer()
+        {
+            for (uint32_t i = 0; i < stage_count(); ++i)
+            {
+                m_events[i].store(0, std::memory_order_relaxed);
+                m_ticks[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /// The buffers of all threads, which are kept after the threads exit.
+    struct buffer_registry
+    {
+        std::mutex m_mutex;
+        std::vector<std::shared_ptr<thread_buffer>> m_buffers;
+    };
+
+private:
+
+    static uint64_t tick_mask()
+    {
+        return ((uint64_t)1 << 56) - 1;
+    }
+
+    static buffer_registry& registry()
+    {
+        static buffer_registry registry;
+        return registry;
+    }
+
+    static thread_buffer& buffer()
+    {
+        static thread_local std::shared_ptr<thread_buffer> local = []()
+        {
+            auto created = std::make_shared<thread_buffer>();
+            std::lock_guard<std::mutex> lock(registry().m_mutex);
+            registry().m_buffers.push_back(created);
+            return created;
+        }();
+        return *local;
+    }
+
+    static void record(
+        thread_buffer& buffer, trace::stage stage, uint64_t ticks)
+    {
+        auto index = (uint32_t)stage;
+        auto& events = buffer.m_events[index];
+        auto& total = buffer.m_ticks[index];
+        events.store(events.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+        total.store(total.load(std::memory_order_relaxed) + ticks,
+                    std::memory_order_relaxed);
+
+        auto written = buffer.m_written.load(std::memory_order_relaxed);
+        buffer.m_ring[written % ring_size()].store(
+            ((uint64_t)index << 56) | std::min(ticks, tick_mask()),
+            std::memory_order_relaxed);
+        buffer.m_written.store(written + 1, std::memory_order_release);
+    }
+
+    static uint32_t bucket(uint64_t ticks)
+    {
+        uint32_t bucket = 0;
+        while (ticks > 1 && bucket + 1 < bucket_count())
+        {
+            ticks >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+};
+}
@@ -0,0 +1,145 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <system_error>
+
+#include "adaptation_field_view.hpp"
+#include "error.hpp"
+
+namespace mts
+{
+/// View of a 188 byte packet which decodes the header fields directly from
+/// the packet when they are accessed, as opposed to ts_packet which decodes
+/// the header and the adaptation field up front.
+class ts_packet_view
+{
+public:
+
+    static uint32_t packet_size()
+    {
+        return 188U;
+    }
+
+public:
+
+    /// @param data The packet, which must be packet_size() bytes.
+    explicit ts_packet_view(const uint8_t* data) :
+        m_data(data)
+    {
+        assert(m_data != nullptr);
+    }
+
+    /// Checks the sync byte and the transport error indicator, and that the
+    /// adaptation field fits in the packet.
+    void verify(std::error_code& error) const
+    {
+        if (m_data[0] != 0x47)
+        {
+            error = mts::error::invalid_sync_byte;
+            return;
+        }
+        if (transport_error_indicator())
+        {
+            error = mts::error::transport_error_indicator_set;
+            return;
+        }
+        if (has_adaptation_field() && payload_offset() > packet_size())
+        {
+            error = mts::error::invalid_adaptation_field_length;
+            return;
+        }
+    }
+
+    bool is_null_packet() const
+    {
+        return pid() == 0x1FFF;
+    }
+
+    bool has_adaptation_field() const
+    {
+        return (adaptation_field_control() & 0x02) != 0;
+    }
+
+    bool has_payload_field() const
+    {
+        return (adaptation_field_control() & 0x01) != 0;
+    }
+
+    bool transport_error_indicator() const
+    {
+        return (m_data[1] & 0x80) != 0;
+    }
+
+    bool payload_unit_start_indicator() const
+    {
+        return (m_data[1] & 0x40) != 0;
+    }
+
+    bool transport_priority() const
+    {
+        return (m_data[1] & 0x20) != 0;
+    }
+
+    uint16_t pid() const
+    {
+        return ((m_data[1] & 0x1F) << 8) | m_data[2];
+    }
+
+    uint8_t transport_scrambling_control() const
+    {
+        return m_data[3] >> 6;
+    }
+
+    uint8_t adaptation_field_control() const
+    {
+        return (m_data[3] >> 4) & 0x03;
+    }
+
+    uint8_t continuity_counter() const
+    {
+        return m_data[3] & 0x0F;
+    }
+
+    mts::adaptation_field_view adaptation_field() const
+    {
+        assert(has_adaptation_field());
+        return mts::adaptation_field_view(m_data + 4);
+    }
+
+    /// @return The offset of the payload, which exceeds the packet size if
+    ///         the adaptation field length is invalid.
+    uint32_t payload_offset() const
+    {
+        return has_adaptation_field() ? 5U + m_data[4] : 4U;
+    }
+
+    const uint8_t* payload_data() const
+    {
+        assert(has_payload_field());
+        assert(payload_offset() <= packet_size());
+        return m_data + payload_offset();
+    }
+
+    uint32_t payload_size() const
+    {
+        assert(has_payload_field());
+        assert(payload_offset() <= packet_size());
+        return packet_size() - payload_offset();
+    }
+
+    const uint8_t* data() const
+    {
+        return m_data;
+    }
+
+private:
+
+    const uint8_t* m_data;
+};
+}
@@ -0,0 +1,342 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MTS_UDP_RECEIVER_POSIX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "rtp_depacketizer.hpp"
+
+#if defined(MTS_UDP_RECEIVER_POSIX)
+
+namespace mts
+{
+/// Receives a transport stream over UDP or RTP, e.g. from a multicast
+/// group, at high datagram rates.
+///
+/// The datagrams are received in batches, with a single recvmmsg() call on
+/// Linux, into a buffer with a slot for each datagram of the batch. The
+/// RTP headers are stripped and the packets of the batch are moved together
+/// and delivered in a single call, so they can be read by the parser as a
+/// buffer of consecutive packets.
+///
+/// Datagrams which do not carry whole 188 byte packets are dropped, see
+/// invalid_datagrams().
+class udp_receiver
+{
+public:
+
+    /// Callback invoked with the whole packets of a batch.
+    using on_data_callback =
+        std::function<void(const uint8_t* data, uint64_t size)>;
+
+public:
+
+    /// @param batch_size The largest number of datagrams received at once.
+    /// @param datagram_size The largest datagram size, larger datagrams are
+    ///        dropped.
+    explicit udp_receiver(
+        uint32_t batch_size = 64, uint32_t datagram_size = 2048) :
+        m_batch_size(batch_size),
+        m_datagram_size(datagram_size),
+        m_buffer((uint64_t)batch_size * datagram_size),
+        m_sizes(batch_size)
+    {
+        assert(batch_size > 0);
+        assert(datagram_size >= rtp_depacketizer::packet_size());
+#if defined(__linux__)
+        m_iovecs.resize(batch_size);
+        m_messages.resize(batch_size);
+        for (uint32_t i = 0; i < batch_size; ++i)
+        {
+            m_iovecs[i].iov_base = m_buffer.data() + i * datagram_size;
+            m_iovecs[i].iov_len = datagram_size;
+            std::memset(&m_messages[i], 0, sizeof(m_messages[i]));
+            m_messages[i].msg_hdr.msg_iov = &m_iovecs[i];
+            m_messages[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+    }
+
+    udp_receiver(const udp_receiver&) = delete;
+    udp_receiver& operator=(const udp_receiver&) = delete;
+
+    ~udp_receiver()
+    {
+        close();
+    }
+
+    /// Opens a socket receiving on an IPv4 address and port. For a
+    /// multicast address the socket is bound to any address and joins the
+    /// group.
+    ///
+    /// @param port The port, or zero for a port chosen by the system, see
+    ///        port().
+    void open(
+        const std::string& address, uint16_t port, std::error_code& error)
+    {
+        assert(!is_open());
+
+        sockaddr_in endpoint;
+        std::memset(&endpoint, 0, sizeof(endpoint));
+        endpoint.sin_family = AF_INET;
+        endpoint.sin_port = htons(port);
+        if (::inet_pton(AF_INET, address.c_str(), &endpoint.sin_addr) != 1)
+        {
+            error = std::make_error_code(std::errc::invalid_argument);
+            return;
+        }
+
+        m_socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_socket < 0)
+        {
+            error = last_error();
+            return;
+        }
+
+        int reuse = 1;
+        ::setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse,
+                     sizeof(reuse));
+
+        auto group = endpoint.sin_addr;
+        bool multicast = IN_MULTICAST(ntohl(group.s_addr));
+        if (multicast)
+            endpoint.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        if (::bind(m_socket, (const sockaddr*)&endpoint,
+                   sizeof(endpoint)) != 0)
+        {
+            error = last_error();
+            close();
+            return;
+        }
+
+        if (multicast)
+        {
+            ip_mreq request;
+            request.imr_multiaddr = group;
+            request.imr_interface.s_addr = htonl(INADDR_ANY);
+            if (::setsockopt(m_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                             &request, sizeof(request)) != 0)
+            {
+                error = last_error();
+                close();
+                return;
+            }
+        }
+    }
+
+    bool is_open() const
+    {
+        return m_socket >= 0;
+    }
+
+    void close()
+    {
+        if (!is_open())
+            return;
+        ::close(m_socket);
+        m_socket = -1;
+    }
+
+    /// @return The port the socket is bound to.
+    uint16_t port() const
+    {
+        assert(is_open());
+        sockaddr_in endpoint;
+        socklen_t size = sizeof(endpoint);
+        if (::getsockname(m_socket, (sockaddr*)&endpoint, &size) != 0)
+            return 0;
+        return ntohs(endpoint.sin_port);
+    }
+
+    /// Sets the size of the receive buffer of the socket, which holds the
+    /// datagrams arriving between the batches.
+    void set_receive_buffer_size(uint32_t size, std::error_code& error)
+    {
+        assert(is_open());
+        int value = (int)size;
+        if (::setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &value,
+                         sizeof(value)) != 0)
+        {
+            error = last_error();
+        }
+    }
+
+    /// Waits for datagrams and receives a batch of them, delivering the
+    /// packets of the batch in a single call.
+    ///
+    /// @param timeout The time to wait for the first datagram in
+    ///        milliseconds, or -1 to wait until a datagram arrives.
+    /// @return The number of datagrams received, which is zero if none
+    ///         arrived in time.
+    uint32_t receive(
+        const on_data_callback& on_data, int timeout, std::error_code& error)
+    {
+        assert(is_open());
+        assert(on_data);
+
+        pollfd descriptor;
+        descriptor.fd = m_socket;
+        descriptor.events = POLLIN;
+        descriptor.revents = 0;
+        int ready = ::poll(&descriptor, 1, timeout);
+        if (ready < 0)
+        {
+            if (errno != EINTR)
+                error = last_error();
+            return 0;
+        }
+        if (ready == 0)
+            return 0;
+
+        auto count = receive_batch(error);
+        if (error)
+            return 0;
+        m_datagrams += count;
+
+        // The packets are moved together at the start of the buffer, which
+        // they never overtake.
+        uint8_t* output = m_buffer.data();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint8_t* datagram = m_buffer.data() + i * m_datagram_size;
+            auto size = m_sizes[i];
+
+            if (size > m_datagram_size)
+            {
+                m_invalid_datagrams++;
+                continue;
+            }
+
+            std::error_code datagram_error;
+            auto payload = m_depacketizer.read(datagram, size, datagram_error);
+            if (datagram_error)
+            {
+                m_invalid_datagrams++;
+                continue;
+            }
+            if (payload.m_size == 0)
+                continue;
+
+            if (output != payload.m_data)
+                std::memmove(output, payload.m_data, payload.m_size);
+            output += payload.m_size;
+        }
+
+        if (output != m_buffer.data())
+            on_data(m_buffer.data(), output - m_buffer.data());
+        return count;
+    }
+
+    const rtp_depacketizer& depacketizer() const
+    {
+        return m_depacketizer;
+    }
+
+    /// @return The number of datagrams received.
+    uint64_t datagrams() const
+    {
+        return m_datagrams;
+    }
+
+    /// @return The number of datagrams dropped as they did not carry whole
+    ///         packets, or were truncated.
+    uint64_t invalid_datagrams() const
+    {
+        return m_invalid_datagrams;
+    }
+
+private:
+
+    /// Receives the datagrams waiting, up to the batch size, without
+    /// blocking.
+    ///
+    /// @return The number of datagrams, of which the sizes are in m_sizes.
+    ///         A truncated datagram is reported larger than the slot.
+    uint32_t receive_batch(std::error_code& error)
+    {
+#if defined(__linux__)
+        for (auto& message : m_messages)
+        {
+            message.msg_hdr.msg_flags = 0;
+        }
+        int count = ::recvmmsg(m_socket, m_messages.data(), m_batch_size,
+                               MSG_DONTWAIT, nullptr);
+        if (count < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                error = last_error();
+            return 0;
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            const auto& message = m_messages[i];
+            m_sizes[i] = message.msg_len;
+            if ((message.msg_hdr.msg_flags & MSG_TRUNC) != 0)
+                m_sizes[i] = m_datagram_size + 1U;
+        }
+        return (uint32_t)count;
+#else
+        uint32_t count = 0;
+        for (; count < m_batch_size; ++count)
+        {
+            auto result = ::recv(
+                m_socket, m_buffer.data() + count * m_datagram_size,
+                m_datagram_size, MSG_DONTWAIT);
+            if (result < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    error = last_error();
+                break;
+            }
+            m_sizes[count] = (uint32_t)result;
+        }
+        return count;
+#endif
+    }
+
+    static std::error_code last_error()
+    {
+        return std::error_code(errno, std::generic_category());
+    }
+
+private:
+
+    int m_socket = -1;
+    uint32_t m_batch_size;
+    uint32_t m_datagram_size;
+
+    /// A slot of the datagram size for each datagram of a batch.
+    std::vector<uint8_t> m_buffer;
+    std::vector<uint32_t> m_sizes;
+#if defined(__linux__)
+    std::vector<iovec> m_iovecs;
+    std::vector<mmsghdr> m_messages;
+#endif
+
+    rtp_depacketizer m_depacketizer;
+    uint64_t m_datagrams = 0;
+    uint64_t m_invalid_datagrams = 0;
+};
+}
+
+#endif
@@ -4,9 +4,70 @@
 // Distributed under the "BSD License". See the accompanying LICENSE.rst file.
 
 #include <mts/adaptation_field.hpp>
+
+#include <fstream>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 TEST(test_adaptation_field, init)
 {
 
 }
+
+TEST(test_adaptation_field, write_test_file)
+{
+    // Writing the parsed adaptation fields gives the same bytes.
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary);
+    ASSERT_TRUE(file.is_open());
+    std::vector<uint8_t> packet(188);
+
+    uint32_t count = 0;
+    while (file.read((char*)packet.data(), packet.size()))
+    {
+        if ((packet[3] & 0x20) == 0)
+            continue;
+
+        std::error_code error;
+        auto field = mts::adaptation_field::parse(
+            packet.data() + 4, packet.size() - 4, error);
+        ASSERT_FALSE((bool)error);
+
+        std::vector<uint8_t> written(field->serialized_size());
+        ASSERT_EQ(1U + packet[4], written.size());
+        EXPECT_EQ(written.size(), field->write(written.data(), written.size()));
+        EXPECT_EQ(std::vector<uint8_t>(
+            packet.data() + 4, packet.data() + 4 + written.size()), written);
+        count++;
+    }
+    EXPECT_NE(0U, count);
+}
+
+TEST(test_adaptation_field, write_fields)
+{
+    mts::adaptation_field field;
+    EXPECT_EQ(1U, field.serialized_size());
+
+    field.set_random_access_indicator(true);
+    EXPECT_EQ(1U, field.length());
+    field.set_program_clock_reference(0x1FFFFFFFFULL * 300U + 299U);
+    EXPECT_EQ(7U, field.length());
+    field.set_length(20);
+
+    std::vector<uint8_t> written(field.serialized_size());
+    EXPECT_EQ(21U, field.write(written.data(), written.size()));
+    EXPECT_EQ(0xFF, written.back());
+
+    std::error_code error;
+    auto parsed = mts::adaptation_field::parse(
+        written.data(), written.size(), error);
+    ASSERT_FALSE((bool)error);
+    EXPECT_EQ(20U, parsed->length());
+    EXPECT_FALSE(parsed->discontinuity_indicator());
+    EXPECT_TRUE(parsed->random_access_indicator());
+    ASSERT_TRUE(parsed->pcr_flag());
+    EXPECT_EQ(0x1FFFFFFFFULL * 300U + 299U,
+              parsed->program_clock_reference());
+    EXPECT_FALSE(parsed->opcr_flag());
+}
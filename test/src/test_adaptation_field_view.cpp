@@ -0,0 +1,86 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/adaptation_field_view.hpp>
+#include <mts/adaptation_field.hpp>
+
+#include <gtest/gtest.h>
+
+TEST(test_adaptation_field_view, all_fields)
+{
+    std::vector<uint8_t> data =
+        {
+            0x00, // length
+            0xFF, // flags
+            0x12, 0x34, 0x56, 0x78, 0x9B, 0x23, // pcr
+            0x01, 0x02, 0x03, 0x04, 0x05, 0x06, // opcr
+            0xFE, // splice countdown
+            0x03, 0xAA, 0xBB, 0xCC, // private data
+            0x0B, // extension length
+            0xFF, // extension flags
+            0x81, 0x23, // ltw
+            0xC5, 0x67, 0x89, // piecewise rate
+            0x5B, 0x12, 0x35, 0x56, 0x79, // seamless splice
+            0xFF // stuffing
+        };
+    data[0] = (uint8_t)(data.size() - 1);
+
+    std::error_code error;
+    auto field = mts::adaptation_field::parse(data.data(), data.size(), error);
+    ASSERT_FALSE((bool)error);
+    ASSERT_NE(boost::none, field);
+
+    mts::adaptation_field_view view(data.data());
+    view.verify(error);
+    ASSERT_FALSE((bool)error);
+
+    EXPECT_EQ(field->length(), view.length());
+    EXPECT_EQ(field->discontinuity_indicator(),
+              view.discontinuity_indicator());
+    EXPECT_EQ(field->random_access_indicator(),
+              view.random_access_indicator());
+    EXPECT_EQ(field->elementary_stream_priority_indicator(),
+              view.elementary_stream_priority_indicator());
+    EXPECT_TRUE(view.pcr_flag());
+    EXPECT_TRUE(view.opcr_flag());
+    EXPECT_TRUE(view.splicing_point_flag());
+    EXPECT_TRUE(view.transport_private_data_flag());
+    EXPECT_TRUE(view.adaptation_field_extension_flag());
+    EXPECT_EQ(field->program_clock_reference(),
+              view.program_clock_reference());
+    EXPECT_EQ(field->original_program_clock_reference(),
+              view.original_program_clock_reference());
+    EXPECT_EQ(field->splice_countdown(), view.splice_countdown());
+    EXPECT_EQ(field->transport_private_data_length(),
+              view.transport_private_data_length());
+    EXPECT_EQ(data.data() + 16, view.transport_private_data());
+    EXPECT_TRUE(view.ltw_flag());
+    EXPECT_TRUE(view.piecewise_rate_flag());
+    EXPECT_TRUE(view.seamless_splice_flag());
+    EXPECT_EQ(field->ltw_valid_flag(), view.ltw_valid_flag());
+    EXPECT_EQ(field->ltw_offset(), view.ltw_offset());
+    EXPECT_EQ(field->piecewise_rate(), view.piecewise_rate());
+    EXPECT_EQ(field->splice_type(), view.splice_type());
+    EXPECT_EQ(field->dts_next_au(), view.dts_next_au());
+}
+
+TEST(test_adaptation_field_view, verify_truncated)
+{
+    // The flags announce a pcr which does not fit in the length.
+    std::vector<uint8_t> data = { 0x04, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+    mts::adaptation_field_view view(data.data());
+    EXPECT_TRUE(view.pcr_flag());
+
+    std::error_code error;
+    view.verify(error);
+    EXPECT_EQ(mts::error::invalid_adaptation_field_length, error);
+
+    data[0] = 0x01;
+    data[1] = 0x00;
+    error.clear();
+    view.verify(error);
+    EXPECT_FALSE((bool)error);
+}
@@ -0,0 +1,196 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/adts_splitter.hpp>
+#include <mts/parser.hpp>
+#include <mts/pes.hpp>
+
+#include <fstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+/// The payloads and presentation timestamps of the audio pes of the test
+/// file.
+std::vector<std::pair<std::vector<uint8_t>, uint64_t>> read_audio()
+{
+    std::ifstream file("test.ts", std::ios::binary|std::ios::ate);
+    EXPECT_TRUE(file.is_open());
+    auto size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    std::vector<std::pair<std::vector<uint8_t>, uint64_t>> result;
+    mts::parser parser;
+    parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+    {
+        if (parser.stream_type(pid) !=
+            mts::stream_type::adts_transport_13818_7)
+        {
+            return;
+        }
+        std::error_code error;
+        const auto& data = parser.pes_data();
+        auto pes = mts::pes::parse(data.data(), data.size(), error);
+        ASSERT_FALSE((bool)error);
+        result.push_back({
+            std::vector<uint8_t>(
+                pes->payload_data(),
+                pes->payload_data() + pes->payload_size()),
+            pes->presentation_timestamp()});
+    });
+    return result;
+}
+
+/// Writes an ADTS header of an AAC LC frame.
+void write_header(
+    uint8_t* data, uint32_t frame_size, uint8_t sampling_frequency_index)
+{
+    data[0] = 0xFF;
+    data[1] = 0xF1;
+    data[2] = (uint8_t)(0x40 | (sampling_frequency_index << 2));
+    data[3] = (uint8_t)(0x80 | (frame_size >> 11));
+    data[4] = (uint8_t)(frame_size >> 3);
+    data[5] = (uint8_t)((frame_size << 5) | 0x1F);
+    data[6] = 0xFC;
+}
+}
+
+TEST(test_adts_splitter, test_file)
+{
+    auto audio = read_audio();
+    ASSERT_FALSE(audio.empty());
+
+    mts::adts_splitter splitter;
+    uint32_t frames = 0;
+    for (const auto& pes : audio)
+    {
+        auto begin = pes.first.data();
+        auto end = begin + pes.first.size();
+        uint64_t expected_pts = pes.second;
+        uint64_t offset = 0;
+        splitter.read(begin, pes.first.size(), pes.second,
+                      [&](const mts::adts_frame& frame)
+        {
+            // The frames of the test file are aligned with the pes.
+            EXPECT_EQ(begin + offset, frame.m_data);
+            EXPECT_LE(frame.m_data + frame.m_size, end);
+            offset += frame.m_size;
+
+            EXPECT_EQ(1U, frame.m_profile);
+            EXPECT_EQ(2U, frame.m_channel_configuration);
+            EXPECT_EQ(1024U, frame.m_samples);
+            EXPECT_EQ(expected_pts, frame.m_pts);
+            expected_pts +=
+                frame.m_samples * 90000U / frame.m_sample_rate;
+            frames++;
+        });
+        EXPECT_EQ(pes.first.size(), offset);
+    }
+    EXPECT_LT(audio.size(), frames);
+    EXPECT_EQ(0U, splitter.skipped_bytes());
+}
+
+TEST(test_adts_splitter, split_payloads)
+{
+    // Frames of 100 to 300 bytes at 48 kHz, split into pieces of every
+    // size, with the timestamp of the frame starting in each piece.
+    std::vector<uint8_t> stream;
+    std::vector<uint32_t> offsets;
+    for (uint32_t i = 0; i < 50; ++i)
+    {
+        uint32_t frame_size = 100U + (i * 37U) % 200U;
+        offsets.push_back((uint32_t)stream.size());
+        stream.resize(stream.size() + frame_size, (uint8_t)i);
+        write_header(stream.data() + offsets.back(), frame_size, 3);
+    }
+
+    for (uint32_t piece_size : {1U, 6U, 7U, 8U, 150U, 1000U})
+    {
+        mts::adts_splitter splitter;
+        std::vector<std::vector<uint8_t>> frames;
+        std::vector<uint64_t> timestamps;
+        auto on_frame = [&](const mts::adts_frame& frame)
+        {
+            EXPECT_EQ(48000U, frame.m_sample_rate);
+            frames.push_back({frame.m_data, frame.m_data + frame.m_size});
+            timestamps.push_back(frame.m_pts);
+        };
+
+        for (uint32_t offset = 0; offset < stream.size();
+             offset += piece_size)
+        {
+            auto size = std::min<uint32_t>(
+                piece_size, (uint32_t)stream.size() - offset);
+            splitter.read(stream.data() + offset, size, 90000U, on_frame);
+        }
+
+        ASSERT_EQ(offsets.size(), frames.size()) << piece_size;
+        for (uint32_t i = 0; i < frames.size(); ++i)
+        {
+            auto end = i + 1 < offsets.size() ? offsets[i + 1] :
+                (uint32_t)stream.size();
+            EXPECT_EQ(std::vector<uint8_t>(
+                stream.begin() + offsets[i], stream.begin() + end),
+                frames[i]);
+        }
+
+        // Every piece carries the same timestamp, so the frames starting
+        // in the same piece as a previous one are counted from it.
+        EXPECT_EQ(90000U, timestamps[0]);
+        EXPECT_EQ(0U, splitter.skipped_bytes());
+    }
+}
+
+TEST(test_adts_splitter, resynchronize)
+{
+    std::vector<uint8_t> stream(20, 0x00);
+    stream[5] = 0xFF;
+    stream.resize(stream.size() + 100, 0x11);
+    write_header(stream.data() + 20, 100, 4);
+    stream.resize(stream.size() + 100, 0x22);
+    write_header(stream.data() + 120, 100, 4);
+
+    mts::adts_splitter splitter;
+    std::vector<uint64_t> timestamps;
+    splitter.read(stream.data(), stream.size(), 1000U,
+                  [&](const mts::adts_frame& frame)
+    {
+        EXPECT_EQ(44100U, frame.m_sample_rate);
+        EXPECT_EQ(100U, frame.m_size);
+        timestamps.push_back(frame.m_pts);
+    });
+
+    EXPECT_EQ(20U, splitter.skipped_bytes());
+    std::vector<uint64_t> expected = { 1000U, 1000U + 1024U * 90000U / 44100U };
+    EXPECT_EQ(expected, timestamps);
+}
+
+TEST(test_adts_splitter, invalid_pending_header)
+{
+    // The first payload ends with a byte which looks like the start of a
+    // header, the second starts with a frame.
+    std::vector<uint8_t> first(50, 0x00);
+    write_header(first.data(), 49, 4);
+    first.back() = 0xFF;
+    std::vector<uint8_t> second(100, 0x33);
+    write_header(second.data(), 100, 4);
+
+    mts::adts_splitter splitter;
+    std::vector<uint64_t> timestamps;
+    auto on_frame = [&](const mts::adts_frame& frame)
+    {
+        timestamps.push_back(frame.m_pts);
+    };
+    splitter.read(first.data(), first.size(), 1000U, on_frame);
+    splitter.read(second.data(), second.size(), 5000U, on_frame);
+
+    std::vector<uint64_t> expected = { 1000U, 5000U };
+    EXPECT_EQ(expected, timestamps);
+    EXPECT_EQ(1U, splitter.skipped_bytes());
+}
@@ -0,0 +1,58 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/buffer_pool.hpp>
+
+#include <gtest/gtest.h>
+
+TEST(test_buffer_pool, acquire_and_release)
+{
+    mts::buffer_pool pool;
+    EXPECT_EQ(0U, pool.allocations());
+    EXPECT_EQ(0U, pool.free_buffers());
+
+    auto small = pool.acquire(10);
+    EXPECT_EQ(0U, small.size());
+    EXPECT_LE(mts::buffer_pool::min_capacity(), small.capacity());
+    EXPECT_EQ(1U, pool.allocations());
+
+    auto large = pool.acquire(100000);
+    EXPECT_LE(100000U, large.capacity());
+    EXPECT_EQ(2U, pool.allocations());
+
+    large.resize(100);
+    pool.release(std::move(large));
+    pool.release(std::move(small));
+    EXPECT_EQ(2U, pool.free_buffers());
+
+    // The buffers are reused for requests of their size class.
+    auto buffer = pool.acquire(70000);
+    EXPECT_EQ(0U, buffer.size());
+    EXPECT_LE(100000U, buffer.capacity());
+    EXPECT_EQ(2U, pool.allocations());
+
+    // The small buffer is too small, and the large buffer is not handed out
+    // for small requests.
+    pool.release(std::move(buffer));
+    auto medium = pool.acquire(5000);
+    EXPECT_LE(5000U, medium.capacity());
+    EXPECT_EQ(3U, pool.allocations());
+    EXPECT_EQ(2U, pool.free_buffers());
+}
+
+TEST(test_buffer_pool, reserve)
+{
+    mts::buffer_pool pool;
+    pool.reserve(4, 65536);
+    EXPECT_EQ(4U, pool.free_buffers());
+
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        auto buffer = pool.acquire(40000);
+        EXPECT_LE(65536U, buffer.capacity());
+    }
+    EXPECT_EQ(0U, pool.allocations());
+    EXPECT_EQ(0U, pool.free_buffers());
+}
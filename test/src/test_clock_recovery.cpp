@@ -0,0 +1,123 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/clock_recovery.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+// A 4 Mbit/s multiplex with a PCR every 10 packets.
+const uint64_t packet_bytes = 188U;
+const uint64_t bitrate = 4000000U;
+const uint64_t pcr_bytes = 10U * packet_bytes;
+const uint64_t pcr_ticks =
+    pcr_bytes * 8U * mts::clock_recovery::frequency() / bitrate;
+}
+
+TEST(test_clock_recovery, constant_bitrate)
+{
+    mts::clock_recovery clock;
+    EXPECT_FALSE(clock.has_pcr());
+    EXPECT_FALSE(clock.has_bitrate());
+
+    // The packets arrive with up to 1000 ticks of noise, with the local
+    // clock 5000 ticks ahead of the PCR.
+    std::srand(42);
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        uint64_t pcr = 1000000U + i * pcr_ticks;
+        uint64_t arrival_time = pcr + 5000U + std::rand() % 1000;
+        clock.update(pcr, i * pcr_bytes, arrival_time, false);
+    }
+
+    EXPECT_TRUE(clock.has_pcr());
+    ASSERT_TRUE(clock.has_bitrate());
+    EXPECT_NEAR((double)bitrate, clock.bitrate(), bitrate * 0.001);
+    EXPECT_LT(100.0, clock.jitter());
+    EXPECT_GT(1000.0, clock.jitter());
+    EXPECT_EQ(0U, clock.discontinuities());
+
+    uint64_t last_pcr = 1000000U + 999U * pcr_ticks;
+    uint64_t last_position = 999U * pcr_bytes;
+    EXPECT_EQ(last_pcr, clock.pcr());
+
+    // Half way to the next PCR.
+    auto pcr = clock.pcr_at(last_position + pcr_bytes / 2);
+    EXPECT_NEAR((double)(last_pcr + pcr_ticks / 2), (double)pcr, 10.0);
+
+    // The local time follows the PCR with the offset and average noise.
+    auto departure_time = clock.departure_time(pcr);
+    EXPECT_NEAR((double)(pcr + 5500U), (double)departure_time, 500.0);
+}
+
+TEST(test_clock_recovery, wrap_around)
+{
+    mts::clock_recovery clock;
+
+    uint64_t first_pcr = mts::clock_recovery::pcr_period() - 5U * pcr_ticks;
+    for (uint64_t i = 0; i < 10; ++i)
+    {
+        uint64_t pcr = (first_pcr + i * pcr_ticks) %
+            mts::clock_recovery::pcr_period();
+        clock.update(pcr, i * pcr_bytes, i * pcr_ticks, false);
+    }
+
+    EXPECT_EQ(0U, clock.discontinuities());
+    EXPECT_NEAR((double)bitrate, clock.bitrate(), 1.0);
+    EXPECT_EQ(4U * pcr_ticks, clock.pcr());
+
+    // The departure times continue past the wrap around.
+    EXPECT_EQ(9U * pcr_ticks, clock.departure_time(clock.pcr()));
+}
+
+TEST(test_clock_recovery, discontinuities)
+{
+    mts::clock_recovery clock;
+
+    uint64_t position = 0;
+    uint64_t arrival_time = 0;
+    uint64_t pcr = 0;
+    auto update = [&](bool discontinuity)
+    {
+        clock.update(pcr, position, arrival_time, discontinuity);
+        pcr += pcr_ticks;
+        position += pcr_bytes;
+        arrival_time += pcr_ticks;
+    };
+
+    for (uint32_t i = 0; i < 10; ++i)
+        update(false);
+
+    // A signalled jump of the PCR.
+    pcr += 123456789U;
+    update(true);
+    EXPECT_EQ(1U, clock.discontinuities());
+
+    for (uint32_t i = 0; i < 10; ++i)
+        update(false);
+
+    // An unsignalled jump backwards.
+    pcr -= 10U * pcr_ticks;
+    update(false);
+    EXPECT_EQ(2U, clock.discontinuities());
+
+    for (uint32_t i = 0; i < 10; ++i)
+        update(false);
+
+    // The estimates carry on over the discontinuities.
+    EXPECT_EQ(2U, clock.discontinuities());
+    EXPECT_NEAR((double)bitrate, clock.bitrate(), 1.0);
+    EXPECT_NEAR(
+        (double)(arrival_time - pcr_ticks),
+        (double)clock.departure_time(clock.pcr()), 2.0);
+
+    clock.reset();
+    EXPECT_FALSE(clock.has_pcr());
+    EXPECT_EQ(0U, clock.discontinuities());
+}
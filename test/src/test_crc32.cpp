@@ -0,0 +1,81 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/crc32.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+uint32_t bitwise_crc32(const uint8_t* data, uint64_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        crc ^= (uint32_t)data[i] << 24;
+        for (uint32_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
+        }
+    }
+    return crc;
+}
+}
+
+TEST(test_crc32, check_value)
+{
+    std::string check = "123456789";
+    EXPECT_EQ(0x0376E6E7U, mts::crc32::compute(
+        (const uint8_t*)check.data(), check.size()));
+    EXPECT_EQ(0xFFFFFFFFU, mts::crc32::compute(nullptr, 0));
+}
+
+TEST(test_crc32, matches_bitwise)
+{
+    std::srand(42);
+    std::vector<uint8_t> data(1000);
+    for (auto& byte : data)
+    {
+        byte = std::rand() % 256;
+    }
+
+    // All alignments and tails of the eight byte steps.
+    for (uint64_t offset = 0; offset < 8; ++offset)
+    {
+        for (uint64_t size = 0; size < 40; ++size)
+        {
+            EXPECT_EQ(
+                bitwise_crc32(data.data() + offset, size),
+                mts::crc32::compute(data.data() + offset, size));
+        }
+    }
+    EXPECT_EQ(
+        bitwise_crc32(data.data(), data.size()),
+        mts::crc32::compute(data.data(), data.size()));
+
+    // Continuing a CRC gives the same result.
+    auto crc = mts::crc32::compute(data.data(), 123);
+    crc = mts::crc32::update(crc, data.data() + 123, data.size() - 123);
+    EXPECT_EQ(mts::crc32::compute(data.data(), data.size()), crc);
+}
+
+TEST(test_crc32, section_with_crc_is_zero)
+{
+    // A PAT with a single program.
+    std::vector<uint8_t> section =
+        { 0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00, 0x00, 0x01, 0xF0,
+          0x00 };
+    auto crc = mts::crc32::compute(section.data(), section.size());
+    section.push_back(crc >> 24);
+    section.push_back(crc >> 16);
+    section.push_back(crc >> 8);
+    section.push_back(crc);
+    EXPECT_EQ(0U, mts::crc32::compute(section.data(), section.size()));
+}
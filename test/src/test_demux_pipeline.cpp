@@ -0,0 +1,249 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/demux_pipeline.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "test_file.hpp"
+
+namespace
+{
+using payloads = std::map<uint16_t, std::vector<std::vector<uint8_t>>>;
+}
+
+TEST(test_demux_pipeline, matches_parser)
+{
+    auto buffer = read_test_file();
+
+    // The payloads of each PID using a single parser.
+    payloads expected;
+    {
+        mts::parser parser;
+        parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+        {
+            auto& pes_data = parser.pes_data();
+            std::error_code error;
+            auto pes = mts::pes::parse(
+                pes_data.data(), pes_data.size(), error);
+            ASSERT_FALSE((bool) error);
+            expected[pid].emplace_back(
+                pes->payload_data(),
+                pes->payload_data() + pes->payload_size());
+        });
+    }
+    EXPECT_EQ(2U, expected.size());
+
+    for (uint32_t shards : {1U, 2U, 3U})
+    {
+        std::mutex mutex;
+        payloads results;
+        std::map<uint16_t, mts::stream_type> types;
+        mts::demux_pipeline pipeline(shards,
+            [&](uint16_t pid, mts::stream_type type, const mts::pes& pes)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                types[pid] = type;
+                results[pid].emplace_back(
+                    pes.payload_data(),
+                    pes.payload_data() + pes.payload_size());
+            });
+        EXPECT_EQ(shards, pipeline.shards());
+
+        // Read in batches, the last one is shorter.
+        uint64_t packets = 100;
+        for (uint64_t offset = 0; offset < buffer.size();
+             offset += packets * mts::parser::packet_size())
+        {
+            auto size = std::min<uint64_t>(
+                packets * mts::parser::packet_size(), buffer.size() - offset);
+            pipeline.read(buffer.data() + offset, size);
+        }
+        pipeline.flush();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(expected, results) << shards;
+        EXPECT_EQ(mts::stream_type::avc_video_stream, types[256]);
+        EXPECT_EQ(mts::stream_type::adts_transport_13818_7, types[257]);
+    }
+}
+
+TEST(test_demux_pipeline, packets_before_pat)
+{
+    auto file = read_test_file();
+    const auto packet_size = mts::parser::packet_size();
+
+    // SI packets, then the PMT and stream packets before any PAT, then the
+    // whole file.
+    std::vector<uint8_t> buffer;
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        std::vector<uint8_t> sdt(packet_size, 0xFF);
+        sdt[0] = 0x47;
+        sdt[1] = 0x40;
+        sdt[2] = 0x11;
+        sdt[3] = 0x10 | i;
+        buffer.insert(buffer.end(), sdt.begin(), sdt.end());
+    }
+    for (uint64_t offset = 0; offset < 100 * packet_size;
+         offset += packet_size)
+    {
+        uint16_t pid = ((file[offset + 1] & 0x1F) << 8) | file[offset + 2];
+        if (pid == 0)
+            continue;
+        buffer.insert(buffer.end(), file.begin() + offset,
+                      file.begin() + offset + packet_size);
+    }
+    buffer.insert(buffer.end(), file.begin(), file.end());
+
+    payloads expected;
+    {
+        mts::parser parser;
+        parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+        {
+            auto& pes_data = parser.pes_data();
+            std::error_code error;
+            auto pes = mts::pes::parse(
+                pes_data.data(), pes_data.size(), error);
+            ASSERT_FALSE((bool) error);
+            expected[pid].emplace_back(
+                pes->payload_data(),
+                pes->payload_data() + pes->payload_size());
+        });
+    }
+    EXPECT_EQ(2U, expected.size());
+
+    std::mutex mutex;
+    payloads results;
+    {
+        mts::demux_pipeline pipeline(3,
+            [&](uint16_t pid, mts::stream_type, const mts::pes& pes)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                results[pid].emplace_back(
+                    pes.payload_data(),
+                    pes.payload_data() + pes.payload_size());
+            });
+        pipeline.read(buffer.data(), buffer.size());
+        pipeline.flush();
+    }
+    EXPECT_EQ(expected, results);
+}
+
+TEST(test_demux_pipeline, slow_feed)
+{
+    auto buffer = read_test_file();
+
+    uint32_t expected = 0;
+    {
+        mts::parser parser;
+        parser.read(buffer.data(), buffer.size(), [&](uint16_t)
+        {
+            expected++;
+        });
+    }
+
+    // The shards go to sleep between the reads, and must wake up for each.
+    std::atomic<uint32_t> delivered{0};
+    {
+        mts::demux_pipeline pipeline(2,
+            [&](uint16_t, mts::stream_type, const mts::pes&)
+            {
+                delivered++;
+            });
+
+        const uint64_t batch = 50 * mts::parser::packet_size();
+        for (uint64_t offset = 0; offset < buffer.size(); offset += batch)
+        {
+            pipeline.read(buffer.data() + offset,
+                          std::min<uint64_t>(batch, buffer.size() - offset));
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            if (offset % (4 * batch) == 0)
+                pipeline.flush();
+        }
+        pipeline.flush();
+        EXPECT_EQ(expected, delivered.load());
+    }
+}
+
+TEST(test_demux_pipeline, pat_updates)
+{
+    auto file = read_test_file();
+
+    // The file starts with an SDT packet followed by the first PAT.
+    const auto pat_offset = mts::parser::packet_size();
+    ASSERT_EQ(0x00, file[pat_offset + 1] & 0x1F);
+    ASSERT_EQ(0x00, file[pat_offset + 2]);
+    uint8_t continuity_counter = file[pat_offset + 3] & 0x0F;
+
+    // A PAT listing program 1 on PID 0x1000 and program 2 on a stream PID.
+    auto write_pat = [&](uint8_t version, uint16_t pid, uint8_t counter)
+    {
+        mts::pat pat;
+        pat.set_version_number(version);
+        pat.add_program_entry(1, 0x1000);
+        pat.add_program_entry(2, pid);
+
+        std::vector<uint8_t> packet(mts::parser::packet_size(), 0xFF);
+        packet[0] = 0x47;
+        packet[1] = 0x40;
+        packet[2] = 0x00;
+        packet[3] = 0x10 | (counter & 0x0F);
+        packet[4] = 0x00;
+        pat.write(packet.data() + 5, packet.size() - 5);
+        return packet;
+    };
+
+    // Before the first PAT of the file, a PAT with a bad CRC listing the
+    // audio PID, and a new version listing the video PID which is dropped
+    // again by the PAT of the file. Neither PID may stay broadcast to every
+    // shard.
+    std::vector<uint8_t> buffer(file.begin(), file.begin() + pat_offset);
+    auto corrupt = write_pat(20, 257, continuity_counter - 2);
+    corrupt[5 + 3] ^= 0x01;
+    buffer.insert(buffer.end(), corrupt.begin(), corrupt.end());
+    auto update = write_pat(21, 256, continuity_counter - 1);
+    buffer.insert(buffer.end(), update.begin(), update.end());
+    buffer.insert(buffer.end(), file.begin() + pat_offset, file.end());
+
+    payloads expected;
+    {
+        mts::parser parser;
+        parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+        {
+            auto& pes_data = parser.pes_data();
+            std::error_code error;
+            auto pes = mts::pes::parse(
+                pes_data.data(), pes_data.size(), error);
+            ASSERT_FALSE((bool) error);
+            expected[pid].emplace_back(
+                pes->payload_data(),
+                pes->payload_data() + pes->payload_size());
+        });
+    }
+    EXPECT_EQ(2U, expected.size());
+
+    std::mutex mutex;
+    payloads results;
+    {
+        mts::demux_pipeline pipeline(3,
+            [&](uint16_t pid, mts::stream_type, const mts::pes& pes)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                results[pid].emplace_back(
+                    pes.payload_data(),
+                    pes.payload_data() + pes.payload_size());
+            });
+        pipeline.read(buffer.data(), buffer.size());
+        pipeline.flush();
+    }
+    EXPECT_EQ(expected, results);
+}
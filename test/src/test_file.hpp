@@ -0,0 +1,25 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+/// @return The contents of test.ts, the transport stream the tests read.
+inline std::vector<uint8_t> read_test_file()
+{
+    std::ifstream file("test.ts", std::ios::binary|std::ios::ate);
+    EXPECT_TRUE(file.is_open());
+    auto size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+    return buffer;
+}
@@ -0,0 +1,87 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/file_reader.hpp>
+#include <mts/packetizer.hpp>
+#include <mts/parser.hpp>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "test_file.hpp"
+
+TEST(test_file_reader, read)
+{
+    auto expected = read_test_file();
+
+    for (bool direct_io : {false, true})
+    {
+        mts::file_reader reader(5000, 3);
+        EXPECT_EQ(8192U, reader.buffer_size());
+        EXPECT_EQ(3 * 8192U, reader.memory_size());
+
+        reader.set_direct_io(direct_io);
+        std::error_code error;
+        reader.open("test.ts", error);
+        ASSERT_FALSE(error);
+        ASSERT_TRUE(reader.is_open());
+        EXPECT_EQ(expected.size(), reader.file_size());
+
+        std::vector<uint8_t> data;
+        reader.read([&](const uint8_t* buffer, uint64_t size)
+        {
+            EXPECT_LE(size, reader.buffer_size());
+            data.insert(data.end(), buffer, buffer + size);
+        }, error);
+        EXPECT_FALSE(error);
+        EXPECT_EQ(expected, data);
+
+        // Reading from an offset which is not aligned.
+        uint64_t offset = 188 * 100;
+        data.clear();
+        reader.read(offset, [&](const uint8_t* buffer, uint64_t size)
+        {
+            data.insert(data.end(), buffer, buffer + size);
+        }, error);
+        EXPECT_FALSE(error);
+        EXPECT_EQ(std::vector<uint8_t>(expected.begin() + offset,
+                                       expected.end()), data);
+        reader.close();
+        EXPECT_FALSE(reader.is_open());
+    }
+}
+
+TEST(test_file_reader, parse)
+{
+    mts::file_reader reader(1 << 16);
+    std::error_code error;
+    reader.open("test.ts", error);
+    ASSERT_FALSE(error);
+
+    // The buffers do not end on packet boundaries, so the packetizer
+    // assembles the packets for the parser.
+    mts::parser parser;
+    uint32_t pes_count = 0;
+    mts::packetizer packetizer([&](const uint8_t* data, uint64_t size)
+    {
+        parser.read(data, size, [&](uint16_t) { ++pes_count; });
+    });
+    reader.read([&](const uint8_t* data, uint64_t size)
+    {
+        packetizer.read(data, size);
+    }, error);
+    EXPECT_FALSE(error);
+    EXPECT_EQ(198U, pes_count);
+}
+
+TEST(test_file_reader, missing_file)
+{
+    mts::file_reader reader;
+    std::error_code error;
+    reader.open("missing.ts", error);
+    EXPECT_EQ(std::errc::no_such_file_or_directory, error);
+    EXPECT_FALSE(reader.is_open());
+}
@@ -55,3 +55,35 @@ TEST(test_helper, continuity_loss_calculation)
     EXPECT_EQ(3U, mts::helper::continuity_loss_calculation(15, 2));
     EXPECT_EQ(4U, mts::helper::continuity_loss_calculation(15, 3));
 }
+
+TEST(test_helper, write_timestamp)
+{
+    uint64_t timestamp = 0x1C0FFEE42;
+    uint8_t data[5];
+    mts::helper::write_timestamp(0x2, timestamp, data);
+    EXPECT_EQ(0x2U, data[0] >> 4U);
+
+    // The marker bits are set.
+    EXPECT_EQ(1U, data[0] & 0x01U);
+    EXPECT_EQ(1U, data[2] & 0x01U);
+    EXPECT_EQ(1U, data[4] & 0x01U);
+
+    uint8_t ts_32_30 = (data[0] >> 1) & 0x07;
+    uint16_t ts_29_15 = ((data[1] << 8) | data[2]) >> 1;
+    uint16_t ts_14_0 = ((data[3] << 8) | data[4]) >> 1;
+    EXPECT_EQ(
+        timestamp, mts::helper::read_timestamp(ts_32_30, ts_29_15, ts_14_0));
+}
+
+TEST(test_helper, write_clock_reference)
+{
+    uint64_t pcr = 0x1C0FFEE42ULL * 300 + 299;
+    uint8_t data[6];
+    mts::helper::write_clock_reference(pcr, data);
+
+    uint64_t base = ((uint64_t)data[0] << 25) | ((uint64_t)data[1] << 17) |
+                    ((uint64_t)data[2] << 9) | ((uint64_t)data[3] << 1) |
+                    (data[4] >> 7);
+    uint16_t extension = ((data[4] & 0x01) << 8) | data[5];
+    EXPECT_EQ(pcr, base * 300 + extension);
+}
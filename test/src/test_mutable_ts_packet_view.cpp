@@ -0,0 +1,56 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/mutable_ts_packet_view.hpp>
+
+#include <fstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(test_mutable_ts_packet_view, rewrite_fields)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary);
+    ASSERT_TRUE(file.is_open());
+    std::vector<uint8_t> packet(188);
+
+    uint32_t pcr_count = 0;
+    while (file.read((char*)packet.data(), packet.size()))
+    {
+        auto original = packet;
+        mts::mutable_ts_packet_view view(packet.data());
+
+        view.set_pid(0x1ABC);
+        view.set_continuity_counter(
+            (view.continuity_counter() + 5) & 0x0F);
+        EXPECT_EQ(0x1ABCU, view.pid());
+        EXPECT_EQ((original[3] + 5) & 0x0F, view.continuity_counter());
+
+        // The other header bits are kept.
+        EXPECT_EQ(original[1] & 0xE0, packet[1] & 0xE0);
+        EXPECT_EQ(original[3] & 0xF0, packet[3] & 0xF0);
+
+        if (view.has_adaptation_field() &&
+            view.adaptation_field().length() != 0 &&
+            view.adaptation_field().pcr_flag())
+        {
+            auto pcr = view.adaptation_field().program_clock_reference();
+            view.set_program_clock_reference(pcr + 27000000U);
+            EXPECT_EQ(pcr + 27000000U,
+                      view.adaptation_field().program_clock_reference());
+
+            view.set_discontinuity_indicator(true);
+            EXPECT_TRUE(view.adaptation_field().discontinuity_indicator());
+            EXPECT_EQ(original[5] & 0x7F, packet[5] & 0x7F);
+            pcr_count++;
+        }
+
+        // The payload is untouched.
+        EXPECT_TRUE(std::equal(
+            original.begin() + 12, original.end(), packet.begin() + 12));
+    }
+    EXPECT_NE(0U, pcr_count);
+}
@@ -0,0 +1,207 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/muxer.hpp>
+#include <mts/parser.hpp>
+#include <mts/pes.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+struct pes_info
+{
+    uint16_t m_pid;
+    uint64_t m_pts;
+    uint64_t m_dts;
+    std::vector<uint8_t> m_payload;
+
+    bool operator==(const pes_info& other) const
+    {
+        return m_pid == other.m_pid && m_pts == other.m_pts &&
+               m_dts == other.m_dts && m_payload == other.m_payload;
+    }
+};
+
+/// Parses the pes of a transport stream.
+std::vector<pes_info> demux(mts::parser& parser, std::vector<uint8_t>& ts)
+{
+    std::vector<pes_info> result;
+    parser.read(ts.data(), ts.size(), [&](uint16_t pid)
+    {
+        std::error_code error;
+        const auto& data = parser.pes_data();
+        auto pes = mts::pes::parse(data.data(), data.size(), error);
+        ASSERT_FALSE((bool) error);
+        auto pts = pes->presentation_timestamp();
+        auto dts = pes->has_decoding_timestamp() ?
+            pes->decoding_timestamp() : pts;
+        result.push_back({pid, pts, dts, std::vector<uint8_t>(
+            pes->payload_data(), pes->payload_data() + pes->payload_size())});
+    });
+    return result;
+}
+}
+
+TEST(test_muxer, round_trip)
+{
+    mts::muxer muxer;
+    muxer.add_stream(256, mts::stream_type::avc_video_stream, 0xE0);
+    muxer.add_stream(257, mts::stream_type::adts_transport_13818_7, 0xC0);
+    EXPECT_EQ(256U, muxer.pcr_pid());
+
+    // Payloads of many sizes, among them some without a pes packet length.
+    std::vector<pes_info> expected;
+    for (uint32_t i = 0; i < 200; ++i)
+    {
+        uint64_t dts = 900000U + i * 1800U;
+        std::vector<uint8_t> video((i * 977U) % 70000U);
+        for (uint32_t j = 0; j < video.size(); ++j)
+        {
+            video[j] = (uint8_t)(i + j);
+        }
+        expected.push_back({256, dts + 3600U, dts, video});
+        expected.push_back({257, dts, dts, std::vector<uint8_t>(i + 1, i)});
+    }
+
+    std::vector<uint8_t> ts;
+    for (const auto& pes : expected)
+    {
+        auto offset = ts.size();
+        ts.resize(offset + mts::muxer::max_output_size(pes.m_payload.size()));
+        auto written = muxer.write_pes(
+            pes.m_pid, pes.m_payload.data(), pes.m_payload.size(), pes.m_pts,
+            pes.m_dts, ts.data() + offset);
+        EXPECT_EQ(0U, written % mts::muxer::packet_size());
+        ts.resize(offset + written);
+    }
+
+    // The last pes of each stream is completed by the next one.
+    expected.push_back({256, 0, 0, {}});
+    expected.push_back({257, 0, 0, {}});
+    std::vector<uint8_t> end(
+        mts::muxer::max_output_size(0) + mts::muxer::max_output_size(0));
+    auto written = muxer.write_pes(256, nullptr, 0, 0, 0, end.data());
+    written += muxer.write_pes(257, nullptr, 0, 0, 0, end.data() + written);
+    ts.insert(ts.end(), end.begin(), end.begin() + written);
+
+    mts::parser parser;
+    auto results = demux(parser, ts);
+    expected.resize(expected.size() - 2);
+    EXPECT_EQ(expected, results);
+    EXPECT_EQ(0U, parser.continuity_errors());
+
+    // The PCR follows the decoding times, 100 ms behind.
+    ASSERT_TRUE(parser.has_clock(257));
+    const auto& clock = parser.clock(257);
+    EXPECT_EQ(0U, clock.discontinuities());
+    EXPECT_TRUE(clock.has_bitrate());
+    uint64_t last_clock = (900000U + 199U * 1800U - 9000U) * 300U;
+    EXPECT_GE(last_clock, clock.pcr());
+    EXPECT_LT(last_clock - 3600U * 300U, clock.pcr());
+}
+
+TEST(test_muxer, remux)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    mts::parser parser;
+    auto expected = demux(parser, buffer);
+    EXPECT_EQ(198U, expected.size());
+
+    mts::muxer muxer;
+    muxer.add_stream(256, mts::stream_type::avc_video_stream, 0xE0);
+    muxer.add_stream(257, mts::stream_type::adts_transport_13818_7, 0xC0);
+
+    std::vector<uint8_t> ts;
+    for (const auto& pes : expected)
+    {
+        auto offset = ts.size();
+        ts.resize(offset + mts::muxer::max_output_size(pes.m_payload.size()));
+        ts.resize(offset + muxer.write_pes(
+            pes.m_pid, pes.m_payload.data(), pes.m_payload.size(), pes.m_pts,
+            pes.m_dts, ts.data() + offset));
+    }
+
+    mts::parser remux_parser;
+    auto results = demux(remux_parser, ts);
+
+    // The pes of each stream, all but the last one.
+    ASSERT_EQ(expected.size() - 2, results.size());
+    std::map<uint16_t, std::vector<pes_info>> expected_streams;
+    for (const auto& pes : expected)
+    {
+        expected_streams[pes.m_pid].push_back(pes);
+    }
+    std::map<uint16_t, std::vector<pes_info>> result_streams;
+    for (const auto& pes : results)
+    {
+        result_streams[pes.m_pid].push_back(pes);
+    }
+    for (auto& item : expected_streams)
+    {
+        item.second.pop_back();
+    }
+    EXPECT_EQ(expected_streams, result_streams);
+}
+
+TEST(test_muxer, psi_updates)
+{
+    mts::muxer muxer(42, 0x100);
+    muxer.add_stream(0x200, mts::stream_type::avc_video_stream, 0xE0);
+    muxer.set_psi_interval(90000U);
+    muxer.set_pcr_delay(0);
+
+    mts::parser parser;
+    std::vector<uint32_t> streams;
+    parser.set_on_program_change([&](
+        uint16_t pid, const boost::optional<mts::program>&,
+        const boost::optional<mts::program>& current)
+    {
+        EXPECT_EQ(0x100U, pid);
+        ASSERT_TRUE((bool) current);
+        EXPECT_EQ(42U, current->program_number());
+        streams.push_back((uint32_t)current->stream_entries().size());
+    });
+
+    std::vector<uint8_t> payload(1000, 0x11);
+    std::vector<uint8_t> ts(mts::muxer::max_output_size(payload.size()));
+    auto write = [&](uint16_t pid, uint64_t dts)
+    {
+        auto written = muxer.write_pes(
+            pid, payload.data(), payload.size(), dts, dts, ts.data());
+        parser.read(ts.data(), written, [](uint16_t) { });
+        return written / mts::muxer::packet_size();
+    };
+
+    // The PSI is written first and at its interval.
+    auto packets = (payload.size() + 14U + 8U + 183U) / 184U;
+    EXPECT_EQ(2U + packets, write(0x200, 0));
+    EXPECT_EQ(packets, write(0x200, 45000U));
+    EXPECT_EQ(2U + packets, write(0x200, 90000U));
+    EXPECT_EQ(0U, muxer.version_number());
+
+    // Adding a stream writes a new version right away.
+    muxer.add_stream(0x201, mts::stream_type::adts_transport_13818_7, 0xC0);
+    EXPECT_EQ(1U, muxer.version_number());
+    EXPECT_LT(2U, write(0x201, 100000U));
+    EXPECT_TRUE(parser.has_stream(0x201));
+
+    std::vector<uint32_t> expected_streams = { 1U, 2U };
+    EXPECT_EQ(expected_streams, streams);
+}
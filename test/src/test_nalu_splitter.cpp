@@ -0,0 +1,284 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/nalu_splitter.hpp>
+#include <mts/parser.hpp>
+#include <mts/pes.hpp>
+
+#include <fstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+struct nalu_info
+{
+    std::vector<uint8_t> m_data;
+    uint8_t m_type;
+    uint64_t m_pts;
+    bool m_access_unit_start;
+    bool m_random_access;
+
+    bool operator==(const nalu_info& other) const
+    {
+        return m_data == other.m_data && m_type == other.m_type &&
+               m_pts == other.m_pts &&
+               m_access_unit_start == other.m_access_unit_start &&
+               m_random_access == other.m_random_access;
+    }
+};
+
+/// The payloads and presentation timestamps of the video pes of the test
+/// file.
+std::vector<std::pair<std::vector<uint8_t>, uint64_t>> read_video()
+{
+    std::ifstream file("test.ts", std::ios::binary|std::ios::ate);
+    EXPECT_TRUE(file.is_open());
+    auto size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    std::vector<std::pair<std::vector<uint8_t>, uint64_t>> result;
+    mts::parser parser;
+    parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+    {
+        if (parser.stream_type(pid) != mts::stream_type::avc_video_stream)
+            return;
+        std::error_code error;
+        const auto& data = parser.pes_data();
+        auto pes = mts::pes::parse(data.data(), data.size(), error);
+        ASSERT_FALSE((bool)error);
+        result.push_back({
+            std::vector<uint8_t>(
+                pes->payload_data(),
+                pes->payload_data() + pes->payload_size()),
+            pes->presentation_timestamp()});
+    });
+    return result;
+}
+
+nalu_info to_info(const mts::nalu& nalu)
+{
+    return {
+        std::vector<uint8_t>(nalu.m_data, nalu.m_data + nalu.m_size),
+        nalu.m_type, nalu.m_pts, nalu.m_access_unit_start,
+        nalu.m_random_access};
+}
+}
+
+TEST(test_nalu_splitter, h264)
+{
+    auto video = read_video();
+    ASSERT_FALSE(video.empty());
+
+    std::vector<nalu_info> nalus;
+    mts::nalu_splitter splitter(mts::stream_type::avc_video_stream);
+    for (const auto& pes : video)
+    {
+        splitter.read(pes.first.data(), pes.first.size(), pes.second,
+                      pes.second, [&](const mts::nalu& nalu)
+        {
+            nalus.push_back(to_info(nalu));
+        });
+    }
+    splitter.flush([&](const mts::nalu& nalu)
+    {
+        nalus.push_back(to_info(nalu));
+    });
+
+    // Each pes of the file holds an access unit.
+    uint32_t access_units = 0;
+    uint32_t random_access = 0;
+    for (const auto& nalu : nalus)
+    {
+        access_units += nalu.m_access_unit_start;
+        random_access += nalu.m_random_access;
+        EXPECT_NE(0U, nalu.m_data[nalu.m_data.size() - 1]);
+    }
+    EXPECT_EQ(video.size(), access_units);
+    EXPECT_NE(0U, random_access);
+    EXPECT_TRUE(nalus[0].m_access_unit_start);
+
+    // The pes start with a NAL unit, so the aligned splitter finds the
+    // same NAL units without copying any.
+    std::vector<nalu_info> aligned_nalus;
+    mts::nalu_splitter aligned_splitter(mts::stream_type::avc_video_stream);
+    aligned_splitter.set_aligned(true);
+    for (const auto& pes : video)
+    {
+        auto begin = pes.first.data();
+        auto end = begin + pes.first.size();
+        aligned_splitter.read(
+            begin, pes.first.size(), pes.second, pes.second,
+            [&](const mts::nalu& nalu)
+            {
+                EXPECT_GE(nalu.m_data, begin);
+                EXPECT_LE(nalu.m_data + nalu.m_size, end);
+                aligned_nalus.push_back(to_info(nalu));
+            });
+    }
+    EXPECT_EQ(nalus, aligned_nalus);
+}
+
+TEST(test_nalu_splitter, data_alignment_indicator)
+{
+    auto video = read_video();
+    ASSERT_FALSE(video.empty());
+
+    auto split = [&](bool data_alignment_indicator)
+    {
+        std::vector<nalu_info> nalus;
+        uint32_t copies = 0;
+        mts::nalu_splitter splitter(mts::stream_type::avc_video_stream);
+        for (const auto& payload : video)
+        {
+            mts::pes pes;
+            pes.set_stream_id(0xE0);
+            pes.set_data_alignment_indicator(data_alignment_indicator);
+            pes.set_presentation_timestamp(payload.second);
+            pes.set_payload(payload.first.data(), payload.first.size());
+
+            auto begin = payload.first.data();
+            auto end = begin + payload.first.size();
+            splitter.read(pes, [&](const mts::nalu& nalu)
+            {
+                if (nalu.m_data < begin || nalu.m_data >= end)
+                    copies++;
+                nalus.push_back(to_info(nalu));
+            });
+        }
+        splitter.flush([&](const mts::nalu& nalu)
+        {
+            copies++;
+            nalus.push_back(to_info(nalu));
+        });
+        EXPECT_EQ(video.size(), copies);
+        return nalus;
+    };
+
+    // The indicator does not tell that the pes ends with a complete NAL
+    // unit, so the last NAL unit of each pes is still copied.
+    EXPECT_EQ(split(false), split(true));
+}
+
+TEST(test_nalu_splitter, nalu_split_after_data_alignment_indicator)
+{
+    // An IDR slice starting in a pes with the data alignment indicator set
+    // and continuing in a pes without it, followed by an access unit
+    // delimiter in the next pes.
+    std::vector<uint8_t> slice(200, 0x42);
+    slice[0] = 0x65;
+    slice[1] = 0x88;
+    std::vector<uint8_t> first = {0x00, 0x00, 0x01};
+    first.insert(first.end(), slice.begin(), slice.begin() + 100);
+    std::vector<uint8_t> second(slice.begin() + 100, slice.end());
+    std::vector<uint8_t> third = {0x00, 0x00, 0x01, 0x09, 0x10};
+
+    std::vector<std::vector<uint8_t>> nalus;
+    auto on_nalu = [&](const mts::nalu& nalu)
+    {
+        nalus.emplace_back(nalu.m_data, nalu.m_data + nalu.m_size);
+    };
+
+    mts::nalu_splitter splitter(mts::stream_type::avc_video_stream);
+    std::vector<std::vector<uint8_t>> payloads = {first, second, third};
+    for (uint32_t i = 0; i < payloads.size(); ++i)
+    {
+        mts::pes pes;
+        pes.set_stream_id(0xE0);
+        pes.set_data_alignment_indicator(i != 1);
+        pes.set_payload(payloads[i].data(), payloads[i].size());
+        splitter.read(pes, on_nalu);
+    }
+    splitter.flush(on_nalu);
+
+    ASSERT_EQ(2U, nalus.size());
+    EXPECT_EQ(slice, nalus[0]);
+    EXPECT_EQ(std::vector<uint8_t>({0x09, 0x10}), nalus[1]);
+}
+
+TEST(test_nalu_splitter, split_payloads)
+{
+    auto video = read_video();
+    std::vector<uint8_t> stream;
+    for (const auto& pes : video)
+    {
+        stream.insert(stream.end(), pes.first.begin(), pes.first.end());
+    }
+
+    auto split = [&](uint64_t piece_size)
+    {
+        std::vector<std::vector<uint8_t>> result;
+        mts::nalu_splitter splitter(mts::stream_type::avc_video_stream);
+        auto on_nalu = [&](const mts::nalu& nalu)
+        {
+            result.push_back({nalu.m_data, nalu.m_data + nalu.m_size});
+        };
+        for (uint64_t offset = 0; offset < stream.size();
+             offset += piece_size)
+        {
+            auto size = std::min<uint64_t>(piece_size, stream.size() - offset);
+            splitter.read(stream.data() + offset, size, 0, 0, on_nalu);
+        }
+        splitter.flush(on_nalu);
+        return result;
+    };
+
+    // The start codes are split at every possible position.
+    auto expected = split(stream.size());
+    EXPECT_LT(video.size(), expected.size());
+    for (uint64_t piece_size : {1U, 2U, 3U, 4U, 5U, 184U, 1000U})
+    {
+        EXPECT_EQ(expected, split(piece_size)) << piece_size;
+    }
+}
+
+TEST(test_nalu_splitter, hevc)
+{
+    // Two access units, the first an IDR picture with its parameter sets
+    // in two slice segments, the second a trailing picture without an
+    // access unit delimiter.
+    std::vector<uint8_t> stream =
+        {
+            0x00, 0x00, 0x00, 0x01, 35 << 1, 0x01, 0x50,
+            0x00, 0x00, 0x01, 32 << 1, 0x01, 0x0C,
+            0x00, 0x00, 0x01, 33 << 1, 0x01, 0x01,
+            0x00, 0x00, 0x01, 34 << 1, 0x01, 0xC1,
+            0x00, 0x00, 0x01, 19 << 1, 0x01, 0xAF, 0x11,
+            0x00, 0x00, 0x01, 19 << 1, 0x01, 0x20, 0x22,
+            0x00, 0x00, 0x01, 1 << 1, 0x01, 0x9A, 0x33, 0x00,
+            0x00, 0x00, 0x01, 39 << 1, 0x01, 0x05, 0x44
+        };
+    std::vector<uint8_t> expected_types = { 35, 32, 33, 34, 19, 19, 1, 39 };
+    std::vector<bool> expected_starts =
+        { true, false, false, false, false, false, true, true };
+
+    std::vector<nalu_info> nalus;
+    mts::nalu_splitter splitter(mts::stream_type::hevc_video_stream);
+    auto on_nalu = [&](const mts::nalu& nalu)
+    {
+        nalus.push_back(to_info(nalu));
+    };
+    splitter.read(stream.data(), 20, 1000, 900, on_nalu);
+    splitter.read(stream.data() + 20, stream.size() - 20, 2000, 1900,
+                  on_nalu);
+    splitter.flush(on_nalu);
+
+    ASSERT_EQ(expected_types.size(), nalus.size());
+    for (uint32_t i = 0; i < nalus.size(); ++i)
+    {
+        EXPECT_EQ(expected_types[i], nalus[i].m_type) << i;
+        EXPECT_EQ(expected_starts[i], nalus[i].m_access_unit_start) << i;
+        EXPECT_EQ(expected_types[i] == 19, nalus[i].m_random_access) << i;
+    }
+
+    // The NAL unit split between the payloads has the timestamps of the
+    // first, and the trailing zero is dropped.
+    EXPECT_EQ(1000U, nalus[2].m_pts);
+    EXPECT_EQ(2000U, nalus[3].m_pts);
+    EXPECT_EQ(4U, nalus[6].m_data.size());
+}
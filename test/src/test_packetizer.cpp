@@ -147,3 +147,183 @@ TEST(test_packetizer, packets_of_size_1490_offset)
 {
     test(100, 1490, 33);
 }
+
+TEST(test_packetizer, resync_after_garbage)
+{
+    // Packets with garbage inserted before some of them, the garbage
+    // contains a lot of false sync bytes.
+    std::vector<uint8_t> data;
+    std::vector<std::vector<uint8_t>> expected_packets;
+    for (uint32_t i = 0; i < 50; ++i)
+    {
+        bool garbage = i % 10 == 5;
+        if (garbage)
+        {
+            for (uint32_t j = 0; j < 100 + i; ++j)
+            {
+                data.push_back(j % 3 == 0 ? 0x47 : 0x00);
+            }
+        }
+
+        std::vector<uint8_t> packet(188, i + 1);
+        packet[0] = 0x47;
+
+        // The garbage starts with a sync byte, so when it starts a read it
+        // is released together with the beginning of the following packet,
+        // after which the sync is lost and found again at the next packet.
+        if (!garbage)
+        {
+            expected_packets.push_back(packet);
+        }
+        data.insert(data.end(), packet.begin(), packet.end());
+    }
+
+    for (uint32_t read_size : {1U, 100U, 187U, 188U, 1490U, 20000U})
+    {
+        std::vector<std::vector<uint8_t>> results;
+        mts::packetizer packetizer([&results](auto data, auto size)
+        {
+            results.push_back({data, data + size});
+        });
+
+        for (uint64_t offset = 0; offset < data.size(); offset += read_size)
+        {
+            auto size = std::min<uint64_t>(read_size, data.size() - offset);
+            packetizer.read(data.data() + offset, size);
+        }
+
+        for (const auto& result : results)
+        {
+            EXPECT_EQ(188U, result.size());
+            EXPECT_EQ(mts::packetizer::sync_byte(), result[0]);
+        }
+
+        // The last packet is not released if it ends up being buffered,
+        // as the packetizer waits for the next sync byte.
+        auto expected = expected_packets;
+        expected.pop_back();
+        for (const auto& packet : expected)
+        {
+            EXPECT_NE(
+                std::find(results.begin(), results.end(), packet),
+                results.end()) << (uint32_t)packet[1] << " " << read_size;
+        }
+
+        // At most the garbage is released in addition to the expected
+        // packets.
+        EXPECT_LE(results.size(), expected.size() + 1 + 5) << read_size;
+    }
+}
+
+TEST(test_packetizer, garbage_starting_with_sync_byte)
+{
+    // A valid packet followed by garbage starting with a sync byte, which
+    // must not be released as a packet once in sync.
+    std::vector<uint8_t> data;
+    std::vector<std::vector<uint8_t>> expected_packets;
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        if (i == 5)
+        {
+            std::vector<uint8_t> garbage(200, 0xEE);
+            garbage[0] = 0x47;
+            data.insert(data.end(), garbage.begin(), garbage.end());
+        }
+        std::vector<uint8_t> packet(188, i + 1);
+        packet[0] = 0x47;
+        expected_packets.push_back(packet);
+        data.insert(data.end(), packet.begin(), packet.end());
+    }
+
+    // The garbage is read together with the packet before it, so the sync
+    // byte following that packet is checked.
+    for (uint32_t read_size : {1U, 100U, 500U, 20000U})
+    {
+        std::vector<std::vector<uint8_t>> results;
+        mts::packetizer packetizer([&results](auto data, auto size)
+        {
+            results.push_back({data, data + size});
+        });
+
+        for (uint64_t offset = 0; offset < data.size(); offset += read_size)
+        {
+            auto size = std::min<uint64_t>(read_size, data.size() - offset);
+            packetizer.read(data.data() + offset, size);
+        }
+
+        // The last packet is released if read whole.
+        ASSERT_LE(expected_packets.size() - 1, results.size()) << read_size;
+        results.resize(expected_packets.size(), expected_packets.back());
+        EXPECT_EQ(expected_packets, results) << read_size;
+    }
+}
+
+TEST(test_packetizer, no_lock_on_false_sync_bytes)
+{
+    // A single sync byte followed by data without sync bytes at packet
+    // distance must not be released.
+    std::vector<uint8_t> data(188 * 10, 0x00);
+    for (uint32_t i = 0; i < data.size(); i += 100)
+    {
+        data[i] = 0x47;
+    }
+
+    uint32_t packets = 0;
+    mts::packetizer packetizer([&packets](auto, auto)
+    {
+        packets++;
+    });
+    packetizer.read(data.data(), data.size());
+    EXPECT_EQ(0U, packets);
+    EXPECT_FALSE(packetizer.is_synced());
+    EXPECT_LT(packetizer.buffered(), 188U * mts::packetizer::lock_packets());
+}
+
+TEST(test_packetizer, detect_packet_format)
+{
+    for (auto format : {mts::packet_format::ts, mts::packet_format::m2ts,
+                        mts::packet_format::reed_solomon})
+    {
+        auto stride = mts::packet_stride(format);
+        auto sync_offset = mts::packet_offset(format);
+
+        // Some garbage followed by framed packets, where the framing bytes
+        // are set to 0xAA.
+        std::vector<uint8_t> data(50, 0x47);
+        std::vector<std::vector<uint8_t>> expected_packets;
+        for (uint32_t i = 0; i < 40; ++i)
+        {
+            std::vector<uint8_t> packet(stride, 0xAA);
+            std::fill_n(packet.begin() + sync_offset, 188, i + 1);
+            packet[sync_offset] = mts::packetizer::sync_byte();
+            expected_packets.push_back(packet);
+            data.insert(data.end(), packet.begin(), packet.end());
+        }
+
+        for (uint32_t read_size : {1U, 187U, 192U, 1490U})
+        {
+            std::vector<std::vector<uint8_t>> results;
+            mts::packetizer packetizer([&results](auto data, auto size)
+            {
+                results.push_back({data, data + size});
+            });
+
+            for (uint64_t offset = 0; offset < data.size();
+                 offset += read_size)
+            {
+                auto size = std::min<uint64_t>(
+                    read_size, data.size() - offset);
+                packetizer.read(data.data() + offset, size);
+            }
+
+            EXPECT_TRUE(packetizer.is_synced());
+            EXPECT_EQ(format, packetizer.packet_format());
+            EXPECT_EQ(stride, packetizer.packet_stride());
+            // The last packet may be buffered waiting for the next sync
+            // byte.
+            ASSERT_GE(results.size(), expected_packets.size() - 1);
+            results.resize(expected_packets.size(), expected_packets.back());
+            EXPECT_EQ(expected_packets, results) << read_size;
+        }
+    }
+}
@@ -0,0 +1,185 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/parallel_parser.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+#include <gtest/gtest.h>
+
+#include <mts/crc32.hpp>
+
+TEST(test_parallel_parser, matches_parser)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    // The payloads of each PID using a single parser.
+    std::map<uint16_t, std::vector<std::vector<uint8_t>>> expected;
+    {
+        mts::parser parser;
+        parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+        {
+            auto& pes_data = parser.pes_data();
+            std::error_code error;
+            auto pes = mts::pes::parse(
+                pes_data.data(), pes_data.size(), error);
+            ASSERT_FALSE((bool) error);
+            expected[pid].emplace_back(
+                pes->payload_data(),
+                pes->payload_data() + pes->payload_size());
+        });
+    }
+    EXPECT_EQ(2U, expected.size());
+
+    for (uint32_t threads : {1U, 2U, 3U})
+    {
+        // Chunks smaller than most of the pes, and a single chunk.
+        for (uint64_t chunk_packets : {7U, 100U, 2000U})
+        {
+            mts::parallel_parser parser(
+                threads, chunk_packets * mts::parser::packet_size());
+            EXPECT_EQ(threads, parser.threads());
+            EXPECT_EQ(
+                chunk_packets * mts::parser::packet_size(),
+                parser.chunk_size());
+
+            // The worker threads are reused by the next read.
+            for (uint32_t round = 0; round < 2; ++round)
+            {
+                std::map<uint16_t, std::vector<std::vector<uint8_t>>> results;
+                parser.read(buffer.data(), buffer.size(),
+                    [&](uint16_t pid, mts::stream_type type,
+                        const mts::pes& pes,
+                        const std::vector<mts::slice>& payload)
+                    {
+                        EXPECT_EQ(pid == 256 ?
+                            mts::stream_type::avc_video_stream :
+                            mts::stream_type::adts_transport_13818_7, type);
+
+                        std::vector<uint8_t> data;
+                        for (const auto& slice : payload)
+                        {
+                            data.insert(data.end(), slice.m_data,
+                                        slice.m_data + slice.m_size);
+                        }
+                        EXPECT_EQ(pes.payload_size(), data.size());
+                        results[pid].push_back(data);
+                    });
+
+                EXPECT_EQ(expected, results)
+                    << threads << " " << chunk_packets << " " << round;
+            }
+        }
+    }
+}
+
+TEST(test_parallel_parser, missing_pmt)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    // Replace each PAT with one also listing a program whose PMT never
+    // appears, so the PSI scan does not complete.
+    std::vector<uint8_t> section =
+    {
+        0x00, 0xB0, 0x11, 0x00, 0x01, 0xC1, 0x00, 0x00,
+        0x00, 0x01, 0xF0, 0x00,
+        0x00, 0x02, 0xF1, 0x00
+    };
+    auto crc = mts::crc32::compute(section.data(), section.size());
+    section.insert(section.end(), {
+        (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8),
+        (uint8_t)crc });
+
+    const auto packet_size = mts::parser::packet_size();
+    for (uint64_t offset = 0; offset < buffer.size(); offset += packet_size)
+    {
+        uint8_t* packet = buffer.data() + offset;
+        uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        if (pid != 0)
+            continue;
+        ASSERT_EQ(0x40, packet[1] & 0x40);
+        packet[3] = 0x10 | (packet[3] & 0x0F);
+        packet[4] = 0; // pointer field
+        std::fill(packet + 5, packet + packet_size, 0xFF);
+        std::copy(section.begin(), section.end(), packet + 5);
+    }
+
+    std::map<uint16_t, std::vector<std::vector<uint8_t>>> expected;
+    {
+        mts::parser parser;
+        parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+        {
+            auto& pes_data = parser.pes_data();
+            std::error_code error;
+            auto pes = mts::pes::parse(
+                pes_data.data(), pes_data.size(), error);
+            ASSERT_FALSE((bool) error);
+            expected[pid].emplace_back(
+                pes->payload_data(),
+                pes->payload_data() + pes->payload_size());
+        });
+        EXPECT_FALSE(parser.programs_complete());
+        EXPECT_TRUE(parser.is_program_pid(0x1000));
+        EXPECT_TRUE(parser.is_program_pid(0x1100));
+        EXPECT_FALSE(parser.has_program(0x1100));
+    }
+    EXPECT_EQ(2U, expected.size());
+
+    // The scan and the overlap are limited, but wide enough for the PSI and
+    // the pes of the file.
+    mts::parallel_parser parser(3, 100 * packet_size);
+    EXPECT_EQ(mts::parallel_parser::default_max_psi_scan(),
+              parser.max_psi_scan());
+    EXPECT_EQ(mts::parallel_parser::default_max_overlap(),
+              parser.max_overlap());
+    parser.set_max_psi_scan(200 * packet_size);
+    parser.set_max_overlap(300 * packet_size);
+    EXPECT_EQ(200 * packet_size, parser.max_psi_scan());
+    EXPECT_EQ(300 * packet_size, parser.max_overlap());
+
+    std::map<uint16_t, std::vector<std::vector<uint8_t>>> results;
+    parser.read(buffer.data(), buffer.size(),
+        [&](uint16_t pid, mts::stream_type, const mts::pes&,
+            const std::vector<mts::slice>& payload)
+        {
+            std::vector<uint8_t> data;
+            for (const auto& slice : payload)
+            {
+                data.insert(data.end(), slice.m_data,
+                            slice.m_data + slice.m_size);
+            }
+            results[pid].push_back(data);
+        });
+    EXPECT_EQ(expected, results);
+
+    // A pes which is not completed within the overlap is dropped.
+    parser.set_max_overlap(packet_size);
+    uint64_t count = 0;
+    parser.read(buffer.data(), buffer.size(),
+        [&](uint16_t, mts::stream_type, const mts::pes&,
+            const std::vector<mts::slice>&)
+        {
+            count++;
+        });
+    EXPECT_LT(count, expected[256].size() + expected[257].size());
+}
@@ -5,10 +5,42 @@
 
 #include <mts/parser.hpp>
 
+#include <algorithm>
 #include <fstream>
+#include <map>
 
 #include <gtest/gtest.h>
 
+#include <mts/crc32.hpp>
+
+namespace
+{
+/// Writes a section with its length and CRC filled in into a packet with
+/// the given header, padded with stuffing.
+void write_section_packet(
+    uint16_t pid, uint8_t continuity_counter, std::vector<uint8_t> section,
+    uint8_t* packet)
+{
+    auto length = section.size() - 3 + 4;
+    section[1] = 0xB0 | ((length >> 8) & 0x0F);
+    section[2] = length & 0xFF;
+
+    auto crc = mts::crc32::compute(section.data(), section.size());
+    section.push_back(crc >> 24);
+    section.push_back(crc >> 16);
+    section.push_back(crc >> 8);
+    section.push_back(crc);
+
+    std::fill(packet, packet + mts::parser::packet_size(), 0xFF);
+    packet[0] = 0x47;
+    packet[1] = 0x40 | ((pid >> 8) & 0x1F);
+    packet[2] = pid & 0xFF;
+    packet[3] = 0x10 | (continuity_counter & 0x0F);
+    packet[4] = 0; // pointer field
+    std::copy(section.begin(), section.end(), packet + 5);
+}
+}
+
 TEST(test_parser, test_ts_parsing)
 {
     auto filename = "test.ts";
@@ -49,3 +81,704 @@ TEST(test_parser, test_ts_parsing)
     }
     EXPECT_EQ(198U, pes_found);
 }
+
+TEST(test_parser, test_stream_lookup)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    mts::parser parser;
+    std::vector<uint8_t> packet(mts::parser::packet_size());
+
+    EXPECT_FALSE(parser.has_stream(256));
+    EXPECT_FALSE(parser.has_stream(257));
+
+    for (uint32_t i = 0; i < size / packet.size(); ++i)
+    {
+        file.read((char*)packet.data(), packet.size());
+        std::error_code error;
+        parser.read(packet.data(), error);
+        ASSERT_FALSE((bool) error);
+    }
+
+    EXPECT_FALSE(parser.has_stream(0));
+    EXPECT_FALSE(parser.has_stream(4096));
+    EXPECT_FALSE(parser.has_stream(8191));
+    ASSERT_TRUE(parser.has_stream(256));
+    ASSERT_TRUE(parser.has_stream(257));
+    EXPECT_EQ(mts::stream_type::avc_video_stream, parser.stream_type(256));
+    EXPECT_EQ(mts::stream_type::adts_transport_13818_7, parser.stream_type(257));
+
+    parser.reset();
+    EXPECT_FALSE(parser.has_stream(256));
+    EXPECT_FALSE(parser.has_stream(257));
+}
+
+TEST(test_parser, test_batch_read)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    // Read packet by packet for reference
+    std::vector<std::pair<uint16_t, std::vector<uint8_t>>> expected;
+    {
+        mts::parser parser;
+        for (uint32_t i = 0; i < size / mts::parser::packet_size(); ++i)
+        {
+            std::error_code error;
+            parser.read(
+                buffer.data() + i * mts::parser::packet_size(), error);
+            ASSERT_FALSE((bool) error);
+            if (parser.has_pes())
+            {
+                expected.emplace_back(parser.pes_pid(), parser.pes_data());
+            }
+        }
+    }
+    EXPECT_EQ(198U, expected.size());
+
+    // Read the same data in batches of varying size, the last batch ends
+    // with a partial packet which is ignored.
+    mts::parser parser;
+    std::vector<std::pair<uint16_t, std::vector<uint8_t>>> results;
+    auto on_pes = [&](uint16_t pid)
+    {
+        EXPECT_TRUE(parser.has_pes());
+        EXPECT_EQ(pid, parser.pes_pid());
+        results.emplace_back(pid, parser.pes_data());
+    };
+
+    uint64_t offset = 0;
+    uint32_t packets = 1;
+    while (offset < buffer.size())
+    {
+        auto batch_size = std::min<uint64_t>(
+            packets * mts::parser::packet_size(), buffer.size() - offset);
+        parser.read(buffer.data() + offset, batch_size, on_pes);
+        offset += batch_size;
+        packets = packets * 2 % 61;
+    }
+    parser.read(buffer.data(), mts::parser::packet_size() - 1, on_pes);
+
+    EXPECT_FALSE(parser.has_pes());
+    EXPECT_EQ(expected, results);
+}
+
+TEST(test_parser, test_batch_read_skips_invalid_packets)
+{
+    std::vector<uint8_t> buffer(mts::parser::packet_size() * 2, 0xFF);
+    buffer[0] = 0x00;
+    buffer[mts::parser::packet_size()] = 0x47;
+    buffer[mts::parser::packet_size() + 1] = 0x1F;
+    buffer[mts::parser::packet_size() + 2] = 0xFF;
+    buffer[mts::parser::packet_size() + 3] = 0x10;
+
+    {
+        mts::parser parser;
+        std::error_code error;
+        parser.read(buffer.data(), error);
+        EXPECT_EQ(mts::error::invalid_sync_byte, error);
+    }
+    {
+        mts::parser parser;
+        uint32_t pes_found = 0;
+        parser.read(buffer.data(), buffer.size(), [&pes_found](uint16_t)
+        {
+            pes_found++;
+        });
+        EXPECT_EQ(0U, pes_found);
+    }
+}
+
+TEST(test_parser, test_packet_formats)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+    auto packets = buffer.size() / mts::parser::packet_size();
+
+    std::vector<std::pair<uint16_t, std::vector<uint8_t>>> expected;
+    {
+        mts::parser parser;
+        parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+        {
+            expected.emplace_back(pid, parser.pes_data());
+        });
+    }
+    EXPECT_EQ(198U, expected.size());
+
+    // m2ts, where the arrival timestamp of each packet is its index
+    // with the copy permission bits set.
+    {
+        std::vector<uint8_t> m2ts;
+        for (uint32_t i = 0; i < packets; ++i)
+        {
+            uint8_t header[4] = {
+                (uint8_t)(0xC0 | (i >> 24)), (uint8_t)(i >> 16),
+                (uint8_t)(i >> 8), (uint8_t)i };
+            m2ts.insert(m2ts.end(), header, header + 4);
+            auto packet = buffer.data() + i * mts::parser::packet_size();
+            m2ts.insert(
+                m2ts.end(), packet, packet + mts::parser::packet_size());
+        }
+
+        mts::parser parser(mts::packet_format::m2ts);
+        EXPECT_EQ(192U, parser.packet_stride());
+
+        // The index of the latest packet starting a pes on each PID.
+        std::map<uint16_t, uint32_t> unit_starts;
+
+        std::vector<std::pair<uint16_t, std::vector<uint8_t>>> results;
+        for (uint32_t i = 0; i < packets; ++i)
+        {
+            auto data = m2ts.data() + i * parser.packet_stride();
+            std::error_code error;
+            parser.read(data, error);
+            ASSERT_FALSE((bool) error);
+            if (parser.has_pes())
+            {
+                // The timestamp of the first packet of the pes, not of the
+                // packet completing it.
+                EXPECT_EQ(
+                    unit_starts.at(parser.pes_pid()),
+                    parser.pes_arrival_timestamp());
+                results.emplace_back(parser.pes_pid(), parser.pes_data());
+            }
+            if ((data[5] & 0x40) != 0)
+            {
+                unit_starts[((data[5] & 0x1F) << 8) | data[6]] = i;
+            }
+        }
+        EXPECT_EQ(expected, results);
+    }
+
+    // Reed-Solomon, where the parity is left as zeros.
+    {
+        std::vector<uint8_t> rs;
+        for (uint32_t i = 0; i < packets; ++i)
+        {
+            auto packet = buffer.data() + i * mts::parser::packet_size();
+            rs.insert(rs.end(), packet, packet + mts::parser::packet_size());
+            rs.resize(rs.size() + 16);
+        }
+
+        mts::parser parser;
+        parser.set_packet_format(mts::packet_format::reed_solomon);
+        EXPECT_EQ(204U, parser.packet_stride());
+
+        std::vector<std::pair<uint16_t, std::vector<uint8_t>>> results;
+        for (uint32_t i = 0; i < packets; ++i)
+        {
+            std::error_code error;
+            parser.read(rs.data() + i * parser.packet_stride(), error);
+            ASSERT_FALSE((bool) error);
+            if (parser.has_pes())
+            {
+                results.emplace_back(parser.pes_pid(), parser.pes_data());
+            }
+        }
+        EXPECT_EQ(expected, results);
+    }
+}
+
+TEST(test_parser, test_no_allocations_when_warmed_up)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    for (bool zero_copy : {false, true})
+    {
+        mts::parser parser;
+        parser.set_zero_copy(zero_copy);
+
+        // Read the file a few times to warm up, the continuity counters
+        // are broken where the file wraps around.
+        uint32_t pes_found = 0;
+        auto on_pes = [&pes_found](uint16_t) { pes_found++; };
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            parser.read(buffer.data(), buffer.size(), on_pes);
+        }
+        EXPECT_NE(0U, parser.allocations());
+
+        auto allocations = parser.allocations();
+        pes_found = 0;
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            parser.read(buffer.data(), buffer.size(), on_pes);
+        }
+        EXPECT_LT(3 * 190U, pes_found);
+        EXPECT_EQ(allocations, parser.allocations()) << zero_copy;
+    }
+}
+
+TEST(test_parser, test_clock_recovery)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    mts::parser parser;
+    EXPECT_FALSE(parser.has_clock(256));
+
+    parser.read(buffer.data(), buffer.size(), [](uint16_t) { });
+
+    // The PCR is carried by the video stream, and shared with the audio.
+    ASSERT_TRUE(parser.has_clock(256));
+    ASSERT_TRUE(parser.has_clock(257));
+    EXPECT_FALSE(parser.has_clock(0));
+    EXPECT_EQ(&parser.clock(256), &parser.clock(257));
+
+    const auto& clock = parser.clock(256);
+    EXPECT_TRUE(clock.has_pcr());
+    ASSERT_TRUE(clock.has_bitrate());
+    EXPECT_LT(100000.0, clock.bitrate());
+    EXPECT_GT(100000000.0, clock.bitrate());
+    EXPECT_EQ(0U, clock.discontinuities());
+
+    // The clocks are recovered anew after a reset.
+    auto pcr = clock.pcr();
+    parser.reset();
+    EXPECT_FALSE(parser.has_clock(256));
+    parser.read(buffer.data(), buffer.size(), [](uint16_t) { });
+    EXPECT_EQ(pcr, parser.clock(256).pcr());
+}
+
+TEST(test_parser, test_program_updates)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+    auto packets = buffer.size() / mts::parser::packet_size();
+
+    std::map<uint16_t, uint32_t> expected;
+    uint16_t program_number = 0;
+    {
+        mts::parser parser;
+        parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+        {
+            expected[pid]++;
+        });
+        ASSERT_TRUE(parser.has_program(0x1000));
+        EXPECT_FALSE(parser.has_program(0x1001));
+        const auto& program = parser.program(0x1000);
+        EXPECT_EQ(2U, program.stream_entries().size());
+        program_number = program.program_number();
+    }
+
+    // From the middle of the file the PMT adds an audio stream.
+    uint8_t last_pat_continuity_counter = 0;
+    for (uint32_t i = 0; i < packets; ++i)
+    {
+        auto packet = buffer.data() + i * mts::parser::packet_size();
+        uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        if (pid == 0)
+            last_pat_continuity_counter = packet[3] & 0x0F;
+        if (pid != 0x1000 || i < packets / 2)
+            continue;
+
+        std::vector<uint8_t> pmt =
+            { 0x02, 0x00, 0x00,
+              (uint8_t)(program_number >> 8), (uint8_t)program_number,
+              0xC3, 0x00, 0x00, 0xE1, 0x00, 0xF0, 0x00,
+              0x1B, 0xE1, 0x00, 0xF0, 0x00,
+              0x0F, 0xE1, 0x01, 0xF0, 0x00,
+              0x0F, 0xE1, 0x02, 0xF0, 0x00 };
+        write_section_packet(pid, packet[3], pmt, packet);
+    }
+
+    mts::parser parser;
+    std::vector<std::pair<uint32_t, uint32_t>> changes;
+    parser.set_on_program_change([&](
+        uint16_t pid, const boost::optional<mts::program>& previous,
+        const boost::optional<mts::program>& current)
+    {
+        EXPECT_EQ(0x1000U, pid);
+        changes.emplace_back(
+            previous ? previous->stream_entries().size() : 0U,
+            current ? current->stream_entries().size() : 0U);
+
+        // The PID table is updated before the callback.
+        if (current)
+        {
+            EXPECT_TRUE(parser.has_stream(
+                current->stream_entries().back().pid()));
+        }
+    });
+
+    std::map<uint16_t, uint32_t> results;
+    parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+    {
+        results[pid]++;
+    });
+
+    // The update is applied once, and no pes of the existing streams is
+    // lost.
+    std::vector<std::pair<uint32_t, uint32_t>> expected_changes =
+        { {0U, 2U}, {2U, 3U} };
+    EXPECT_EQ(expected_changes, changes);
+    EXPECT_EQ(expected, results);
+    ASSERT_TRUE(parser.has_stream(258));
+    EXPECT_EQ(mts::stream_type::adts_transport_13818_7, parser.stream_type(258));
+    EXPECT_TRUE(parser.has_clock(258));
+    EXPECT_EQ(&parser.clock(256), &parser.clock(258));
+
+    // A PAT without programs removes the program.
+    std::vector<uint8_t> pat(mts::parser::packet_size());
+    write_section_packet(
+        0, last_pat_continuity_counter + 1,
+        { 0x00, 0x00, 0x00, 0x00, 0x01, 0xC3, 0x00, 0x00 }, pat.data());
+    std::error_code error;
+    parser.read(pat.data(), error);
+    EXPECT_FALSE((bool) error);
+
+    ASSERT_EQ(3U, changes.size());
+    EXPECT_EQ(std::make_pair(3U, 0U), changes.back());
+    EXPECT_FALSE(parser.has_program(0x1000));
+    EXPECT_FALSE(parser.has_stream(256));
+    EXPECT_FALSE(parser.has_stream(258));
+    EXPECT_FALSE(parser.has_clock(256));
+}
+
+TEST(test_parser, test_incremental)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    // The payloads and timestamps of the complete pes of each stream.
+    std::map<uint16_t, std::vector<std::vector<uint8_t>>> expected;
+    std::map<uint16_t, std::vector<uint64_t>> expected_pts;
+    mts::parser parser;
+    parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+    {
+        const auto& pes_data = parser.pes_data();
+        std::error_code error;
+        auto pes = mts::pes::parse(pes_data.data(), pes_data.size(), error);
+        ASSERT_FALSE((bool) error);
+        expected[pid].emplace_back(
+            pes->payload_data(), pes->payload_data() + pes->payload_size());
+        expected_pts[pid].push_back(pes->presentation_timestamp());
+    });
+
+    // Drops a packet in the middle of the tenth pes of PID 256.
+    using ends_map = std::map<uint16_t, std::vector<bool>>;
+    auto read = [&](bool drop, mts::continuity_policy policy) -> ends_map
+    {
+        std::map<uint16_t, std::vector<std::vector<uint8_t>>> payloads;
+        std::map<uint16_t, std::vector<uint64_t>> pts;
+        ends_map ends;
+        std::map<uint16_t, bool> open;
+
+        mts::parser incremental;
+        incremental.set_continuity_policy(policy);
+        incremental.set_incremental(
+            [&](uint16_t pid, const mts::pes& header)
+            {
+                EXPECT_FALSE(open[pid]);
+                EXPECT_EQ(0U, header.payload_size());
+                open[pid] = true;
+                payloads[pid].emplace_back();
+                pts[pid].push_back(header.presentation_timestamp());
+            },
+            [&](uint16_t pid, const uint8_t* data, uint64_t size)
+            {
+                EXPECT_TRUE(open[pid]);
+                auto& payload = payloads[pid].back();
+                payload.insert(payload.end(), data, data + size);
+            },
+            [&](uint16_t pid, bool complete)
+            {
+                EXPECT_TRUE(open[pid]);
+                open[pid] = false;
+                ends[pid].push_back(complete);
+            });
+        EXPECT_TRUE(incremental.incremental());
+
+        uint32_t starts = 0;
+        bool dropping = drop;
+        std::error_code error;
+        for (uint64_t offset = 0; offset < buffer.size(); offset += 188)
+        {
+            const uint8_t* packet = buffer.data() + offset;
+            uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+            if (pid == 256 && (packet[1] & 0x40) != 0)
+                ++starts;
+            if (dropping && pid == 256 && starts == 10 &&
+                (packet[1] & 0x40) == 0)
+            {
+                dropping = false;
+                continue;
+            }
+            incremental.read(packet, error);
+            EXPECT_FALSE(incremental.has_pes());
+        }
+
+        for (const auto& item : expected)
+        {
+            auto pid = item.first;
+            EXPECT_LE(item.second.size(), payloads[pid].size());
+            for (uint32_t i = 0; i < item.second.size() &&
+                 i < payloads[pid].size(); ++i)
+            {
+                EXPECT_EQ(expected_pts[pid][i], pts[pid][i]);
+                if (pid == 256 && i == 9 && drop)
+                {
+                    // Padding keeps the size of the payload.
+                    if (policy == mts::continuity_policy::pad)
+                    {
+                        EXPECT_EQ(item.second[i].size(),
+                                  payloads[pid][i].size());
+                    }
+                    continue;
+                }
+                EXPECT_EQ(item.second[i], payloads[pid][i]);
+            }
+        }
+        return ends;
+    };
+
+    auto ends = read(false, mts::continuity_policy::drop);
+    EXPECT_EQ(std::vector<bool>(ends[256].size(), true), ends[256]);
+    EXPECT_EQ(std::vector<bool>(ends[257].size(), true), ends[257]);
+
+    // The pes with the lost packet ends incomplete, and the rest of its
+    // payload is dropped unless the lost payload is padded.
+    for (auto policy : {mts::continuity_policy::drop,
+                        mts::continuity_policy::pad})
+    {
+        ends = read(true, policy);
+        auto incomplete = std::vector<bool>(ends[256].size(), true);
+        incomplete[9] = false;
+        EXPECT_EQ(incomplete, ends[256]);
+    }
+}
+
+TEST(test_parser, test_continuity_policies)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    using pes_map = std::map<uint16_t, std::vector<std::vector<uint8_t>>>;
+    pes_map expected;
+    mts::parser parser;
+    parser.read(buffer.data(), buffer.size(), [&](uint16_t pid)
+    {
+        expected[pid].push_back(parser.pes_data());
+    });
+
+    // Drops a packet without adaptation field in the middle of the tenth
+    // pes of PID 256, repeats a packet of PID 257, and later moves the
+    // continuity counters of PID 256 on at a discontinuity_indicator.
+    std::vector<uint8_t> packets;
+    uint32_t starts = 0;
+    uint32_t audio_packets = 0;
+    bool dropped = false;
+    uint8_t shift = 0;
+    uint64_t lost_offset = 0;
+    for (uint64_t offset = 0; offset < buffer.size(); offset += 188)
+    {
+        std::vector<uint8_t> packet(
+            buffer.begin() + offset, buffer.begin() + offset + 188);
+        uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        bool start = (packet[1] & 0x40) != 0;
+        bool adaptation_field = (packet[3] & 0x20) != 0;
+        if (pid == 256 && start)
+            ++starts;
+        if (pid == 256 && starts == 10 && !start && !adaptation_field &&
+            !dropped)
+        {
+            dropped = true;
+            continue;
+        }
+        if (pid == 256 && starts == 10 && !dropped)
+            lost_offset += 188 - 4 - (adaptation_field ? 1 + packet[4] : 0);
+        if (pid == 256 && starts > 20 && shift == 0 && adaptation_field &&
+            packet[4] != 0)
+        {
+            packet[5] |= 0x80;
+            shift = 3;
+        }
+        if (pid == 256)
+            packet[3] = (packet[3] & 0xF0) | ((packet[3] + shift) & 0x0F);
+
+        packets.insert(packets.end(), packet.begin(), packet.end());
+        if (pid == 257 && ++audio_packets == 5)
+            packets.insert(packets.end(), packet.begin(), packet.end());
+    }
+    ASSERT_TRUE(dropped);
+    ASSERT_EQ(3U, shift);
+
+    struct result
+    {
+        pes_map m_pes;
+        std::map<uint16_t, std::vector<bool>> m_truncated;
+        std::map<uint16_t, std::vector<std::vector<mts::pes_loss>>> m_losses;
+    };
+    auto read = [&](mts::continuity_policy policy, bool zero_copy)
+    {
+        result result;
+        mts::parser parser;
+        parser.set_continuity_policy(policy);
+        parser.set_zero_copy(zero_copy);
+        EXPECT_EQ(policy, parser.continuity_policy());
+        parser.read(packets.data(), packets.size(), [&](uint16_t pid)
+        {
+            std::vector<uint8_t> data;
+            if (zero_copy)
+            {
+                for (const auto& slice : parser.pes_slices())
+                {
+                    data.insert(data.end(), slice.m_data,
+                                slice.m_data + slice.m_size);
+                }
+            }
+            else
+            {
+                data = parser.pes_data();
+            }
+            result.m_pes[pid].push_back(data);
+            result.m_truncated[pid].push_back(parser.pes_truncated());
+            result.m_losses[pid].push_back(parser.pes_losses());
+        });
+        EXPECT_EQ(1U, parser.continuity_errors());
+        EXPECT_EQ(1U, parser.duplicate_packets());
+        return result;
+    };
+
+    // The flags of the pes of PID 256 where only the tenth is truncated.
+    auto truncated_at_ten = [&](const result& result)
+    {
+        auto flags = std::vector<bool>(result.m_pes.at(256).size(), false);
+        flags[9] = true;
+        return flags;
+    };
+
+    // The pes with the lost packet is left out.
+    {
+        auto result = read(mts::continuity_policy::drop, false);
+        EXPECT_EQ(expected[257], result.m_pes[257]);
+        auto video = expected[256];
+        video.erase(video.begin() + 9);
+        EXPECT_EQ(video, result.m_pes[256]);
+        EXPECT_EQ(std::vector<bool>(video.size(), false),
+                  result.m_truncated[256]);
+    }
+
+    // The pes with the lost packet ends at the loss.
+    {
+        auto result = read(mts::continuity_policy::truncate, false);
+        EXPECT_EQ(expected[257], result.m_pes[257]);
+        auto video = expected[256];
+        video[9].resize(lost_offset);
+        EXPECT_EQ(video, result.m_pes[256]);
+        EXPECT_EQ(truncated_at_ten(result), result.m_truncated[256]);
+
+        // A truncated pes is shorter than its pes packet length, so it only
+        // parses when told it is truncated, and its payload is what was
+        // received. The video pes of the file are unbounded, so the length
+        // of the whole pes is written into it.
+        auto data = result.m_pes[256][9];
+        auto length = expected[256][9].size() - 6;
+        ASSERT_GE(0xFFFFU, length);
+        data[4] = (uint8_t)(length >> 8);
+        data[5] = (uint8_t)length;
+
+        std::error_code error;
+        mts::pes::parse(data.data(), data.size(), error);
+        EXPECT_TRUE((bool)error);
+
+        error = std::error_code();
+        auto pes = mts::pes::parse(data.data(), data.size(), true, error);
+        ASSERT_FALSE((bool)error);
+        EXPECT_EQ(data.data() + data.size(),
+                  pes->payload_data() + pes->payload_size());
+
+        std::vector<mts::slice> slices = {
+            {data.data(), 100}, {data.data() + 100, data.size() - 100}};
+        std::vector<mts::slice> payload;
+        mts::pes::parse(slices, payload, error);
+        EXPECT_EQ(mts::error::invalid_pes_packet_length, error);
+
+        error = std::error_code();
+        auto sliced = mts::pes::parse(slices, true, payload, error);
+        ASSERT_FALSE((bool)error);
+        EXPECT_EQ(pes->payload_size(), sliced->payload_size());
+        ASSERT_FALSE(payload.empty());
+        EXPECT_EQ(pes->payload_data(), payload.front().m_data);
+        EXPECT_EQ(data.data() + data.size(),
+                  payload.back().m_data + payload.back().m_size);
+    }
+
+    // The pes with the lost packet keeps its size, with zeros in place of
+    // the lost payload.
+    for (bool zero_copy : {false, true})
+    {
+        auto result = read(mts::continuity_policy::pad, zero_copy);
+        EXPECT_EQ(expected[257], result.m_pes[257]);
+        auto video = expected[256];
+        std::fill(video[9].begin() + lost_offset,
+                  video[9].begin() + lost_offset + 184, 0);
+        EXPECT_EQ(video, result.m_pes[256]);
+        EXPECT_EQ(truncated_at_ten(result), result.m_truncated[256]);
+
+        ASSERT_EQ(video.size(), result.m_losses[256].size());
+        for (uint32_t i = 0; i < video.size(); ++i)
+        {
+            const auto& losses = result.m_losses[256][i];
+            if (i != 9)
+            {
+                EXPECT_TRUE(losses.empty());
+                continue;
+            }
+            ASSERT_EQ(1U, losses.size());
+            EXPECT_EQ(lost_offset, losses[0].m_offset);
+            EXPECT_EQ(184U, losses[0].m_size);
+        }
+    }
+}
@@ -49,3 +49,41 @@ TEST(test_pat, init)
 
     EXPECT_EQ(2043760854U, pat->crc());
 }
+
+TEST(test_pat, write)
+{
+    std::vector<uint8_t> buffer =
+        {
+            0x00, 0xb0, 0x15, 0x00, 0x02, 0xc1, 0x00, 0x00,
+            0x00, 0x00, 0xe0, 0x10, 0x00, 0x01, 0xe0, 0x64,
+            0x00, 0x02, 0xe0, 0xc8, 0x79, 0xd1, 0x50, 0xd6
+        };
+    std::error_code error;
+    auto pat = mts::pat::parse(buffer.data(), buffer.size(), error);
+    ASSERT_FALSE((bool)error);
+
+    // Writing the parsed table gives the same section.
+    ASSERT_EQ(buffer.size(), pat->serialized_size());
+    std::vector<uint8_t> written(pat->serialized_size());
+    EXPECT_EQ(buffer.size(), pat->write(written.data(), written.size()));
+    EXPECT_EQ(buffer, written);
+
+    // A table built from scratch.
+    mts::pat built;
+    built.set_transport_stream_id(2);
+    built.add_program_entry(0, 0x0010);
+    built.add_program_entry(1, 0x0064);
+    built.add_program_entry(2, 0x00c8);
+    built.write(written.data(), written.size());
+    EXPECT_EQ(buffer, written);
+
+    // Changing an entry updates the CRC.
+    built.program_entries()[1].set_pid(0x0065);
+    built.set_version_number(1);
+    built.write(written.data(), written.size());
+    auto changed = mts::pat::parse(written.data(), written.size(), error);
+    ASSERT_FALSE((bool)error);
+    EXPECT_EQ(1U, changed->version_number());
+    EXPECT_EQ(0x0065U, changed->program_entries()[1].pid());
+    EXPECT_EQ(0U, mts::crc32::compute(written.data(), written.size()));
+}
@@ -6,6 +6,7 @@
 #include <mts/pes.hpp>
 #include <mts/parser.hpp>
 
+#include <algorithm>
 #include <fstream>
 
 #include <gtest/gtest.h>
@@ -79,3 +80,168 @@ TEST(test_pes, pes_dump)
     EXPECT_NE(nullptr, pes->payload_data());
     EXPECT_EQ(3017U, pes->payload_size());
 }
+
+TEST(test_pes, pes_dump_slices)
+{
+    auto filename = "pes_dump";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    std::error_code error;
+    auto expected = mts::pes::parse(buffer.data(), buffer.size(), error);
+    ASSERT_TRUE(!error);
+
+    // Split the pes into slices of different sizes, so that the header
+    // crosses slice boundaries.
+    for (uint64_t slice_size : {1U, 2U, 7U, 13U, 184U, 5000U})
+    {
+        std::vector<mts::slice> slices;
+        for (uint64_t offset = 0; offset < buffer.size(); offset += slice_size)
+        {
+            slices.push_back({
+                buffer.data() + offset,
+                std::min<uint64_t>(slice_size, buffer.size() - offset)});
+        }
+
+        std::vector<mts::slice> payload;
+        auto pes = mts::pes::parse(slices, payload, error);
+        ASSERT_TRUE(!error) << slice_size;
+
+        EXPECT_EQ(expected->stream_id(), pes->stream_id());
+        EXPECT_EQ(expected->presentation_timestamp(),
+                  pes->presentation_timestamp());
+        EXPECT_EQ(expected->decoding_timestamp(), pes->decoding_timestamp());
+        EXPECT_EQ(expected->payload_size(), pes->payload_size());
+
+        std::vector<uint8_t> payload_data;
+        for (const auto& s : payload)
+        {
+            payload_data.insert(
+                payload_data.end(), s.m_data, s.m_data + s.m_size);
+        }
+        EXPECT_EQ(
+            std::vector<uint8_t>(
+                expected->payload_data(),
+                expected->payload_data() + expected->payload_size()),
+            payload_data);
+    }
+
+    // Truncated pes
+    std::vector<mts::slice> slices = {{ buffer.data(), 4U }};
+    std::vector<mts::slice> payload;
+    auto pes = mts::pes::parse(slices, payload, error);
+    EXPECT_TRUE((bool)error);
+    EXPECT_EQ(boost::none, pes);
+}
+
+TEST(test_pes, test_pes_parsing_zero_copy)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    std::vector<std::vector<uint8_t>> expected;
+    mts::parser parser;
+    parser.read(buffer.data(), buffer.size(), [&](uint16_t)
+    {
+        std::error_code error;
+        auto& pes_data = parser.pes_data();
+        auto pes = mts::pes::parse(pes_data.data(), pes_data.size(), error);
+        ASSERT_FALSE((bool)error);
+        expected.push_back({
+            pes->payload_data(), pes->payload_data() + pes->payload_size()});
+    });
+    EXPECT_EQ(198U, expected.size());
+
+    mts::parser zero_copy_parser;
+    zero_copy_parser.set_zero_copy(true);
+    EXPECT_TRUE(zero_copy_parser.zero_copy());
+
+    uint32_t pes_index = 0;
+    zero_copy_parser.read(buffer.data(), buffer.size(), [&](uint16_t)
+    {
+        std::error_code error;
+        std::vector<mts::slice> payload;
+        auto& slices = zero_copy_parser.pes_slices();
+        auto pes = mts::pes::parse(slices, payload, error);
+        ASSERT_FALSE((bool)error);
+        ASSERT_LT(pes_index, expected.size());
+
+        std::vector<uint8_t> payload_data;
+        for (const auto& s : payload)
+        {
+            // The slices must point into the original buffer
+            EXPECT_GE(s.m_data, buffer.data());
+            EXPECT_LE(s.m_data + s.m_size, buffer.data() + buffer.size());
+            payload_data.insert(
+                payload_data.end(), s.m_data, s.m_data + s.m_size);
+        }
+        EXPECT_EQ(pes->payload_size(), payload_data.size());
+        EXPECT_EQ(expected[pes_index], payload_data) << pes_index;
+        pes_index++;
+    });
+    EXPECT_EQ(expected.size(), pes_index);
+}
+
+TEST(test_pes, write)
+{
+    auto filename = "pes_dump";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    std::error_code error;
+    auto pes = mts::pes::parse(buffer.data(), buffer.size(), error);
+    ASSERT_TRUE(!error);
+
+    // The header is written as it was read, apart from the packet length
+    // which the video stream may leave unset.
+    std::vector<uint8_t> written(pes->serialized_size());
+    EXPECT_EQ(written.size(), pes->write(written.data(), written.size()));
+    uint64_t length = (written[4] << 8) | written[5];
+    EXPECT_EQ(written.size() - 6U, length);
+    written[4] = buffer[4];
+    written[5] = buffer[5];
+    EXPECT_EQ(std::vector<uint8_t>(
+        buffer.begin(), buffer.begin() + written.size()), written);
+
+    // A pes built from scratch.
+    std::vector<uint8_t> payload(1000, 0x42);
+    mts::pes built;
+    built.set_stream_id(0xE0);
+    built.set_data_alignment_indicator(true);
+    built.set_presentation_timestamp(0x1FFFFFFFFULL);
+    built.set_decoding_timestamp(12345U);
+    built.set_payload(payload.data(), (uint32_t)payload.size());
+    EXPECT_EQ(19U, built.header_size());
+
+    written.resize(built.serialized_size());
+    built.write(written.data(), written.size());
+    auto parsed = mts::pes::parse(written.data(), written.size(), error);
+    ASSERT_TRUE(!error);
+    EXPECT_EQ(0xE0U, parsed->stream_id());
+    EXPECT_TRUE(parsed->data_alignment_indicator());
+    EXPECT_EQ(0x1FFFFFFFFULL, parsed->presentation_timestamp());
+    EXPECT_EQ(12345U, parsed->decoding_timestamp());
+    EXPECT_EQ(payload.size(), parsed->payload_size());
+    EXPECT_EQ(payload, std::vector<uint8_t>(
+        parsed->payload_data(),
+        parsed->payload_data() + parsed->payload_size()));
+}
@@ -0,0 +1,93 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/pid_remapper.hpp>
+#include <mts/parser.hpp>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "test_file.hpp"
+
+namespace
+{
+std::vector<std::vector<uint8_t>> demux(
+    mts::parser& parser, std::vector<uint8_t>& buffer)
+{
+    std::vector<std::vector<uint8_t>> result;
+    parser.read(buffer.data(), buffer.size(), [&](uint16_t)
+    {
+        result.push_back(parser.pes_data());
+    });
+    return result;
+}
+}
+
+TEST(test_pid_remapper, remap)
+{
+    auto buffer = read_test_file();
+    mts::parser parser;
+    auto expected = demux(parser, buffer);
+    EXPECT_EQ(198U, expected.size());
+
+    mts::pid_remapper remapper;
+    remapper.remap(256, 0x300);
+    remapper.remap(257, 0x301);
+    remapper.remap(0x1000, 0x1100);
+    EXPECT_EQ(0x300U, remapper.pid(256));
+    EXPECT_EQ(0x42U, remapper.pid(0x42));
+    remapper.rewrite(buffer.data(), buffer.size());
+
+    mts::parser remapped_parser;
+    auto results = demux(remapped_parser, buffer);
+    EXPECT_EQ(expected, results);
+
+    EXPECT_TRUE(remapped_parser.has_program(0x1100));
+    EXPECT_FALSE(remapped_parser.has_program(0x1000));
+    EXPECT_TRUE(remapped_parser.has_stream(0x300));
+    EXPECT_TRUE(remapped_parser.has_stream(0x301));
+    EXPECT_FALSE(remapped_parser.has_stream(256));
+    EXPECT_TRUE(remapped_parser.has_clock(0x300));
+    EXPECT_EQ(0U, remapped_parser.continuity_errors());
+
+    const auto& program = remapped_parser.program(0x1100);
+    EXPECT_EQ(0x300U, program.pcr_pid());
+    ASSERT_EQ(2U, program.stream_entries().size());
+    EXPECT_EQ(0x300U, program.stream_entries()[0].pid());
+    EXPECT_EQ(0x301U, program.stream_entries()[1].pid());
+}
+
+TEST(test_pid_remapper, identity)
+{
+    // Without PIDs to move the packets are unchanged.
+    auto buffer = read_test_file();
+    auto original = buffer;
+
+    mts::pid_remapper remapper;
+    remapper.rewrite(buffer.data(), buffer.size());
+    EXPECT_EQ(original, buffer);
+}
+
+TEST(test_pid_remapper, invalid_crc)
+{
+    auto buffer = read_test_file();
+
+    // Break the CRC of the first PAT.
+    uint8_t* packet = buffer.data();
+    for (; packet != buffer.data() + buffer.size(); packet += 188)
+    {
+        if (((packet[1] & 0x1F) << 8 | packet[2]) == 0)
+            break;
+    }
+    ASSERT_NE(buffer.data() + buffer.size(), packet);
+    uint32_t section_size = 3U + (((packet[6] & 0x0F) << 8) | packet[7]);
+    packet[5 + section_size - 1] ^= 0x01;
+
+    mts::pid_remapper remapper;
+    std::error_code error;
+    remapper.rewrite(packet, error);
+    EXPECT_EQ(mts::error::invalid_crc, error);
+}
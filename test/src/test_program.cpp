@@ -0,0 +1,94 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/program.hpp>
+#include <mts/stream_type.hpp>
+
+#include <fstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(test_program, write)
+{
+    // The program map section of the test file, which fits in a packet.
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary);
+    ASSERT_TRUE(file.is_open());
+    std::vector<uint8_t> packet(188);
+    std::vector<uint8_t> section;
+    while (file.read((char*)packet.data(), packet.size()))
+    {
+        uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        bool payload_unit_start_indicator = (packet[1] & 0x40) != 0;
+        if (pid != 0x1000 || !payload_unit_start_indicator)
+            continue;
+
+        ASSERT_EQ(0x10, packet[3] & 0x30);
+        auto data = packet.data() + 5 + packet[4];
+        uint32_t size = 3U + (((data[1] & 0x0F) << 8) | data[2]);
+        ASSERT_GE(packet.data() + packet.size(), data + size);
+        section.assign(data, data + size);
+        break;
+    }
+    ASSERT_FALSE(section.empty());
+
+    std::error_code error;
+    auto program = mts::program::parse(section.data(), section.size(), error);
+    ASSERT_FALSE((bool)error);
+
+    ASSERT_EQ(section.size(), program->serialized_size());
+    std::vector<uint8_t> written(program->serialized_size());
+    EXPECT_EQ(section.size(),
+              program->write(written.data(), written.size()));
+    EXPECT_EQ(section, written);
+
+    // Moving the streams recomputes the CRC.
+    for (auto& stream : program->stream_entries())
+    {
+        stream.set_pid(stream.pid() + 0x100);
+    }
+    program->set_pcr_pid(program->pcr_pid() + 0x100);
+    program->write(written.data(), written.size());
+
+    auto moved = mts::program::parse(written.data(), written.size(), error);
+    ASSERT_FALSE((bool)error);
+    EXPECT_EQ(0U, mts::crc32::compute(written.data(), written.size()));
+    EXPECT_EQ(0x200U, moved->pcr_pid());
+    ASSERT_EQ(2U, moved->stream_entries().size());
+    EXPECT_EQ(0x200U, moved->stream_entries()[0].pid());
+    EXPECT_EQ(0x201U, moved->stream_entries()[1].pid());
+}
+
+TEST(test_program, build)
+{
+    mts::program program;
+    program.set_program_number(7);
+    program.set_version_number(3);
+    program.set_pcr_pid(0x100);
+    program.add_stream_entry(
+        (uint8_t)mts::stream_type::avc_video_stream, 0x100);
+    program.add_stream_entry(
+        (uint8_t)mts::stream_type::adts_transport_13818_7, 0x101);
+
+    std::vector<uint8_t> written(program.serialized_size());
+    program.write(written.data(), written.size());
+
+    std::error_code error;
+    auto parsed = mts::program::parse(written.data(), written.size(), error);
+    ASSERT_FALSE((bool)error);
+    EXPECT_EQ(0x02U, parsed->table_id());
+    EXPECT_TRUE(parsed->section_syntax_indicator());
+    EXPECT_TRUE(parsed->current_next_indicator());
+    EXPECT_EQ(7U, parsed->program_number());
+    EXPECT_EQ(3U, parsed->version_number());
+    EXPECT_EQ(0x100U, parsed->pcr_pid());
+    EXPECT_EQ(0U, parsed->program_info_length());
+    ASSERT_EQ(2U, parsed->stream_entries().size());
+    EXPECT_EQ((uint8_t)mts::stream_type::avc_video_stream,
+              parsed->stream_entries()[0].type());
+    EXPECT_EQ(0x101U, parsed->stream_entries()[1].pid());
+    EXPECT_EQ(0U, mts::crc32::compute(written.data(), written.size()));
+}
@@ -0,0 +1,226 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/program_filter.hpp>
+#include <mts/muxer.hpp>
+#include <mts/parser.hpp>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "test_file.hpp"
+
+namespace
+{
+std::vector<std::vector<uint8_t>> demux(
+    mts::parser& parser, std::vector<uint8_t>& buffer)
+{
+    std::vector<std::vector<uint8_t>> result;
+    parser.read(buffer.data(), buffer.size(), [&](uint16_t)
+    {
+        result.push_back(parser.pes_data());
+    });
+    return result;
+}
+
+/// Appends the packets of a muxer, dropping its PAT.
+void append(std::vector<uint8_t>& ts, const std::vector<uint8_t>& packets)
+{
+    for (uint32_t i = 0; i < packets.size(); i += 188)
+    {
+        uint16_t pid = ((packets[i + 1] & 0x1F) << 8) | packets[i + 2];
+        if (pid == 0)
+            continue;
+        ts.insert(ts.end(), packets.begin() + i, packets.begin() + i + 188);
+    }
+}
+}
+
+TEST(test_program_filter, single_program)
+{
+    // Selecting the only program passes the stream through.
+    auto buffer = read_test_file();
+    mts::parser parser;
+    auto expected = demux(parser, buffer);
+
+    mts::program_filter filter;
+    filter.select_program(1);
+    std::vector<uint8_t> output(buffer.size());
+    output.resize(filter.filter(buffer.data(), buffer.size(), output.data()));
+    EXPECT_EQ(0U, output.size() % 188U);
+
+    EXPECT_TRUE(filter.is_selected(0x1000));
+    EXPECT_TRUE(filter.is_selected(256));
+    EXPECT_TRUE(filter.is_selected(257));
+    EXPECT_FALSE(filter.is_selected(258));
+
+    mts::parser filtered_parser;
+    EXPECT_EQ(expected, demux(filtered_parser, output));
+    EXPECT_TRUE(filtered_parser.has_program(0x1000));
+    EXPECT_EQ(0U, filtered_parser.continuity_errors());
+
+    // Filtering in place.
+    auto size = filter.filter(buffer.data(), buffer.size(), buffer.data());
+    buffer.resize(size);
+    mts::parser in_place_parser;
+    EXPECT_EQ(expected, demux(in_place_parser, buffer));
+}
+
+TEST(test_program_filter, multi_program)
+{
+    mts::muxer first(1, 0x100);
+    first.add_stream(0x101, mts::stream_type::avc_video_stream, 0xE0);
+    mts::muxer second(2, 0x200);
+    second.add_stream(0x201, mts::stream_type::avc_video_stream, 0xE0);
+    second.add_stream(0x202, mts::stream_type::adts_transport_13818_7, 0xC0);
+
+    // The PAT of both programs.
+    mts::pat pat;
+    pat.set_transport_stream_id(7);
+    pat.add_program_entry(0, 0x10);
+    pat.add_program_entry(1, 0x100);
+    pat.add_program_entry(2, 0x200);
+    std::vector<uint8_t> pat_packet(188, 0xFF);
+    pat_packet[0] = 0x47;
+    pat_packet[1] = 0x40;
+    pat_packet[2] = 0x00;
+    pat_packet[4] = 0x00;
+    pat.write(pat_packet.data() + 5, pat_packet.size() - 5);
+
+    std::vector<uint8_t> ts;
+    std::vector<uint8_t> packets;
+    std::vector<uint8_t> payload(2000, 0x42);
+    auto write = [&](mts::muxer& muxer, uint16_t pid, uint64_t dts)
+    {
+        packets.resize(mts::muxer::max_output_size(payload.size()));
+        packets.resize(muxer.write_pes(
+            pid, payload.data(), payload.size(), dts, dts, packets.data()));
+        append(ts, packets);
+    };
+
+    uint8_t pat_continuity_counter = 0;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        if (i % 10 == 0)
+        {
+            pat_packet[3] = 0x10 | pat_continuity_counter;
+            pat_continuity_counter = (pat_continuity_counter + 1) & 0x0F;
+            ts.insert(ts.end(), pat_packet.begin(), pat_packet.end());
+        }
+        write(first, 0x101, i * 3600U);
+        write(second, 0x201, i * 3600U);
+        write(second, 0x202, i * 3600U);
+    }
+
+    mts::program_filter filter;
+    filter.select_program(2);
+    std::vector<uint8_t> output(ts.size());
+    output.resize(filter.filter(ts.data(), ts.size(), output.data()));
+
+    EXPECT_FALSE(filter.is_selected(0x100));
+    EXPECT_FALSE(filter.is_selected(0x101));
+    EXPECT_TRUE(filter.is_selected(0x200));
+    EXPECT_TRUE(filter.is_selected(0x201));
+    EXPECT_TRUE(filter.is_selected(0x202));
+
+    mts::parser parser;
+    uint32_t pes_count = 0;
+    parser.read(output.data(), output.size(), [&](uint16_t pid)
+    {
+        EXPECT_TRUE(pid == 0x201 || pid == 0x202);
+        pes_count++;
+    });
+    EXPECT_EQ(2U * 99U, pes_count);
+    EXPECT_FALSE(parser.has_program(0x100));
+    EXPECT_TRUE(parser.has_program(0x200));
+    EXPECT_EQ(0U, parser.continuity_errors());
+
+    // The PAT written lists the selected program only.
+    std::error_code error;
+    auto filtered = mts::pat::parse(output.data() + 5, 183, error);
+    ASSERT_FALSE((bool)error);
+    EXPECT_EQ(7U, filtered->transport_stream_id());
+    ASSERT_EQ(1U, filtered->program_entries().size());
+    EXPECT_EQ(2U, filtered->program_entries()[0].program_number());
+    EXPECT_EQ(0x200U, filtered->program_entries()[0].pid());
+    EXPECT_EQ(0U, filter.version_number());
+
+    // Selecting another program changes the version.
+    filter.select_program(1);
+    EXPECT_EQ(1U, filter.version_number());
+    EXPECT_TRUE(filter.is_selected(0x100));
+}
+
+TEST(test_program_filter, invalid_pids)
+{
+    // A PAT and PMT assigning the PAT and null PIDs to programs.
+    mts::pat pat;
+    pat.add_program_entry(1, 0x100);
+    pat.add_program_entry(2, 0x0000);
+    pat.add_program_entry(3, 0x1FFF);
+
+    mts::program pmt;
+    pmt.set_program_number(1);
+    pmt.set_pcr_pid(0x0000);
+    pmt.add_stream_entry(0x1B, 0x101);
+    pmt.add_stream_entry(0x1B, 0x0000);
+    pmt.add_stream_entry(0x1B, 0x1FFF);
+
+    auto packet = [](uint16_t pid, uint8_t continuity_counter)
+    {
+        std::vector<uint8_t> data(188, 0xFF);
+        data[0] = 0x47;
+        data[1] = 0x40 | (pid >> 8);
+        data[2] = (uint8_t)pid;
+        data[3] = 0x10 | continuity_counter;
+        data[4] = 0x00;
+        return data;
+    };
+
+    std::vector<uint8_t> ts;
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        auto pat_packet = packet(0x0000, i);
+        pat.write(pat_packet.data() + 5, pat_packet.size() - 5);
+        ts.insert(ts.end(), pat_packet.begin(), pat_packet.end());
+
+        auto pmt_packet = packet(0x100, i);
+        pmt.write(pmt_packet.data() + 5, pmt_packet.size() - 5);
+        ts.insert(ts.end(), pmt_packet.begin(), pmt_packet.end());
+
+        for (uint16_t pid : {0x101, 0x1FFF})
+        {
+            auto stream_packet = packet(pid, i);
+            ts.insert(ts.end(), stream_packet.begin(), stream_packet.end());
+        }
+    }
+
+    mts::program_filter filter;
+    for (uint16_t program_number : {1, 2, 3})
+    {
+        filter.select_program(program_number);
+    }
+    std::vector<uint8_t> output(ts.size());
+    output.resize(filter.filter(ts.data(), ts.size(), output.data()));
+
+    EXPECT_TRUE(filter.is_selected(0x100));
+    EXPECT_TRUE(filter.is_selected(0x101));
+    EXPECT_FALSE(filter.is_selected(0x0000));
+    EXPECT_FALSE(filter.is_selected(0x1FFF));
+
+    // Each PAT is replaced by one listing the valid program only.
+    ASSERT_EQ(3U * 3U * 188U, output.size());
+    for (uint32_t i = 0; i < output.size(); i += 3 * 188)
+    {
+        EXPECT_EQ(0x00, output[i + 2]);
+        std::error_code error;
+        auto filtered = mts::pat::parse(output.data() + i + 5, 183, error);
+        ASSERT_FALSE((bool)error);
+        ASSERT_EQ(1U, filtered->program_entries().size());
+        EXPECT_EQ(1U, filtered->program_entries()[0].program_number());
+        EXPECT_EQ(0x100U, filtered->program_entries()[0].pid());
+    }
+}
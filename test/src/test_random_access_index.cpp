@@ -0,0 +1,209 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/random_access_index.hpp>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "test_file.hpp"
+
+TEST(test_random_access_index, test_file)
+{
+    auto buffer = read_test_file();
+    mts::random_access_index index;
+    index.read(buffer.data(), buffer.size());
+    EXPECT_EQ(buffer.size(), index.size());
+
+    // Every pes of the file starts with a PTS.
+    const auto& pes_entries = index.pes_entries();
+    ASSERT_EQ(200U, pes_entries.size());
+    EXPECT_EQ(256U, pes_entries[0].m_pid);
+    EXPECT_TRUE(pes_entries[0].m_random_access);
+    for (const auto& entry : pes_entries)
+    {
+        auto packet = buffer.data() + entry.m_offset;
+        EXPECT_EQ(0U, entry.m_offset % 188);
+        EXPECT_EQ(0x40, packet[1] & 0x40);
+        EXPECT_EQ(entry.m_pid, ((packet[1] & 0x1F) << 8) | packet[2]);
+    }
+
+    const auto& pcr_entries = index.pcr_entries();
+    ASSERT_FALSE(pcr_entries.empty());
+    for (uint32_t i = 1; i < pcr_entries.size(); ++i)
+    {
+        EXPECT_EQ(256U, pcr_entries[i].m_pid);
+        EXPECT_LT(pcr_entries[i - 1].m_offset, pcr_entries[i].m_offset);
+        EXPECT_LT(pcr_entries[i - 1].m_pcr, pcr_entries[i].m_pcr);
+    }
+
+    // The repeated PAT and PMT are only recorded once.
+    const auto& section_entries = index.section_entries();
+    ASSERT_EQ(2U, section_entries.size());
+    EXPECT_EQ(0x0000U, section_entries[0].m_pid);
+    EXPECT_EQ(0x1000U, section_entries[1].m_pid);
+    EXPECT_EQ(0x00U, section_entries[0].m_section[0]);
+    EXPECT_EQ(0x02U, section_entries[1].m_section[0]);
+
+    // Reading in pieces gives the same index.
+    mts::random_access_index pieces;
+    for (uint64_t offset = 0; offset < buffer.size(); offset += 188 * 7)
+    {
+        auto size = std::min<uint64_t>(188 * 7, buffer.size() - offset);
+        pieces.read(buffer.data() + offset, size);
+    }
+    EXPECT_EQ(index.pes_entries().size(), pieces.pes_entries().size());
+    EXPECT_EQ(index.pcr_entries().size(), pieces.pcr_entries().size());
+    EXPECT_EQ(index.pes_entries().back().m_offset,
+              pieces.pes_entries().back().m_offset);
+}
+
+TEST(test_random_access_index, timestamp_wrap_around)
+{
+    // A pes header with a PTS just before and after the wrap around.
+    auto write_packet = [](
+        std::vector<uint8_t>& buffer, uint16_t pid, uint64_t pts)
+    {
+        std::vector<uint8_t> packet(188, 0xFF);
+        packet[0] = 0x47;
+        packet[1] = (uint8_t)(0x40 | (pid >> 8));
+        packet[2] = (uint8_t)pid;
+        packet[3] = 0x10;
+        const uint8_t header[] = {0x00, 0x00, 0x01, 0xE0, 0x00, 0x00,
+                                  0x80, 0x80, 0x05};
+        std::copy(header, header + sizeof(header), packet.begin() + 4);
+        mts::helper::write_timestamp(0x2, pts, packet.data() + 13);
+        buffer.insert(buffer.end(), packet.begin(), packet.end());
+    };
+
+    // The PAT and the PMT of the test file, listing PIDs 256 and 257.
+    auto file = read_test_file();
+    std::vector<uint8_t> buffer;
+    for (uint16_t pid : {0x0000, 0x1000})
+    {
+        for (uint32_t i = 0; i < file.size(); i += 188)
+        {
+            if ((((file[i + 1] & 0x1F) << 8) | file[i + 2]) != pid)
+                continue;
+            buffer.insert(buffer.end(), file.begin() + i,
+                          file.begin() + i + 188);
+            break;
+        }
+    }
+
+    // The timestamps of PID 257 are unrelated, as if of another program,
+    // and interleave with those of PID 256.
+    write_packet(buffer, 256, 0x1FFFFFFFFULL - 3000);
+    write_packet(buffer, 257, 1000000);
+    write_packet(buffer, 256, 0);
+    write_packet(buffer, 257, 1003000);
+
+    mts::random_access_index index;
+    index.read(buffer.data(), buffer.size());
+    ASSERT_EQ(4U, index.pes_entries().size());
+    EXPECT_EQ(0x1FFFFFFFFULL - 3000, index.pes_entries()[0].m_pts);
+    EXPECT_EQ(1000000U, index.pes_entries()[1].m_pts);
+    EXPECT_EQ(0x200000000ULL, index.pes_entries()[2].m_pts);
+    EXPECT_EQ(1003000U, index.pes_entries()[3].m_pts);
+}
+
+TEST(test_random_access_index, streams_without_optional_header)
+{
+    // The PAT and the PMT of the test file, listing PIDs 256 and 257.
+    auto file = read_test_file();
+    std::vector<uint8_t> buffer(file.begin() + 188, file.begin() + 3 * 188);
+    ASSERT_EQ(0x0000, ((buffer[1] & 0x1F) << 8) | buffer[2]);
+    ASSERT_EQ(0x1000, ((buffer[188 + 1] & 0x1F) << 8) | buffer[188 + 2]);
+
+    // Pes starting with the bytes of a header with a PTS, where the stream
+    // id or the marker bits tell there is no optional header.
+    for (uint8_t stream_id : {0xE0, 0xBE, 0xBF, 0xF0, 0xE0})
+    {
+        std::vector<uint8_t> packet(188, 0xFF);
+        packet[0] = 0x47;
+        packet[1] = 0x41;
+        packet[2] = 0x00;
+        packet[3] = 0x10;
+        const uint8_t header[] = {0x00, 0x00, 0x01, stream_id, 0x00, 0xB3,
+                                  0x80, 0x80, 0x05};
+        std::copy(header, header + sizeof(header), packet.begin() + 4);
+        mts::helper::write_timestamp(0x2, 90000, packet.data() + 13);
+        buffer.insert(buffer.end(), packet.begin(), packet.end());
+    }
+    buffer[buffer.size() - 188 + 10] = 0x0F;
+
+    mts::random_access_index index;
+    index.read(buffer.data(), buffer.size());
+    ASSERT_EQ(1U, index.pes_entries().size());
+    EXPECT_EQ(2U * 188U, index.pes_entries()[0].m_offset);
+    EXPECT_EQ(90000U, index.pes_entries()[0].m_pts);
+}
+
+TEST(test_random_access_index, write_parse)
+{
+    auto buffer = read_test_file();
+    mts::random_access_index index;
+    index.read(buffer.data(), buffer.size());
+
+    std::vector<uint8_t> data(index.serialized_size());
+    EXPECT_EQ(data.size(), index.write(data.data(), data.size()));
+
+    std::error_code error;
+    auto parsed = mts::random_access_index::parse(
+        data.data(), data.size(), error);
+    ASSERT_FALSE(error);
+    ASSERT_TRUE(bool(parsed));
+
+    EXPECT_EQ(index.size(), parsed->size());
+    ASSERT_EQ(index.pes_entries().size(), parsed->pes_entries().size());
+    for (uint32_t i = 0; i < index.pes_entries().size(); ++i)
+    {
+        const auto& expected = index.pes_entries()[i];
+        const auto& actual = parsed->pes_entries()[i];
+        EXPECT_EQ(expected.m_offset, actual.m_offset);
+        EXPECT_EQ(expected.m_pts, actual.m_pts);
+        EXPECT_EQ(expected.m_pid, actual.m_pid);
+        EXPECT_EQ(expected.m_random_access, actual.m_random_access);
+    }
+    ASSERT_EQ(index.pcr_entries().size(), parsed->pcr_entries().size());
+    for (uint32_t i = 0; i < index.pcr_entries().size(); ++i)
+    {
+        const auto& expected = index.pcr_entries()[i];
+        const auto& actual = parsed->pcr_entries()[i];
+        EXPECT_EQ(expected.m_offset, actual.m_offset);
+        EXPECT_EQ(expected.m_pcr, actual.m_pcr);
+        EXPECT_EQ(expected.m_pid, actual.m_pid);
+    }
+    ASSERT_EQ(index.section_entries().size(),
+              parsed->section_entries().size());
+    for (uint32_t i = 0; i < index.section_entries().size(); ++i)
+    {
+        const auto& expected = index.section_entries()[i];
+        const auto& actual = parsed->section_entries()[i];
+        EXPECT_EQ(expected.m_offset, actual.m_offset);
+        EXPECT_EQ(expected.m_pid, actual.m_pid);
+        EXPECT_EQ(expected.m_section, actual.m_section);
+    }
+
+    // Writing the parsed index gives the same bytes.
+    std::vector<uint8_t> rewritten(parsed->serialized_size());
+    parsed->write(rewritten.data(), rewritten.size());
+    EXPECT_EQ(data, rewritten);
+
+    // A truncated index is rejected.
+    auto truncated = mts::random_access_index::parse(
+        data.data(), data.size() - 1, error);
+    EXPECT_TRUE(bool(error));
+    EXPECT_FALSE(bool(truncated));
+
+    // As is an index of another format.
+    error.clear();
+    data[0] = 'X';
+    auto invalid = mts::random_access_index::parse(
+        data.data(), data.size(), error);
+    EXPECT_TRUE(bool(error));
+    EXPECT_FALSE(bool(invalid));
+}
@@ -0,0 +1,130 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/rtp_depacketizer.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+std::vector<uint8_t> make_packets(uint32_t count)
+{
+    std::vector<uint8_t> packets(188 * count, 0xFF);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        packets[188 * i] = 0x47;
+        packets[188 * i + 1] = 0x01;
+        packets[188 * i + 2] = (uint8_t)i;
+    }
+    return packets;
+}
+
+std::vector<uint8_t> make_rtp(
+    uint16_t sequence_number, const std::vector<uint8_t>& payload)
+{
+    const uint8_t header[] =
+        {
+            0x80, 33, (uint8_t)(sequence_number >> 8),
+            (uint8_t)sequence_number, 0x00, 0x00, 0x00, 0x00,
+            0x12, 0x34, 0x56, 0x78
+        };
+    std::vector<uint8_t> datagram(sizeof(header) + payload.size());
+    std::copy(header, header + sizeof(header), datagram.begin());
+    std::copy(payload.begin(), payload.end(),
+              datagram.begin() + sizeof(header));
+    return datagram;
+}
+}
+
+TEST(test_rtp_depacketizer, raw)
+{
+    auto packets = make_packets(7);
+    mts::rtp_depacketizer depacketizer;
+    std::error_code error;
+    auto payload = depacketizer.read(packets.data(), packets.size(), error);
+    EXPECT_FALSE(error);
+    EXPECT_FALSE(depacketizer.is_rtp());
+    EXPECT_EQ(packets.data(), payload.m_data);
+    EXPECT_EQ(packets.size(), payload.m_size);
+
+    // A partial packet.
+    payload = depacketizer.read(packets.data(), packets.size() - 1, error);
+    EXPECT_EQ(mts::error::invalid_datagram, error);
+    EXPECT_EQ(0U, payload.m_size);
+}
+
+TEST(test_rtp_depacketizer, rtp)
+{
+    auto packets = make_packets(7);
+    mts::rtp_depacketizer depacketizer;
+    std::error_code error;
+
+    auto datagram = make_rtp(10, packets);
+    auto payload = depacketizer.read(datagram.data(), datagram.size(), error);
+    EXPECT_FALSE(error);
+    EXPECT_TRUE(depacketizer.is_rtp());
+    EXPECT_EQ(datagram.data() + 12, payload.m_data);
+    EXPECT_EQ(packets.size(), payload.m_size);
+
+    // With a CSRC, a header extension and padding.
+    datagram = make_rtp(11, {});
+    datagram[0] = 0x80 | 0x20 | 0x10 | 0x01;
+    const uint8_t csrc_and_extension[] =
+        {0x00, 0x00, 0x00, 0x01, 0xAB, 0xCD, 0x00, 0x01, 0x00, 0x00, 0x00,
+         0x00};
+    datagram.insert(datagram.end(), csrc_and_extension,
+                    csrc_and_extension + sizeof(csrc_and_extension));
+    datagram.insert(datagram.end(), packets.begin(), packets.end());
+    datagram.insert(datagram.end(), {0x00, 0x00, 0x03});
+    payload = depacketizer.read(datagram.data(), datagram.size(), error);
+    EXPECT_FALSE(error);
+    EXPECT_EQ(datagram.data() + 24, payload.m_data);
+    EXPECT_EQ(packets.size(), payload.m_size);
+    EXPECT_EQ(0U, depacketizer.lost_datagrams());
+
+    // A header larger than the datagram.
+    datagram = make_rtp(12, {});
+    datagram[0] = 0x8F;
+    payload = depacketizer.read(datagram.data(), datagram.size(), error);
+    EXPECT_EQ(mts::error::invalid_rtp_header, error);
+    EXPECT_EQ(0U, payload.m_size);
+}
+
+TEST(test_rtp_depacketizer, sequence_numbers)
+{
+    auto packets = make_packets(1);
+    mts::rtp_depacketizer depacketizer;
+    std::error_code error;
+
+    auto read = [&](uint16_t sequence_number)
+    {
+        auto datagram = make_rtp(sequence_number, packets);
+        return depacketizer.read(datagram.data(), datagram.size(), error)
+               .m_size;
+    };
+
+    EXPECT_EQ(188U, read(0xFFFE));
+    EXPECT_EQ(188U, read(0xFFFF));
+
+    // Across the wrap around, with two datagrams lost.
+    EXPECT_EQ(188U, read(2));
+    EXPECT_EQ(2U, depacketizer.lost_datagrams());
+
+    // A late datagram and a duplicate are dropped.
+    EXPECT_EQ(0U, read(1));
+    EXPECT_EQ(0U, read(2));
+    EXPECT_FALSE(error);
+    EXPECT_EQ(2U, depacketizer.late_datagrams());
+    EXPECT_EQ(188U, read(3));
+    EXPECT_EQ(2U, depacketizer.lost_datagrams());
+
+    // After a reset any sequence number is accepted.
+    depacketizer.reset();
+    EXPECT_EQ(188U, read(1000));
+    EXPECT_EQ(2U, depacketizer.lost_datagrams());
+}
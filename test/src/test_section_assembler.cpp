@@ -0,0 +1,214 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/section_assembler.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+/// @return A section with the long header, a body of the given size and
+///         its CRC.
+std::vector<uint8_t> make_section(
+    uint8_t table_id, uint8_t version, uint32_t body_size, uint8_t fill)
+{
+    uint32_t length = 5 + body_size + 4;
+    std::vector<uint8_t> section =
+        { table_id, (uint8_t)(0xB0 | (length >> 8)), (uint8_t)length,
+          0x00, 0x01, (uint8_t)(0xC1 | (version << 1)), 0x00, 0x00 };
+    section.resize(section.size() + body_size, fill);
+    auto crc = mts::crc32::compute(section.data(), section.size());
+    section.push_back(crc >> 24);
+    section.push_back(crc >> 16);
+    section.push_back(crc >> 8);
+    section.push_back(crc);
+    return section;
+}
+
+/// Splits a payload unit into 184 byte payloads, the first with a pointer
+/// field, and the last padded with stuffing.
+std::vector<std::vector<uint8_t>> packetize(std::vector<uint8_t> data)
+{
+    data.insert(data.begin(), 0x00);
+    std::vector<std::vector<uint8_t>> payloads;
+    for (uint32_t offset = 0; offset < data.size(); offset += 184)
+    {
+        std::vector<uint8_t> payload(184, 0xFF);
+        auto count = std::min<uint32_t>(184, data.size() - offset);
+        std::copy(
+            data.begin() + offset, data.begin() + offset + count,
+            payload.begin());
+        payloads.push_back(payload);
+    }
+    return payloads;
+}
+
+struct fixture
+{
+    void read(
+        const std::vector<std::vector<uint8_t>>& payloads,
+        std::error_code& error)
+    {
+        for (uint32_t i = 0; i < payloads.size(); ++i)
+        {
+            m_assembler.read(
+                payloads[i].data(), payloads[i].size(), i == 0,
+                m_continuity_counter++ & 0x0F,
+                [this](const uint8_t* data, uint32_t size)
+                {
+                    m_sections.emplace_back(data, data + size);
+                },
+                error);
+        }
+    }
+
+    mts::section_assembler m_assembler;
+    uint8_t m_continuity_counter = 0;
+    std::vector<std::vector<uint8_t>> m_sections;
+};
+}
+
+TEST(test_section_assembler, multi_packet_section)
+{
+    fixture f;
+    auto section = make_section(0x02, 1, 500, 0xAB);
+    auto payloads = packetize(section);
+    ASSERT_EQ(3U, payloads.size());
+
+    std::error_code error;
+    f.read(payloads, error);
+    EXPECT_FALSE((bool) error);
+    ASSERT_EQ(1U, f.m_sections.size());
+    EXPECT_EQ(section, f.m_sections[0]);
+}
+
+TEST(test_section_assembler, several_sections_in_a_packet)
+{
+    fixture f;
+    auto first = make_section(0x02, 1, 10, 0x01);
+    auto second = make_section(0x03, 1, 20, 0x02);
+    auto data = first;
+    data.insert(data.end(), second.begin(), second.end());
+
+    std::error_code error;
+    f.read(packetize(data), error);
+    EXPECT_FALSE((bool) error);
+    ASSERT_EQ(2U, f.m_sections.size());
+    EXPECT_EQ(first, f.m_sections[0]);
+    EXPECT_EQ(second, f.m_sections[1]);
+}
+
+TEST(test_section_assembler, pointer_field)
+{
+    fixture f;
+    auto first = make_section(0x02, 1, 300, 0x01);
+    auto second = make_section(0x03, 1, 20, 0x02);
+
+    // The second packet ends the first section, and its pointer field
+    // points to the start of the second section.
+    std::vector<uint8_t> payload(184, 0xFF);
+    payload[0] = 0x00;
+    std::copy(first.begin(), first.begin() + 183, payload.begin() + 1);
+    std::vector<uint8_t> next(184, 0xFF);
+    uint8_t rest = first.size() - 183;
+    next[0] = rest;
+    std::copy(first.begin() + 183, first.end(), next.begin() + 1);
+    std::copy(second.begin(), second.end(), next.begin() + 1 + rest);
+
+    std::error_code error;
+    f.m_assembler.read(
+        payload.data(), payload.size(), true, 0,
+        [&f](const uint8_t* data, uint32_t size)
+        {
+            f.m_sections.emplace_back(data, data + size);
+        },
+        error);
+    f.m_assembler.read(
+        next.data(), next.size(), true, 1,
+        [&f](const uint8_t* data, uint32_t size)
+        {
+            f.m_sections.emplace_back(data, data + size);
+        },
+        error);
+    EXPECT_FALSE((bool) error);
+    ASSERT_EQ(2U, f.m_sections.size());
+    EXPECT_EQ(first, f.m_sections[0]);
+    EXPECT_EQ(second, f.m_sections[1]);
+}
+
+TEST(test_section_assembler, repeated_sections_are_skipped)
+{
+    fixture f;
+    auto version_1 = make_section(0x02, 1, 50, 0x01);
+    auto version_2 = make_section(0x02, 2, 50, 0x02);
+
+    std::error_code error;
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        f.read(packetize(version_1), error);
+    }
+    EXPECT_EQ(1U, f.m_sections.size());
+    EXPECT_EQ(9U, f.m_assembler.repeated_sections());
+
+    f.read(packetize(version_2), error);
+    f.read(packetize(version_2), error);
+    ASSERT_EQ(2U, f.m_sections.size());
+    EXPECT_EQ(version_2, f.m_sections[1]);
+    EXPECT_FALSE((bool) error);
+
+    // Delivered again after a reset.
+    f.m_assembler.reset();
+    f.read(packetize(version_2), error);
+    EXPECT_EQ(3U, f.m_sections.size());
+}
+
+TEST(test_section_assembler, invalid_crc)
+{
+    fixture f;
+    auto section = make_section(0x02, 1, 50, 0x01);
+    section[20] ^= 0x01;
+
+    std::error_code error;
+    f.read(packetize(section), error);
+    EXPECT_EQ(mts::error::invalid_crc, error);
+    EXPECT_TRUE(f.m_sections.empty());
+}
+
+TEST(test_section_assembler, continuity_error)
+{
+    fixture f;
+    auto section = make_section(0x02, 1, 500, 0x01);
+    auto payloads = packetize(section);
+    payloads.erase(payloads.begin() + 1);
+
+    std::error_code error;
+    f.read(payloads, error);
+    EXPECT_FALSE((bool) error);
+    EXPECT_TRUE(f.m_sections.empty());
+
+    // Duplicate packets are ignored.
+    payloads = packetize(section);
+    payloads.insert(payloads.begin() + 1, payloads[0]);
+    f.m_continuity_counter = 0;
+    f.m_assembler.reset();
+    for (uint32_t i = 0; i < payloads.size(); ++i)
+    {
+        uint8_t continuity_counter = i < 2 ? 0 : i - 1;
+        f.m_assembler.read(
+            payloads[i].data(), payloads[i].size(), i < 2,
+            continuity_counter,
+            [&f](const uint8_t* data, uint32_t size)
+            {
+                f.m_sections.emplace_back(data, data + size);
+            },
+            error);
+    }
+    EXPECT_FALSE((bool) error);
+    ASSERT_EQ(1U, f.m_sections.size());
+    EXPECT_EQ(section, f.m_sections[0]);
+}
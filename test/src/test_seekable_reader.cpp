@@ -0,0 +1,102 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/seekable_reader.hpp>
+#include <mts/parser.hpp>
+#include <mts/random_access_index.hpp>
+
+#include <map>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "test_file.hpp"
+
+namespace
+{
+using pes_map = std::map<uint16_t, std::vector<std::vector<uint8_t>>>;
+
+pes_map demux(mts::parser& parser, const uint8_t* data, uint64_t size)
+{
+    pes_map result;
+    parser.read(data, size, [&](uint16_t pid)
+    {
+        result[pid].push_back(parser.pes_data());
+    });
+    return result;
+}
+}
+
+TEST(test_seekable_reader, find)
+{
+    auto buffer = read_test_file();
+    mts::random_access_index index;
+    index.read(buffer.data(), buffer.size());
+
+    mts::seekable_reader reader(buffer.data(), buffer.size(), index);
+    EXPECT_EQ(256U, reader.pcr_pid());
+    EXPECT_EQ(index.pcr_entries().back().m_pcr -
+              index.pcr_entries().front().m_pcr, reader.duration());
+
+    // The offsets are random access points and move forward in time.
+    uint64_t previous = 0;
+    for (uint64_t time = 0; time <= reader.duration() + 27000000;
+         time += 2700000)
+    {
+        auto offset = reader.find(time);
+        EXPECT_LE(previous, offset);
+        previous = offset;
+
+        bool found = offset == 0;
+        for (const auto& entry : index.pes_entries())
+        {
+            found = found || (entry.m_offset == offset &&
+                              entry.m_random_access);
+        }
+        EXPECT_TRUE(found);
+    }
+    EXPECT_LT(0U, previous);
+
+    // The video stream only has a key frame at its start.
+    auto key_frame = index.pes_entries()[0].m_offset;
+    EXPECT_EQ(key_frame, reader.find(reader.duration(), 256));
+    EXPECT_EQ(key_frame, reader.find(reader.duration() / 2, 256));
+}
+
+TEST(test_seekable_reader, seek)
+{
+    auto buffer = read_test_file();
+    mts::random_access_index index;
+    index.read(buffer.data(), buffer.size());
+
+    mts::parser parser;
+    auto expected = demux(parser, buffer.data(), buffer.size());
+
+    mts::seekable_reader reader(buffer.data(), buffer.size(), index);
+    for (uint64_t time : {0ULL, 27000000ULL, 2 * 27000000ULL,
+                          (unsigned long long)reader.duration()})
+    {
+        auto offset = reader.seek(parser, time);
+        EXPECT_TRUE(parser.programs_complete());
+        EXPECT_TRUE(parser.has_stream(256));
+        EXPECT_TRUE(parser.has_stream(257));
+
+        // The pes read are the pes starting from the offset.
+        auto actual = demux(
+            parser, buffer.data() + offset, buffer.size() - offset);
+        for (const auto& item : expected)
+        {
+            uint32_t skipped = 0;
+            for (const auto& entry : index.pes_entries())
+            {
+                if (entry.m_pid == item.first && entry.m_offset < offset)
+                    ++skipped;
+            }
+            std::vector<std::vector<uint8_t>> rest(
+                item.second.begin() + skipped, item.second.end());
+            EXPECT_EQ(rest, actual[item.first]);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/spsc_queue.hpp>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+TEST(test_spsc_queue, push_and_pop)
+{
+    mts::spsc_queue<uint32_t> queue(4);
+    EXPECT_EQ(4U, queue.capacity());
+    EXPECT_EQ(0U, queue.size());
+
+    uint32_t value = 0;
+    EXPECT_FALSE(queue.try_pop(value));
+
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(queue.try_push(i));
+    }
+    EXPECT_FALSE(queue.try_push(4));
+    EXPECT_EQ(4U, queue.size());
+
+    EXPECT_TRUE(queue.try_pop(value));
+    EXPECT_EQ(0U, value);
+    EXPECT_TRUE(queue.try_push(4));
+
+    for (uint32_t i = 1; i < 5; ++i)
+    {
+        EXPECT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(i, value);
+    }
+    EXPECT_FALSE(queue.try_pop(value));
+    EXPECT_EQ(0U, queue.size());
+}
+
+TEST(test_spsc_queue, threads)
+{
+    const uint32_t count = 100000;
+    mts::spsc_queue<uint32_t> queue(64);
+
+    std::thread producer([&queue]()
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            while (!queue.try_push(i))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t expected = 0;
+    while (expected < count)
+    {
+        auto value = queue.front();
+        if (value == nullptr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_EQ(expected, *value);
+        queue.commit_pop();
+        expected++;
+    }
+    producer.join();
+    EXPECT_EQ(0U, queue.size());
+}
@@ -0,0 +1,65 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/start_code_scanner.hpp>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(test_start_code_scanner, find)
+{
+    std::vector<uint8_t> buffer(200, 0xFF);
+
+    EXPECT_EQ(0U, mts::start_code_scanner::find(buffer.data(), 0));
+    EXPECT_EQ(buffer.size(),
+              mts::start_code_scanner::find(buffer.data(), buffer.size()));
+
+    // Place a start code at every position, covering the vectorized and
+    // the scalar part of the search.
+    for (uint32_t i = 0; i + 3 <= buffer.size(); ++i)
+    {
+        buffer[i] = 0x00;
+        buffer[i + 1] = 0x00;
+        buffer[i + 2] = 0x01;
+        EXPECT_EQ(i, mts::start_code_scanner::find(
+            buffer.data(), buffer.size()));
+        EXPECT_EQ(i, mts::start_code_scanner::find(buffer.data(), i + 3));
+
+        // A truncated start code is not found.
+        EXPECT_EQ(i + 2, mts::start_code_scanner::find(
+            buffer.data(), i + 2));
+        buffer[i] = 0xFF;
+        buffer[i + 1] = 0xFF;
+        buffer[i + 2] = 0xFF;
+    }
+}
+
+TEST(test_start_code_scanner, zeros)
+{
+    // Runs of zeros and ones which are not start codes.
+    std::vector<uint8_t> buffer(100, 0x00);
+    EXPECT_EQ(buffer.size(),
+              mts::start_code_scanner::find(buffer.data(), buffer.size()));
+    for (uint32_t i = 0; i < buffer.size(); i += 2)
+    {
+        buffer[i] = 0x01;
+    }
+    EXPECT_EQ(buffer.size(),
+              mts::start_code_scanner::find(buffer.data(), buffer.size()));
+
+    // The prefix of a four byte start code is found after its first zero.
+    std::vector<uint8_t> four_byte = { 0x10, 0x00, 0x00, 0x00, 0x01, 0x67 };
+    EXPECT_EQ(2U, mts::start_code_scanner::find(
+        four_byte.data(), four_byte.size()));
+
+    for (uint32_t i = 50; i < buffer.size(); ++i)
+    {
+        buffer[i] = 0x00;
+    }
+    buffer[90] = 0x01;
+    EXPECT_EQ(88U, mts::start_code_scanner::find(
+        buffer.data(), buffer.size()));
+}
@@ -0,0 +1,144 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/stream_generator.hpp>
+
+#include <cstdint>
+#include <system_error>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <mts/packetizer.hpp>
+#include <mts/parser.hpp>
+#include <mts/pes.hpp>
+
+TEST(test_stream_generator, test_deterministic)
+{
+    auto generate = [](uint64_t seed)
+    {
+        mts::stream_generator generator(seed);
+        generator.set_adaptation_field_rate(0.1);
+        generator.set_loss_rate(0.01);
+        generator.set_garbage_rate(0.01);
+        std::vector<uint8_t> output;
+        generator.generate(1000, output);
+        generator.generate(1000, output);
+        EXPECT_EQ(2000U, generator.packets());
+        EXPECT_EQ((generator.packets() - generator.lost_packets()) * 188U +
+                  generator.garbage_bytes(), output.size());
+        return output;
+    };
+
+    auto output = generate(42);
+    EXPECT_EQ(output, generate(42));
+    EXPECT_NE(output, generate(43));
+}
+
+TEST(test_stream_generator, test_parse)
+{
+    mts::stream_generator generator(7);
+    generator.set_programs(3);
+    generator.set_streams(3);
+    generator.set_pes_size(100, 70000);
+    generator.set_adaptation_field_rate(0.2);
+    std::vector<uint8_t> output;
+    generator.generate(20000, output);
+    ASSERT_EQ(20000U * 188U, output.size());
+
+    mts::parser parser;
+    uint64_t pes_count = 0;
+    parser.read(output.data(), output.size(), [&](uint16_t pid)
+    {
+        pes_count++;
+        std::error_code error;
+        auto pes = mts::pes::parse(
+            parser.pes_data().data(), parser.pes_data().size(), error);
+        ASSERT_FALSE((bool) error);
+        EXPECT_LE(generator.min_pes_size(), pes->payload_size());
+        EXPECT_GE(generator.max_pes_size(), pes->payload_size());
+        EXPECT_TRUE(pes->has_presentation_timestamp());
+
+        auto video = pid == mts::stream_generator::stream_pid(0, 0) ||
+                     pid == mts::stream_generator::stream_pid(1, 0) ||
+                     pid == mts::stream_generator::stream_pid(2, 0);
+        EXPECT_EQ(video, pes->has_decoding_timestamp());
+        EXPECT_EQ(video ? 0xE0 : 0xC0, pes->stream_id() & 0xF0);
+        if (video)
+        {
+            EXPECT_EQ(mts::stream_type::avc_video_stream,
+                      parser.stream_type(pid));
+            const uint8_t* payload = pes->payload_data();
+            EXPECT_EQ(0x00, payload[0]);
+            EXPECT_EQ(0x01, payload[3]);
+            EXPECT_EQ(0x09, payload[4]);
+        }
+    });
+
+    EXPECT_TRUE(parser.programs_complete());
+    for (uint32_t program = 0; program < 3; ++program)
+    {
+        auto pid = mts::stream_generator::pmt_pid(program);
+        ASSERT_TRUE(parser.has_program(pid));
+        EXPECT_EQ(mts::stream_generator::stream_pid(program, 0),
+                  parser.program(pid).pcr_pid());
+        for (uint32_t stream = 0; stream < 3; ++stream)
+        {
+            EXPECT_TRUE(parser.has_stream(
+                mts::stream_generator::stream_pid(program, stream)));
+        }
+    }
+    EXPECT_EQ(0U, parser.continuity_errors());
+
+    // The last pes of each stream is not delivered, as it is only complete
+    // at the start of the next.
+    EXPECT_EQ(generator.pes_count() - 9U, pes_count);
+
+    // The PCR is carried by the video streams.
+    EXPECT_TRUE(parser.has_clock(mts::stream_generator::stream_pid(0, 1)));
+    EXPECT_TRUE(parser.clock(mts::stream_generator::stream_pid(0, 0))
+        .has_pcr());
+
+    // Besides the rate given, the first packet of each video pes and the
+    // last packet of each pes carry an adaptation field.
+    uint64_t adaptation_fields = 0;
+    for (uint64_t offset = 0; offset < output.size(); offset += 188)
+    {
+        if ((output[offset + 3] & 0x20) != 0)
+            adaptation_fields++;
+    }
+    EXPECT_NEAR(0.2, (double)adaptation_fields / 20000.0, 0.05);
+}
+
+TEST(test_stream_generator, test_loss_and_garbage)
+{
+    mts::stream_generator generator(3);
+    generator.set_loss_rate(0.01);
+    generator.set_garbage_rate(0.01);
+    std::vector<uint8_t> output;
+    generator.generate(20000, output);
+    EXPECT_LT(0U, generator.lost_packets());
+    EXPECT_LT(0U, generator.garbage_bytes());
+
+    mts::parser parser;
+    uint64_t packets = 0;
+    mts::packetizer packetizer([&](const uint8_t* data, uint64_t size)
+    {
+        EXPECT_EQ(188U, size);
+        packets++;
+        std::error_code error;
+        parser.read(data, error);
+    });
+    packetizer.read(output.data(), output.size());
+
+    // Up to a few packets are lost while getting in sync after garbage.
+    auto received = generator.packets() - generator.lost_packets();
+    EXPECT_GE(received, packets);
+    EXPECT_LT(received * 95U / 100U, packets);
+
+    EXPECT_LT(0U, parser.continuity_errors());
+    EXPECT_GE(generator.lost_packets() + (received - packets),
+              parser.continuity_errors());
+}
@@ -0,0 +1,323 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/stream_monitor.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <mts/helper.hpp>
+#include <mts/parser.hpp>
+
+namespace
+{
+/// @return A packet with a payload, and an adaptation field if a PCR or
+///         the discontinuity indicator is given.
+std::vector<uint8_t> make_packet(
+    uint16_t pid, uint8_t continuity_counter, bool discontinuity = false,
+    bool has_pcr = false, uint64_t pcr = 0)
+{
+    std::vector<uint8_t> packet(188, 0xFF);
+    packet[0] = 0x47;
+    packet[1] = (pid >> 8) & 0x1F;
+    packet[2] = pid & 0xFF;
+    packet[3] = 0x10 | (continuity_counter & 0x0F);
+    if (discontinuity || has_pcr)
+    {
+        packet[3] |= 0x20;
+        packet[4] = has_pcr ? 7 : 1;
+        packet[5] = (discontinuity ? 0x80 : 0x00) | (has_pcr ? 0x10 : 0x00);
+        if (has_pcr)
+            mts::helper::write_clock_reference(pcr, packet.data() + 6);
+    }
+    return packet;
+}
+
+mts::stream_monitor::statistics find(
+    const std::vector<mts::stream_monitor::statistics>& snapshot,
+    uint16_t pid)
+{
+    auto result = std::find_if(
+        snapshot.begin(), snapshot.end(),
+        [pid](const mts::stream_monitor::statistics& statistics)
+        {
+            return statistics.m_pid == pid;
+        });
+    EXPECT_NE(snapshot.end(), result);
+    return result == snapshot.end() ?
+        mts::stream_monitor::statistics() : *result;
+}
+}
+
+TEST(test_stream_monitor, test_file)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    // The packets arrive at 10 Mbit/s.
+    const uint64_t packet_ticks = 4061U;
+    mts::stream_monitor monitor;
+    mts::parser parser;
+    parser.set_monitor(&monitor);
+    EXPECT_EQ(&monitor, parser.monitor());
+
+    std::error_code error;
+    uint64_t packets = buffer.size() / 188;
+    for (uint64_t i = 0; i < packets; ++i)
+    {
+        parser.set_arrival_time(i * packet_ticks);
+        parser.read(buffer.data() + i * 188, error);
+        ASSERT_FALSE((bool) error);
+    }
+
+    auto multiplex = monitor.multiplex();
+    EXPECT_EQ(mts::stream_monitor::pid_count(), multiplex.m_pid);
+    EXPECT_EQ(packets, multiplex.m_packets);
+    EXPECT_EQ(0U, multiplex.m_sync_byte_errors);
+    EXPECT_EQ(0U, multiplex.m_transport_errors);
+    EXPECT_EQ(0U, multiplex.m_continuity_errors);
+    EXPECT_EQ(0U, monitor.untracked_packets());
+    EXPECT_NEAR(10000000.0, multiplex.bitrate(), 1000.0);
+
+    auto snapshot = monitor.snapshot();
+    ASSERT_LE(4U, snapshot.size());
+    EXPECT_TRUE(std::is_sorted(
+        snapshot.begin(), snapshot.end(),
+        [](const mts::stream_monitor::statistics& a,
+           const mts::stream_monitor::statistics& b)
+        {
+            return a.m_pid < b.m_pid;
+        }));
+
+    uint64_t total = 0;
+    for (const auto& statistics : snapshot)
+    {
+        total += statistics.m_packets;
+        EXPECT_EQ(0U, statistics.m_continuity_errors);
+        EXPECT_EQ(0U, statistics.m_duplicate_packets);
+        EXPECT_EQ(0U, statistics.m_crc_errors);
+    }
+    EXPECT_EQ(packets, total);
+
+    // The PAT and the PMT are repeated every few tens of packets.
+    for (uint16_t pid : {0x0000, 0x1000})
+    {
+        auto statistics = find(snapshot, pid);
+        EXPECT_LT(20U, statistics.m_sections);
+        EXPECT_EQ(0U, statistics.m_section_repetition_errors);
+        EXPECT_LT(0U, statistics.m_max_section_interval);
+        EXPECT_GT(mts::stream_monitor::max_section_interval(),
+                  statistics.m_max_section_interval);
+    }
+
+    auto video = find(snapshot, 256);
+    EXPECT_LT(0U, video.m_pcrs);
+    EXPECT_LT(0U, video.m_max_pcr_interval);
+    EXPECT_EQ(0U, find(snapshot, 257).m_pcrs);
+    EXPECT_EQ(0U, find(snapshot, 257).m_sections);
+
+    EXPECT_LT(find(snapshot, 257).bitrate(), video.bitrate());
+    EXPECT_LT(video.bitrate(), multiplex.bitrate());
+}
+
+TEST(test_stream_monitor, test_packet_errors)
+{
+    mts::stream_monitor monitor;
+    uint64_t time = 0;
+    auto read = [&](const std::vector<uint8_t>& packet)
+    {
+        monitor.read(packet.data(), time, false);
+        time += 1000;
+    };
+
+    read(make_packet(100, 0));
+    read(make_packet(100, 1));
+    read(make_packet(100, 1));
+    read(make_packet(100, 4));
+
+    // A signalled discontinuity is not an error.
+    read(make_packet(100, 9, true));
+    read(make_packet(100, 10));
+
+    // The header of a packet with a transport error is not checked.
+    auto packet = make_packet(100, 3);
+    packet[1] |= 0x80;
+    read(packet);
+
+    packet = make_packet(100, 11);
+    packet[3] |= 0x80;
+    read(packet);
+
+    packet = make_packet(100, 12);
+    packet[0] = 0x00;
+    read(packet);
+
+    auto statistics = find(monitor.snapshot(), 100);
+    EXPECT_EQ(8U, statistics.m_packets);
+    EXPECT_EQ(0U, statistics.m_first_arrival_time);
+    EXPECT_EQ(7000U, statistics.m_last_arrival_time);
+    EXPECT_EQ(1U, statistics.m_duplicate_packets);
+    EXPECT_EQ(2U, statistics.m_continuity_errors);
+    EXPECT_EQ(1U, statistics.m_transport_errors);
+    EXPECT_EQ(1U, statistics.m_scrambled_packets);
+    EXPECT_EQ(0U, statistics.m_sync_byte_errors);
+
+    auto multiplex = monitor.multiplex();
+    EXPECT_EQ(9U, multiplex.m_packets);
+    EXPECT_EQ(1U, multiplex.m_sync_byte_errors);
+    EXPECT_EQ(1U, multiplex.m_transport_errors);
+    EXPECT_EQ(2U, multiplex.m_continuity_errors);
+
+    monitor.read_crc_error(100);
+    EXPECT_EQ(1U, find(monitor.snapshot(), 100).m_crc_errors);
+
+    // PIDs beyond the capacity are only counted for the multiplex.
+    mts::stream_monitor small(1);
+    small.read(make_packet(100, 0).data(), 0, false);
+    small.read(make_packet(101, 0).data(), 0, false);
+    EXPECT_EQ(1U, small.snapshot().size());
+    EXPECT_EQ(2U, small.multiplex().m_packets);
+    EXPECT_EQ(1U, small.untracked_packets());
+}
+
+TEST(test_stream_monitor, test_pcr)
+{
+    mts::stream_monitor monitor;
+    uint8_t continuity_counter = 0;
+    uint8_t filler_counter = 0;
+
+    // A PCR every ten packets.
+    auto read_pcr = [&](uint64_t pcr, bool discontinuity)
+    {
+        for (uint32_t i = 0; i < 9; ++i)
+        {
+            auto filler = make_packet(300, filler_counter++);
+            monitor.read(filler.data(), 0, false);
+        }
+        auto packet = make_packet(
+            200, continuity_counter++, discontinuity, true, pcr);
+        monitor.read(packet.data(), 0, false);
+    };
+
+    // Every 30 ms at a constant rate.
+    const uint64_t interval = 810000U;
+    uint64_t pcr = 1000000U;
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        read_pcr(pcr, false);
+        pcr += interval;
+    }
+
+    auto statistics = find(monitor.snapshot(), 200);
+    EXPECT_EQ(10U, statistics.m_pcrs);
+    EXPECT_EQ(0U, statistics.m_pcr_repetition_errors);
+    EXPECT_EQ(0U, statistics.m_pcr_discontinuity_errors);
+    EXPECT_EQ(0U, statistics.m_pcr_accuracy_errors);
+    EXPECT_EQ(interval, statistics.m_max_pcr_interval);
+    EXPECT_EQ(0U, statistics.m_max_pcr_inaccuracy);
+
+    // 2 us off.
+    read_pcr(pcr + 54U, false);
+    pcr += interval;
+    statistics = find(monitor.snapshot(), 200);
+    EXPECT_EQ(1U, statistics.m_pcr_accuracy_errors);
+    EXPECT_NEAR(2000.0, (double)statistics.m_max_pcr_inaccuracy, 1.0);
+
+    // 50 ms after the previous PCR.
+    pcr += 540000U;
+    read_pcr(pcr, false);
+    statistics = find(monitor.snapshot(), 200);
+    EXPECT_EQ(1U, statistics.m_pcr_repetition_errors);
+    EXPECT_EQ(interval + 540000U - 54U, statistics.m_max_pcr_interval);
+
+    // 200 ms after the previous PCR, and before it.
+    pcr += 5400000U;
+    read_pcr(pcr, false);
+    read_pcr(pcr - interval, false);
+    statistics = find(monitor.snapshot(), 200);
+    EXPECT_EQ(2U, statistics.m_pcr_discontinuity_errors);
+
+    // A signalled discontinuity is not an error, and the PCRs after it are
+    // checked again.
+    pcr += 100000000U;
+    read_pcr(pcr, true);
+    read_pcr(pcr + interval, false);
+    statistics = find(monitor.snapshot(), 200);
+    EXPECT_EQ(2U, statistics.m_pcr_discontinuity_errors);
+    EXPECT_EQ(1U, statistics.m_pcr_repetition_errors);
+    EXPECT_EQ(16U, statistics.m_pcrs);
+}
+
+TEST(test_stream_monitor, test_section_repetition)
+{
+    mts::stream_monitor monitor;
+    const uint64_t frequency = mts::stream_monitor::frequency();
+    uint8_t continuity_counter = 0;
+    for (uint64_t time : {0U, 100U, 800U, 1000U})
+    {
+        auto packet = make_packet(0, continuity_counter++);
+        packet[1] |= 0x40;
+        monitor.read(packet.data(), time * frequency / 1000U, true);
+
+        // Packets continuing a section are not counted.
+        packet = make_packet(0, continuity_counter++);
+        monitor.read(packet.data(), time * frequency / 1000U, true);
+    }
+
+    auto statistics = find(monitor.snapshot(), 0);
+    EXPECT_EQ(4U, statistics.m_sections);
+    EXPECT_EQ(1U, statistics.m_section_repetition_errors);
+    EXPECT_EQ(700U * frequency / 1000U, statistics.m_max_section_interval);
+}
+
+TEST(test_stream_monitor, test_concurrent_snapshots)
+{
+    mts::stream_monitor monitor;
+    std::atomic<bool> done{false};
+
+    // The arrival time follows the packet count, so a consistent snapshot
+    // has one less than the other.
+    std::thread reader([&]()
+    {
+        while (!done.load())
+        {
+            for (const auto& statistics : monitor.snapshot())
+            {
+                if (statistics.m_packets == 0)
+                    continue;
+                EXPECT_EQ(statistics.m_packets - 1,
+                          statistics.m_last_arrival_time);
+            }
+            auto multiplex = monitor.multiplex();
+            if (multiplex.m_packets != 0)
+            {
+                EXPECT_EQ(multiplex.m_packets - 1,
+                          multiplex.m_last_arrival_time);
+            }
+        }
+    });
+
+    for (uint64_t i = 0; i < 200000; ++i)
+    {
+        auto packet = make_packet(100, (uint8_t)i);
+        monitor.read(packet.data(), i, false);
+    }
+    done = true;
+    reader.join();
+
+    auto statistics = find(monitor.snapshot(), 100);
+    EXPECT_EQ(200000U, statistics.m_packets);
+    EXPECT_EQ(0U, statistics.m_continuity_errors);
+}
@@ -0,0 +1,58 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/sync_scanner.hpp>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(test_sync_scanner, find)
+{
+    std::vector<uint8_t> buffer(200, 0x00);
+
+    EXPECT_EQ(0U, mts::sync_scanner::find(buffer.data(), 0, 0x47));
+    EXPECT_EQ(buffer.size(),
+              mts::sync_scanner::find(buffer.data(), buffer.size(), 0x47));
+
+    // Place the value at every position, covering the vectorized and the
+    // scalar part of the search.
+    for (uint32_t i = 0; i < buffer.size(); ++i)
+    {
+        buffer[i] = 0x47;
+        EXPECT_EQ(i, mts::sync_scanner::find(
+            buffer.data(), buffer.size(), 0x47));
+        EXPECT_EQ(i, mts::sync_scanner::find(buffer.data(), i, 0x47));
+        buffer[i] = 0x00;
+    }
+
+    // The first occurrence is found
+    buffer[70] = 0x47;
+    buffer[33] = 0x47;
+    buffer[34] = 0x47;
+    EXPECT_EQ(33U, mts::sync_scanner::find(
+        buffer.data(), buffer.size(), 0x47));
+    EXPECT_EQ(34U, mts::sync_scanner::find(
+        buffer.data() + 34, buffer.size() - 34, 0x47) + 34);
+}
+
+TEST(test_sync_scanner, count_strided)
+{
+    std::vector<uint8_t> buffer(188 * 3, 0x00);
+    buffer[10] = 0x47;
+    buffer[10 + 188] = 0x47;
+
+    EXPECT_EQ(2U, mts::sync_scanner::count_strided(
+        buffer.data(), buffer.size(), 10, 0x47, 188, 5));
+    EXPECT_EQ(1U, mts::sync_scanner::count_strided(
+        buffer.data(), buffer.size(), 10, 0x47, 188, 1));
+    EXPECT_EQ(0U, mts::sync_scanner::count_strided(
+        buffer.data(), buffer.size(), 11, 0x47, 188, 5));
+
+    // End of data
+    buffer[10 + 376] = 0x47;
+    EXPECT_EQ(3U, mts::sync_scanner::count_strided(
+        buffer.data(), buffer.size(), 10, 0x47, 188, 5));
+}
@@ -0,0 +1,107 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/trace.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <mts/parser.hpp>
+
+namespace
+{
+void wait(uint64_t ticks)
+{
+    auto start = mts::trace::now();
+    while (mts::trace::now() - start < ticks)
+    {
+    }
+}
+}
+
+TEST(test_trace, test_scopes)
+{
+    mts::trace::reset();
+
+    // The inner stages are not part of the time of the outer stage.
+    {
+        mts::trace::scope outer(mts::trace::stage::packetizer_read);
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            mts::trace::scope inner(mts::trace::stage::pes_parse);
+            wait(100000);
+        }
+        wait(1000);
+    }
+
+    // Stopped scopes are recorded once, also on other threads.
+    std::thread thread([]()
+    {
+        mts::trace::scope scope(mts::trace::stage::ts_header);
+        scope.stop();
+        scope.stop();
+    });
+    thread.join();
+
+    auto histograms = mts::trace::histograms();
+    ASSERT_EQ(mts::trace::stage_count(), histograms.size());
+
+    const auto& outer =
+        histograms[(uint32_t)mts::trace::stage::packetizer_read];
+    EXPECT_EQ(mts::trace::stage::packetizer_read, outer.m_stage);
+    EXPECT_EQ(1U, outer.m_events);
+    EXPECT_LE(1000U, outer.m_ticks);
+    EXPECT_GT(100000U, outer.m_ticks);
+
+    const auto& inner = histograms[(uint32_t)mts::trace::stage::pes_parse];
+    EXPECT_EQ(3U, inner.m_events);
+    EXPECT_LE(300000U, inner.m_ticks);
+
+    // Each event of at least 100000 ticks is in bucket 16 or above.
+    uint64_t slow = 0;
+    for (uint32_t i = 16; i < mts::trace::bucket_count(); ++i)
+    {
+        slow += inner.m_buckets[i];
+    }
+    EXPECT_EQ(3U, slow);
+
+    EXPECT_EQ(1U, histograms[(uint32_t)mts::trace::stage::ts_header].m_events);
+    EXPECT_EQ(0U, histograms[(uint32_t)mts::trace::stage::psi_parse].m_events);
+
+    std::stringstream output;
+    mts::trace::write(output);
+    EXPECT_NE(std::string::npos, output.str().find("pes_parse: 3 events"));
+    EXPECT_EQ(std::string::npos, output.str().find("psi_parse"));
+
+    mts::trace::reset();
+    for (const auto& histogram : mts::trace::histograms())
+    {
+        EXPECT_EQ(0U, histogram.m_events);
+    }
+}
+
+TEST(test_trace, test_disabled)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary|std::ios::ate);
+    ASSERT_TRUE(file.is_open());
+    auto size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), buffer.size());
+
+    // The tests are built without MTS_TRACE, so nothing is recorded.
+    mts::trace::reset();
+    mts::parser parser;
+    parser.read(buffer.data(), buffer.size(), [](uint16_t) {});
+    for (const auto& histogram : mts::trace::histograms())
+    {
+        EXPECT_EQ(0U, histogram.m_events);
+    }
+}
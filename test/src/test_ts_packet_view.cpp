@@ -0,0 +1,115 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/ts_packet_view.hpp>
+#include <mts/ts_packet.hpp>
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+TEST(test_ts_packet_view, matches_ts_packet)
+{
+    auto filename = "test.ts";
+    std::ifstream file(filename, std::ios::binary);
+    ASSERT_TRUE(file.is_open());
+    std::vector<uint8_t> buffer(188);
+
+    uint32_t pcr_count = 0;
+    while (file.read((char*)buffer.data(), buffer.size()))
+    {
+        std::error_code error;
+        auto packet = mts::ts_packet::parse(
+            buffer.data(), buffer.size(), error);
+        ASSERT_FALSE((bool)error);
+        ASSERT_NE(boost::none, packet);
+
+        mts::ts_packet_view view(buffer.data());
+        view.verify(error);
+        ASSERT_FALSE((bool)error);
+
+        EXPECT_EQ(packet->is_null_packet(), view.is_null_packet());
+        EXPECT_EQ(packet->has_adaptation_field(), view.has_adaptation_field());
+        EXPECT_EQ(packet->has_payload_field(), view.has_payload_field());
+        EXPECT_EQ(packet->transport_error_indicator(),
+                  view.transport_error_indicator());
+        EXPECT_EQ(packet->payload_unit_start_indicator(),
+                  view.payload_unit_start_indicator());
+        EXPECT_EQ(packet->transport_priority(), view.transport_priority());
+        EXPECT_EQ(packet->pid(), view.pid());
+        EXPECT_EQ(packet->transport_scrambling_control(),
+                  view.transport_scrambling_control());
+        EXPECT_EQ(packet->continuity_counter(), view.continuity_counter());
+
+        if (!packet->has_adaptation_field())
+        {
+            EXPECT_EQ(buffer.data() + 4, view.payload_data());
+            EXPECT_EQ(184U, view.payload_size());
+            continue;
+        }
+
+        const auto& field = packet->adaptation_field();
+        auto field_view = view.adaptation_field();
+        field_view.verify(error);
+        ASSERT_FALSE((bool)error);
+        EXPECT_EQ(field.length(), field_view.length());
+        if (view.has_payload_field())
+        {
+            EXPECT_EQ(183U - field.length(), view.payload_size());
+        }
+        if (field.length() == 0)
+            continue;
+
+        EXPECT_EQ(field.random_access_indicator(),
+                  field_view.random_access_indicator());
+        EXPECT_EQ(field.pcr_flag(), field_view.pcr_flag());
+        if (field.pcr_flag())
+        {
+            EXPECT_EQ(field.program_clock_reference(),
+                      field_view.program_clock_reference());
+            pcr_count++;
+        }
+    }
+    EXPECT_NE(0U, pcr_count);
+}
+
+TEST(test_ts_packet_view, verify)
+{
+    std::vector<uint8_t> buffer(188, 0xFF);
+    buffer[0] = 0x47;
+    buffer[1] = 0x01;
+    buffer[2] = 0x00;
+    buffer[3] = 0x30;
+    buffer[4] = 183;
+
+    mts::ts_packet_view view(buffer.data());
+    {
+        std::error_code error;
+        view.verify(error);
+        EXPECT_FALSE((bool)error);
+        EXPECT_EQ(0U, view.payload_size());
+    }
+
+    buffer[4] = 184;
+    {
+        std::error_code error;
+        view.verify(error);
+        EXPECT_EQ(mts::error::invalid_adaptation_field_length, error);
+    }
+
+    buffer[1] = 0x81;
+    {
+        std::error_code error;
+        view.verify(error);
+        EXPECT_EQ(mts::error::transport_error_indicator_set, error);
+    }
+
+    buffer[0] = 0x48;
+    {
+        std::error_code error;
+        view.verify(error);
+        EXPECT_EQ(mts::error::invalid_sync_byte, error);
+    }
+}
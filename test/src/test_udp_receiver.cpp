@@ -0,0 +1,141 @@
+// Copyright (c) Steinwurf ApS 2017.
+// All Rights Reserved
+//
+// Distributed under the "BSD License". See the accompanying LICENSE.rst file.
+
+#include <mts/udp_receiver.hpp>
+#include <mts/parser.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "test_file.hpp"
+
+#if defined(MTS_UDP_RECEIVER_POSIX)
+
+namespace
+{
+/// Sends the packets of a buffer to a port on the loopback interface, seven
+/// packets to a datagram, optionally behind an RTP header. Every datagram
+/// with an index in skip is left out.
+void send(
+    const std::vector<uint8_t>& buffer, uint16_t port, bool rtp,
+    const std::vector<uint32_t>& skip)
+{
+    int socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_LE(0, socket);
+    sockaddr_in endpoint;
+    std::memset(&endpoint, 0, sizeof(endpoint));
+    endpoint.sin_family = AF_INET;
+    endpoint.sin_port = htons(port);
+    endpoint.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    const uint64_t payload_size = 7 * 188;
+    uint16_t sequence_number = 0;
+    uint32_t index = 0;
+    for (uint64_t offset = 0; offset < buffer.size();
+         offset += payload_size, ++index, ++sequence_number)
+    {
+        if (std::find(skip.begin(), skip.end(), index) != skip.end())
+            continue;
+
+        std::vector<uint8_t> datagram;
+        if (rtp)
+        {
+            datagram = {0x80, 33, (uint8_t)(sequence_number >> 8),
+                        (uint8_t)sequence_number, 0, 0, 0, 0, 0, 0, 0, 1};
+        }
+        auto size = std::min(payload_size, buffer.size() - offset);
+        datagram.insert(datagram.end(), buffer.begin() + offset,
+                        buffer.begin() + offset + size);
+        ASSERT_EQ((ssize_t)datagram.size(),
+                  ::sendto(socket, datagram.data(), datagram.size(), 0,
+                           (const sockaddr*)&endpoint, sizeof(endpoint)));
+    }
+    ::close(socket);
+}
+}
+
+TEST(test_udp_receiver, loopback)
+{
+    auto buffer = read_test_file();
+    uint32_t datagrams = (uint32_t)((buffer.size() + 7 * 188 - 1) / (7 * 188));
+
+    for (bool rtp : {false, true})
+    {
+        mts::parser reference;
+        uint32_t expected_pes = 0;
+        reference.read(buffer.data(), buffer.size(),
+                       [&](uint16_t) { ++expected_pes; });
+
+        mts::udp_receiver receiver(16);
+        std::error_code error;
+        receiver.open("127.0.0.1", 0, error);
+        ASSERT_FALSE(error);
+        receiver.set_receive_buffer_size(1 << 21, error);
+        ASSERT_FALSE(error);
+
+        std::vector<uint32_t> skip;
+        if (rtp)
+            skip = {10, 11};
+        send(buffer, receiver.port(), rtp, skip);
+
+        // The packets arrive in batches of whole packets.
+        std::vector<uint8_t> received;
+        mts::parser parser;
+        uint32_t pes_count = 0;
+        while (receiver.datagrams() + skip.size() < datagrams)
+        {
+            auto count = receiver.receive(
+                [&](const uint8_t* data, uint64_t size)
+                {
+                    EXPECT_EQ(0U, size % 188);
+                    received.insert(received.end(), data, data + size);
+                    parser.read(data, size, [&](uint16_t) { ++pes_count; });
+                }, 1000, error);
+            ASSERT_FALSE(error);
+            ASSERT_NE(0U, count);
+        }
+
+        EXPECT_EQ(datagrams - skip.size(), receiver.datagrams());
+        EXPECT_EQ(0U, receiver.invalid_datagrams());
+        EXPECT_EQ(rtp, receiver.depacketizer().is_rtp());
+        EXPECT_EQ(skip.size(), receiver.depacketizer().lost_datagrams());
+        EXPECT_EQ(buffer.size() - skip.size() * 7 * 188, received.size());
+        if (!rtp)
+        {
+            EXPECT_EQ(buffer, received);
+            EXPECT_EQ(expected_pes, pes_count);
+        }
+        else
+        {
+            // The pes with lost packets are dropped.
+            EXPECT_GT(expected_pes, pes_count);
+            EXPECT_LT(0U, pes_count);
+        }
+    }
+}
+
+TEST(test_udp_receiver, timeout)
+{
+    mts::udp_receiver receiver;
+    std::error_code error;
+    receiver.open("127.0.0.1", 0, error);
+    ASSERT_FALSE(error);
+    EXPECT_NE(0U, receiver.port());
+
+    auto count = receiver.receive(
+        [](const uint8_t*, uint64_t) { FAIL(); }, 10, error);
+    EXPECT_FALSE(error);
+    EXPECT_EQ(0U, count);
+
+    mts::udp_receiver invalid;
+    invalid.open("not an address", 0, error);
+    EXPECT_EQ(std::errc::invalid_argument, error);
+    EXPECT_FALSE(invalid.is_open());
+}
+
+#endif